@@ -0,0 +1,368 @@
+/**
+ * @file terrain_bench.cpp
+ * @brief Microbenchmarks for the hot kernels, the QuadTree and the loader.
+ *
+ * Every benchmark is repeated (10 times by default) and reported with its
+ * mean, median, standard deviation and a 95% confidence interval. Results
+ * are also saved as JSON (terrain_bench.json unless --benchmark_out is
+ * given) so that later optimisations can be compared to the same baseline.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "MNT.hpp"
+#include "quadtree.hpp"
+#include "rasterizer.hpp"
+#include "thread_pool.hpp"
+#include "triangulation.hpp"
+
+namespace {
+
+// Side of the synthetic survey area, in meters
+const double AREA = 2000.0;
+
+enum Distribution { Uniform = 0, Clustered = 1, Adversarial = 2 };
+
+const char *distributionName(int d) {
+  switch (d) {
+  case Uniform:
+    return "uniform";
+  case Clustered:
+    return "clustered";
+  default:
+    return "adversarial";
+  }
+}
+
+/**
+ * @brief Generates 2D positions following one of the test distributions.
+ *
+ * - uniform: spread over the whole area;
+ * - clustered: a few Gaussian blobs (typical of survey lines crossing);
+ * - adversarial: everything in a 2 m square, which forces the QuadTree to
+ *   max depth and leaves thousands of triangles in a single leaf.
+ */
+std::vector<Point> makePositions(std::size_t n, int distribution,
+                                 unsigned seed) {
+  std::mt19937_64 rng(seed);
+  std::uniform_real_distribution<double> uni(0.0, AREA);
+  std::normal_distribution<double> gauss(0.0, AREA / 40.0);
+  std::uniform_real_distribution<double> tiny(AREA / 2.0, AREA / 2.0 + 2.0);
+  const double centers[4][2] = {{0.2 * AREA, 0.3 * AREA},
+                                {0.7 * AREA, 0.6 * AREA},
+                                {0.4 * AREA, 0.8 * AREA},
+                                {0.8 * AREA, 0.2 * AREA}};
+
+  std::vector<Point> pts;
+  pts.reserve(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    double x, y;
+    if (distribution == Uniform) {
+      x = uni(rng);
+      y = uni(rng);
+    } else if (distribution == Clustered) {
+      const double *c = centers[i % 4];
+      x = std::clamp(c[0] + gauss(rng), 0.0, AREA);
+      y = std::clamp(c[1] + gauss(rng), 0.0, AREA);
+    } else {
+      x = tiny(rng);
+      y = tiny(rng);
+    }
+    pts.push_back({x, y, 100.0 + 0.01 * x - 0.02 * y});
+  }
+  return pts;
+}
+
+/**
+ * @brief Builds a mesh from positions, keeping the whole area as the root
+ * bounds (the four corners are always part of the point set).
+ */
+Mesh makeMesh(std::size_t n, int distribution) {
+  std::vector<Point> pts = makePositions(n, distribution, 42);
+  pts.push_back({0.0, 0.0, 100.0});
+  pts.push_back({AREA, 0.0, 100.0});
+  pts.push_back({0.0, AREA, 100.0});
+  pts.push_back({AREA, AREA, 100.0});
+
+  // triangulate() reports on std::cout, keep the benchmark output clean
+  std::ostringstream sink;
+  std::streambuf *old = std::cout.rdbuf(sink.rdbuf());
+  Mesh mesh = triangulate(pts);
+  std::cout.rdbuf(old);
+  return mesh;
+}
+
+QuadTree buildTree(const Mesh &mesh) {
+  QuadTree tree(BoundingBox{0.0, 0.0, AREA, AREA});
+  for (const auto &t : mesh.triangles) {
+    tree.insert(t, mesh.points);
+  }
+  return tree;
+}
+
+// Random triangles with one query point each, shared by the kernel benchmarks
+struct KernelData {
+  std::vector<Point> vertices; // 3 per triangle
+  std::vector<Point> queries;  // 1 per triangle
+};
+
+const KernelData &kernelData() {
+  static const KernelData data = [] {
+    const std::size_t n = 4096;
+    std::mt19937_64 rng(7);
+    std::uniform_real_distribution<double> uni(0.0, 50.0);
+    std::uniform_real_distribution<double> alt(-120.0, 20.0);
+    KernelData d;
+    for (std::size_t i = 0; i < n; ++i) {
+      for (int k = 0; k < 3; ++k)
+        d.vertices.push_back({uni(rng), uni(rng), alt(rng)});
+      d.queries.push_back({uni(rng), uni(rng), 0.0});
+    }
+    return d;
+  }();
+  return data;
+}
+
+// Half-width of the 95% confidence interval of the mean (Student t)
+double ci95(const std::vector<double> &v) {
+  std::size_t n = v.size();
+  if (n < 2)
+    return 0.0;
+  double mean = 0.0;
+  for (double x : v)
+    mean += x;
+  mean /= n;
+  double var = 0.0;
+  for (double x : v)
+    var += (x - mean) * (x - mean);
+  var /= (n - 1);
+  static const double T[] = {0,     12.71, 4.303, 3.182, 2.776, 2.571, 2.447,
+                             2.365, 2.306, 2.262, 2.228, 2.201, 2.179, 2.160,
+                             2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086};
+  double t = (n - 1) < sizeof(T) / sizeof(T[0]) ? T[n - 1] : 1.96;
+  return t * std::sqrt(var / n);
+}
+
+double ci95Relative(const std::vector<double> &v) {
+  double mean = 0.0;
+  for (double x : v)
+    mean += x;
+  mean /= v.empty() ? 1 : v.size();
+  return mean > 0 ? ci95(v) / mean : 0.0;
+}
+
+} // namespace
+
+// --- Kernels -----------------------------------------------------------------
+
+static void BM_IsPointInTriangle(benchmark::State &state) {
+  const KernelData &d = kernelData();
+  std::size_t n = d.queries.size();
+  std::size_t i = 0;
+  for (auto _ : state) {
+    const Point *v = &d.vertices[3 * i];
+    benchmark::DoNotOptimize(
+        isPointInTriangle(d.queries[i].x, d.queries[i].y, v[0], v[1], v[2]));
+    i = (i + 1) % n;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_InterpolateZ(benchmark::State &state) {
+  const KernelData &d = kernelData();
+  std::size_t n = d.queries.size();
+  std::size_t i = 0;
+  for (auto _ : state) {
+    const Point *v = &d.vertices[3 * i];
+    benchmark::DoNotOptimize(
+        interpolateZ(d.queries[i].x, d.queries[i].y, v[0], v[1], v[2]));
+    i = (i + 1) % n;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_GetColor(benchmark::State &state) {
+  const KernelData &d = kernelData();
+  std::size_t n = d.vertices.size();
+  std::size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(getColor(d.vertices[i].z, -120.0, 20.0));
+    i = (i + 1) % n;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_CalculateShade(benchmark::State &state) {
+  const KernelData &d = kernelData();
+  std::size_t n = d.queries.size();
+  std::size_t i = 0;
+  for (auto _ : state) {
+    const Point *v = &d.vertices[3 * i];
+    benchmark::DoNotOptimize(calculateShade(v[0], v[1], v[2]));
+    i = (i + 1) % n;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// --- QuadTree ----------------------------------------------------------------
+
+// Args: number of points, mesh distribution
+static void BM_QuadTreeInsert(benchmark::State &state) {
+  Mesh mesh = makeMesh(state.range(0), static_cast<int>(state.range(1)));
+  for (auto _ : state) {
+    QuadTree tree = buildTree(mesh);
+    benchmark::DoNotOptimize(&tree);
+  }
+  state.SetItemsProcessed(state.iterations() * mesh.triangles.size());
+  state.SetLabel(distributionName(static_cast<int>(state.range(1))));
+}
+
+// Args: number of points, distribution (used for both mesh and queries)
+static void BM_QuadTreeFind(benchmark::State &state) {
+  int distribution = static_cast<int>(state.range(1));
+  Mesh mesh = makeMesh(state.range(0), distribution);
+  QuadTree tree = buildTree(mesh);
+  std::vector<Point> queries = makePositions(1 << 14, distribution, 1234);
+  std::size_t i = 0;
+  std::size_t hits = 0;
+  for (auto _ : state) {
+    const Point &q = queries[i];
+    auto t = tree.find(q.x, q.y, mesh.points);
+    hits += t.has_value();
+    benchmark::DoNotOptimize(t);
+    i = (i + 1) % queries.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["hit_rate"] =
+      state.iterations() ? double(hits) / state.iterations() : 0.0;
+  state.SetLabel(distributionName(distribution));
+}
+
+// --- Loader ------------------------------------------------------------------
+
+namespace {
+
+// Geographic points around Lake Guerlédan
+std::vector<Point> makeGeographic(std::size_t n) {
+  std::mt19937_64 rng(3);
+  std::uniform_real_distribution<double> lat(48.19, 48.22);
+  std::uniform_real_distribution<double> lon(-3.05, -2.98);
+  std::uniform_real_distribution<double> alt(-130.0, 0.0);
+  std::vector<Point> pts;
+  pts.reserve(n);
+  for (std::size_t i = 0; i < n; ++i)
+    pts.push_back({lon(rng), lat(rng), alt(rng)});
+  return pts;
+}
+
+} // namespace
+
+static void BM_ParseText(benchmark::State &state) {
+  std::size_t n = state.range(0);
+  std::string path =
+      (std::filesystem::temp_directory_path() / "terrain_bench_parse.txt")
+          .string();
+  {
+    FILE *f = fopen(path.c_str(), "w");
+    for (const auto &p : makeGeographic(n))
+      fprintf(f, "%.8f %.9f %.3f\n", p.y, p.x, p.z);
+    fclose(f);
+  }
+  for (auto _ : state) {
+    std::vector<Point> pts = lirePoints(path);
+    benchmark::DoNotOptimize(pts.data());
+  }
+  std::remove(path.c_str());
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 35);
+}
+
+static void BM_Projection(benchmark::State &state) {
+  std::size_t n = state.range(0);
+  const std::vector<Point> geo = makeGeographic(n);
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<Point> pts = geo;
+    state.ResumeTiming();
+    projeterPoints(pts);
+    benchmark::DoNotOptimize(pts.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// --- Thread pool -------------------------------------------------------------
+
+// Args: threads. Scheduling cost of a parallelFor over 64K tiny items.
+static void BM_ParallelForOverhead(benchmark::State &state) {
+  ThreadPool pool(static_cast<int>(state.range(0)));
+  const std::size_t n = 1 << 16;
+  std::vector<double> values(n, 1.0);
+  for (auto _ : state) {
+    pool.parallelFor(0, n, 256, [&](std::size_t b, std::size_t e) {
+      for (std::size_t i = b; i < e; ++i)
+        values[i] = values[i] * 1.0000001;
+    });
+    benchmark::DoNotOptimize(values.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// --- Registration ------------------------------------------------------------
+
+#define TERRAIN_BENCHMARK(fn)                                                  \
+  BENCHMARK(fn)                                                                \
+      ->ComputeStatistics("ci95", ci95)                                        \
+      ->ComputeStatistics("ci95_rel", ci95Relative,                            \
+                          benchmark::StatisticUnit::kPercentage)
+
+TERRAIN_BENCHMARK(BM_IsPointInTriangle);
+TERRAIN_BENCHMARK(BM_InterpolateZ);
+TERRAIN_BENCHMARK(BM_GetColor);
+TERRAIN_BENCHMARK(BM_CalculateShade);
+TERRAIN_BENCHMARK(BM_QuadTreeInsert)
+    ->ArgsProduct({{10000, 100000}, {Uniform, Clustered, Adversarial}})
+    ->Unit(benchmark::kMillisecond);
+TERRAIN_BENCHMARK(BM_QuadTreeFind)
+    ->ArgsProduct({{10000, 100000}, {Uniform, Clustered, Adversarial}});
+TERRAIN_BENCHMARK(BM_ParseText)
+    ->Arg(100000)
+    ->Unit(benchmark::kMillisecond);
+TERRAIN_BENCHMARK(BM_Projection)
+    ->Arg(100000)
+    ->Unit(benchmark::kMillisecond);
+TERRAIN_BENCHMARK(BM_ParallelForOverhead)->Arg(1)->Arg(2)->Arg(4)->UseRealTime();
+
+int main(int argc, char **argv) {
+  // Defaults for reproducible baselines, overridable on the command line
+  std::vector<std::string> defaults = {
+      "--benchmark_repetitions=10", "--benchmark_report_aggregates_only=true",
+      "--benchmark_out=terrain_bench.json", "--benchmark_out_format=json"};
+
+  std::vector<char *> args(argv, argv + argc);
+  for (auto &def : defaults) {
+    std::string key = def.substr(0, def.find('=') + 1);
+    bool given = false;
+    for (int i = 1; i < argc; ++i)
+      given |= std::string(argv[i]).rfind(key, 0) == 0;
+    if (!given)
+      args.push_back(&def[0]);
+  }
+  int count = static_cast<int>(args.size());
+
+  benchmark::Initialize(&count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(count, args.data()))
+    return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,406 @@
+/**
+ * @file terrain_scaling.cpp
+ * @brief End-to-end scaling harness for the create_raster pipeline.
+ *
+ * Runs triangulation, indexing, rendering and writing over a matrix of point
+ * counts, output widths and thread counts. Point counts larger or smaller
+ * than the input are obtained by resampling it, or every size is synthesised
+ * with --synthetic. Every run is appended to a JSONL history file and
+ * optionally compared to a stored baseline.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "MNT.hpp"
+#include "profiling.hpp"
+#include "rasterizer.hpp"
+#include "synthetic.hpp"
+#include "thread_pool.hpp"
+#include "triangulation.hpp"
+
+namespace {
+
+struct Config {
+  std::string input;
+  bool synthetic = false;
+  SyntheticOptions synth;
+  std::vector<long long> points;
+  std::vector<long long> widths = {1000};
+  std::vector<long long> threads = {1, 2, 4};
+  std::string history = "scaling_history.jsonl";
+  std::string baseline;
+  bool saveBaseline = false;
+  double tolerance = 0.10;
+  double jitter = 0.25;
+  std::string output = "scaling_output.ppm";
+  std::string label;
+};
+
+/**
+ * @struct Run
+ * @brief Measurements of one (points, width, threads) configuration.
+ */
+struct Run {
+  long long points, width, threads;
+  double load, triangulate, index, render, write, total;
+  double speedup, efficiency;
+  std::size_t peakRss;
+  std::size_t allocPeak[static_cast<int>(Stage::Count)];
+};
+
+void usage() {
+  std::cerr
+      << "Usage: terrain_scaling (--input <fichier> | --synthetic <motif>) "
+         "[options]\n"
+         "  --synthetic <motif>   génère chaque taille (uniform, clustered,\n"
+         "                        tracks, rows, hotspot) au lieu de lire\n"
+         "  --model perlin|diamond  relief des données synthétiques\n"
+         "  --points 1M,10M,...   nombres de points (reechantillonnage)\n"
+         "  --widths 1000,4000    largeurs d'image\n"
+         "  --threads 1,2,4,8     nombres de threads\n"
+         "  --history <fichier>   historique JSONL (scaling_history.jsonl)\n"
+         "  --baseline <fichier>  reference JSONL pour detecter les regressions\n"
+         "  --save-baseline       ecrit les mesures courantes comme reference\n"
+         "  --tolerance 0.10      ralentissement tolere avant regression\n"
+         "  --jitter 0.25         bruit XY (m) des points dupliques\n"
+         "  --output <fichier>    image produite (ecrasee a chaque run)\n"
+         "  --label <nom>         etiquette enregistree dans l'historique\n";
+}
+
+// Parses "10", "2K", "1.5M", "3G"
+long long parseCount(const std::string &s) {
+  char *end = nullptr;
+  double v = std::strtod(s.c_str(), &end);
+  switch (end && *end ? *end : ' ') {
+  case 'k':
+  case 'K':
+    v *= 1e3;
+    break;
+  case 'm':
+  case 'M':
+    v *= 1e6;
+    break;
+  case 'g':
+  case 'G':
+    v *= 1e9;
+    break;
+  default:
+    break;
+  }
+  return static_cast<long long>(v);
+}
+
+std::vector<long long> parseList(const std::string &s) {
+  std::vector<long long> values;
+  std::stringstream ss(s);
+  std::string item;
+  while (std::getline(ss, item, ','))
+    if (!item.empty())
+      values.push_back(parseCount(item));
+  return values;
+}
+
+bool parseArgs(int argc, char *argv[], Config &cfg) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      return i + 1 < argc ? argv[++i] : std::string();
+    };
+    if (arg == "--input")
+      cfg.input = next();
+    else if (arg == "--synthetic") {
+      cfg.synthetic = true;
+      if (!parseSampling(next(), cfg.synth.sampling))
+        return false;
+    } else if (arg == "--model") {
+      if (!parseTerrainModel(next(), cfg.synth.model))
+        return false;
+    } else if (arg == "--points")
+      cfg.points = parseList(next());
+    else if (arg == "--widths")
+      cfg.widths = parseList(next());
+    else if (arg == "--threads")
+      cfg.threads = parseList(next());
+    else if (arg == "--history")
+      cfg.history = next();
+    else if (arg == "--baseline")
+      cfg.baseline = next();
+    else if (arg == "--save-baseline")
+      cfg.saveBaseline = true;
+    else if (arg == "--tolerance")
+      cfg.tolerance = std::atof(next().c_str());
+    else if (arg == "--jitter")
+      cfg.jitter = std::atof(next().c_str());
+    else if (arg == "--output")
+      cfg.output = next();
+    else if (arg == "--label")
+      cfg.label = next();
+    else {
+      std::cerr << "Option inconnue : " << arg << std::endl;
+      return false;
+    }
+  }
+  if (cfg.input.empty() == !cfg.synthetic || cfg.widths.empty() ||
+      cfg.threads.empty())
+    return false;
+  if (cfg.synthetic) {
+    cfg.input = "synthetic";
+    if (cfg.points.empty())
+      cfg.points.push_back(1000000);
+  }
+  std::sort(cfg.threads.begin(), cfg.threads.end());
+  return true;
+}
+
+/**
+ * @brief Resamples a point cloud to exactly n points.
+ *
+ * Downsampling keeps an evenly strided subset. Upsampling keeps every
+ * original point and adds copies jittered in XY, which densifies the survey
+ * over the same area (the interesting case for the index and the renderer).
+ */
+std::vector<Point> resample(const std::vector<Point> &src, std::size_t n,
+                            double jitter) {
+  std::vector<Point> out;
+  out.reserve(n);
+  if (n <= src.size()) {
+    for (std::size_t i = 0; i < n; ++i)
+      out.push_back(src[i * src.size() / n]);
+    return out;
+  }
+  out = src;
+  std::mt19937_64 rng(n);
+  std::uniform_real_distribution<double> d(-jitter, jitter);
+  for (std::size_t i = 0; out.size() < n; i = (i + 1) % src.size()) {
+    Point p = src[i];
+    p.x += d(rng);
+    p.y += d(rng);
+    out.push_back(p);
+  }
+  return out;
+}
+
+// Silences the pipeline's progress messages on std::cout
+class MuteCout {
+public:
+  MuteCout() : old(std::cout.rdbuf(sink.rdbuf())) {}
+  ~MuteCout() { std::cout.rdbuf(old); }
+
+private:
+  std::ostringstream sink;
+  std::streambuf *old;
+};
+
+std::string jsonString(const std::string &s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      out += '\\';
+    out += c;
+  }
+  return out + "\"";
+}
+
+std::string toJson(const Run &r, const Config &cfg) {
+  std::ostringstream os;
+  os << std::setprecision(6);
+  os << "{\"timestamp\":" << std::time(nullptr)
+     << ",\"label\":" << jsonString(cfg.label)
+     << ",\"input\":" << jsonString(cfg.input) << ",\"points\":" << r.points
+     << ",\"width\":" << r.width << ",\"threads\":" << r.threads
+     << ",\"load_s\":" << r.load << ",\"triangulate_s\":" << r.triangulate
+     << ",\"index_s\":" << r.index << ",\"render_s\":" << r.render
+     << ",\"write_s\":" << r.write << ",\"total_s\":" << r.total
+     << ",\"speedup\":" << r.speedup << ",\"efficiency\":" << r.efficiency
+     << ",\"peak_rss_mb\":" << r.peakRss / 1048576.0;
+  if (allocTrackingEnabled()) {
+    os << ",\"alloc_peak_mb\":{";
+    for (int s = 0; s < static_cast<int>(Stage::Count); ++s)
+      os << (s ? "," : "") << "\"" << stageName(static_cast<Stage>(s))
+         << "\":" << r.allocPeak[s] / 1048576.0;
+    os << "}";
+  }
+  os << "}";
+  return os.str();
+}
+
+// Reads a numeric field of one of our own JSON lines
+double jsonNumber(const std::string &line, const std::string &key) {
+  std::size_t pos = line.find("\"" + key + "\":");
+  if (pos == std::string::npos)
+    return std::nan("");
+  return std::strtod(line.c_str() + pos + key.size() + 3, nullptr);
+}
+
+using RunKey = std::tuple<long long, long long, long long>;
+
+std::map<RunKey, double> loadBaseline(const std::string &path) {
+  std::map<RunKey, double> totals;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty())
+      continue;
+    RunKey key{static_cast<long long>(jsonNumber(line, "points")),
+               static_cast<long long>(jsonNumber(line, "width")),
+               static_cast<long long>(jsonNumber(line, "threads"))};
+    totals[key] = jsonNumber(line, "total_s");
+  }
+  return totals;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Config cfg;
+  if (!parseArgs(argc, argv, cfg)) {
+    usage();
+    return EXIT_FAILURE;
+  }
+
+  std::vector<Point> source;
+  double loadSeconds = 0.0;
+  if (!cfg.synthetic) {
+    std::cout << "Lecture et projection de " << cfg.input << "..."
+              << std::endl;
+    resetStageTimes();
+    {
+      StageTimer timer(Stage::Load);
+      source = lireEtConvertir(cfg.input);
+    }
+    loadSeconds = stageSeconds(Stage::Load);
+    if (source.empty()) {
+      std::cerr << "Aucun point chargé." << std::endl;
+      return EXIT_FAILURE;
+    }
+    std::cout << source.size() << " points chargés en " << loadSeconds << " s"
+              << std::endl;
+    if (cfg.points.empty())
+      cfg.points.push_back(static_cast<long long>(source.size()));
+  }
+
+  std::vector<Run> runs;
+  std::cout << std::left << std::setw(12) << "points" << std::setw(8)
+            << "largeur" << std::setw(8) << "threads" << std::right
+            << std::setw(10) << "triang" << std::setw(10) << "index"
+            << std::setw(10) << "rendu" << std::setw(10) << "ecriture"
+            << std::setw(10) << "total" << std::setw(10) << "speedup"
+            << std::setw(8) << "eff." << std::setw(10) << "RSS Mo"
+            << std::endl;
+  std::cout << std::fixed << std::setprecision(3);
+
+  for (long long n : cfg.points) {
+    std::vector<Point> points;
+    if (cfg.synthetic) {
+      // Synthesis and projection stand for the load stage
+      resetStageTimes();
+      {
+        StageTimer timer(Stage::Load);
+        cfg.synth.count = n;
+        points = generateSynthetic(cfg.synth);
+        projeterPoints(points);
+      }
+      loadSeconds = stageSeconds(Stage::Load);
+    } else {
+      points = resample(source, n, cfg.jitter);
+    }
+    for (long long w : cfg.widths) {
+      double reference = 0.0;
+      for (long long t : cfg.threads) {
+        resetStageTimes();
+        resetAllocPeaks();
+        resetPeakResident();
+        {
+          MuteCout mute;
+          ThreadPool pool(static_cast<int>(t));
+          Mesh mesh;
+          {
+            StageTimer timer(Stage::Triangulate);
+            mesh = triangulate(points, pool);
+          }
+          RenderOptions options;
+          options.pool = &pool;
+          generateImage(cfg.output, static_cast<int>(w), mesh, options);
+        }
+
+        Run r{};
+        r.points = n;
+        r.width = w;
+        r.threads = t;
+        r.load = loadSeconds;
+        r.triangulate = stageSeconds(Stage::Triangulate);
+        r.index = stageSeconds(Stage::Index);
+        r.render = stageSeconds(Stage::Render);
+        r.write = stageSeconds(Stage::Write);
+        r.total = r.triangulate + r.index + r.render + r.write;
+        if (t == cfg.threads.front())
+          reference = r.total;
+        r.speedup = r.total > 0 ? reference / r.total : 0.0;
+        r.efficiency = r.speedup * cfg.threads.front() / t;
+        r.peakRss = peakResidentBytes();
+        for (int s = 0; s < static_cast<int>(Stage::Count); ++s)
+          r.allocPeak[s] = allocStats(static_cast<Stage>(s)).peak;
+        runs.push_back(r);
+
+        std::cout << std::left << std::setw(12) << n << std::setw(8) << w
+                  << std::setw(8) << t << std::right << std::setw(10)
+                  << r.triangulate << std::setw(10) << r.index << std::setw(10)
+                  << r.render << std::setw(10) << r.write << std::setw(10)
+                  << r.total << std::setw(10) << r.speedup << std::setw(8)
+                  << r.efficiency << std::setw(10) << r.peakRss / 1048576.0
+                  << std::endl;
+      }
+    }
+  }
+
+  // History
+  {
+    std::ofstream history(cfg.history, std::ios::app);
+    for (const auto &r : runs)
+      history << toJson(r, cfg) << "\n";
+    std::cout << runs.size() << " mesures ajoutées à " << cfg.history
+              << std::endl;
+  }
+
+  // Regression check against the baseline
+  int regressions = 0;
+  if (!cfg.baseline.empty() && !cfg.saveBaseline) {
+    std::map<RunKey, double> baseline = loadBaseline(cfg.baseline);
+    for (const auto &r : runs) {
+      auto it = baseline.find(RunKey{r.points, r.width, r.threads});
+      if (it == baseline.end() || !(it->second > 0))
+        continue;
+      double ratio = r.total / it->second;
+      if (ratio > 1.0 + cfg.tolerance) {
+        ++regressions;
+        std::cout << "REGRESSION points=" << r.points << " largeur=" << r.width
+                  << " threads=" << r.threads << " : " << r.total << " s vs "
+                  << it->second << " s (x" << ratio << ")" << std::endl;
+      }
+    }
+    if (regressions == 0)
+      std::cout << "Aucune régression par rapport à " << cfg.baseline
+                << std::endl;
+  }
+  if (!cfg.baseline.empty() && cfg.saveBaseline) {
+    std::ofstream out(cfg.baseline);
+    for (const auto &r : runs)
+      out << toJson(r, cfg) << "\n";
+    std::cout << "Référence enregistrée dans " << cfg.baseline << std::endl;
+  }
+
+  return regressions ? 2 : EXIT_SUCCESS;
+}
@@ -2,8 +2,11 @@
 #define MNT_HPP
 
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "thread_pool.hpp"
+
 /**
  * @struct Point
  * @brief Represents a point in 3D space.
@@ -14,6 +17,77 @@ struct Point {
   double z; /**< Z coordinate (e.g., altitude). */
 };
 
+/**
+ * @brief Reads raw geographic points from a text file.
+ *
+ * Each line holds "latitude longitude altitude"; files ending in .bin or .las
+ * are read with readPointFile() instead. The returned points store
+ * the longitude in x, the latitude in y and the altitude in z, ready for
+ * projeterPoints(). Text files are read in blocks whose lines are parsed in
+ * parallel; unreadable lines are skipped.
+ *
+ * @param nomFichier The path to the input data file.
+ * @param pool Threads parsing the text blocks.
+ * @return std::vector<Point> The geographic points (empty on error).
+ */
+std::vector<Point> lirePoints(const std::string &nomFichier,
+                              ThreadPool &pool = ThreadPool::serial());
+
+/**
+ * @brief Reads raw geographic points from byte ranges of a text file.
+ *
+ * Each range must start at the beginning of a line and end after a newline
+ * (or at the end of the file), as recorded by a point index. Points are
+ * returned in the order of the ranges, like lirePoints().
+ *
+ * @param nomFichier The path to the text data file.
+ * @param plages The (offset, length) ranges to read.
+ * @param pool Threads parsing the text blocks.
+ * @return std::vector<Point> The geographic points.
+ */
+std::vector<Point>
+lirePlages(const std::string &nomFichier,
+           const std::vector<std::pair<std::size_t, std::size_t>> &plages,
+           ThreadPool &pool = ThreadPool::serial());
+
+/**
+ * @brief Parses "latitude longitude altitude" lines held in memory.
+ *
+ * Same parsing as lirePoints() for text files, for points that do not come
+ * from a file (e.g., a live stream); unreadable lines are skipped.
+ *
+ * @param texte Whole lines of text.
+ * @param points Receives the geographic points, appended in order.
+ */
+void analyserLignes(const std::string &texte, std::vector<Point> &points);
+
+/**
+ * @brief Projects geographic points to Lambert93 in place.
+ *
+ * x (longitude) and y (latitude) are replaced by the projected coordinates
+ * in meters; z is left untouched. Each thread of the pool uses its own PROJ
+ * context.
+ *
+ * @param points The points to project.
+ * @param pool Threads sharing the work.
+ * @return true on success, false if the projection could not be created.
+ */
+bool projeterPoints(std::vector<Point> &points,
+                    ThreadPool &pool = ThreadPool::serial());
+
+/**
+ * @brief Converts Lambert93 points back to geographic coordinates in place.
+ *
+ * Inverse of projeterPoints(): x and y become the longitude and latitude in
+ * degrees; z is left untouched.
+ *
+ * @param points The points to convert.
+ * @param pool Threads sharing the work.
+ * @return true on success, false if the projection could not be created.
+ */
+bool deprojeterPoints(std::vector<Point> &points,
+                      ThreadPool &pool = ThreadPool::serial());
+
 /**
  * @brief Reads terrain data from a file and converts coordinates.
  *
@@ -22,8 +96,10 @@ struct Point {
  * coordinate system (Lambert93) using the PROJ library.
  *
  * @param nomFichier The path to the input data file.
+ * @param pool Threads used by both steps.
  * @return std::vector<Point> A vector of projected 3D points.
  */
-std::vector<Point> lireEtConvertir(const std::string &nomFichier);
+std::vector<Point> lireEtConvertir(const std::string &nomFichier,
+                                   ThreadPool &pool = ThreadPool::serial());
 
 #endif // MNT_HPP
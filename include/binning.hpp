@@ -0,0 +1,110 @@
+#ifndef BINNING_HPP
+#define BINNING_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MNT.hpp"
+#include "heightfield.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * @enum BinStatistic
+ * @brief Altitude kept for a pixel holding several points.
+ */
+enum class BinStatistic {
+  Mean, /**< Average altitude. */
+  Min,  /**< Lowest altitude. */
+  Max   /**< Highest altitude. */
+};
+
+/**
+ * @struct BinningOptions
+ * @brief Parameters of the binning engine.
+ */
+struct BinningOptions {
+  BinStatistic statistic = BinStatistic::Mean;
+  int fillRadius = 2; /**< Empty pixels filled from data this close (px). */
+  std::string densityFile; /**< Point-count image, none if empty. */
+};
+
+/**
+ * @brief Parses "mean", "min" or "max".
+ * @param name The statistic name.
+ * @param statistic Receives the statistic.
+ * @return true if the name is known.
+ */
+bool parseBinStatistic(const std::string &name, BinStatistic &statistic);
+
+/**
+ * @brief Bins projected points into the pixels of a grid.
+ *
+ * The points are first sorted by row band of the grid (a counting sort over
+ * chunks of points, in parallel), then each band is accumulated by a single
+ * worker in cache-sized arrays and written to the field. Memory grows with
+ * the points (8 bytes each) rather than with threads times pixels, and the
+ * result does not depend on the number of threads. Points outside the grid
+ * are ignored.
+ *
+ * @param points Projected points.
+ * @param field Receives the chosen statistic per pixel (grid already set).
+ * @param statistic The statistic kept.
+ * @param pool Threads binning and merging.
+ * @param counts If not null, receives the number of points per pixel.
+ * @return false if cancelled.
+ */
+bool binPoints(const std::vector<Point> &points, HeightField &field,
+               BinStatistic statistic, ThreadPool &pool,
+               std::vector<std::uint32_t> *counts = nullptr);
+
+/**
+ * @brief Writes a point-count grid as a gray image.
+ *
+ * Gray levels follow log(1 + count), scaled so that the densest pixel is
+ * white; pixels without points are black.
+ *
+ * @param filename The output file.
+ * @param width The image width.
+ * @param height The image height.
+ * @param counts The number of points per pixel, row by row.
+ * @return true on success.
+ */
+bool writeDensityImage(const std::string &filename, int width, int height,
+                       const std::vector<std::uint32_t> &counts);
+
+/**
+ * @brief Computes the altitudes of an image by binning the points.
+ *
+ * Same grid as generateImage(); small holes between the bins are closed by
+ * fillGaps(). Writes the density image if one is requested.
+ *
+ * @param points Projected points.
+ * @param width The image width in pixels.
+ * @param options Statistic, fill radius and density image.
+ * @param pool Threads binning.
+ * @param field Receives the altitudes.
+ * @return false if the points span no area or if cancelled.
+ */
+bool makeBinnedField(const std::vector<Point> &points, int width,
+                     const BinningOptions &options, ThreadPool &pool,
+                     HeightField &field);
+
+/**
+ * @brief Generates an image by binning the points, without a mesh.
+ *
+ * makeBinnedField() then writeHeightFieldImage(). Much faster than the
+ * triangulation for previews, but pixels receiving no point within the
+ * fill radius stay black.
+ *
+ * @param filename The output filename.
+ * @param width The image width in pixels.
+ * @param points Projected points.
+ * @param options Statistic, fill radius and density image.
+ * @param pool Threads binning and coloring.
+ */
+void generateBinnedImage(const std::string &filename, int width,
+                         const std::vector<Point> &points,
+                         const BinningOptions &options, ThreadPool &pool);
+
+#endif // BINNING_HPP
@@ -0,0 +1,145 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "image_io.hpp"
+#include "triangulation.hpp"
+
+/**
+ * @struct CheckpointOptions
+ * @brief Checkpointing requested for a render.
+ */
+struct CheckpointOptions {
+  bool enabled = false;    /**< Write a journal while rendering. */
+  double interval = 30.0;  /**< Seconds between two flushes. */
+  bool resume = false;     /**< Skip the units of an existing journal. */
+  std::string fingerprint; /**< Identifies the input (inputFingerprint()). */
+};
+
+/**
+ * @class Checkpoint
+ * @brief Journal of the finished units (row bands or tiles) of a render.
+ *
+ * The output image is written in place as units finish. Periodically, the
+ * image is flushed to disk with fdatasync(2) and only then are the units
+ * finished since the previous flush appended to "<output>.journal" and
+ * synced, so the journal never lists pixels that could be lost. A run
+ * restarted with resume skips every unit of the journal.
+ *
+ * The journal starts with a fingerprint of the render (input, size, mode);
+ * a journal written for another render is rejected rather than mixed in.
+ */
+class Checkpoint {
+public:
+  Checkpoint() = default;
+  ~Checkpoint();
+
+  Checkpoint(const Checkpoint &) = delete;
+  Checkpoint &operator=(const Checkpoint &) = delete;
+
+  /**
+   * @brief Opens (or resumes) the journal of an output image.
+   * @param output The image being written.
+   * @param fingerprint One line identifying the render.
+   * @param units Number of units of the render.
+   * @param interval Seconds between two flushes.
+   * @param resume Whether to reload an existing journal.
+   * @return false on I/O error or if the journal belongs to another render.
+   */
+  bool open(const std::string &output, const std::string &fingerprint,
+            std::size_t units, double interval, bool resume);
+
+  /** @brief Whether units were reloaded from a previous run. */
+  bool resumed() const { return finishedAtOpen > 0; }
+
+  /** @brief Number of units finished by previous runs. */
+  std::size_t finishedBefore() const { return finishedAtOpen; }
+
+  /**
+   * @brief Whether a unit was finished by a previous run.
+   * @param unit The unit.
+   * @return true if it can be skipped.
+   */
+  bool isDone(std::size_t unit) const {
+    return unit < done.size() && done[unit];
+  }
+
+  /**
+   * @brief Sets the image flushed before each journal write.
+   * @param image The writer of the output image.
+   */
+  void attach(PpmWriter &image) { writer = &image; }
+
+  /**
+   * @brief Records a unit whose pixels have been written. Thread-safe.
+   *
+   * Flushes when the interval has elapsed since the previous flush.
+   *
+   * @param unit The unit.
+   */
+  void complete(std::size_t unit);
+
+  /**
+   * @brief Flushes the image then the pending units. Thread-safe.
+   * @return false on I/O error.
+   */
+  bool flush();
+
+  /**
+   * @brief Flushes and deletes the journal once the image is complete.
+   *
+   * Call it before closing the attached writer, which it syncs.
+   *
+   * @return false on I/O error.
+   */
+  bool finish();
+
+private:
+  bool flushLocked();
+
+  std::string journalPath;
+  int fd = -1;
+  std::vector<char> done;
+  std::size_t finishedAtOpen = 0;
+  std::vector<std::size_t> pending;
+  std::mutex mutex;
+  std::chrono::steady_clock::time_point lastFlush;
+  double interval = 30.0;
+  PpmWriter *writer = nullptr;
+  bool failed = false;
+};
+
+/**
+ * @brief Returns a fingerprint of an input file (path and size).
+ * @param input The input file.
+ * @return std::string One line.
+ */
+std::string inputFingerprint(const std::string &input);
+
+/**
+ * @brief Saves a mesh so that a resumed run can skip loading and
+ * triangulation.
+ * @param path The cache file.
+ * @param fingerprint Identifies the input of the mesh.
+ * @param mesh The mesh.
+ * @return true on success.
+ */
+bool saveMeshCache(const std::string &path, const std::string &fingerprint,
+                   const Mesh &mesh);
+
+/**
+ * @brief Loads a mesh saved by saveMeshCache().
+ * @param path The cache file.
+ * @param fingerprint Must match the one saved.
+ * @param mesh Receives the mesh.
+ * @return false if the cache is missing, stale or unreadable.
+ */
+bool loadMeshCache(const std::string &path, const std::string &fingerprint,
+                   Mesh &mesh);
+
+#endif // CHECKPOINT_HPP
@@ -0,0 +1,58 @@
+#ifndef DISTANCE_HPP
+#define DISTANCE_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "MNT.hpp"
+#include "heightfield.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * @brief Exact Euclidean distance from every pixel to the nearest seed.
+ *
+ * Separable transform (Meijster et al.): a first pass finds, in each
+ * column, the nearest seed above or below every pixel, scanning strips of
+ * columns in parallel row by row; a second pass takes, along each row, the
+ * lower envelope of the parabolas of those column distances (Felzenszwalb
+ * and Huttenlocher), rows in parallel. Both passes are linear in the
+ * number of pixels. Pixels may be rectangular.
+ *
+ * @param seeds One byte per pixel, row by row; non-zero for a seed.
+ * @param grid The pixel grid (size and pixel sizes).
+ * @param pool Threads sharing the strips and rows.
+ * @param distance Receives the distance of each pixel to the nearest seed
+ * (m), NaN everywhere if there is no seed.
+ * @return false if cancelled.
+ */
+bool distanceTransform(const std::vector<std::uint8_t> &seeds,
+                       const RasterGrid &grid, ThreadPool &pool,
+                       std::vector<float> &distance);
+
+/**
+ * @brief Marks the pixels holding at least one point.
+ * @param points Projected points.
+ * @param grid The pixel grid.
+ * @param seeds Receives one byte per pixel, 1 where a point falls.
+ */
+void markPoints(const std::vector<Point> &points, const RasterGrid &grid,
+                std::vector<std::uint8_t> &seeds);
+
+/**
+ * @brief Signed distance to the shoreline at a water level.
+ *
+ * Pixels below the level are under water and get their distance to the
+ * nearest pixel at or above it, positive; pixels at or above the level get
+ * minus their distance to the nearest pixel below it. Empty pixels stay
+ * NaN, and do not count on either side.
+ *
+ * @param field The altitudes.
+ * @param level The water level (m).
+ * @param pool Threads computing the two transforms.
+ * @param distance Receives the signed distance of each pixel (m).
+ * @return false if cancelled.
+ */
+bool shoreDistance(const HeightField &field, double level, ThreadPool &pool,
+                   std::vector<float> &distance);
+
+#endif // DISTANCE_HPP
@@ -0,0 +1,145 @@
+#ifndef EXPRESSION_HPP
+#define EXPRESSION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "heightfield.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * @struct ExpressionGrids
+ * @brief Layers computed over the whole grid before an evaluation, one
+ * value per pixel, row by row; empty if the program does not use them.
+ */
+struct ExpressionGrids {
+  /** sounding_distance: distance to the nearest pixel holding a sounding
+   * (m), see markPoints() and distanceTransform(). */
+  std::vector<float> soundingDistance;
+  /** shore_distance: signed distance to the shoreline (m), see
+   * shoreDistance(). */
+  std::vector<float> shoreDistance;
+};
+
+/**
+ * @class Expression
+ * @brief Raster-algebra expression compiled to a plan evaluated over blocks
+ * of pixels.
+ *
+ * A program is a list of statements separated by ';'. "name = expr" binds
+ * a name for the statements after it; the value of the last statement is
+ * the result. Expressions read the layers of the height field:
+ * - z: the altitude (m);
+ * - slope: the slope (degrees), from heightFieldGradient();
+ * - aspect: the direction the slope faces (degrees clockwise from north,
+ *   empty where flat);
+ * - x, y: the projected coordinates of the pixel center (m);
+ * - sounding_distance, shore_distance: grids computed beforehand, see
+ *   ExpressionGrids.
+ *
+ * Operators, from the loosest to the tightest: c ? a : b, ||, &&, == !=,
+ * < <= > >=, + -, * / %, unary - and !, ^ (power). Functions: abs, sqrt,
+ * exp, log, floor, ceil, round, min, max, pow, clamp(v, lo, hi) and
+ * defined(v). Comparisons and logic give 1 or 0.
+ *
+ * An empty pixel (NaN) stays empty through every operator and function,
+ * except defined(), which gives 0 there and 1 elsewhere. Infinite results
+ * are empty too.
+ *
+ * Compilation gives a list of instructions over registers of BLOCK pixels,
+ * with constant parts folded and each layer loaded once. x and y are held
+ * as offsets from the grid origin, and constants compared with them are
+ * moved by the origin in double precision, so that comparing Lambert93
+ * coordinates keeps the precision of a metre fraction. Each instruction
+ * is one loop over a block, so a whole program runs in one pass over the
+ * pixels with no full-size temporary.
+ */
+class Expression {
+public:
+  /** @brief Pixels evaluated together by each instruction. */
+  static const int BLOCK = 256;
+
+  /**
+   * @brief Compiles a program.
+   * @param text The program.
+   * @param error Receives the first error, with its position.
+   * @return false on syntax error or unknown name.
+   */
+  bool compile(const std::string &text, std::string &error);
+
+  /** @brief Whether a program was compiled. */
+  bool empty() const { return code.empty(); }
+
+  /** @brief Whether the result depends on a layer, given by name. */
+  bool uses(const std::string &layer) const;
+
+  /**
+   * @brief Evaluates the program over a run of pixels of one row.
+   * @param field The altitudes.
+   * @param grids The precomputed layers the program uses.
+   * @param row The row.
+   * @param col0 First column.
+   * @param cols Number of columns, at most BLOCK.
+   * @param out Receives one value per pixel, NaN if empty.
+   * @param scratch Registers, reused across calls by one thread.
+   */
+  void evaluate(const HeightField &field, const ExpressionGrids &grids,
+                int row, int col0, int cols, float *out,
+                std::vector<float> &scratch) const;
+
+  /** @brief Instructions of the plan (after folding). */
+  std::size_t size() const { return code.size(); }
+
+private:
+  struct Instruction {
+    std::uint8_t op;
+    int target, a, b, c;
+    double value;
+    int kx = 0, ky = 0; // Multiples of the grid origin added to value
+  };
+  std::vector<Instruction> code;
+  int registers = 0;
+  int result = 0;
+
+  friend class ExpressionCompiler;
+};
+
+/**
+ * @struct ExpressionStats
+ * @brief What writeExpression() wrote.
+ */
+struct ExpressionStats {
+  std::size_t pixels = 0; /**< Pixels with a value. */
+  double min = 0;         /**< Lowest value. */
+  double max = 0;         /**< Highest value. */
+};
+
+/**
+ * @brief Evaluates an expression over a height field and writes the result.
+ *
+ * Row bands are evaluated in parallel. The format follows the extension:
+ * - .ppm: an image, values colored with the altitude colormap over their
+ *   own range and empty pixels black. The range comes from a first pass,
+ *   and the bands of the second one are colored and written as they are
+ *   evaluated;
+ * - otherwise a point file (text, .bin or .las, see pointFormatFromPath()):
+ *   one point per pixel with a value, at the pixel center in
+ *   longitude/latitude, the value as altitude, written a few bands at a
+ *   time.
+ *
+ * @param filename The output file.
+ * @param expression The compiled program.
+ * @param field The altitudes.
+ * @param grids The precomputed layers the program uses.
+ * @param pool Threads evaluating row bands.
+ * @param stats If not null, receives the counts and range.
+ * @return false if cancelled or on write error.
+ */
+bool writeExpression(const std::string &filename, const Expression &expression,
+                     const HeightField &field, const ExpressionGrids &grids,
+                     ThreadPool &pool,
+                     ExpressionStats *stats = nullptr);
+
+#endif // EXPRESSION_HPP
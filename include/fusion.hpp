@@ -0,0 +1,86 @@
+#ifndef FUSION_HPP
+#define FUSION_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "MNT.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * @struct SourceSpec
+ * @brief One input of a fused survey.
+ */
+struct SourceSpec {
+  std::string path;     /**< Point file (text, .bin or .las). */
+  int priority = 0;     /**< Higher wins where sources overlap. */
+  double quality = 0.0; /**< Vertical accuracy (m); lower wins among equal
+                             priorities, 0 if unknown. */
+};
+
+/**
+ * @enum OverlapRule
+ * @brief How the source kept in an overlap is chosen.
+ */
+enum class OverlapRule {
+  Priority, /**< Priority, then quality, then the source given last. */
+  Recency   /**< The source given last. */
+};
+
+/**
+ * @struct FusionOptions
+ * @brief Overlap resolution parameters.
+ */
+struct FusionOptions {
+  double cellSize = 10.0; /**< Side of a spatial hash cell (m). */
+  OverlapRule rule = OverlapRule::Priority;
+};
+
+/**
+ * @struct SourceStats
+ * @brief Outcome of the fusion for one source.
+ */
+struct SourceStats {
+  std::size_t loaded = 0;  /**< Points read and projected. */
+  std::size_t dropped = 0; /**< Points in cells won by another source. */
+};
+
+/**
+ * @brief Parses "file[:priority[:quality]]".
+ * @param text The specification.
+ * @param spec Receives the source.
+ * @return false if the priority or quality is malformed.
+ */
+bool parseSourceSpec(const std::string &text, SourceSpec &spec);
+
+/**
+ * @brief Parses "priority" or "recency".
+ * @param name The rule name.
+ * @param rule Receives the rule.
+ * @return true if the name is known.
+ */
+bool parseOverlapRule(const std::string &name, OverlapRule &rule);
+
+/**
+ * @brief Loads several sources into one projected point set.
+ *
+ * Each source is read and projected with lireEtConvertir(), on the whole
+ * pool. Where sources overlap, the area is cut into square cells (a spatial
+ * hash) and, in each cell holding points of several sources, only the points
+ * of the winning source are kept: mixing two surveys of the same ground
+ * would triangulate a zigzag between their surfaces. Points outside the
+ * common extent of two sources never enter the hash.
+ *
+ * @param sources The sources, oldest first.
+ * @param options Cell size and rule.
+ * @param pool Threads loading and resolving.
+ * @param stats If not null, receives one entry per source.
+ * @return std::vector<Point> The fused points, in source order (empty if a
+ * source could not be read).
+ */
+std::vector<Point> fuseSources(const std::vector<SourceSpec> &sources,
+                               const FusionOptions &options, ThreadPool &pool,
+                               std::vector<SourceStats> *stats = nullptr);
+
+#endif // FUSION_HPP
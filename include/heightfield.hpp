@@ -0,0 +1,108 @@
+#ifndef HEIGHTFIELD_HPP
+#define HEIGHTFIELD_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "rasterizer.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * @struct HeightField
+ * @brief One altitude per pixel of a raster grid.
+ *
+ * Engines that do not rasterize triangles one by one (binning,
+ * interpolation) produce this grid first and color it afterwards. Pixels
+ * without data hold NaN.
+ */
+struct HeightField {
+  RasterGrid grid;      /**< Pixel grid and color scale. */
+  std::vector<float> z; /**< Altitudes row by row, top row first. */
+
+  /** @brief Allocates the grid with every pixel empty. */
+  void reset(const RasterGrid &g) {
+    grid = g;
+    z.assign(static_cast<std::size_t>(g.width) * g.height, NAN);
+  }
+
+  /** @brief Altitude of (row, col). */
+  float at(int row, int col) const {
+    return z[static_cast<std::size_t>(row) * grid.width + col];
+  }
+
+  /** @brief Whether (row, col) has an altitude. */
+  bool has(int row, int col) const { return !std::isnan(at(row, col)); }
+};
+
+/**
+ * @brief Computes the altitudes of an image from the mesh.
+ *
+ * Same grid and linear interpolation as generateImage(), kept as altitudes
+ * instead of colors so that they can be processed before coloring.
+ *
+ * @param mesh The mesh.
+ * @param width The image width in pixels.
+ * @param pool Threads building the index and interpolating row bands.
+ * @param field Receives the altitudes.
+ * @return false if the mesh spans no area or if cancelled.
+ */
+bool makeMeshField(const Mesh &mesh, int width, ThreadPool &pool,
+                   HeightField &field);
+
+/**
+ * @brief Slope of a height field at a pixel.
+ *
+ * Differences with the neighbours: central where both exist, one-sided at
+ * the edges of the data, 0 along an axis with neither.
+ *
+ * @param field The altitudes.
+ * @param row The row of a filled pixel.
+ * @param col The column of that pixel.
+ * @param gx Receives the altitude change per meter eastwards.
+ * @param gy Receives the altitude change per meter northwards.
+ */
+void heightFieldGradient(const HeightField &field, int row, int col,
+                         double &gx, double &gy);
+
+/**
+ * @brief Colors a band of rows of a height field.
+ *
+ * Same colormap and light as the triangle renderer; the slope of a pixel
+ * comes from heightFieldGradient(). Empty pixels are black.
+ *
+ * @param field The altitudes.
+ * @param row0 First row (inclusive).
+ * @param row1 Last row (exclusive).
+ * @param out RGB pixel of (row0, 0).
+ * @param stride Bytes between two rows of out.
+ */
+void shadeHeightField(const HeightField &field, int row0, int row1,
+                      unsigned char *out, std::size_t stride);
+
+/**
+ * @brief Colors a height field and writes it as a PPM image.
+ * @param filename The output file.
+ * @param field The altitudes.
+ * @param pool Threads coloring row bands.
+ * @return false if cancelled or on write error.
+ */
+bool writeHeightFieldImage(const std::string &filename,
+                           const HeightField &field, ThreadPool &pool);
+
+/**
+ * @brief Gives each empty pixel the altitude of the nearest filled pixel,
+ * up to a distance.
+ *
+ * The nearest filled pixel is propagated in two raster scans (forward,
+ * then backward) over the 8 neighbours, a fast approximation of the
+ * Euclidean distance transform. Filled pixels are unchanged.
+ *
+ * @param field The altitudes, filled in place.
+ * @param radius Largest distance filled (pixels); 0 does nothing.
+ * @return std::size_t The number of pixels filled.
+ */
+std::size_t fillGaps(HeightField &field, int radius);
+
+#endif // HEIGHTFIELD_HPP
@@ -0,0 +1,44 @@
+#ifndef HOLEFILL_HPP
+#define HOLEFILL_HPP
+
+#include <cstddef>
+
+#include "heightfield.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * @struct HoleFillStats
+ * @brief What fillHoles() found and filled.
+ */
+struct HoleFillStats {
+  std::size_t filled = 0;  /**< Holes filled. */
+  std::size_t pixels = 0;  /**< Pixels filled. */
+  std::size_t skipped = 0; /**< Holes larger than the limit, left empty. */
+};
+
+/**
+ * @brief Fills the holes of a height field with a membrane surface.
+ *
+ * A hole is a 4-connected region of empty pixels that does not reach the
+ * edge of the image, so it is surrounded by data: the gaps the 70 m filter
+ * leaves inside the survey, while the area outside the survey, which
+ * always reaches the edge, stays empty. Each hole is filled with the
+ * solution of Laplace's equation whose boundary values are the altitudes
+ * around it: the smoothest surface that meets the surrounding data, without
+ * new peaks or pits.
+ *
+ * Holes are solved independently in parallel, each over its bounding box,
+ * by conjugate gradients preconditioned with a multigrid V-cycle (2 x 2
+ * cells merged per level), so that wide holes converge in a few dozen
+ * iterations.
+ *
+ * @param field The altitudes, filled in place.
+ * @param maxArea Largest hole filled (m²); larger holes stay empty.
+ * @param pool Threads solving holes.
+ * @param stats If not null, receives the counts.
+ * @return false if cancelled.
+ */
+bool fillHoles(HeightField &field, double maxArea, ThreadPool &pool,
+               HoleFillStats *stats = nullptr);
+
+#endif // HOLEFILL_HPP
@@ -0,0 +1,74 @@
+#ifndef IDW_HPP
+#define IDW_HPP
+
+#include <string>
+#include <vector>
+
+#include "MNT.hpp"
+#include "heightfield.hpp"
+#include "kdtree.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * @struct IdwOptions
+ * @brief Parameters of inverse-distance weighting.
+ */
+struct IdwOptions {
+  int neighbours = 8;   /**< Points averaged per pixel (k nearest). */
+  double radius = 70.0; /**< Search radius (m); pixels with no point this
+                             close stay empty. */
+  double power = 2.0;   /**< Weight of a point: 1 / distance^power. */
+};
+
+/**
+ * @brief Fills a height field by inverse-distance weighting.
+ *
+ * Pixels are processed by 64 x 64 tiles in parallel, each tile row by row
+ * in alternating directions. A pixel starts its search within the distance
+ * of the previous pixel's farthest neighbour plus one pixel step: those
+ * neighbours are all that close, so the search stays exact while skipping
+ * most of the tree.
+ *
+ * @param tree The points.
+ * @param field Receives the altitudes (grid already set).
+ * @param options Neighbours, radius and power.
+ * @param pool Threads processing tiles.
+ * @return false if cancelled.
+ */
+bool idwGrid(const KdTree &tree, HeightField &field, const IdwOptions &options,
+             ThreadPool &pool);
+
+/**
+ * @brief Computes the altitudes of an image by inverse-distance weighting.
+ *
+ * Same grid as generateImage(): builds the k-d tree, then idwGrid().
+ *
+ * @param points Projected points (moved into the k-d tree).
+ * @param width The image width in pixels.
+ * @param options Neighbours, radius and power.
+ * @param pool Threads building the tree and gridding.
+ * @param field Receives the altitudes.
+ * @return false if the points span no area or if cancelled.
+ */
+bool makeIdwField(std::vector<Point> points, int width,
+                  const IdwOptions &options, ThreadPool &pool,
+                  HeightField &field);
+
+/**
+ * @brief Generates an image by inverse-distance weighting, without a mesh.
+ *
+ * makeIdwField() then writeHeightFieldImage(). Smoother than linear
+ * interpolation on noisy soundings, since each pixel averages several
+ * points.
+ *
+ * @param filename The output filename.
+ * @param width The image width in pixels.
+ * @param points Projected points (moved into the k-d tree).
+ * @param options Neighbours, radius and power.
+ * @param pool Threads building the tree and gridding.
+ */
+void generateIdwImage(const std::string &filename, int width,
+                      std::vector<Point> points, const IdwOptions &options,
+                      ThreadPool &pool);
+
+#endif // IDW_HPP
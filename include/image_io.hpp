@@ -0,0 +1,144 @@
+#ifndef IMAGE_IO_HPP
+#define IMAGE_IO_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+/**
+ * @struct Image
+ * @brief An 8-bit RGB image stored row by row.
+ */
+struct Image {
+  int width = 0;                     /**< Width in pixels. */
+  int height = 0;                    /**< Height in pixels. */
+  std::vector<unsigned char> pixels; /**< RGB triplets, top row first. */
+};
+
+/**
+ * @brief Reads a binary (P6, 8-bit) PPM image.
+ * @param filename The file to read.
+ * @param image Receives the image.
+ * @return true on success.
+ */
+bool readPPM(const std::string &filename, Image &image);
+
+/**
+ * @brief Writes a binary (P6) PPM image.
+ * @param filename The file to write.
+ * @param image The image.
+ * @return true on success.
+ */
+bool writePPM(const std::string &filename, const Image &image);
+
+/**
+ * @class PpmWriter
+ * @brief Writes a binary PPM image piece by piece, in any order.
+ *
+ * The file is created at its final size up front and each block of pixels
+ * is written at its own offset with pwrite(2), so several threads can write
+ * disjoint regions concurrently and no full-image buffer is needed.
+ */
+class PpmWriter {
+public:
+  PpmWriter() = default;
+  ~PpmWriter();
+
+  PpmWriter(const PpmWriter &) = delete;
+  PpmWriter &operator=(const PpmWriter &) = delete;
+
+  /**
+   * @brief Creates the file and writes the header.
+   * @param filename The file to write.
+   * @param width Image width in pixels.
+   * @param height Image height in pixels.
+   * @param comment Optional header comment line (without the '#').
+   * @param keep Keep the pixels of an existing file of the same size, to
+   * resume an interrupted render.
+   * @return true on success.
+   */
+  bool open(const std::string &filename, int width, int height,
+            const std::string &comment = "", bool keep = false);
+
+  /**
+   * @brief Writes a rectangle of pixels. Thread-safe for disjoint regions.
+   * @param row0 First row.
+   * @param rows Number of rows.
+   * @param col0 First column.
+   * @param cols Number of columns.
+   * @param pixels RGB pixel of (row0, col0).
+   * @param stride Bytes between two rows of pixels.
+   * @return true on success.
+   */
+  bool writeBlock(int row0, int rows, int col0, int cols,
+                  const unsigned char *pixels, std::size_t stride);
+
+  /**
+   * @brief Flushes the pixels written so far to the disk (fdatasync).
+   * @return true on success.
+   */
+  bool sync();
+
+  /**
+   * @brief Closes the file.
+   * @return true if every write succeeded.
+   */
+  bool close();
+
+private:
+  int fd = -1;
+  int width = 0;
+  int height = 0;
+  std::size_t headerSize = 0;
+  bool failed = false;
+};
+
+/**
+ * @struct PpmPart
+ * @brief Header of a partial image written by one shard.
+ *
+ * A part is a valid PPM holding rows [row0, row0 + rows) of an image of
+ * the given height, tagged by a "# terrain-part <row0> <height>" comment.
+ */
+struct PpmPart {
+  int width = 0;              /**< Width of the image and of the part. */
+  int rows = 0;               /**< Rows held by the part (may be 0). */
+  int row0 = 0;               /**< First row in the full image. */
+  int height = 0;             /**< Height of the full image. */
+  std::size_t dataOffset = 0; /**< Offset of the first pixel in the file. */
+};
+
+/**
+ * @brief Returns the header comment tagging a part.
+ * @param row0 First row of the part in the full image.
+ * @param height Height of the full image.
+ * @return std::string The comment, for PpmWriter::open().
+ */
+std::string ppmPartComment(int row0, int height);
+
+/**
+ * @brief Reads the header of a partial image.
+ * @param filename The part file.
+ * @param part Receives the header.
+ * @return true if the file is a part.
+ */
+bool readPpmPart(const std::string &filename, PpmPart &part);
+
+/**
+ * @brief Assembles partial images into the full one.
+ *
+ * Parts are checked to share the same image size and to cover every row
+ * exactly once, in any order; each is then copied with positioned writes,
+ * parts in parallel.
+ *
+ * @param output The full image to write.
+ * @param parts The part files.
+ * @param pool Threads copying the parts.
+ * @return true on success.
+ */
+bool mergePpmParts(const std::string &output,
+                   const std::vector<std::string> &parts, ThreadPool &pool);
+
+#endif // IMAGE_IO_HPP
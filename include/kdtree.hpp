@@ -0,0 +1,83 @@
+#ifndef KDTREE_HPP
+#define KDTREE_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "MNT.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * @class KdTree
+ * @brief Static 2D k-d tree over points, for nearest-neighbour queries.
+ *
+ * The tree has no node objects: the points are reordered so that the node
+ * of a range [begin, end) is its middle element, with the left subtree in
+ * [begin, middle) and the right one in (middle, end). Each node splits
+ * along the wider axis of its range. Subtrees are contiguous in memory, and
+ * small ranges at the bottom are scanned linearly.
+ */
+class KdTree {
+public:
+  /**
+   * @struct Neighbour
+   * @brief A point found by a query.
+   */
+  struct Neighbour {
+    double distSq;      /**< Squared planar distance to the query. */
+    std::uint32_t index; /**< Index in points(). */
+  };
+
+  /**
+   * @brief Builds the tree; large subtrees are built in parallel.
+   * @param points The points, reordered and kept by the tree.
+   * @param pool Threads building subtrees.
+   * @param keepOrder If true, order() gives the input index of each point.
+   * The build then partitions indices and moves the points once at the end.
+   */
+  void build(std::vector<Point> points, ThreadPool &pool,
+             bool keepOrder = false);
+
+  /** @brief The points, in tree order. */
+  const std::vector<Point> &points() const { return pts; }
+
+  /**
+   * @brief Index in the input of each point of points(); empty unless
+   * built with keepOrder.
+   */
+  const std::vector<std::uint32_t> &order() const { return ids; }
+
+  /** @brief Gives back the points, in tree order, and empties the tree. */
+  std::vector<Point> release() {
+    std::vector<Point> out;
+    out.swap(pts);
+    axis.clear();
+    ids.clear();
+    return out;
+  }
+
+  /**
+   * @brief Finds the k points nearest to (x, y) within a distance.
+   *
+   * @param x X coordinate of the query.
+   * @param y Y coordinate of the query.
+   * @param k Largest number of neighbours.
+   * @param maxDistSq Squared search radius; farther points are ignored.
+   * @param out Receives the neighbours, in no particular order except that
+   * out.front() is the farthest one.
+   */
+  void nearest(double x, double y, int k, double maxDistSq,
+               std::vector<Neighbour> &out) const;
+
+private:
+  void buildRange(std::size_t begin, std::size_t end, ThreadPool &pool);
+  void search(std::size_t begin, std::size_t end, double x, double y,
+              std::size_t k, double &bound,
+              std::vector<Neighbour> &out) const;
+
+  std::vector<Point> pts;
+  std::vector<std::uint8_t> axis; // Split axis of each node (0 = x, 1 = y)
+  std::vector<std::uint32_t> ids;  // Input index of each node, if kept
+};
+
+#endif // KDTREE_HPP
@@ -0,0 +1,88 @@
+#ifndef LATTICE_HPP
+#define LATTICE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MNT.hpp"
+#include "rasterizer.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * @enum LatticeMode
+ * @brief Whether the loader looks for a regular grid.
+ */
+enum class LatticeMode {
+  Off,  /**< Always triangulate. */
+  Auto, /**< Use the grid path when the input is a regular grid. */
+  On    /**< Require a regular grid; fail otherwise. */
+};
+
+/**
+ * @struct Lattice
+ * @brief A regular longitude/latitude grid of points, stored densely.
+ *
+ * Node (i, j) lies at longitude lon0 + i * dLon and latitude
+ * lat0 + j * dLat; nodes[j * cols + i] is the index of its point, or
+ * NO_POINT where the grid has a hole.
+ */
+struct Lattice {
+  static const std::uint32_t NO_POINT = UINT32_MAX;
+
+  double lon0 = 0, lat0 = 0;   /**< Node (0, 0) (degrees). */
+  double dLon = 0, dLat = 0;   /**< Steps (degrees). */
+  int cols = 0, rows = 0;      /**< Nodes along each axis. */
+  std::vector<std::uint32_t> nodes; /**< Point of each node, row by row. */
+};
+
+/**
+ * @brief Parses "off", "auto" or "on".
+ * @param name The mode name.
+ * @param mode Receives the mode.
+ * @return true if the name is known.
+ */
+bool parseLatticeMode(const std::string &name, LatticeMode &mode);
+
+/**
+ * @brief Recognizes a regular grid among geographic points.
+ *
+ * Grid exports are written in raster order, so the smallest step between
+ * consecutive points gives the spacing along each axis, refined over the
+ * whole extent. Every point must then lie within tolerance (a fraction of
+ * the spacing) of a node, and at least a quarter of the nodes must be
+ * present; the check stops at the first stray point, so scattered surveys
+ * are rejected almost at once.
+ *
+ * @param points Geographic points (longitude in x, latitude in y), before
+ * projection.
+ * @param tolerance Allowed offset from a node, in steps.
+ * @param lattice Receives the grid.
+ * @return true if the points form a regular grid.
+ */
+bool detectLattice(const std::vector<Point> &points, double tolerance,
+                   Lattice &lattice);
+
+/**
+ * @brief Generates the image of a regular grid without triangulating it.
+ *
+ * Same grid, colors and shading as generateImage(): each grid cell is read
+ * as two triangles, with the 70 m edge filter applied to them. The node
+ * containing a pixel is found by bilinear lookup: the pixel centers of a
+ * coarse control grid are converted back to longitude and latitude, and
+ * pixels in between are interpolated, so there is no Delaunay step and no
+ * QuadTree.
+ *
+ * @param filename The output filename.
+ * @param width The image width in pixels.
+ * @param lattice The grid, from detectLattice().
+ * @param points The same points, projected.
+ * @param options Rendering options (thread pool; checkpoints are ignored).
+ */
+void generateLatticeImage(const std::string &filename, int width,
+                          const Lattice &lattice,
+                          const std::vector<Point> &points,
+                          const RenderOptions &options = RenderOptions());
+
+#endif // LATTICE_HPP
@@ -0,0 +1,56 @@
+#ifndef LOGGING_HPP
+#define LOGGING_HPP
+
+#include <ostream>
+#include <string>
+
+/**
+ * @enum LogLevel
+ * @brief Verbosity of the console messages, from silent to chatty.
+ */
+enum class LogLevel {
+  Quiet, /**< Nothing at all, not even errors. */
+  Error, /**< Errors only (batch runs). */
+  Info,  /**< Errors and pipeline steps (default). */
+  Debug  /**< Everything, including per-stage details. */
+};
+
+/**
+ * @brief Sets the process-wide verbosity.
+ * @param level The new level.
+ */
+void setLogLevel(LogLevel level);
+
+/**
+ * @brief Returns the process-wide verbosity.
+ * @return LogLevel The current level.
+ */
+LogLevel logLevel();
+
+/**
+ * @brief Parses "quiet", "error", "info" or "debug".
+ * @param name The level name.
+ * @param level Receives the level.
+ * @return true if the name is known.
+ */
+bool parseLogLevel(const std::string &name, LogLevel &level);
+
+/**
+ * @brief Stream for error messages: std::cerr, or a null stream below
+ * LogLevel::Error.
+ */
+std::ostream &logError();
+
+/**
+ * @brief Stream for pipeline steps: std::cout, or a null stream below
+ * LogLevel::Info.
+ */
+std::ostream &logInfo();
+
+/**
+ * @brief Stream for details: std::cout at LogLevel::Debug, a null stream
+ * otherwise.
+ */
+std::ostream &logDebug();
+
+#endif // LOGGING_HPP
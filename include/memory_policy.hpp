@@ -0,0 +1,155 @@
+#ifndef MEMORY_POLICY_HPP
+#define MEMORY_POLICY_HPP
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @enum HugePages
+ * @brief Page size requested for the large buffers.
+ */
+enum class HugePages {
+  Off,         /**< Kernel default (4 KiB pages unless THP is "always"). */
+  Transparent, /**< madvise(MADV_HUGEPAGE) on large buffers. */
+  Explicit     /**< Reserved huge pages (MAP_HUGETLB) for the pixel buffer,
+                    transparent ones elsewhere or when none are free. */
+};
+
+/**
+ * @enum NumaPlacement
+ * @brief Placement of the large buffers on a multi-socket machine.
+ */
+enum class NumaPlacement {
+  Default,    /**< Kernel default: pages on the node of the first writer. */
+  Interleave, /**< Every page of the process round-robin over the nodes. */
+  Split       /**< Buffers read by every worker (points, triangles)
+                   interleaved; only the buffers split between workers
+                   (pixels) are local, placed on the node of the worker
+                   writing them first. */
+};
+
+/**
+ * @struct MemoryPolicy
+ * @brief Page size and placement of the large buffers.
+ */
+struct MemoryPolicy {
+  HugePages hugePages = HugePages::Off;
+  NumaPlacement numa = NumaPlacement::Default;
+};
+
+/**
+ * @brief Parses "off", "thp" or "explicit".
+ * @param name The mode name.
+ * @param mode Receives the mode.
+ * @return true if the name is known.
+ */
+bool parseHugePages(const std::string &name, HugePages &mode);
+
+/**
+ * @brief Parses "default", "interleave" or "split".
+ * @param name The placement name.
+ * @param placement Receives the placement.
+ * @return true if the name is known.
+ */
+bool parseNumaPlacement(const std::string &name, NumaPlacement &placement);
+
+/**
+ * @brief Sets the process-wide policy.
+ *
+ * NumaPlacement::Interleave sets the memory policy of the calling thread,
+ * which threads started afterwards inherit: call it before creating the
+ * thread pool.
+ *
+ * @param policy The policy.
+ * @return false if the kernel refused the NUMA policy (it is then ignored).
+ */
+bool setMemoryPolicy(const MemoryPolicy &policy);
+
+/**
+ * @brief Returns the process-wide policy.
+ * @return const MemoryPolicy& The current policy.
+ */
+const MemoryPolicy &memoryPolicy();
+
+/**
+ * @brief Returns the number of online NUMA nodes (1 without NUMA).
+ */
+int numaNodeCount();
+
+/**
+ * @brief Applies the policy to a buffer read by every worker.
+ *
+ * Requests huge pages for it and, with NumaPlacement::Split, interleaves
+ * it over the nodes. Pages not yet touched are placed when first written;
+ * pages already there are migrated and collapsed into huge pages. Does
+ * nothing under the default policy.
+ *
+ * @param data Start of the buffer.
+ * @param bytes Size of the buffer.
+ */
+void placeShared(const void *data, std::size_t bytes);
+
+/**
+ * @class LargeBuffer
+ * @brief Zero-filled buffer mapped directly from the kernel, untouched
+ * until written.
+ *
+ * Unlike a std::vector, which zeroes its storage on the allocating thread,
+ * each page is placed when a worker first writes it: a buffer split between
+ * workers the way they will later use it ends up local to each of them.
+ */
+class LargeBuffer {
+public:
+  LargeBuffer() = default;
+
+  /**
+   * @brief Maps a buffer according to the process-wide policy.
+   * @param bytes Size of the buffer.
+   */
+  explicit LargeBuffer(std::size_t bytes);
+  ~LargeBuffer();
+
+  LargeBuffer(const LargeBuffer &) = delete;
+  LargeBuffer &operator=(const LargeBuffer &) = delete;
+
+  /** @brief Start of the buffer, or nullptr if the mapping failed. */
+  unsigned char *data() { return bytes; }
+
+  /** @brief Size of the buffer. */
+  std::size_t size() const { return length; }
+
+private:
+  unsigned char *bytes = nullptr;
+  std::size_t length = 0;
+  std::size_t mapped = 0;
+};
+
+/**
+ * @brief Returns the bytes of the process backed by transparent huge pages.
+ * @return std::size_t AnonHugePages of /proc/self/smaps_rollup, or 0.
+ */
+std::size_t hugePageBytes();
+
+/**
+ * @class AccessCounterScope
+ * @brief Counts the remote-node loads and dTLB load misses of the process
+ * while it is alive, and writes them to logDebug() when destroyed.
+ *
+ * Threads started after construction are counted once they have exited, so
+ * the scope must outlive the thread pool. Uses perf_event_open(2); when the
+ * counters are unavailable (no PMU, perf_event_paranoid), says so instead.
+ */
+class AccessCounterScope {
+public:
+  AccessCounterScope();
+  ~AccessCounterScope();
+
+  AccessCounterScope(const AccessCounterScope &) = delete;
+  AccessCounterScope &operator=(const AccessCounterScope &) = delete;
+
+private:
+  int remoteLoads = -1;
+  int tlbMisses = -1;
+};
+
+#endif // MEMORY_POLICY_HPP
@@ -0,0 +1,61 @@
+#ifndef OUTLIERS_HPP
+#define OUTLIERS_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "MNT.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * @struct OutlierOptions
+ * @brief Parameters of the statistical outlier removal.
+ */
+struct OutlierOptions {
+  int neighbours = 16;    /**< Neighbours compared with each point (k). */
+  double threshold = 6.0; /**< Largest altitude deviation kept, in robust
+                               standard deviations of the neighbours. */
+  std::string rejectedFile; /**< If not empty, receives the rejected
+                                 points (geographic, format from the
+                                 extension). */
+};
+
+/**
+ * @struct OutlierStats
+ * @brief How many points removeOutliers() rejected, and why.
+ */
+struct OutlierStats {
+  std::size_t vertical = 0; /**< Spikes: altitude off its neighbours. */
+  std::size_t planar = 0;   /**< Fliers: far from all their neighbours. */
+};
+
+/**
+ * @brief Removes spikes and isolated fliers from projected points.
+ *
+ * Each point is compared with its k nearest neighbours in the plane, found
+ * in parallel with a k-d tree:
+ * - a spike lies more than threshold robust standard deviations from the
+ *   median altitude of its neighbours. The deviation is 1.4826 times the
+ *   neighbours' median absolute deviation (the standard deviation for
+ *   normal data), at least 5 cm: the neighbours' own roughness sets the
+ *   scale, so steep slopes are not mistaken for spikes, and neither
+ *   statistic is dragged by the outlier itself;
+ * - a flier lies farther from the centroid of its neighbours than three
+ *   times their spread around it: its neighbours are all on one side, far
+ *   away. Points on the border of the survey stay around one spread.
+ *
+ * The kept points keep their input order.
+ *
+ * @param points Projected points, cleaned in place.
+ * @param options Neighbours and threshold.
+ * @param pool Threads building the tree and measuring points.
+ * @param rejected If not null, receives the rejected points.
+ * @param stats If not null, receives the counts.
+ * @return false if cancelled (all points are then kept).
+ */
+bool removeOutliers(std::vector<Point> &points, const OutlierOptions &options,
+                    ThreadPool &pool, std::vector<Point> *rejected = nullptr,
+                    OutlierStats *stats = nullptr);
+
+#endif // OUTLIERS_HPP
@@ -0,0 +1,72 @@
+#ifndef PERSPECTIVE_HPP
+#define PERSPECTIVE_HPP
+
+#include <cstddef>
+#include <string>
+
+#include "thread_pool.hpp"
+#include "triangulation.hpp"
+
+/**
+ * @struct PerspectiveOptions
+ * @brief Camera, relief and light of a perspective view.
+ *
+ * The camera orbits the center of the mesh and looks at it; at distance 1
+ * the whole mesh fits in the frame whatever the direction.
+ */
+struct PerspectiveOptions {
+  int width = 1920;        /**< Image width in pixels. */
+  int height = 1080;       /**< Image height in pixels. */
+  double azimuth = 200;    /**< Where the camera stands, seen from the
+                                center (degrees clockwise from north). */
+  double elevation = 35;   /**< Camera height above the horizon (degrees,
+                                90 looks straight down). */
+  double fov = 40;         /**< Vertical field of view (degrees). */
+  double distance = 1;     /**< Camera distance, as a multiple of the one
+                                framing the whole mesh. */
+  double exaggeration = 1; /**< Vertical exaggeration of the relief. */
+  double sunAzimuth = 315;   /**< Direction of the light (degrees clockwise
+                                  from north). */
+  double sunElevation = 45;  /**< Height of the light (degrees). */
+};
+
+/**
+ * @struct PerspectiveStats
+ * @brief What renderPerspective() drew.
+ */
+struct PerspectiveStats {
+  std::size_t visible = 0; /**< Triangles left after culling. */
+  std::size_t binned = 0;  /**< Triangle references over all the tiles. */
+  std::size_t pixels = 0;  /**< Pixels covered by the terrain. */
+};
+
+/**
+ * @brief Renders a perspective view of the mesh to a PPM image.
+ *
+ * The vertices are projected in parallel. Triangles are then culled in
+ * chunks: behind the camera, outside the frame, facing away or covering no
+ * pixel center; the others are binned to the tiles of the image they
+ * overlap, chunks in parallel, in the order of the mesh. Tiles are then
+ * rasterized in parallel, each with its own depth buffer: integer edge
+ * functions at 1/16 pixel with a top-left fill rule (no gap and no
+ * overlap along shared edges), depth and altitude interpolated with
+ * perspective correction. A pixel takes the altitude colormap over the
+ * range of the mesh, shaded by the orientation of its triangle to the
+ * light, and the terrain-free pixels stay black. Each tile is written as
+ * soon as it is done.
+ *
+ * Triangles crossing the plane of the camera, possible below distance 1,
+ * are dropped rather than clipped.
+ *
+ * @param filename The output image.
+ * @param mesh The mesh, in projected coordinates (m).
+ * @param options Camera, relief and light.
+ * @param pool Threads sharing vertices, chunks and tiles.
+ * @param stats If not null, receives the counts.
+ * @return false if cancelled, if the mesh is empty or on write error.
+ */
+bool renderPerspective(const std::string &filename, const Mesh &mesh,
+                       const PerspectiveOptions &options, ThreadPool &pool,
+                       PerspectiveStats *stats = nullptr);
+
+#endif // PERSPECTIVE_HPP
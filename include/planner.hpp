@@ -0,0 +1,98 @@
+#ifndef PLANNER_HPP
+#define PLANNER_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "MNT.hpp"
+#include "rasterizer.hpp"
+
+/**
+ * @struct MemoryPlan
+ * @brief Execution plan chosen to stay under a memory budget.
+ */
+struct MemoryPlan {
+  bool tiled = false;            /**< Tiled pipeline instead of whole image. */
+  int tileSize = 0;              /**< Tile side in pixels (tiled only). */
+  int tilesInFlight = 0;         /**< Tiles alive at once (tiled only). */
+  std::size_t pointBytes = 0;    /**< Points kept in memory. */
+  std::size_t meshBytes = 0;     /**< Mesh and index (largest tile if tiled). */
+  std::size_t imageBytes = 0;    /**< Image buffer (one tile if tiled). */
+  std::size_t estimatedBytes = 0; /**< Estimated peak of the whole run. */
+};
+
+/**
+ * @brief Parses a byte size such as "8G", "512M", "1.5g" or "1000000".
+ *
+ * Suffixes K, M, G and T are powers of 1024; an optional trailing "B" or
+ * "iB" is accepted.
+ *
+ * @param text The size.
+ * @param bytes Receives the number of bytes.
+ * @return true if the text is a positive size.
+ */
+bool parseByteSize(const std::string &text, std::size_t &bytes);
+
+/**
+ * @brief Formats a byte count with a binary unit (e.g., "1.5 Gio").
+ * @param bytes The number of bytes.
+ * @return std::string The formatted size.
+ */
+std::string formatBytes(std::size_t bytes);
+
+/**
+ * @brief Estimates the number of points of an input file without reading it.
+ *
+ * The format follows the extension, as for loading: LAS files give the
+ * count of their header and binary files their size over the record size.
+ * For text, the average line length is measured on the start of the file
+ * and extrapolated to its size.
+ *
+ * @param filename The input point file.
+ * @return std::size_t Estimated point count, 0 if the file cannot be read.
+ */
+std::size_t estimatePointCount(const std::string &filename);
+
+/**
+ * @brief Estimates the peak memory of the process while loading and
+ * projecting points.
+ * @param points Number of points.
+ * @param threads Threads of the pool (one read buffer piece each).
+ * @return std::size_t Bytes.
+ */
+std::size_t estimateLoadBytes(std::size_t points, int threads);
+
+/**
+ * @brief Chooses how to render loaded points within a memory budget.
+ *
+ * The whole-image pipeline is kept when it fits. Otherwise the tiled
+ * pipeline is planned: for decreasing tile sizes, the points gathered by
+ * the densest tile (halo included) are counted on the actual data, and the
+ * largest tile size leaving room for at least one tile per thread is kept
+ * (or, failing that, the largest one that fits at all).
+ *
+ * @param points The projected points.
+ * @param grid The grid of the image.
+ * @param limit The memory budget in bytes.
+ * @param threads Threads of the pool.
+ * @param halo Halo of the tiled pipeline in metres.
+ * @param forcedTileSize Tile size imposed by the user, 0 to let the planner
+ * choose.
+ * @param plan Receives the chosen plan, or the smallest one tried.
+ * @return true if a plan fits the budget.
+ */
+bool planMemory(const std::vector<Point> &points, const RasterGrid &grid,
+                std::size_t limit, int threads, double halo,
+                int forcedTileSize, MemoryPlan &plan);
+
+/**
+ * @brief Prints a plan, one line per memory item.
+ * @param os The output stream.
+ * @param plan The plan.
+ * @param limit The budget it was planned for.
+ */
+void printPlan(std::ostream &os, const MemoryPlan &plan, std::size_t limit);
+
+#endif // PLANNER_HPP
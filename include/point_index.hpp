@@ -0,0 +1,93 @@
+#ifndef POINT_INDEX_HPP
+#define POINT_INDEX_HPP
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MNT.hpp"
+#include "quadtree.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * @struct IndexedRange
+ * @brief A run of whole lines of a text point file and its projected extent.
+ */
+struct IndexedRange {
+  std::size_t offset = 0;          /**< First byte (start of a line). */
+  std::size_t length = 0;          /**< Bytes, ending after a newline. */
+  std::size_t points = 0;          /**< Points read from the range. */
+  BoundingBox bounds{0, 0, 0, 0};  /**< Projected extent of its points. */
+};
+
+/**
+ * @struct PointIndex
+ * @brief Spatial pre-index of a text point file, stored next to it.
+ *
+ * Surveys are written along flight lines or scan rows, so consecutive lines
+ * of the file are close to each other: the extent of each range lets a
+ * process that only needs part of the area skip most of the file, and the
+ * global extent gives every process the same image grid without reading
+ * all the points.
+ */
+struct PointIndex {
+  std::size_t fileSize = 0;       /**< Size of the indexed file (staleness). */
+  std::size_t points = 0;         /**< Total number of points. */
+  BoundingBox bounds{0, 0, 0, 0}; /**< Projected extent of all points. */
+  double minZ = 0, maxZ = 0;      /**< Altitude range of all points. */
+  std::vector<IndexedRange> ranges; /**< Ranges in file order. */
+};
+
+/**
+ * @brief Returns the path of the index of a point file ("<file>.idx").
+ * @param input The point file.
+ * @return std::string The index path.
+ */
+std::string pointIndexPath(const std::string &input);
+
+/**
+ * @brief Indexes a text point file.
+ *
+ * The file is cut into ranges of about rangeBytes bytes at line ends, and
+ * each range is read and projected to record its extent.
+ *
+ * @param input The text point file.
+ * @param rangeBytes Approximate size of a range.
+ * @param pool Threads parsing and projecting.
+ * @param index Receives the index.
+ * @return true on success.
+ */
+bool buildPointIndex(const std::string &input, std::size_t rangeBytes,
+                     ThreadPool &pool, PointIndex &index);
+
+/**
+ * @brief Writes an index as text.
+ * @param path The index file.
+ * @param index The index.
+ * @return true on success.
+ */
+bool writePointIndex(const std::string &path, const PointIndex &index);
+
+/**
+ * @brief Reads the index of a point file, if there is an up-to-date one.
+ *
+ * A missing index is not an error; an index whose recorded size differs
+ * from the file is reported and ignored.
+ *
+ * @param input The point file.
+ * @param index Receives the index.
+ * @return true if a valid index was read.
+ */
+bool readPointIndex(const std::string &input, PointIndex &index);
+
+/**
+ * @brief Lists the ranges whose extent meets an area.
+ * @param index The index.
+ * @param area The area of interest (projected coordinates).
+ * @return The (offset, length) ranges, in file order, for lirePlages().
+ */
+std::vector<std::pair<std::size_t, std::size_t>>
+selectRanges(const PointIndex &index, const BoundingBox &area);
+
+#endif // POINT_INDEX_HPP
@@ -0,0 +1,91 @@
+#ifndef POINT_IO_HPP
+#define POINT_IO_HPP
+
+#include "MNT.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * @enum PointFormat
+ * @brief On-disk formats of geographic point clouds.
+ */
+enum class PointFormat {
+  Text,   /**< "latitude longitude altitude" lines (the original format). */
+  Binary, /**< Raw little-endian doubles: latitude, longitude, altitude. */
+  Las     /**< ASPRS LAS 1.2, point format 0, X = longitude, Y = latitude. */
+};
+
+/**
+ * @brief Guesses the format from the file extension (.bin, .las, else text).
+ */
+PointFormat pointFormatFromPath(const std::string &path);
+
+/**
+ * @brief Parses a format name ("text", "bin", "las").
+ * @return true if the name is known.
+ */
+bool parsePointFormat(const std::string &name, PointFormat &format);
+
+/**
+ * @brief Reads a binary or LAS point file (see lirePoints for text).
+ *
+ * Points follow the lirePoints() convention: x = longitude, y = latitude.
+ *
+ * @param path The file to read.
+ * @param format Binary or Las.
+ * @param points Receives the points.
+ * @return true on success, false on I/O or format error.
+ */
+bool readPointFile(const std::string &path, PointFormat format,
+                   std::vector<Point> &points);
+
+/**
+ * @class PointWriter
+ * @brief Streams geographic points to a file (or stdout) in any format.
+ *
+ * LAS needs a seekable file: its header (counts and bounds) is rewritten by
+ * close().
+ */
+class PointWriter {
+public:
+  PointWriter() = default;
+  ~PointWriter();
+
+  PointWriter(const PointWriter &) = delete;
+  PointWriter &operator=(const PointWriter &) = delete;
+
+  /**
+   * @brief Opens the output.
+   * @param path Output file, or "-" for stdout (text and binary only).
+   * @param format Output format.
+   * @return true on success.
+   */
+  bool open(const std::string &path, PointFormat format);
+
+  /**
+   * @brief Appends points (x = longitude, y = latitude).
+   * @return true on success.
+   */
+  bool write(const std::vector<Point> &points);
+
+  /**
+   * @brief Finalizes and closes the output.
+   * @return true on success.
+   */
+  bool close();
+
+private:
+  FILE *file = nullptr;
+  bool ownsFile = false;
+  PointFormat format = PointFormat::Text;
+  std::uint64_t count = 0;
+  double minX = 0, maxX = 0, minY = 0, maxY = 0, minZ = 0, maxZ = 0;
+  double offsetX = 0, offsetY = 0; // LAS coordinate offsets
+  std::vector<char> buffer;
+
+  bool writeLasHeader();
+};
+
+#endif // POINT_IO_HPP
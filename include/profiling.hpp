@@ -0,0 +1,146 @@
+#ifndef PROFILING_HPP
+#define PROFILING_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+
+/**
+ * @enum Stage
+ * @brief Pipeline stages used to attribute profiling data.
+ */
+enum class Stage {
+  Other,       /**< Anything outside a tagged stage. */
+  Load,        /**< Reading and projecting the input file. */
+  Triangulate, /**< Delaunay triangulation and edge filtering. */
+  Index,       /**< Spatial indexes: QuadTree construction, k-d tree
+                    queries of outlier removal. */
+  Render,      /**< Per-pixel rasterization. */
+  Write,       /**< Image encoding and output. */
+  Count        /**< Number of stages (not a stage). */
+};
+
+/**
+ * @brief Returns the short lowercase name of a stage (e.g., "load").
+ * @param stage The stage.
+ * @return const char* The stage name.
+ */
+const char *stageName(Stage stage);
+
+/**
+ * @brief Returns the stage tag of the calling thread.
+ * @return Stage The current stage.
+ */
+Stage currentStage();
+
+/**
+ * @class StageScope
+ * @brief RAII tag marking the calling thread as working on a stage.
+ *
+ * The tag is thread-local: worker threads must open their own scope. The
+ * previous tag is restored on destruction, so scopes can be nested.
+ */
+class StageScope {
+public:
+  explicit StageScope(Stage stage);
+  ~StageScope();
+
+  StageScope(const StageScope &) = delete;
+  StageScope &operator=(const StageScope &) = delete;
+
+private:
+  Stage previous;
+};
+
+/**
+ * @class StageTimer
+ * @brief RAII stage tag that also accumulates the wall time of the stage.
+ *
+ * Meant for the thread orchestrating the pipeline; worker threads only need a
+ * StageScope, otherwise the same interval would be counted several times.
+ */
+class StageTimer {
+public:
+  explicit StageTimer(Stage stage);
+  ~StageTimer();
+
+  StageTimer(const StageTimer &) = delete;
+  StageTimer &operator=(const StageTimer &) = delete;
+
+private:
+  Stage stage;
+  StageScope scope;
+  std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * @brief Returns the wall time accumulated by StageTimer for a stage.
+ * @param stage The stage.
+ * @return double Seconds.
+ */
+double stageSeconds(Stage stage);
+
+/**
+ * @brief Resets the accumulated stage times to zero.
+ */
+void resetStageTimes();
+
+/**
+ * @brief Returns the peak resident set size of the process.
+ * @return std::size_t Bytes (VmHWM), or 0 if unavailable.
+ */
+std::size_t peakResidentBytes();
+
+/**
+ * @brief Resets the peak resident set size to the current one.
+ *
+ * Linux only (writes to /proc/self/clear_refs); a no-op elsewhere.
+ */
+void resetPeakResident();
+
+/**
+ * @struct AllocStats
+ * @brief Heap allocation counters of a single stage.
+ */
+struct AllocStats {
+  std::size_t allocations; /**< Number of operator new calls. */
+  std::size_t frees;       /**< Number of operator delete calls. */
+  std::size_t bytes;       /**< Total bytes requested. */
+  std::size_t live;        /**< Bytes currently allocated. */
+  std::size_t peak;        /**< Highest value reached by live. */
+};
+
+/**
+ * @brief Tells whether the allocation tracker was compiled in.
+ *
+ * Tracking is opt-in: configure with -DTERRAIN_ALLOC_TRACKING=ON to replace
+ * the global operator new/delete.
+ */
+bool allocTrackingEnabled();
+
+/**
+ * @brief Returns the allocation counters of a stage.
+ *
+ * Frees are charged to the stage that made the allocation, so live and peak
+ * reflect the memory a stage still holds.
+ */
+AllocStats allocStats(Stage stage);
+
+/**
+ * @brief Resets every stage's allocation peak to its current live size.
+ */
+void resetAllocPeaks();
+
+/**
+ * @brief Writes a per-stage allocation table.
+ * @param os Destination stream.
+ */
+void printAllocSummary(std::ostream &os);
+
+/**
+ * @brief Writes the per-stage allocation counters as a single JSON object.
+ * @param os Destination stream.
+ */
+void writeAllocJson(std::ostream &os);
+
+#endif // PROFILING_HPP
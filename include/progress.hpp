@@ -0,0 +1,112 @@
+#ifndef PROGRESS_HPP
+#define PROGRESS_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "profiling.hpp"
+
+/**
+ * @brief Starts tracking the progress of a stage.
+ *
+ * Only one stage is tracked at a time; starting a new one replaces the
+ * previous. The counters are plain relaxed atomics, so the workers pay one
+ * uncontended fetch_add per call to progressAdvance().
+ *
+ * @param stage The stage being worked on.
+ * @param total Amount of work (rows, bytes, ...), 0 if unknown.
+ * @param unit Short name of the unit, for human output (e.g., "lignes").
+ */
+void progressBegin(Stage stage, std::uint64_t total, const char *unit);
+
+/**
+ * @brief Records work done on the current stage.
+ *
+ * Call it per band or per batch, not per item.
+ *
+ * @param amount Work done since the previous call.
+ */
+void progressAdvance(std::uint64_t amount);
+
+/**
+ * @brief Marks the current stage as finished.
+ */
+void progressEnd();
+
+/**
+ * @struct ProgressSample
+ * @brief State of the tracked stage at one instant.
+ */
+struct ProgressSample {
+  std::uint64_t generation = 0; /**< Index of the stage, 0 if none yet. */
+  bool active = false;          /**< False once progressEnd() was called. */
+  Stage stage = Stage::Other;   /**< The stage. */
+  const char *unit = "";        /**< Unit of done and total. */
+  std::uint64_t done = 0;       /**< Work done. */
+  std::uint64_t total = 0;      /**< Total work, 0 if unknown. */
+  double elapsed = 0.0;         /**< Seconds since progressBegin(). */
+};
+
+/**
+ * @brief Reads the progress of the tracked stage.
+ * @return ProgressSample The current state.
+ */
+ProgressSample progressSnapshot();
+
+/**
+ * @enum ProgressFormat
+ * @brief Output format of the ProgressReporter.
+ */
+enum class ProgressFormat {
+  None,  /**< No progress output. */
+  Human, /**< One line rewritten in place ("\r"), for terminals. */
+  Json   /**< One JSON object per line, for log collectors. */
+};
+
+/**
+ * @brief Parses "none", "human" or "json".
+ * @param name The format name.
+ * @param format Receives the format.
+ * @return true if the name is known.
+ */
+bool parseProgressFormat(const std::string &name, ProgressFormat &format);
+
+/**
+ * @class ProgressReporter
+ * @brief Background thread sampling the progress counters at a fixed rate.
+ *
+ * Each sample reports the work done, the throughput (smoothed over the last
+ * samples) and the estimated time to completion. Output goes straight to a
+ * file descriptor with write(2), so a slow terminal or pipe never blocks the
+ * workers. The thread stops, after a last report, on destruction.
+ */
+class ProgressReporter {
+public:
+  /**
+   * @param format Output format; ProgressFormat::None starts no thread.
+   * @param fd File descriptor to write to (2 for stderr).
+   * @param intervalSeconds Time between two samples.
+   */
+  ProgressReporter(ProgressFormat format, int fd, double intervalSeconds);
+  ~ProgressReporter();
+
+  ProgressReporter(const ProgressReporter &) = delete;
+  ProgressReporter &operator=(const ProgressReporter &) = delete;
+
+private:
+  void run();
+  void emit(const ProgressSample &sample, double rate);
+
+  ProgressFormat format;
+  int fd;
+  double interval;
+  bool stopping = false;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::thread thread;
+};
+
+#endif // PROGRESS_HPP
@@ -0,0 +1,101 @@
+#ifndef PYRAMID_HPP
+#define PYRAMID_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "heightfield.hpp"
+#include "quadtree.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * @struct RegionStats
+ * @brief Aggregates of the altitudes in a region.
+ */
+struct RegionStats {
+  float min = 0;          /**< Lowest altitude (0 if no pixel). */
+  float max = 0;          /**< Highest altitude (0 if no pixel). */
+  double sum = 0;         /**< Sum of the altitudes. */
+  std::size_t count = 0;  /**< Pixels with an altitude. */
+
+  /** @brief Average altitude, 0 if no pixel. */
+  double mean() const { return count ? sum / count : 0; }
+};
+
+/**
+ * @class HeightPyramid
+ * @brief Min/max/sum/count pyramid of a height field, for rectangle
+ * queries without scanning the pixels.
+ *
+ * Level 0 is the field itself; each level above merges 2 x 2 cells of the
+ * one below (the last row or column alone when odd), up to a single cell.
+ * A query descends from the top: a cell inside the rectangle gives its
+ * aggregates at once, a cell crossing its border is split into its four
+ * children, down to the pixels along the border. A query visits a few
+ * cells per level along the border, so its cost follows the perimeter of
+ * the rectangle in cells of the coarsest level that fits, not its area.
+ */
+class HeightPyramid {
+public:
+  /**
+   * @brief Builds the pyramid, rows of each level in parallel.
+   *
+   * Level 0 is read from the field, which is not copied: it must outlive
+   * the pyramid and keep its altitudes while queries run.
+   *
+   * @param field The altitudes (empty pixels are skipped).
+   * @param pool Threads merging rows.
+   * @return false if cancelled or if the field is empty.
+   */
+  bool build(const HeightField &field, ThreadPool &pool);
+
+  /**
+   * @brief Aggregates a rectangle of pixels, clipped to the grid.
+   * @param row0 First row (inclusive).
+   * @param col0 First column (inclusive).
+   * @param row1 Last row (exclusive).
+   * @param col1 Last column (exclusive).
+   * @return RegionStats The aggregates of the filled pixels.
+   */
+  RegionStats query(int row0, int col0, int row1, int col1) const;
+
+  /**
+   * @brief Aggregates the pixels whose center lies in an area.
+   * @param area The area, in projected coordinates (m).
+   * @return RegionStats The aggregates of the filled pixels.
+   */
+  RegionStats query(const BoundingBox &area) const;
+
+  /** @brief Number of levels, the field included. */
+  std::size_t levelCount() const { return levels.size(); }
+
+  /** @brief Grid of the field. */
+  const RasterGrid &grid() const { return rasterGrid; }
+
+private:
+  // A cell of level l covers up to 4^l pixels: 32-bit counts below
+  // WIDE_LEVEL, 64-bit from there
+  static const int WIDE_LEVEL = 16;
+
+  struct Level {
+    int width = 0, height = 0;
+    std::vector<float> min, max;
+    std::vector<double> sum;
+    std::vector<std::uint32_t> count;     // Levels below WIDE_LEVEL
+    std::vector<std::uint64_t> wideCount; // Levels from WIDE_LEVEL
+
+    std::uint64_t cellCount(std::size_t k) const {
+      return wideCount.empty() ? count[k] : wideCount[k];
+    }
+  };
+
+  void visit(int level, int row, int col, int row0, int col0, int row1,
+             int col1, RegionStats &stats) const;
+
+  RasterGrid rasterGrid;
+  const HeightField *field = nullptr; // Level 0, not owned
+  std::vector<Level> levels; // levels[0] only holds the size
+};
+
+#endif // PYRAMID_HPP
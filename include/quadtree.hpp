@@ -1,7 +1,9 @@
 #ifndef QUADTREE_HPP
 #define QUADTREE_HPP
 
+#include "thread_pool.hpp"
 #include "triangulation.hpp"
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <vector>
@@ -29,6 +31,28 @@ struct BoundingBox {
   bool intersects(const BoundingBox &other) const;
 };
 
+/**
+ * @brief Computes the bounding box of a single triangle.
+ * @param t The triangle.
+ * @param points The list of vertex points.
+ * @return BoundingBox The minimal bounding box containing the triangle.
+ */
+BoundingBox getTriangleBounds(const Triangle &t,
+                              const std::vector<Point> &points);
+
+/**
+ * @brief Checks if a 2D point lies inside a 2D triangle using barycentric
+ * coordinates.
+ * @param px X coordinate of the point.
+ * @param py Y coordinate of the point.
+ * @param p1 First vertex of the triangle.
+ * @param p2 Second vertex of the triangle.
+ * @param p3 Third vertex of the triangle.
+ * @return true if the point is inside or on the edge, false otherwise.
+ */
+bool isPointInTriangle(double px, double py, const Point &p1, const Point &p2,
+                       const Point &p3);
+
 /**
  * @class QuadTree
  * @brief A recursive QuadTree structure for spatial indexing of triangles.
@@ -53,6 +77,21 @@ public:
    */
   void insert(const Triangle &triangle, const std::vector<Point> &points);
 
+  /**
+   * @brief Inserts a whole list of triangles, building subtrees in parallel.
+   *
+   * Produces exactly the tree that inserting the triangles one by one, in
+   * order, would produce: a node is a leaf if at most MAX_TRIANGLES of them
+   * reach it (or at MAX_DEPTH), otherwise each child receives, in order, the
+   * triangles overlapping it. Meant for an empty tree.
+   *
+   * @param triangles The triangles to insert.
+   * @param points The complete list of points.
+   * @param pool Threads building independent subtrees.
+   */
+  void build(const std::vector<Triangle> &triangles,
+             const std::vector<Point> &points, ThreadPool &pool);
+
   /**
    * @brief Finds the triangle containing a specific point.
    * @param x X coordinate.
@@ -75,6 +114,9 @@ private:
 
   bool isLeaf() const;
   void subdivide();
+  void buildNode(std::vector<std::uint32_t> &ids,
+                 const std::vector<Triangle> &all,
+                 const std::vector<Point> &points, ThreadPool &pool);
 };
 
 #endif // QUADTREE_HPP
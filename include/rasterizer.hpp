@@ -1,9 +1,151 @@
 #ifndef RASTERIZER_HPP
 #define RASTERIZER_HPP
 
+#include "checkpoint.hpp"
+#include "quadtree.hpp"
 #include "triangulation.hpp"
+#include <cstddef>
 #include <string>
 
+/**
+ * @struct Color
+ * @brief An 8-bit RGB color.
+ */
+struct Color {
+  unsigned char r, g, b;
+};
+
+/**
+ * @brief Maps an altitude to a color using a Haxby-like colormap.
+ * @param z Current altitude.
+ * @param minZ Minimum altitude in the dataset.
+ * @param maxZ Maximum altitude in the dataset.
+ * @return Color The corresponding RGB color.
+ */
+Color getColor(double z, double minZ, double maxZ);
+
+/**
+ * @brief Computes the Z coordinate at point (px, py) within a triangle using
+ * barycentric interpolation.
+ * @param px X coordinate of the target point.
+ * @param py Y coordinate of the target point.
+ * @param p1 First vertex of the triangle.
+ * @param p2 Second vertex of the triangle.
+ * @param p3 Third vertex of the triangle.
+ * @return double The interpolated altitude (Z).
+ */
+double interpolateZ(double px, double py, const Point &p1, const Point &p2,
+                    const Point &p3);
+
+/**
+ * @brief Calculates a shading factor based on the triangle's normal and a fixed
+ * light source.
+ *
+ * Computes the normal vector of the triangle (cross product of edges) and takes
+ * the dot product with a fixed light direction (from NW).
+ *
+ * @param p1 First vertex.
+ * @param p2 Second vertex.
+ * @param p3 Third vertex.
+ * @return double Shading factor (0.4 to 1.0).
+ */
+double calculateShade(const Point &p1, const Point &p2, const Point &p3);
+
+/**
+ * @struct RasterGrid
+ * @brief Pixel grid of the output image and its color scale.
+ *
+ * Pixel (row, col) samples the point (minX + (col + 0.5) * pixelSizeX,
+ * maxY - (row + 0.5) * pixelSizeY).
+ */
+struct RasterGrid {
+  BoundingBox bounds{0, 0, 0, 0};        /**< Bounding box of the points. */
+  double minX = 0, maxY = 0;             /**< Top-left corner (meters). */
+  double pixelSizeX = 1, pixelSizeY = 1; /**< Pixel size (meters). */
+  int width = 0, height = 0;             /**< Size in pixels. */
+  double minZ = 0, maxZ = 0;             /**< Range of the color scale. */
+};
+
+/**
+ * @brief Computes the grid covering a set of points at a given width.
+ *
+ * The height keeps the aspect ratio of the bounding box.
+ *
+ * @param points The points to cover.
+ * @param width The image width in pixels.
+ * @param grid Receives the grid.
+ * @return false if the points span no area.
+ */
+bool makeRasterGrid(const std::vector<Point> &points, int width,
+                    RasterGrid &grid);
+
+/**
+ * @brief Computes the grid covering a known extent at a given width.
+ *
+ * Same grid as the overload taking points, when given their bounding box
+ * and altitude range (e.g., read from a point index).
+ *
+ * @param bounds The area to cover.
+ * @param minZ Lowest altitude of the color scale.
+ * @param maxZ Highest altitude of the color scale.
+ * @param width The image width in pixels.
+ * @param grid Receives the grid.
+ * @return false if the area is empty.
+ */
+bool makeRasterGrid(const BoundingBox &bounds, double minZ, double maxZ,
+                    int width, RasterGrid &grid);
+
+/**
+ * @brief Renders a rectangle of pixels: color from the interpolated altitude,
+ * shaded by the triangle normal, black where no triangle covers the pixel.
+ *
+ * @param mesh The mesh.
+ * @param index QuadTree over the mesh triangles.
+ * @param grid The image grid.
+ * @param row0 First row (inclusive).
+ * @param row1 Last row (exclusive).
+ * @param col0 First column (inclusive).
+ * @param col1 Last column (exclusive).
+ * @param out RGB pixel of (row0, col0).
+ * @param stride Bytes between two rows of out.
+ */
+void renderRegion(const Mesh &mesh, const QuadTree &index,
+                  const RasterGrid &grid, int row0, int row1, int col0,
+                  int col1, unsigned char *out, std::size_t stride);
+
+/**
+ * @enum RenderEngine
+ * @brief How the altitude of a pixel is obtained from the points.
+ */
+enum class RenderEngine {
+  Triangulation,   /**< Linear interpolation in the Delaunay triangles. */
+  Binning,         /**< Points accumulated per pixel, no mesh. */
+  Idw,             /**< Inverse-distance weighting of the nearest points. */
+  NaturalNeighbour /**< Sibson interpolation over the Delaunay mesh. */
+};
+
+/**
+ * @brief Parses "triangulation", "binning", "idw" or "natural".
+ * @param name The engine name.
+ * @param engine Receives the engine.
+ * @return true if the name is known.
+ */
+bool parseRenderEngine(const std::string &name, RenderEngine &engine);
+
+/**
+ * @struct RenderOptions
+ * @brief Tuning knobs of generateImage().
+ */
+struct RenderOptions {
+  /** Pool running the index build and the row bands; if null, a pool of
+   * `threads` threads is created for the call. */
+  ThreadPool *pool = nullptr;
+  int threads = 1; /**< Threads of the temporary pool when pool is null. */
+  /** Journal of the finished row bands; the image is then written band by
+   * band instead of at the end. */
+  CheckpointOptions checkpoint;
+};
+
 /**
  * @brief Generates a colorized raster image (PPM) from the triangulated mesh.
  *
@@ -14,7 +156,10 @@
  * @param filename The output filename (e.g., "output.ppm").
  * @param width The desired width of the output image in pixels.
  * @param mesh The triangulated mesh to rasterize.
+ * @param options Rendering options (thread pool). Nothing is written if the
+ * pool is cancelled during rendering.
  */
-void generateImage(const std::string &filename, int width, const Mesh &mesh);
+void generateImage(const std::string &filename, int width, const Mesh &mesh,
+                   const RenderOptions &options = RenderOptions());
 
 #endif // RASTERIZER_HPP
@@ -0,0 +1,87 @@
+#ifndef SIBSON_HPP
+#define SIBSON_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "heightfield.hpp"
+#include "thread_pool.hpp"
+#include "triangulation.hpp"
+
+/**
+ * @struct SibsonStats
+ * @brief How the pixels of a natural-neighbour grid were interpolated.
+ */
+struct SibsonStats {
+  std::size_t natural = 0; /**< Pixels with Sibson weights. */
+  std::size_t linear = 0;  /**< Pixels near the mesh border, interpolated
+                                linearly in their triangle. */
+};
+
+/**
+ * @brief Fills a height field by natural-neighbour (Sibson) interpolation.
+ *
+ * For each pixel the insertion of a point is simulated without modifying
+ * the mesh: the Bowyer-Watson cavity (the triangles whose circumcircle
+ * contains the pixel) is grown from the triangle containing it through the
+ * adjacency, and each cavity vertex is weighted by the area its Voronoi
+ * cell would lose to the new point. The stolen areas are summed per cavity
+ * triangle from its circumcenter and those of the new triangles, so no
+ * Voronoi cell is built. Rows run in parallel by bands; along a row, the
+ * search for the containing triangle starts from the previous pixel's.
+ * The cavity itself is grown anew for each pixel: it holds a few triangles,
+ * and checking the previous one would cost as many in-circle tests.
+ *
+ * Voronoi cells on the border of the mesh are unbounded, so pixels whose
+ * cavity reaches the hull or a triangle removed by the 70 m filter fall
+ * back to linear interpolation. Pixels outside every triangle stay empty.
+ *
+ * @param mesh The mesh.
+ * @param adjacency Neighbours of its triangles, from buildMesh().
+ * @param field Receives the altitudes (grid already set).
+ * @param pool Threads processing row bands.
+ * @param stats If not null, receives the pixel counts.
+ * @return false if cancelled.
+ */
+bool sibsonGrid(const Mesh &mesh, const std::vector<std::uint32_t> &adjacency,
+                HeightField &field, ThreadPool &pool,
+                SibsonStats *stats = nullptr);
+
+/**
+ * @brief Computes the altitudes of an image by natural-neighbour
+ * interpolation.
+ *
+ * Same grid as generateImage(), filled by sibsonGrid().
+ *
+ * @param mesh The mesh.
+ * @param adjacency Neighbours of its triangles, from buildMesh().
+ * @param width The image width in pixels.
+ * @param pool Threads interpolating.
+ * @param field Receives the altitudes.
+ * @return false if the mesh spans no area or if cancelled.
+ */
+bool makeSibsonField(const Mesh &mesh,
+                     const std::vector<std::uint32_t> &adjacency, int width,
+                     ThreadPool &pool, HeightField &field);
+
+/**
+ * @brief Generates an image by natural-neighbour interpolation.
+ *
+ * makeSibsonField() then writeHeightFieldImage(): the surface is smooth
+ * across triangle edges, and shading follows the slope of the interpolated
+ * grid.
+ *
+ * @param filename The output filename.
+ * @param width The image width in pixels.
+ * @param mesh The mesh.
+ * @param adjacency Neighbours of its triangles, from buildMesh().
+ * @param pool Threads interpolating and coloring.
+ */
+void generateSibsonImage(const std::string &filename, int width,
+                         const Mesh &mesh,
+                         const std::vector<std::uint32_t> &adjacency,
+                         ThreadPool &pool);
+
+#endif // SIBSON_HPP
@@ -0,0 +1,64 @@
+#ifndef SIMPLIFY_HPP
+#define SIMPLIFY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.hpp"
+#include "triangulation.hpp"
+
+/**
+ * @struct LodLevel
+ * @brief One simplified mesh of a level-of-detail hierarchy.
+ */
+struct LodLevel {
+  double tolerance = 0; /**< Largest vertical error allowed (m). */
+  double error = 0;     /**< Largest vertical error reached (m). */
+  Mesh mesh;            /**< The simplified mesh. */
+};
+
+/**
+ * @brief Builds simplified meshes whose vertical error stays within given
+ * tolerances.
+ *
+ * Greedy insertion: the simplified mesh starts from the convex hull, the
+ * lowest and highest vertices and the vertices along the edge of the mesh
+ * (hull and triangles removed by the 70 m filter), and is refined in
+ * rounds. Each round measures, in parallel, the vertical distance between
+ * the vertices not yet kept and the simplified triangle above or below
+ * them (only those whose triangle changed), then inserts the farthest
+ * vertex of each triangle still beyond the tolerance into the Delaunay
+ * triangulation, sequentially, with edge flips. Tolerances are reached
+ * from the largest to the smallest, so each level contains the vertices of
+ * the coarser ones.
+ *
+ * Edges of a Delaunay triangulation remain edges of the triangulation of
+ * any subset of its vertices, so every level keeps the edges of the mesh;
+ * its triangles are sorted into inside and outside by a flood fill from
+ * them, and the levels cover exactly the area of the mesh. The extremes of
+ * all the points are carried by each level, outside any triangle, so that
+ * the image grid and the color scale do not change.
+ *
+ * @param mesh The full mesh.
+ * @param adjacency Neighbours of its triangles, from buildMesh().
+ * @param tolerances Vertical errors of the levels (m), in any order.
+ * @param pool Threads measuring the vertices.
+ * @param levels Receives one level per tolerance, the coarsest first.
+ * @return false if cancelled or if the mesh has no triangle.
+ */
+bool simplifyMesh(const Mesh &mesh, const std::vector<std::uint32_t> &adjacency,
+                  std::vector<double> tolerances, ThreadPool &pool,
+                  std::vector<LodLevel> &levels);
+
+/**
+ * @brief Picks the coarsest level whose tolerance is at most a given error.
+ * @param levels The hierarchy, coarsest first (see simplifyMesh()).
+ * @param maxError The largest vertical error acceptable (m), typically half
+ * a pixel of the render.
+ * @return std::size_t The index of the level; the finest one (last) if
+ * none is fine enough.
+ */
+std::size_t selectLod(const std::vector<LodLevel> &levels, double maxError);
+
+#endif // SIMPLIFY_HPP
@@ -0,0 +1,110 @@
+#ifndef STREAMING_HPP
+#define STREAMING_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "MNT.hpp"
+#include "image_io.hpp"
+#include "rasterizer.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * @struct StreamOptions
+ * @brief Map and schedule of a live survey.
+ */
+struct StreamOptions {
+  BoundingBox extent{0, 0, 0, 0}; /**< Mapped area (projected, meters). */
+  double minZ = 0, maxZ = 0;      /**< Range of the color scale. */
+  int width = 0;                  /**< Image width in pixels. */
+  int tileSize = 256;             /**< Side of a re-rendered tile (px). */
+  double halo = 150.0;            /**< Neighbours triangulated with a tile (m). */
+  double publishInterval = 2.0;   /**< Seconds between two publications. */
+};
+
+/**
+ * @class LiveMap
+ * @brief Image of a survey that grows while it is rendered.
+ *
+ * The image is fixed (extent, size and color scale are given up front) and
+ * cut into tiles, as in renderTiled(). New points are sorted into the tile
+ * containing them and mark dirty every tile whose halo reaches them. A
+ * publication re-triangulates, indexes and renders only the dirty tiles
+ * from their points and those of their halo, and writes their blocks in
+ * place, so its cost depends on where the new points fall, not on how many
+ * points the survey already holds.
+ */
+class LiveMap {
+public:
+  /**
+   * @brief Creates the image, black until points arrive.
+   * @param output The PPM file published.
+   * @param options Extent, size and tiling.
+   * @return false if the extent is empty or the file cannot be created.
+   */
+  bool open(const std::string &output, const StreamOptions &options);
+
+  /**
+   * @brief Adds projected points; points outside the extent are dropped.
+   * @param points The new points.
+   * @return std::size_t The number of points kept.
+   */
+  std::size_t add(const std::vector<Point> &points);
+
+  /** @brief Number of tiles waiting for the next publication. */
+  std::size_t dirtyTiles() const { return dirty.size(); }
+
+  /** @brief Number of points of the survey so far. */
+  std::size_t pointCount() const { return total; }
+
+  /**
+   * @brief Re-renders the dirty tiles and writes them to the image.
+   * @param pool Threads rendering the tiles.
+   * @return false on write error or cancellation.
+   */
+  bool publish(ThreadPool &pool);
+
+  /**
+   * @brief Closes the image.
+   * @return true if every write succeeded.
+   */
+  bool close();
+
+  /** @brief The image grid. */
+  const RasterGrid &rasterGrid() const { return grid; }
+
+private:
+  std::vector<Point> gather(int tx, int ty) const;
+
+  RasterGrid grid;
+  int tileSize = 256;
+  int tilesX = 0, tilesY = 0;
+  double tileW = 0, tileH = 0, halo = 0;
+  std::vector<std::vector<Point>> buckets; // Points of each tile
+  std::vector<char> isDirty;
+  std::vector<std::size_t> dirty; // Dirty tiles, in marking order
+  std::size_t total = 0;
+  PpmWriter writer;
+};
+
+/**
+ * @brief Renders a survey streamed as text lines until end of input.
+ *
+ * Reads "latitude longitude altitude" lines from fd (stdin or a FIFO),
+ * projects them as they arrive, and publishes the map every
+ * options.publishInterval seconds if new points came in, then once more at
+ * end of input. Cancelling the pool (Ctrl-C) stops at once; the image keeps
+ * the last publication.
+ *
+ * @param fd The input file descriptor.
+ * @param output The PPM file published.
+ * @param options Extent, size, tiling and interval.
+ * @param pool Threads parsing, projecting and rendering.
+ * @return true if the input was read to its end and every publication
+ * succeeded.
+ */
+bool streamSurvey(int fd, const std::string &output,
+                  const StreamOptions &options, ThreadPool &pool);
+
+#endif // STREAMING_HPP
@@ -0,0 +1,94 @@
+#ifndef SYNTHETIC_HPP
+#define SYNTHETIC_HPP
+
+#include "MNT.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @enum TerrainModel
+ * @brief Fractal model used for the synthetic elevation.
+ */
+enum class TerrainModel {
+  Perlin,       /**< Fractional Brownian motion of Perlin gradient noise. */
+  DiamondSquare /**< Diamond-square heightmap, sampled bilinearly. */
+};
+
+/**
+ * @enum Sampling
+ * @brief Spatial distribution of the synthetic soundings.
+ */
+enum class Sampling {
+  Uniform,   /**< Uniformly random over the area. */
+  Clustered, /**< Gaussian clusters of varying density. */
+  Tracks,    /**< Multibeam survey lines (boustrophedon, swath of beams). */
+  Rows,      /**< Exactly collinear rows on a regular grid. */
+  Hotspot    /**< Everything inside a 1 m square (one max-depth leaf). */
+};
+
+/**
+ * @struct SyntheticOptions
+ * @brief Parameters of the synthetic point-cloud generator.
+ */
+struct SyntheticOptions {
+  std::uint64_t count = 1000000;             /**< Number of points. */
+  TerrainModel model = TerrainModel::Perlin; /**< Elevation model. */
+  Sampling sampling = Sampling::Uniform;     /**< Point distribution. */
+  double size = 5000.0;      /**< Side of the square area, in meters. */
+  double centerLat = 48.2;   /**< Latitude of the area center. */
+  double centerLon = -3.0;   /**< Longitude of the area center. */
+  double baseZ = -60.0;      /**< Mean elevation. */
+  double relief = 120.0;     /**< Peak-to-peak elevation range. */
+  int octaves = 6;           /**< Perlin octaves / detail level. */
+  double roughness = 0.55;   /**< Amplitude decay per octave. */
+  double noise = 0.05;       /**< Gaussian Z noise (standard deviation). */
+  double spikes = 0.0;       /**< Fraction of outliers (fliers). */
+  double spikeHeight = 40.0; /**< Amplitude of the outliers. */
+  double duplicates = 0.0;   /**< Fraction of exact duplicate points. */
+  double trackSpacing = 50.0; /**< Distance between survey lines (m). */
+  double pingSpacing = 0.5;   /**< Distance between pings (m). */
+  int beams = 64;             /**< Beams per ping across the swath. */
+  std::uint64_t seed = 1;     /**< Random seed. */
+};
+
+/**
+ * @brief Parses a model name ("perlin", "diamond").
+ * @return true if the name is known.
+ */
+bool parseTerrainModel(const std::string &name, TerrainModel &model);
+
+/**
+ * @brief Parses a sampling name ("uniform", "clustered", "tracks", "rows",
+ * "hotspot").
+ * @return true if the name is known.
+ */
+bool parseSampling(const std::string &name, Sampling &sampling);
+
+/**
+ * @brief Streams synthetic geographic points in chunks.
+ *
+ * Points follow the lirePoints() convention (x = longitude, y = latitude,
+ * z = altitude). Each chunk is derived from the seed and its index only, so
+ * the output is reproducible and no more than one chunk is held in memory,
+ * which allows billions of points.
+ *
+ * @param options Generator parameters.
+ * @param sink Called for every chunk; return false to stop early.
+ * @param chunkSize Maximum number of points per chunk.
+ */
+void generateSynthetic(
+    const SyntheticOptions &options,
+    const std::function<bool(const std::vector<Point> &)> &sink,
+    std::size_t chunkSize = 1 << 20);
+
+/**
+ * @brief Generates a synthetic point cloud in memory.
+ * @param options Generator parameters.
+ * @return std::vector<Point> The geographic points.
+ */
+std::vector<Point> generateSynthetic(const SyntheticOptions &options);
+
+#endif // SYNTHETIC_HPP
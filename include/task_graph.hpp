@@ -0,0 +1,65 @@
+#ifndef TASK_GRAPH_HPP
+#define TASK_GRAPH_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+/**
+ * @class TaskGraph
+ * @brief Dependency graph of tasks executed on a ThreadPool.
+ *
+ * A node is queued as soon as all its prerequisites have finished, so
+ * independent chains (e.g., one per tile) overlap instead of waiting at
+ * global barriers. The graph is built once, then run once.
+ */
+class TaskGraph {
+public:
+  using Node = std::size_t;
+
+  /**
+   * @brief Adds a node.
+   * @param fn The work of the node.
+   * @return Node Its identifier.
+   */
+  Node add(std::function<void()> fn);
+
+  /**
+   * @brief Makes node wait for prerequisite.
+   * @param node The dependent node.
+   * @param prerequisite The node that must finish first.
+   */
+  void depend(Node node, Node prerequisite);
+
+  /** @brief Number of nodes. */
+  std::size_t size() const { return nodes.size(); }
+
+  /**
+   * @brief Runs every node and waits for the whole graph.
+   *
+   * Once the pool is cancelled, the remaining nodes are released without
+   * running their work.
+   *
+   * @param pool Threads running the nodes.
+   * @return false if the pool was cancelled.
+   */
+  bool run(ThreadPool &pool);
+
+private:
+  struct NodeData {
+    std::function<void()> fn;
+    std::vector<Node> successors;
+    int prerequisites = 0;
+    std::atomic<int> remaining{0};
+  };
+
+  void launch(Node node, ThreadPool &pool, TaskGroup &group);
+
+  std::vector<std::unique_ptr<NodeData>> nodes;
+};
+
+#endif // TASK_GRAPH_HPP
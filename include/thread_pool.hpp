@@ -0,0 +1,302 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "profiling.hpp"
+
+class ThreadPool;
+
+/**
+ * @struct PoolTask
+ * @brief A unit of work queued in the pool (internal).
+ */
+struct PoolTask {
+  std::function<void()> fn;           /**< The work. */
+  std::atomic<std::size_t> *pending;  /**< Counter of the owning TaskGroup. */
+  Stage stage;                        /**< Stage of the submitting thread. */
+};
+
+/**
+ * @class WorkDeque
+ * @brief Chase–Lev work-stealing deque of tasks.
+ *
+ * The owning worker pushes and pops at the bottom without locking; other
+ * workers steal from the top with a single compare-and-swap. The ring grows
+ * on demand; retired rings are kept until destruction since a thief may
+ * still be reading them.
+ */
+class WorkDeque {
+public:
+  WorkDeque();
+  ~WorkDeque();
+
+  WorkDeque(const WorkDeque &) = delete;
+  WorkDeque &operator=(const WorkDeque &) = delete;
+
+  /** @brief Owner only: adds a task at the bottom. */
+  void push(PoolTask *task);
+
+  /** @brief Owner only: takes the most recent task, or nullptr. */
+  PoolTask *pop();
+
+  /** @brief Any thread: takes the oldest task, or nullptr if empty or lost
+   * the race. */
+  PoolTask *steal();
+
+private:
+  struct Ring;
+
+  Ring *grow(Ring *ring, std::int64_t bottom, std::int64_t top);
+
+  std::atomic<std::int64_t> top{0};
+  std::atomic<std::int64_t> bottom{0};
+  std::atomic<Ring *> ring;
+  std::vector<std::unique_ptr<Ring>> rings; // Current and retired rings
+};
+
+/**
+ * @class TaskGroup
+ * @brief A set of tasks that can be waited for together.
+ *
+ * Tasks may spawn further tasks in their own groups; a waiting worker keeps
+ * executing queued tasks instead of blocking, so nested parallelism does not
+ * deadlock. The destructor waits.
+ */
+class TaskGroup {
+public:
+  explicit TaskGroup(ThreadPool &pool);
+  ~TaskGroup();
+
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+
+  /**
+   * @brief Queues a task (runs it inline on a single-threaded pool).
+   * @param fn The work.
+   */
+  void run(std::function<void()> fn);
+
+  /**
+   * @brief Waits until every task of the group has finished.
+   */
+  void wait();
+
+private:
+  ThreadPool &pool;
+  std::atomic<std::size_t> pending{0};
+};
+
+/**
+ * @struct WorkerStats
+ * @brief Activity of one worker since the pool was created or reset.
+ */
+struct WorkerStats {
+  std::uint64_t tasks = 0;  /**< Tasks executed. */
+  std::uint64_t steals = 0; /**< Tasks taken from another worker. */
+  double busySeconds = 0.0; /**< Time spent executing tasks. */
+  double utilization = 0.0; /**< busySeconds / wall time since reset. */
+};
+
+/**
+ * @class ThreadPool
+ * @brief Work-stealing pool shared by every stage of the pipeline.
+ *
+ * Slot 0 is the thread that creates the pool: it executes tasks while it
+ * waits for a TaskGroup, and threads - 1 workers are started for the other
+ * slots. Each slot owns a WorkDeque; idle workers steal from the others and
+ * sleep when there is nothing left. Tasks inherit the profiling stage of the
+ * thread that queued them.
+ */
+class ThreadPool {
+public:
+  /**
+   * @param threads Number of threads including the caller; 0 selects the
+   * number of hardware threads.
+   * @param cpus CPUs to pin slot i to (cpus[i % cpus.size()]); empty for no
+   * pinning.
+   */
+  explicit ThreadPool(int threads = 0, const std::vector<int> &cpus = {});
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /**
+   * @brief A single-threaded pool that runs everything inline, for callers
+   * that do not pass a pool.
+   */
+  static ThreadPool &serial();
+
+  /** @brief Number of threads, caller included. */
+  int size() const { return static_cast<int>(slots.size()); }
+
+  /**
+   * @brief Slot of the calling thread in this pool, or -1 if it is not one
+   * of the pool's threads. Stable for the duration of a task, so it can
+   * index per-thread scratch data.
+   */
+  int currentSlot() const;
+
+  /**
+   * @brief Number of per-thread scratch entries indexed by scratchSlot():
+   * one per thread plus one for a caller outside the pool.
+   */
+  int scratchSlots() const { return size() + 1; }
+
+  /**
+   * @brief Like currentSlot(), but a thread outside the pool gets the last
+   * entry, size(). Such a thread only runs bodies inline (a range within
+   * one grain) and never picks up the pool's tasks, so the entry is not
+   * shared within one call.
+   */
+  int scratchSlot() const {
+    int slot = currentSlot();
+    return slot >= 0 ? slot : size();
+  }
+
+  /**
+   * @brief Runs body(b, e) over [begin, end) split into ranges of at most
+   * grain items, distributed by recursive halving so idle workers can steal
+   * large halves.
+   *
+   * Ranges not started when cancel() is called are skipped.
+   *
+   * @return false if the loop was cancelled.
+   */
+  template <class Body>
+  bool parallelFor(std::size_t begin, std::size_t end, std::size_t grain,
+                   const Body &body) {
+    if (grain == 0)
+      grain = 1;
+    if (size() == 1 || end - begin <= grain) {
+      for (std::size_t b = begin; b < end && !cancelled(); b += grain)
+        body(b, std::min(end, b + grain));
+      return !cancelled();
+    }
+    TaskGroup group(*this);
+    splitFor(group, begin, end, grain, body);
+    group.wait();
+    return !cancelled();
+  }
+
+  /**
+   * @brief Maps fixed chunks of [begin, end) and combines the partial
+   * results in chunk order, so the result does not depend on scheduling.
+   *
+   * @param identity Initial value of each partial result.
+   * @param map map(b, e, partial) accumulates items [b, e) into partial.
+   * @param combine combine(total, partial) folds a partial result.
+   */
+  template <class T, class Map, class Combine>
+  T parallelReduce(std::size_t begin, std::size_t end, std::size_t grain,
+                   const T &identity, const Map &map, const Combine &combine) {
+    if (grain == 0)
+      grain = 1;
+    std::size_t chunks = end > begin ? (end - begin + grain - 1) / grain : 0;
+    std::vector<T> partials(chunks, identity);
+    parallelFor(0, chunks, 1, [&](std::size_t c0, std::size_t c1) {
+      for (std::size_t c = c0; c < c1; ++c) {
+        std::size_t b = begin + c * grain;
+        map(b, std::min(end, b + grain), partials[c]);
+      }
+    });
+    T total = identity;
+    for (auto &p : partials)
+      combine(total, p);
+    return total;
+  }
+
+  /**
+   * @brief Asks running loops to stop. Async-signal-safe.
+   */
+  void cancel() { cancelFlag.store(true, std::memory_order_relaxed); }
+
+  /** @brief Tells whether cancel() was called since the last reset. */
+  bool cancelled() const {
+    return cancelFlag.load(std::memory_order_relaxed);
+  }
+
+  /** @brief Clears the cancellation flag. */
+  void resetCancel() { cancelFlag.store(false, std::memory_order_relaxed); }
+
+  /** @brief Per-slot activity counters. */
+  std::vector<WorkerStats> stats() const;
+
+  /** @brief Clears the activity counters. */
+  void resetStats();
+
+  /**
+   * @brief Writes a per-worker utilization table.
+   * @param os Destination stream.
+   */
+  void printStats(std::ostream &os) const;
+
+private:
+  friend class TaskGroup;
+
+  struct Slot;
+
+  template <class Body>
+  void splitFor(TaskGroup &group, std::size_t begin, std::size_t end,
+                std::size_t grain, const Body &body) {
+    // Hand the upper halves to the pool, keep the lowest range
+    while (end - begin > grain && !cancelled()) {
+      std::size_t mid = begin + (end - begin) / 2;
+      group.run([this, &group, mid, end, grain, &body] {
+        splitFor(group, mid, end, grain, body);
+      });
+      end = mid;
+    }
+    if (!cancelled())
+      body(begin, end);
+  }
+
+  void submit(PoolTask *task);
+  PoolTask *findTask(int slot);
+  void execute(PoolTask *task, int slot);
+  void workerLoop(int slot);
+  void helpUntil(const std::atomic<std::size_t> &pending);
+
+  std::vector<std::unique_ptr<Slot>> slots;
+  std::vector<std::thread> threads;
+  std::mutex injectMutex; // Tasks queued by threads outside the pool
+  std::deque<PoolTask *> injected;
+  std::mutex sleepMutex;
+  std::condition_variable sleepCv;
+  std::atomic<std::int64_t> queued{0}; // Tasks queued but not yet taken
+  std::atomic<int> sleepers{0};
+  std::atomic<bool> stopping{false};
+  std::atomic<bool> cancelFlag{false};
+  std::chrono::steady_clock::time_point statsStart;
+  ThreadPool *previousPool = nullptr; // Restored on slot 0 at destruction
+  int previousSlot = -1;
+};
+
+/**
+ * @brief Parses a CPU list such as "0-3,8,10-11".
+ * @param text The list.
+ * @param cpus Receives the CPU numbers.
+ * @return true if the list is well formed.
+ */
+bool parseCpuList(const std::string &text, std::vector<int> &cpus);
+
+/**
+ * @brief Returns the CPUs the process may run on, in increasing order.
+ */
+std::vector<int> availableCpus();
+
+#endif // THREAD_POOL_HPP
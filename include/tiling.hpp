@@ -0,0 +1,96 @@
+#ifndef TILING_HPP
+#define TILING_HPP
+
+#include <string>
+#include <vector>
+
+#include "MNT.hpp"
+#include "rasterizer.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * @struct TileOptions
+ * @brief Parameters of the tiled pipeline.
+ */
+struct TileOptions {
+  int tileSize = 512;  /**< Tile side in pixels. */
+  double halo = 150.0; /**< Margin of neighbouring points around a tile (m). */
+  int maxInFlight = 0; /**< Tiles alive at once; 0 for twice the threads. */
+  int shard = 0;       /**< Index of this process among shardCount. */
+  int shardCount = 1;  /**< Processes sharing the image; 1 for all of it. */
+  CheckpointOptions checkpoint; /**< Journal of the finished tiles. */
+};
+
+/**
+ * @brief Returns the partial image name of a shard.
+ *
+ * "output.ppm" becomes "output.part-2-of-8.ppm".
+ *
+ * @param output The full image name.
+ * @param shard Index of the shard.
+ * @param count Number of shards.
+ * @return std::string The part name.
+ */
+std::string shardFileName(const std::string &output, int shard, int count);
+
+/**
+ * @brief Returns the area whose points a shard needs.
+ *
+ * Shard i of N renders tile rows [i * rows / N, (i + 1) * rows / N), so
+ * any process computes the same split; its area is that band of the survey
+ * plus the halo.
+ *
+ * @param grid The grid of the full image.
+ * @param options Tiling parameters, shard included.
+ * @return BoundingBox The area (projected coordinates).
+ */
+BoundingBox shardArea(const RasterGrid &grid, const TileOptions &options);
+
+/**
+ * @brief Renders an image tile by tile with overlapping stages.
+ *
+ * The points are sorted by tile of the final image. Every tile then runs
+ * its own chain on a TaskGraph: gather its points and a halo of neighbours
+ * (so that its triangulation matches the global one inside the tile),
+ * triangulate, index, render, write. Chains of different tiles overlap, and
+ * a tile's mesh, index and pixels are freed as soon as its block is written
+ * to the file. At most maxInFlight tiles are alive at once, so memory beyond
+ * the points themselves depends on the tile size, not on the survey size.
+ *
+ * Pixels, colors and shading are computed exactly as generateImage() does;
+ * the only differences come from triangles near a tile edge whose
+ * circumcircle reaches beyond the halo.
+ *
+ * @param filename The output PPM file.
+ * @param width The image width in pixels.
+ * @param points The projected points (consumed).
+ * @param pool Threads running the tile chains.
+ * @param options Tiling parameters.
+ * @return true if the image was written.
+ */
+bool renderTiled(const std::string &filename, int width,
+                 std::vector<Point> points, ThreadPool &pool,
+                 const TileOptions &options = TileOptions());
+
+/**
+ * @brief Renders tile by tile on a given grid.
+ *
+ * Same as above, with the grid of the full image given instead of derived
+ * from the points, as a shard that loaded only its part of the survey must
+ * do. With options.shardCount > 1, only the shard's band of tile rows is
+ * rendered, into a partial image for mergePpmParts(); given the same grid
+ * and options, the merged shards are identical to a single tiled run.
+ *
+ * @param filename The output PPM file (or part).
+ * @param grid The grid of the full image.
+ * @param points The projected points (consumed); points outside the
+ * shard's area are ignored.
+ * @param pool Threads running the tile chains.
+ * @param options Tiling parameters.
+ * @return true if the image was written.
+ */
+bool renderTiled(const std::string &filename, const RasterGrid &grid,
+                 std::vector<Point> points, ThreadPool &pool,
+                 const TileOptions &options = TileOptions());
+
+#endif // TILING_HPP
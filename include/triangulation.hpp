@@ -3,6 +3,7 @@
 
 #include "MNT.hpp"
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 
 /**
@@ -23,16 +24,46 @@ struct Mesh {
       triangles; /**< List of triangles connecting the vertices. */
 };
 
+/** Marks a triangle edge with no neighbour in the mesh (hull or filtered). */
+const std::uint32_t NO_TRIANGLE = UINT32_MAX;
+
+/**
+ * @brief Builds the filtered Delaunay mesh of a point set, silently.
+ *
+ * Same mesh as triangulate() but without console or progress output, and
+ * taking the points by value so callers can move them in. Fewer than three
+ * points, or all collinear, give a mesh without triangles.
+ *
+ * @param points The points (moved into the mesh).
+ * @param pool Threads used for the filtering pass.
+ * @param rejected If not null, receives the number of triangles dropped by
+ * the edge-length filter.
+ * @param adjacency If not null, receives for each kept triangle t the
+ * triangle across its edges p1-p2, p2-p3 and p3-p1 at 3t, 3t+1 and 3t+2,
+ * taken from Delaunator's half-edges (NO_TRIANGLE on the hull and next to
+ * filtered triangles).
+ * @return Mesh The mesh.
+ */
+Mesh buildMesh(std::vector<Point> points, ThreadPool &pool,
+               std::size_t *rejected = nullptr,
+               std::vector<std::uint32_t> *adjacency = nullptr);
+
 /**
  * @brief Performs Delaunay triangulation on a set of 2D points.
  *
  * Uses the delaunator-cpp library to generate a triangulation from the
  * projected X and Y coordinates of the input points. The Z coordinate is
- * preserved in the resulting mesh.
+ * preserved in the resulting mesh. Triangles with an edge longer than 70 m
+ * are dropped; that filter runs on the pool and keeps Delaunator's order.
  *
  * @param points The vector of input points to triangulate.
+ * @param pool Threads used for the filtering pass.
+ * @param adjacency If not null, receives the neighbours of each triangle
+ * (see buildMesh()).
  * @return Mesh The resulting triangular mesh containing points and triangles.
  */
-Mesh triangulate(const std::vector<Point> &points);
+Mesh triangulate(const std::vector<Point> &points,
+                 ThreadPool &pool = ThreadPool::serial(),
+                 std::vector<std::uint32_t> *adjacency = nullptr);
 
 #endif // TRIANGULATION_HPP
@@ -4,14 +4,181 @@
  */
 
 #include "MNT.hpp"
+#include "logging.hpp"
+#include "point_io.hpp"
+#include "progress.hpp"
+#include <algorithm>
+#include <cctype>
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <proj.h>
 
-// Fonction qui va lire le fichier et convertir les données
-std::vector<Point> lireEtConvertir(const std::string &nomFichier) {
+namespace {
+
+// Taille des blocs lus d'un coup dans les fichiers texte
+const std::size_t TAILLE_BLOC = 4 << 20;
+
+// Découpe [debut, fin) en lignes "lat lon alt" ; les lignes illisibles sont
+// ignorées
+void analyserBloc(const char *debut, const char *fin,
+                  std::vector<Point> &points) {
+  const char *p = debut;
+  while (p < fin) {
+    char *suite = nullptr;
+    double lat = std::strtod(p, &suite);
+    bool ok = suite != p;
+    p = suite;
+    double lon = std::strtod(p, &suite);
+    ok = ok && suite != p;
+    p = suite;
+    double alt = std::strtod(p, &suite);
+    ok = ok && suite != p;
+    p = suite;
+    if (p > fin)
+      break; // Triplet incomplet en fin de morceau
+    if (ok) {
+      points.push_back({lon, lat, alt});
+    } else {
+      // Ligne illisible : passer à la suivante
+      while (p < fin && *p != '\n')
+        ++p;
+      if (p < fin)
+        ++p;
+    }
+    while (p < fin && std::isspace(static_cast<unsigned char>(*p)))
+      ++p;
+  }
+}
+
+// Lit au plus longueur octets depuis la position courante de f, par blocs
+// terminés par une fin de ligne ; chaque bloc est découpé en morceaux
+// analysés en parallèle puis concaténés dans l'ordre
+void lireBlocs(FILE *f, std::size_t longueur, ThreadPool &pool,
+               std::vector<Point> &points) {
+  std::vector<char> bloc;
+  std::size_t reste = 0; // Début de ligne incomplète reporté au bloc suivant
+  int nbMorceaux = pool.size() * 4;
+  std::vector<std::vector<Point>> morceaux(nbMorceaux);
+  bool finFichier = false;
+
+  while (!finFichier) {
+    std::size_t demande = std::min(TAILLE_BLOC, longueur);
+    bloc.resize(reste + demande + 1);
+    std::size_t lus = fread(bloc.data() + reste, 1, demande, f);
+    longueur -= lus;
+    finFichier = lus < demande || longueur == 0;
+    std::size_t tailleBloc = reste + lus;
+    std::size_t utile = tailleBloc;
+    if (!finFichier) {
+      while (utile > 0 && bloc[utile - 1] != '\n')
+        --utile;
+      if (utile == 0)
+        utile = tailleBloc; // Ligne plus longue qu'un bloc
+    }
+    bloc[tailleBloc] = '\0';
+
+    // Bornes des morceaux, alignées sur les fins de ligne
+    std::vector<std::size_t> bornes(nbMorceaux + 1, utile);
+    bornes[0] = 0;
+    for (int m = 1; m < nbMorceaux; ++m) {
+      std::size_t b = std::max(bornes[m - 1], utile * m / nbMorceaux);
+      while (b > 0 && b < utile && bloc[b - 1] != '\n')
+        ++b;
+      bornes[m] = b;
+    }
+
+    const char *donnees = bloc.data();
+    pool.parallelFor(0, nbMorceaux, 1, [&](std::size_t m0, std::size_t m1) {
+      for (std::size_t m = m0; m < m1; ++m) {
+        morceaux[m].clear();
+        analyserBloc(donnees + bornes[m], donnees + bornes[m + 1], morceaux[m]);
+      }
+    });
+    for (auto &morceau : morceaux)
+      points.insert(points.end(), morceau.begin(), morceau.end());
+
+    // Ligne incomplète recopiée en tête du prochain bloc
+    reste = tailleBloc - utile;
+    std::copy(bloc.begin() + utile, bloc.begin() + tailleBloc, bloc.begin());
+    progressAdvance(lus);
+  }
+}
+
+} // namespace
+
+// Lecture brute du fichier (Lat, Lon, Alt) sans projection
+std::vector<Point> lirePoints(const std::string &nomFichier, ThreadPool &pool) {
+  std::vector<Point> points;
+
+  // Formats binaires (.bin, .las) écrits par terrain_synth
+  PointFormat format = pointFormatFromPath(nomFichier);
+  if (format != PointFormat::Text) {
+    if (!readPointFile(nomFichier, format, points))
+      points.clear();
+    return points;
+  }
+
+  // Ouverture du fichier de données
+  FILE *f = fopen(nomFichier.c_str(), "r");
+  if (!f) {
+    logError() << "Impossible d'ouvrir le fichier " << nomFichier << std::endl;
+    return points;
+  }
+
+  // Taille du fichier pour suivre l'avancement en octets
+  fseek(f, 0, SEEK_END);
+  long taille = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  progressBegin(Stage::Load, taille > 0 ? taille : 0, "octets");
+  if (taille > 0)
+    points.reserve(static_cast<std::size_t>(taille) / 32);
+
+  lireBlocs(f, static_cast<std::size_t>(-1), pool, points);
+  progressEnd();
+
+  fclose(f);
+  return points;
+}
+
+// Lignes déjà en mémoire ; le '\0' final de la chaîne arrête strtod
+void analyserLignes(const std::string &texte, std::vector<Point> &points) {
+  analyserBloc(texte.c_str(), texte.c_str() + texte.size(), points);
+}
+
+// Lecture de plages d'octets du fichier texte, dans l'ordre donné
+std::vector<Point>
+lirePlages(const std::string &nomFichier,
+           const std::vector<std::pair<std::size_t, std::size_t>> &plages,
+           ThreadPool &pool) {
   std::vector<Point> points;
+  FILE *f = fopen(nomFichier.c_str(), "r");
+  if (!f) {
+    logError() << "Impossible d'ouvrir le fichier " << nomFichier << std::endl;
+    return points;
+  }
+
+  std::size_t total = 0;
+  for (const auto &plage : plages)
+    total += plage.second;
+  progressBegin(Stage::Load, total, "octets");
+  for (const auto &plage : plages) {
+    if (fseek(f, static_cast<long>(plage.first), SEEK_SET) != 0)
+      break;
+    lireBlocs(f, plage.second, pool, points);
+  }
+  progressEnd();
 
+  fclose(f);
+  return points;
+}
+
+namespace {
+
+// Transformation sur place entre (Longitude, Latitude) et Lambert93, dans
+// le sens demandé
+bool transformerPoints(std::vector<Point> &points, ThreadPool &pool,
+                       PJ_DIRECTION sens) {
   // Initialisation de PROJ
   // Source : EPSG:4326 (GPS classique en degrés : Lat, Lon)
   const char *src_desc = "EPSG:4326";
@@ -20,53 +187,97 @@ std::vector<Point> lireEtConvertir(const std::string &nomFichier) {
       "+proj=lcc +lat_1=49 +lat_2=44 +lat_0=46.5 +lon_0=3 +x_0=700000 "
       "+y_0=6600000 +ellps=GRS80 +towgs84=0,0,0,0,0,0,0 +units=m +no_defs";
 
-  PJ_CONTEXT *C = proj_context_create();
-  PJ *P = proj_create_crs_to_crs(C, src_desc, tgt_desc, NULL);
+  // Un contexte PROJ par thread : les objets PJ ne sont pas partageables
+  struct Projection {
+    PJ_CONTEXT *C = nullptr;
+    PJ *P = nullptr;
+    bool essaye = false;
+  };
+  std::vector<Projection> projections(pool.scratchSlots());
 
-  if (P == 0) {
-    std::cerr << "Erreur de création de la projection." << std::endl;
-    return points;
-  }
+  auto creer = [&](Projection &proj) {
+    proj.essaye = true;
+    proj.C = proj_context_create();
+    proj.P = proj_create_crs_to_crs(proj.C, src_desc, tgt_desc, NULL);
+    if (proj.P == 0)
+      return;
 
-  // Normalisation pour s'assurer de l'ordre (Longitude, Latitude)
-  PJ *P_norm = proj_normalize_for_visualization(C, P);
-  if (P_norm) {
-    proj_destroy(P);
-    P = P_norm;
-  }
+    // Normalisation pour s'assurer de l'ordre (Longitude, Latitude)
+    PJ *P_norm = proj_normalize_for_visualization(proj.C, proj.P);
+    if (P_norm) {
+      proj_destroy(proj.P);
+      proj.P = P_norm;
+    }
+  };
 
-  // Ouverture du fichier de données
-  FILE *f = fopen(nomFichier.c_str(), "r");
-  if (!f) {
-    std::cerr << "Impossible d'ouvrir le fichier " << nomFichier << std::endl;
-    proj_destroy(P);
-    proj_context_destroy(C);
-    return points;
-  }
+  // Le premier contexte est créé ici pour détecter une erreur avant de
+  // lancer les threads
+  creer(projections[0]);
+  bool ok = projections[0].P != 0;
 
-  // Boucle de lecture et transformation
-  double lat, lon, alt;
-  while (fscanf(f, "%lf %lf %lf", &lat, &lon, &alt) != EOF) {
+  const std::size_t GRAIN = 1 << 15;
+  if (ok) {
+    pool.parallelFor(0, points.size(), GRAIN, [&](std::size_t b, std::size_t e) {
+      Projection &proj = projections[pool.scratchSlot()];
+      if (!proj.essaye)
+        creer(proj);
+      if (proj.P == 0)
+        return;
 
-    PJ_COORD c_in, c_out;
+      for (std::size_t i = b; i < e; ++i) {
+        Point &p = points[i];
+        PJ_COORD c_in, c_out;
 
-    // PROJ normalisé veut (Longitude, Latitude)
-    c_in.lpzt.lam = lon;
-    c_in.lpzt.phi = lat;
-    c_in.lpzt.z = alt;
-    c_in.lpzt.t = 0.0;
+        // PROJ normalisé veut (Longitude, Latitude) ou (x, y) en mètres
+        c_in.v[0] = p.x;
+        c_in.v[1] = p.y;
+        c_in.v[2] = p.z;
+        c_in.v[3] = 0.0;
 
-    // Transformation
-    c_out = proj_trans(P, PJ_FWD, c_in);
+        // Transformation
+        c_out = proj_trans(proj.P, sens, c_in);
 
-    // Stockage du résultat transformé (x, y en mètres)
-    points.push_back({c_out.xy.x, c_out.xy.y, alt});
+        // Stockage du résultat transformé
+        p.x = c_out.v[0];
+        p.y = c_out.v[1];
+      }
+    });
+    for (const auto &proj : projections)
+      ok = ok && (!proj.essaye || proj.P != 0);
   }
 
+  if (!ok)
+    logError() << "Erreur de création de la projection." << std::endl;
+
   // Nettoyage
-  fclose(f);
-  proj_destroy(P);
-  proj_context_destroy(C);
+  for (auto &proj : projections) {
+    if (proj.P)
+      proj_destroy(proj.P);
+    if (proj.C)
+      proj_context_destroy(proj.C);
+  }
+
+  return ok;
+}
+
+} // namespace
+
+// Projection des points (Longitude, Latitude) vers Lambert93, sur place
+bool projeterPoints(std::vector<Point> &points, ThreadPool &pool) {
+  return transformerPoints(points, pool, PJ_FWD);
+}
 
+// Retour de Lambert93 vers (Longitude, Latitude), sur place
+bool deprojeterPoints(std::vector<Point> &points, ThreadPool &pool) {
+  return transformerPoints(points, pool, PJ_INV);
+}
+
+// Fonction qui va lire le fichier et convertir les données
+std::vector<Point> lireEtConvertir(const std::string &nomFichier,
+                                   ThreadPool &pool) {
+  std::vector<Point> points = lirePoints(nomFichier, pool);
+  if (!points.empty() && !projeterPoints(points, pool)) {
+    points.clear();
+  }
   return points;
-}
\ No newline at end of file
+}
@@ -0,0 +1,229 @@
+/**
+ * @file binning.cpp
+ * @brief Implementation of the triangulation-free binning engine.
+ */
+
+#include "binning.hpp"
+#include "image_io.hpp"
+#include "logging.hpp"
+#include "profiling.hpp"
+#include "progress.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+// Points per chunk of the counting and scattering passes
+const std::size_t CHUNK = 1 << 16;
+
+// Pixels per row band: the accumulators of a band stay in cache
+const std::size_t BAND_PIXELS = 1 << 16;
+
+// A point sorted into its row band
+struct Binned {
+  std::uint32_t offset; // Pixel, from the start of the band
+  float z;
+};
+
+} // namespace
+
+bool parseBinStatistic(const std::string &name, BinStatistic &out) {
+  if (name == "mean")
+    out = BinStatistic::Mean;
+  else if (name == "min")
+    out = BinStatistic::Min;
+  else if (name == "max")
+    out = BinStatistic::Max;
+  else
+    return false;
+  return true;
+}
+
+bool binPoints(const std::vector<Point> &points, HeightField &field,
+               BinStatistic statistic, ThreadPool &pool,
+               std::vector<std::uint32_t> *counts) {
+  const RasterGrid &grid = field.grid;
+  const int width = grid.width, height = grid.height;
+  const std::size_t pixels = static_cast<std::size_t>(width) * height;
+  const int bandRows = static_cast<int>(
+      std::max<std::size_t>(1, BAND_PIXELS / std::max(1, width)));
+  const std::size_t bands = (height + bandRows - 1) / bandRows;
+  const std::size_t chunks = (points.size() + CHUNK - 1) / CHUNK;
+
+  // Pixel of a point, false outside the grid
+  auto pixelOf = [&](const Point &p, int &row, int &col) {
+    col = static_cast<int>((p.x - grid.minX) / grid.pixelSizeX);
+    row = static_cast<int>((grid.maxY - p.y) / grid.pixelSizeY);
+    // The right and bottom edges of the extent belong to the last pixel
+    if (col == width && p.x <= grid.bounds.maxX)
+      col = width - 1;
+    if (row == height && p.y >= grid.bounds.minY)
+      row = height - 1;
+    return p.x >= grid.minX && p.y <= grid.maxY && col < width &&
+           row < height;
+  };
+
+  // Points of each chunk per band, then where each chunk writes in each
+  // band: bands follow each other, chunks in order within a band
+  std::vector<std::size_t> offsets(chunks * bands, 0);
+  bool complete = pool.parallelFor(0, chunks, 1, [&](std::size_t c0,
+                                                     std::size_t c1) {
+    for (std::size_t c = c0; c < c1; ++c) {
+      std::size_t *mine = &offsets[c * bands];
+      std::size_t end = std::min(points.size(), (c + 1) * CHUNK);
+      for (std::size_t i = c * CHUNK; i < end; ++i) {
+        int row, col;
+        if (pixelOf(points[i], row, col))
+          ++mine[row / bandRows];
+      }
+    }
+  });
+  if (!complete)
+    return false;
+  std::vector<std::size_t> bandStart(bands + 1, 0);
+  std::size_t total = 0;
+  for (std::size_t band = 0; band < bands; ++band) {
+    bandStart[band] = total;
+    for (std::size_t c = 0; c < chunks; ++c) {
+      std::size_t n = offsets[c * bands + band];
+      offsets[c * bands + band] = total;
+      total += n;
+    }
+  }
+  bandStart[bands] = total;
+
+  std::vector<Binned> sorted(total);
+  complete = pool.parallelFor(0, chunks, 1, [&](std::size_t c0,
+                                                std::size_t c1) {
+    for (std::size_t c = c0; c < c1; ++c) {
+      std::size_t *next = &offsets[c * bands];
+      std::size_t end = std::min(points.size(), (c + 1) * CHUNK);
+      for (std::size_t i = c * CHUNK; i < end; ++i) {
+        int row, col;
+        if (!pixelOf(points[i], row, col))
+          continue;
+        int band = row / bandRows;
+        sorted[next[band]++] = {static_cast<std::uint32_t>(
+                                    (row - band * bandRows) * width + col),
+                                float(points[i].z)};
+      }
+    }
+  });
+  if (!complete)
+    return false;
+  std::vector<std::size_t>().swap(offsets);
+
+  // Each band is accumulated by one worker, in the order of the points, and
+  // written straight to the field
+  if (counts)
+    counts->assign(pixels, 0);
+  progressBegin(Stage::Render, total, "points");
+  complete = pool.parallelFor(0, bands, 1, [&](std::size_t b0,
+                                               std::size_t b1) {
+    std::vector<std::uint32_t> n;
+    std::vector<double> sum;
+    std::vector<float> extreme;
+    for (std::size_t band = b0; band < b1; ++band) {
+      int row0 = static_cast<int>(band) * bandRows;
+      int rows = std::min(bandRows, height - row0);
+      std::size_t size = static_cast<std::size_t>(rows) * width;
+      std::size_t first = static_cast<std::size_t>(row0) * width;
+      n.assign(size, 0);
+      if (statistic == BinStatistic::Mean)
+        sum.assign(size, 0.0);
+      else
+        extreme.assign(size, statistic == BinStatistic::Min
+                                 ? std::numeric_limits<float>::infinity()
+                                 : -std::numeric_limits<float>::infinity());
+
+      for (std::size_t i = bandStart[band]; i < bandStart[band + 1]; ++i) {
+        const Binned &p = sorted[i];
+        ++n[p.offset];
+        if (statistic == BinStatistic::Mean)
+          sum[p.offset] += p.z;
+        else if (statistic == BinStatistic::Min)
+          extreme[p.offset] = std::min(extreme[p.offset], p.z);
+        else
+          extreme[p.offset] = std::max(extreme[p.offset], p.z);
+      }
+
+      for (std::size_t k = 0; k < size; ++k) {
+        if (counts)
+          (*counts)[first + k] = n[k];
+        if (n[k] > 0)
+          field.z[first + k] = statistic == BinStatistic::Mean
+                                   ? float(sum[k] / n[k])
+                                   : extreme[k];
+      }
+      progressAdvance(bandStart[band + 1] - bandStart[band]);
+    }
+  });
+  progressEnd();
+  return complete;
+}
+
+bool writeDensityImage(const std::string &filename, int width, int height,
+                       const std::vector<std::uint32_t> &counts) {
+  std::uint32_t densest = 0;
+  for (std::uint32_t n : counts)
+    densest = std::max(densest, n);
+  double scale = densest > 0 ? 255.0 / std::log1p(double(densest)) : 0;
+
+  Image image;
+  image.width = width;
+  image.height = height;
+  image.pixels.resize(counts.size() * 3);
+  for (std::size_t k = 0; k < counts.size(); ++k) {
+    auto gray =
+        static_cast<unsigned char>(std::lround(std::log1p(counts[k]) * scale));
+    image.pixels[3 * k] = image.pixels[3 * k + 1] = image.pixels[3 * k + 2] =
+        gray;
+  }
+  return writePPM(filename, image);
+}
+
+bool makeBinnedField(const std::vector<Point> &points, int width,
+                     const BinningOptions &options, ThreadPool &pool,
+                     HeightField &field) {
+  RasterGrid grid;
+  if (!makeRasterGrid(points, width, grid)) {
+    logError() << "Dimensions de la grille invalides." << std::endl;
+    return false;
+  }
+  logInfo() << "Générer une image " << width << "x" << grid.height
+            << " par cumul des points" << std::endl;
+
+  std::vector<std::uint32_t> counts;
+  {
+    StageTimer timer(Stage::Render);
+    field.reset(grid);
+    if (!binPoints(points, field, options.statistic, pool,
+                   options.densityFile.empty() ? nullptr : &counts)) {
+      logError() << "Rendu annulé, aucune image écrite." << std::endl;
+      return false;
+    }
+    std::size_t filled = fillGaps(field, options.fillRadius);
+    logDebug() << "Pixels comblés : " << filled << std::endl;
+  }
+
+  if (!options.densityFile.empty()) {
+    StageTimer timer(Stage::Write);
+    if (writeDensityImage(options.densityFile, width, grid.height, counts))
+      logInfo() << "Densité enregistrée dans " << options.densityFile
+                << std::endl;
+    else
+      logError() << "Erreur d'écriture dans " << options.densityFile
+                 << std::endl;
+  }
+  return true;
+}
+
+void generateBinnedImage(const std::string &filename, int width,
+                         const std::vector<Point> &points,
+                         const BinningOptions &options, ThreadPool &pool) {
+  HeightField field;
+  if (makeBinnedField(points, width, options, pool, field))
+    writeHeightFieldImage(filename, field, pool);
+}
@@ -0,0 +1,230 @@
+/**
+ * @file checkpoint.cpp
+ * @brief Implementation of render checkpoints and of the mesh cache.
+ */
+
+#include "checkpoint.hpp"
+#include "logging.hpp"
+#include "memory_policy.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char *const JOURNAL_TAG = "# terrain-journal 1 ";
+const char MESH_MAGIC[8] = {'T', 'M', 'E', 'S', 'H', '0', '0', '1'};
+
+bool writeAll(int fd, const char *data, std::size_t length) {
+  while (length > 0) {
+    ssize_t n = ::write(fd, data, length);
+    if (n <= 0)
+      return false;
+    data += n;
+    length -= static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+bool exists(const std::string &path) {
+  struct stat st;
+  return ::stat(path.c_str(), &st) == 0;
+}
+
+} // namespace
+
+Checkpoint::~Checkpoint() {
+  if (fd >= 0)
+    ::close(fd);
+}
+
+bool Checkpoint::open(const std::string &output,
+                      const std::string &fingerprint, std::size_t units,
+                      double seconds, bool resume) {
+  journalPath = output + ".journal";
+  interval = seconds;
+  done.assign(units, 0);
+  finishedAtOpen = 0;
+  pending.clear();
+  failed = false;
+  lastFlush = std::chrono::steady_clock::now();
+  const std::string header = JOURNAL_TAG + fingerprint + "\n";
+
+  // Reload the journal: the header must match, then one finished unit per
+  // complete line (a line torn by a crash is dropped)
+  std::size_t keep = 0;
+  if (resume && exists(journalPath) && exists(output)) {
+    std::ifstream ifs(journalPath, std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(ifs)),
+                        std::istreambuf_iterator<char>());
+    if (content.compare(0, header.size(), header) != 0) {
+      logError() << "Le journal " << journalPath
+                 << " correspond à un autre rendu ; supprimez-le ou relancez "
+                    "sans --resume."
+                 << std::endl;
+      return false;
+    }
+    std::size_t pos = header.size();
+    keep = pos;
+    while (true) {
+      std::size_t eol = content.find('\n', pos);
+      if (eol == std::string::npos)
+        break;
+      std::size_t unit = std::strtoull(content.c_str() + pos, nullptr, 10);
+      if (unit < units && !done[unit]) {
+        done[unit] = 1;
+        ++finishedAtOpen;
+      }
+      pos = eol + 1;
+      keep = pos;
+    }
+  }
+
+  if (keep > 0) {
+    fd = ::open(journalPath.c_str(), O_WRONLY);
+    if (fd >= 0 && (::ftruncate(fd, static_cast<off_t>(keep)) != 0 ||
+                    ::lseek(fd, 0, SEEK_END) < 0)) {
+      ::close(fd);
+      fd = -1;
+    }
+  } else {
+    fd = ::open(journalPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0 && (!writeAll(fd, header.data(), header.size()) ||
+                    ::fdatasync(fd) != 0)) {
+      ::close(fd);
+      fd = -1;
+    }
+  }
+  if (fd < 0) {
+    logError() << "Impossible d'écrire le journal " << journalPath
+               << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void Checkpoint::complete(std::size_t unit) {
+  std::lock_guard<std::mutex> lock(mutex);
+  pending.push_back(unit);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - lastFlush;
+  if (elapsed.count() >= interval)
+    flushLocked();
+}
+
+bool Checkpoint::flush() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return flushLocked();
+}
+
+bool Checkpoint::flushLocked() {
+  lastFlush = std::chrono::steady_clock::now();
+  if (pending.empty() || failed)
+    return !failed;
+
+  // Pixels first: the journal must never list units not yet on disk
+  if (writer && !writer->sync())
+    failed = true;
+
+  std::string lines;
+  for (std::size_t unit : pending)
+    lines += std::to_string(unit) + "\n";
+  if (!failed && (!writeAll(fd, lines.data(), lines.size()) ||
+                  ::fdatasync(fd) != 0))
+    failed = true;
+  if (failed)
+    logError() << "Erreur d'écriture du point de reprise " << journalPath
+               << std::endl;
+  pending.clear();
+  return !failed;
+}
+
+bool Checkpoint::finish() {
+  bool ok = flush();
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+  if (ok)
+    std::remove(journalPath.c_str());
+  return ok;
+}
+
+std::string inputFingerprint(const std::string &input) {
+  struct stat st;
+  long long size = ::stat(input.c_str(), &st) == 0 ? st.st_size : -1;
+  return "input=" + input + " size=" + std::to_string(size);
+}
+
+bool saveMeshCache(const std::string &path, const std::string &fingerprint,
+                   const Mesh &mesh) {
+  // Written aside then renamed: a preempted write never leaves a cache
+  // that looks complete
+  const std::string temporary = path + ".tmp";
+  std::ofstream ofs(temporary, std::ios::binary);
+  if (!ofs) {
+    logError() << "Impossible de créer le cache " << path << std::endl;
+    return false;
+  }
+  std::uint64_t length = fingerprint.size();
+  std::uint64_t points = mesh.points.size();
+  std::uint64_t triangles = mesh.triangles.size();
+  ofs.write(MESH_MAGIC, sizeof(MESH_MAGIC));
+  ofs.write(reinterpret_cast<const char *>(&length), sizeof(length));
+  ofs.write(fingerprint.data(), fingerprint.size());
+  ofs.write(reinterpret_cast<const char *>(&points), sizeof(points));
+  ofs.write(reinterpret_cast<const char *>(mesh.points.data()),
+            points * sizeof(Point));
+  ofs.write(reinterpret_cast<const char *>(&triangles), sizeof(triangles));
+  ofs.write(reinterpret_cast<const char *>(mesh.triangles.data()),
+            triangles * sizeof(Triangle));
+  ofs.close();
+  if (!ofs || std::rename(temporary.c_str(), path.c_str()) != 0) {
+    logError() << "Erreur d'écriture dans " << path << std::endl;
+    std::remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool loadMeshCache(const std::string &path, const std::string &fingerprint,
+                   Mesh &mesh) {
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs)
+    return false;
+  char magic[sizeof(MESH_MAGIC)];
+  std::uint64_t length = 0, points = 0, triangles = 0;
+  ifs.read(magic, sizeof(magic));
+  ifs.read(reinterpret_cast<char *>(&length), sizeof(length));
+  if (!ifs || std::memcmp(magic, MESH_MAGIC, sizeof(magic)) != 0 ||
+      length != fingerprint.size())
+    return false;
+  std::string saved(length, '\0');
+  ifs.read(&saved[0], length);
+  if (!ifs || saved != fingerprint)
+    return false;
+
+  ifs.read(reinterpret_cast<char *>(&points), sizeof(points));
+  mesh.points.resize(points);
+  ifs.read(reinterpret_cast<char *>(mesh.points.data()),
+           points * sizeof(Point));
+  ifs.read(reinterpret_cast<char *>(&triangles), sizeof(triangles));
+  mesh.triangles.resize(triangles);
+  ifs.read(reinterpret_cast<char *>(mesh.triangles.data()),
+           triangles * sizeof(Triangle));
+  if (!ifs) {
+    mesh = Mesh();
+    return false;
+  }
+  placeShared(mesh.points.data(), points * sizeof(Point));
+  placeShared(mesh.triangles.data(), triangles * sizeof(Triangle));
+  return true;
+}
@@ -0,0 +1,150 @@
+/**
+ * @file distance.cpp
+ * @brief Parallel exact Euclidean distance transform and its seed grids.
+ */
+
+#include "distance.hpp"
+#include "progress.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Columns scanned together by the first pass: long enough runs of each
+// row for the prefetcher, a gap array that stays in the L1 cache
+const int STRIP = 2048;
+
+const float INF = std::numeric_limits<float>::infinity();
+
+} // namespace
+
+bool distanceTransform(const std::vector<std::uint8_t> &seeds,
+                       const RasterGrid &grid, ThreadPool &pool,
+                       std::vector<float> &distance) {
+  const int width = grid.width, height = grid.height;
+  const double sx = grid.pixelSizeX, sy = grid.pixelSizeY;
+  if (std::none_of(seeds.begin(), seeds.end(),
+                   [](std::uint8_t seed) { return seed != 0; })) {
+    distance.assign(seeds.size(), std::numeric_limits<float>::quiet_NaN());
+    return true;
+  }
+  distance.resize(static_cast<std::size_t>(width) * height);
+  auto at = [&](int row, int col) {
+    return static_cast<std::size_t>(row) * width + col;
+  };
+
+  progressBegin(Stage::Render, static_cast<std::size_t>(2) * height,
+                "lignes");
+  // Columns: rows to the nearest seed above (downwards scan), then below
+  // (upwards scan); counted in rows, exact in float, and scaled afterwards
+  const int strips = (width + STRIP - 1) / STRIP;
+  bool complete = pool.parallelFor(
+      0, strips, 1, [&](std::size_t s0, std::size_t s1) {
+        for (std::size_t s = s0; s < s1; ++s) {
+          const int c0 = static_cast<int>(s) * STRIP;
+          const int c1 = std::min(width, c0 + STRIP);
+          std::vector<float> gap(c1 - c0, INF);
+          for (int row = 0; row < height; ++row) {
+            const std::uint8_t *seed = &seeds[at(row, c0)];
+            float *out = &distance[at(row, c0)];
+            for (int c = 0; c < c1 - c0; ++c) {
+              gap[c] = seed[c] ? 0 : gap[c] + 1;
+              out[c] = gap[c];
+            }
+          }
+          std::fill(gap.begin(), gap.end(), INF);
+          for (int row = height - 1; row >= 0; --row) {
+            const std::uint8_t *seed = &seeds[at(row, c0)];
+            float *out = &distance[at(row, c0)];
+            for (int c = 0; c < c1 - c0; ++c) {
+              gap[c] = seed[c] ? 0 : gap[c] + 1;
+              out[c] = std::min(out[c], gap[c]);
+            }
+          }
+        }
+      });
+  progressAdvance(height);
+  if (!complete) {
+    progressEnd();
+    return false;
+  }
+
+  // Rows: lower envelope of the parabolas (x - x_q)^2 + g_q^2 over the
+  // columns q that have a seed in their column
+  complete = pool.parallelFor(
+      0, height, 16, [&](std::size_t r0, std::size_t r1) {
+        // h_q = g_q^2 + x_q^2: the parabolas of v and q cross at
+        // (h_q - h_v) / (2 (x_q - x_v)), compared without dividing
+        std::vector<double> f(width), h(width), x(width), z(width + 1);
+        std::vector<int> v(width);
+        for (std::size_t row = r0; row < r1; ++row) {
+          float *line = &distance[at(static_cast<int>(row), 0)];
+          int k = -1;
+          for (int q = 0; q < width; ++q) {
+            if (line[q] == INF)
+              continue;
+            const double xq = q * sx;
+            f[q] = (line[q] * sy) * (line[q] * sy);
+            h[q] = f[q] + xq * xq;
+            x[q] = xq;
+            while (k > 0 && h[q] - h[v[k]] <= 2 * (xq - x[v[k]]) * z[k])
+              --k;
+            ++k;
+            v[k] = q;
+            z[k] = k == 0 ? -INFINITY
+                          : (h[q] - h[v[k - 1]]) / (2 * (xq - x[v[k - 1]]));
+            z[k + 1] = INFINITY;
+          }
+          int j = 0;
+          for (int p = 0; p < width; ++p) {
+            const double xp = p * sx;
+            while (z[j + 1] < xp)
+              ++j;
+            const double dx = xp - v[j] * sx;
+            line[p] = static_cast<float>(std::sqrt(dx * dx + f[v[j]]));
+          }
+        }
+        progressAdvance(r1 - r0);
+      });
+  progressEnd();
+  return complete;
+}
+
+void markPoints(const std::vector<Point> &points, const RasterGrid &grid,
+                std::vector<std::uint8_t> &seeds) {
+  seeds.assign(static_cast<std::size_t>(grid.width) * grid.height, 0);
+  for (const Point &p : points) {
+    // Points on the right or bottom edge of the grid go to the last pixel
+    double col = std::floor((p.x - grid.minX) / grid.pixelSizeX);
+    double row = std::floor((grid.maxY - p.y) / grid.pixelSizeY);
+    col = col == grid.width ? col - 1 : col;
+    row = row == grid.height ? row - 1 : row;
+    if (col < 0 || row < 0 || col >= grid.width || row >= grid.height)
+      continue;
+    seeds[static_cast<std::size_t>(row) * grid.width +
+          static_cast<std::size_t>(col)] = 1;
+  }
+}
+
+bool shoreDistance(const HeightField &field, double level, ThreadPool &pool,
+                   std::vector<float> &distance) {
+  const std::size_t n = field.z.size();
+  std::vector<std::uint8_t> dry(n), wet(n);
+  for (std::size_t k = 0; k < n; ++k) {
+    float z = field.z[k];
+    dry[k] = !std::isnan(z) && z >= level;
+    wet[k] = !std::isnan(z) && z < level;
+  }
+  std::vector<float> toWater;
+  if (!distanceTransform(dry, field.grid, pool, distance) ||
+      !distanceTransform(wet, field.grid, pool, toWater))
+    return false;
+  for (std::size_t k = 0; k < n; ++k) {
+    if (std::isnan(field.z[k]))
+      distance[k] = std::numeric_limits<float>::quiet_NaN();
+    else if (dry[k])
+      distance[k] = -toWater[k];
+  }
+  return true;
+}
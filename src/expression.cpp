@@ -0,0 +1,993 @@
+/**
+ * @file expression.cpp
+ * @brief Compilation and fused evaluation of raster-algebra expressions.
+ */
+
+#include "expression.hpp"
+#include "MNT.hpp"
+#include "image_io.hpp"
+#include "point_io.hpp"
+#include "profiling.hpp"
+#include "progress.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <mutex>
+
+namespace {
+
+enum Op : std::uint8_t {
+  // Layers
+  LOAD_Z,
+  LOAD_SLOPE,
+  LOAD_ASPECT,
+  LOAD_X,
+  LOAD_Y,
+  LOAD_SOUNDINGS,
+  LOAD_SHORE,
+  CONST,
+  // Offsets from the grid origin (see ExpressionCompiler::Bias)
+  CONST_SHIFTED,
+  SHIFT,
+  // Unary
+  NEG,
+  NOT,
+  ABS,
+  SQRT,
+  EXP,
+  LOG,
+  FLOOR,
+  CEIL,
+  ROUND,
+  DEFINED,
+  // Binary
+  ADD,
+  SUB,
+  MUL,
+  DIV,
+  MOD,
+  POW,
+  LT,
+  LE,
+  GT,
+  GE,
+  EQ,
+  NE,
+  AND,
+  OR,
+  MIN,
+  MAX,
+  // Ternary
+  SELECT,
+  CLAMP
+};
+
+const double DEGREES = 180.0 / 3.14159265358979323846;
+
+struct Function {
+  const char *name;
+  Op op;
+  int arguments;
+};
+
+const Function FUNCTIONS[] = {
+    {"abs", ABS, 1},     {"sqrt", SQRT, 1},   {"exp", EXP, 1},
+    {"log", LOG, 1},     {"floor", FLOOR, 1}, {"ceil", CEIL, 1},
+    {"round", ROUND, 1}, {"defined", DEFINED, 1}, {"min", MIN, 2},
+    {"max", MAX, 2},     {"pow", POW, 2},     {"clamp", CLAMP, 3}};
+
+struct Layer {
+  const char *name;
+  Op op;
+};
+
+const Layer LAYERS[] = {{"z", LOAD_Z},
+                        {"slope", LOAD_SLOPE},
+                        {"aspect", LOAD_ASPECT},
+                        {"x", LOAD_X},
+                        {"y", LOAD_Y},
+                        {"sounding_distance", LOAD_SOUNDINGS},
+                        {"shore_distance", LOAD_SHORE}};
+
+bool empty(float v) { return std::isnan(v); }
+
+// Applies an operator to n pixels; the loops have no branch across pixels,
+// so the compiler can vectorize them
+void apply(Op op, int n, float *out, const float *a, const float *b,
+           const float *c) {
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  switch (op) {
+  case NEG:
+    for (int i = 0; i < n; ++i)
+      out[i] = -a[i];
+    break;
+  case NOT:
+    for (int i = 0; i < n; ++i)
+      out[i] = empty(a[i]) ? nan : float(a[i] == 0);
+    break;
+  case ABS:
+    for (int i = 0; i < n; ++i)
+      out[i] = std::abs(a[i]);
+    break;
+  case SQRT:
+    for (int i = 0; i < n; ++i)
+      out[i] = std::sqrt(a[i]);
+    break;
+  case EXP:
+    for (int i = 0; i < n; ++i)
+      out[i] = std::exp(a[i]);
+    break;
+  case LOG:
+    for (int i = 0; i < n; ++i)
+      out[i] = std::log(a[i]);
+    break;
+  case FLOOR:
+    for (int i = 0; i < n; ++i)
+      out[i] = std::floor(a[i]);
+    break;
+  case CEIL:
+    for (int i = 0; i < n; ++i)
+      out[i] = std::ceil(a[i]);
+    break;
+  case ROUND:
+    for (int i = 0; i < n; ++i)
+      out[i] = std::round(a[i]);
+    break;
+  case DEFINED:
+    for (int i = 0; i < n; ++i)
+      out[i] = float(!empty(a[i]));
+    break;
+  case ADD:
+    for (int i = 0; i < n; ++i)
+      out[i] = a[i] + b[i];
+    break;
+  case SUB:
+    for (int i = 0; i < n; ++i)
+      out[i] = a[i] - b[i];
+    break;
+  case MUL:
+    for (int i = 0; i < n; ++i)
+      out[i] = a[i] * b[i];
+    break;
+  case DIV:
+    for (int i = 0; i < n; ++i)
+      out[i] = a[i] / b[i];
+    break;
+  case MOD:
+    for (int i = 0; i < n; ++i)
+      out[i] = std::fmod(a[i], b[i]);
+    break;
+  case POW:
+    for (int i = 0; i < n; ++i)
+      out[i] = std::pow(a[i], b[i]);
+    break;
+  case LT:
+    for (int i = 0; i < n; ++i)
+      out[i] = empty(a[i] + b[i]) ? nan : float(a[i] < b[i]);
+    break;
+  case LE:
+    for (int i = 0; i < n; ++i)
+      out[i] = empty(a[i] + b[i]) ? nan : float(a[i] <= b[i]);
+    break;
+  case GT:
+    for (int i = 0; i < n; ++i)
+      out[i] = empty(a[i] + b[i]) ? nan : float(a[i] > b[i]);
+    break;
+  case GE:
+    for (int i = 0; i < n; ++i)
+      out[i] = empty(a[i] + b[i]) ? nan : float(a[i] >= b[i]);
+    break;
+  case EQ:
+    for (int i = 0; i < n; ++i)
+      out[i] = empty(a[i] + b[i]) ? nan : float(a[i] == b[i]);
+    break;
+  case NE:
+    for (int i = 0; i < n; ++i)
+      out[i] = empty(a[i] + b[i]) ? nan : float(a[i] != b[i]);
+    break;
+  case AND:
+    for (int i = 0; i < n; ++i)
+      out[i] = empty(a[i] + b[i]) ? nan : float(a[i] != 0 && b[i] != 0);
+    break;
+  case OR:
+    for (int i = 0; i < n; ++i)
+      out[i] = empty(a[i] + b[i]) ? nan : float(a[i] != 0 || b[i] != 0);
+    break;
+  case MIN:
+    for (int i = 0; i < n; ++i)
+      out[i] = empty(a[i] + b[i]) ? nan : std::min(a[i], b[i]);
+    break;
+  case MAX:
+    for (int i = 0; i < n; ++i)
+      out[i] = empty(a[i] + b[i]) ? nan : std::max(a[i], b[i]);
+    break;
+  case SELECT:
+    for (int i = 0; i < n; ++i)
+      out[i] = empty(a[i]) ? nan : a[i] != 0 ? b[i] : c[i];
+    break;
+  case CLAMP:
+    for (int i = 0; i < n; ++i)
+      out[i] = empty(a[i] + b[i] + c[i]) ? nan
+                                         : std::min(std::max(a[i], b[i]), c[i]);
+    break;
+  default:
+    break;
+  }
+}
+
+// x and y registers hold offsets from the grid origin (minX, maxY), so
+// that single-precision registers keep centimetres on Lambert93
+// northings; a register stands for its value plus kx * minX + ky * maxY +
+// constant. Sums with constants only change the bias; operators comparing
+// their operands bring them to one bias, the constants exactly; the
+// others get absolute values.
+struct Bias {
+  int kx = 0, ky = 0;
+  double constant = 0;
+  bool operator==(const Bias &o) const {
+    return kx == o.kx && ky == o.ky && constant == o.constant;
+  }
+  bool zero() const { return *this == Bias(); }
+};
+
+} // namespace
+
+// Recursive-descent parser emitting the instructions as it goes, one
+// register per value
+class ExpressionCompiler {
+public:
+  ExpressionCompiler(const std::string &text, Expression &plan)
+      : text(text), plan(plan) {}
+
+  bool run(std::string &error) {
+    plan.code.clear();
+    plan.registers = 0;
+    next();
+    int value = -1;
+    while (ok && token != END) {
+      if (token == ';') {
+        next();
+        continue;
+      }
+      value = statement();
+      if (ok && token != ';' && token != END)
+        fail("';' attendu");
+    }
+    if (ok && value < 0)
+      fail("expression vide");
+    if (!ok) {
+      error = "position " + std::to_string(errorAt + 1) + " : " + message;
+      plan.code.clear();
+      return false;
+    }
+    plan.result = rebase(value, Bias());
+    prune();
+    return true;
+  }
+
+private:
+  enum Token { END = 256, NUMBER, NAME, LE_, GE_, EQ_, NE_, AND_, OR_ };
+
+  const std::string &text;
+  Expression &plan;
+  std::size_t pos = 0, start = 0;
+  int token = END;
+  double number = 0;
+  std::string name;
+  bool ok = true;
+  std::size_t errorAt = 0;
+  std::string message;
+  std::map<std::string, int> names;   // Bound names and loaded layers
+  std::vector<char> isConstant;       // Per register
+  std::vector<float> constantValue;   // Per register
+  std::vector<double> exactValue;     // Per register, for shifted constants
+  std::vector<Bias> bias;             // Per register
+
+  void fail(const std::string &what) {
+    if (!ok)
+      return;
+    ok = false;
+    errorAt = start;
+    message = what;
+  }
+
+  void next() {
+    while (pos < text.size() && std::isspace((unsigned char)text[pos]))
+      ++pos;
+    start = pos;
+    if (pos >= text.size()) {
+      token = END;
+      return;
+    }
+    char ch = text[pos];
+    if (std::isdigit((unsigned char)ch) || ch == '.') {
+      char *end = nullptr;
+      number = std::strtod(text.c_str() + pos, &end);
+      if (end == text.c_str() + pos) {
+        fail("nombre invalide");
+        token = END;
+        return;
+      }
+      pos = end - text.c_str();
+      token = NUMBER;
+      return;
+    }
+    if (std::isalpha((unsigned char)ch) || ch == '_') {
+      while (pos < text.size() &&
+             (std::isalnum((unsigned char)text[pos]) || text[pos] == '_'))
+        ++pos;
+      name = text.substr(start, pos - start);
+      token = NAME;
+      return;
+    }
+    static const struct {
+      const char *text;
+      int token;
+    } PAIRS[] = {{"<=", LE_}, {">=", GE_}, {"==", EQ_},
+                 {"!=", NE_}, {"&&", AND_}, {"||", OR_}};
+    for (const auto &pair : PAIRS)
+      if (text.compare(pos, 2, pair.text) == 0) {
+        pos += 2;
+        token = pair.token;
+        return;
+      }
+    if (std::string("+-*/%^()<>!?:,;=").find(ch) == std::string::npos) {
+      fail(std::string("caractère inattendu '") + ch + "'");
+      token = END;
+      return;
+    }
+    ++pos;
+    token = ch;
+  }
+
+  void expect(int wanted, const char *what) {
+    if (token == wanted)
+      next();
+    else
+      fail(std::string("'") + what + "' attendu");
+  }
+
+  int newRegister(bool constant, double value, const Bias &offset = Bias()) {
+    isConstant.push_back(constant);
+    constantValue.push_back(static_cast<float>(value));
+    exactValue.push_back(value);
+    bias.push_back(offset);
+    return plan.registers++;
+  }
+
+  int constant(double value) {
+    int target = newRegister(true, value);
+    plan.code.push_back({CONST, target, -1, -1, -1, value});
+    return target;
+  }
+
+  // Brings a register to another bias: constants exactly, other registers
+  // shifted by the difference in double precision
+  int rebase(int r, const Bias &wanted) {
+    if (bias[r] == wanted)
+      return r;
+    if (isConstant[r]) {
+      int target = newRegister(false, 0, wanted);
+      plan.code.push_back({CONST_SHIFTED, target, -1, -1, -1,
+                           exactValue[r] - wanted.constant, -wanted.kx,
+                           -wanted.ky});
+      return target;
+    }
+    const Bias from = bias[r];
+    int target = newRegister(false, 0, wanted);
+    plan.code.push_back({SHIFT, target, r, -1, -1,
+                         from.constant - wanted.constant, from.kx - wanted.kx,
+                         from.ky - wanted.ky});
+    return target;
+  }
+
+  // Emits an operator, or folds it into a constant if its operands are
+  int emit(Op op, int a, int b = -1, int c = -1) {
+    if (!ok)
+      return 0;
+    bool folded = true;
+    for (int r : {a, b, c})
+      folded = folded && (r < 0 || isConstant[r]);
+    if (folded) {
+      float x = constantValue[a], y = b < 0 ? 0.f : constantValue[b],
+            z = c < 0 ? 0.f : constantValue[c], v;
+      apply(op, 1, &v, &x, &y, &z);
+      // Sums and products of literals stay exact for shifted constants
+      double ex = exactValue[a], ey = b < 0 ? 0 : exactValue[b], exact = v;
+      if (op == NEG)
+        exact = -ex;
+      else if (op == ADD)
+        exact = ex + ey;
+      else if (op == SUB)
+        exact = ex - ey;
+      else if (op == MUL)
+        exact = ex * ey;
+      else if (op == DIV)
+        exact = ex / ey;
+      int target = newRegister(true, exact);
+      constantValue[target] = v;
+      plan.code.push_back({CONST, target, -1, -1, -1, v});
+      return target;
+    }
+
+    Bias result;
+    switch (op) {
+    case NEG:
+      result.kx = -bias[a].kx;
+      result.ky = -bias[a].ky;
+      result.constant = -bias[a].constant;
+      break;
+    case ADD:
+    case SUB: {
+      // A constant operand goes into the bias
+      int sign = op == ADD ? 1 : -1;
+      result = bias[a];
+      if (isConstant[b] && !result.zero()) {
+        result.constant += sign * exactValue[b];
+        int target = newRegister(false, 0, result);
+        plan.code.push_back({SHIFT, target, a, -1, -1, 0, 0, 0});
+        return target;
+      }
+      if (isConstant[a] && !bias[b].zero()) {
+        result = bias[b];
+        result.kx *= sign;
+        result.ky *= sign;
+        result.constant = sign * result.constant + exactValue[a];
+        if (op == ADD) {
+          int target = newRegister(false, 0, result);
+          plan.code.push_back({SHIFT, target, b, -1, -1, 0, 0, 0});
+          return target;
+        }
+        int target = newRegister(false, 0, result);
+        plan.code.push_back({NEG, target, b, -1, -1, 0});
+        return target;
+      }
+      result.kx += sign * bias[b].kx;
+      result.ky += sign * bias[b].ky;
+      result.constant += sign * bias[b].constant;
+      break;
+    }
+    case DEFINED:
+      break;
+    case LT:
+    case LE:
+    case GT:
+    case GE:
+    case EQ:
+    case NE:
+    case MIN:
+    case MAX:
+    case CLAMP:
+    case SELECT: {
+      // Operands compared or chosen between share the bias of the first
+      // offset one
+      int *operands[3] = {&a, &b, &c};
+      int first = op == SELECT ? 1 : 0;
+      if (op == SELECT)
+        a = rebase(a, Bias());
+      for (int k = first; k < 3 && *operands[k] >= 0; ++k)
+        if (!bias[*operands[k]].zero()) {
+          result = bias[*operands[k]];
+          break;
+        }
+      for (int k = first; k < 3 && *operands[k] >= 0; ++k)
+        *operands[k] = rebase(*operands[k], result);
+      if (op != MIN && op != MAX && op != CLAMP && op != SELECT)
+        result = Bias();
+      break;
+    }
+    default:
+      for (int *r : {&a, &b, &c})
+        if (*r >= 0)
+          *r = rebase(*r, Bias());
+      break;
+    }
+    int target = newRegister(false, 0, result);
+    plan.code.push_back({op, target, a, b, c, 0});
+    return target;
+  }
+
+  int statement() {
+    if (token == NAME) {
+      // name = expr, told apart from an expression by the '=' after it
+      std::size_t save = pos, saveStart = start;
+      std::string bound = name;
+      next();
+      if (token == '=') {
+        for (const Layer &layer : LAYERS)
+          if (bound == layer.name) {
+            start = saveStart;
+            fail("la couche " + bound + " ne peut pas être redéfinie");
+            return 0;
+          }
+        next();
+        int value = expression();
+        names[bound] = value;
+        return value;
+      }
+      pos = save;
+      start = saveStart;
+      name = bound;
+      token = NAME;
+    }
+    return expression();
+  }
+
+  int expression() {
+    int condition = logicalOr();
+    if (token != '?')
+      return condition;
+    next();
+    int a = expression();
+    expect(':', ":");
+    int b = expression();
+    return emit(SELECT, condition, a, b);
+  }
+
+  int logicalOr() {
+    int a = logicalAnd();
+    while (ok && token == OR_) {
+      next();
+      a = emit(OR, a, logicalAnd());
+    }
+    return a;
+  }
+
+  int logicalAnd() {
+    int a = equality();
+    while (ok && token == AND_) {
+      next();
+      a = emit(AND, a, equality());
+    }
+    return a;
+  }
+
+  int equality() {
+    int a = relational();
+    while (ok && (token == EQ_ || token == NE_)) {
+      Op op = token == EQ_ ? EQ : NE;
+      next();
+      a = emit(op, a, relational());
+    }
+    return a;
+  }
+
+  int relational() {
+    int a = additive();
+    while (ok && (token == '<' || token == '>' || token == LE_ ||
+                  token == GE_)) {
+      Op op = token == '<' ? LT : token == '>' ? GT : token == LE_ ? LE : GE;
+      next();
+      a = emit(op, a, additive());
+    }
+    return a;
+  }
+
+  int additive() {
+    int a = multiplicative();
+    while (ok && (token == '+' || token == '-')) {
+      Op op = token == '+' ? ADD : SUB;
+      next();
+      a = emit(op, a, multiplicative());
+    }
+    return a;
+  }
+
+  int multiplicative() {
+    int a = unary();
+    while (ok && (token == '*' || token == '/' || token == '%')) {
+      Op op = token == '*' ? MUL : token == '/' ? DIV : MOD;
+      next();
+      a = emit(op, a, unary());
+    }
+    return a;
+  }
+
+  // -2^2 is -(2^2), as in mathematics
+  int unary() {
+    if (token == '-' || token == '!') {
+      Op op = token == '-' ? NEG : NOT;
+      next();
+      return emit(op, unary());
+    }
+    if (token == '+') {
+      next();
+      return unary();
+    }
+    int base = primary();
+    if (ok && token == '^') {
+      next();
+      return emit(POW, base, unary());
+    }
+    return base;
+  }
+
+  int primary() {
+    if (!ok)
+      return 0;
+    if (token == NUMBER) {
+      double value = number;
+      next();
+      return constant(value);
+    }
+    if (token == '(') {
+      next();
+      int value = expression();
+      expect(')', ")");
+      return value;
+    }
+    if (token != NAME) {
+      fail("expression attendue");
+      return 0;
+    }
+    std::string called = name;
+    std::size_t at = start;
+    next();
+    if (token == '(')
+      return call(called, at);
+
+    auto found = names.find(called);
+    if (found != names.end())
+      return found->second;
+    // A layer is loaded once, where first used
+    for (const Layer &layer : LAYERS)
+      if (called == layer.name) {
+        Bias offset;
+        offset.kx = layer.op == LOAD_X;
+        offset.ky = layer.op == LOAD_Y;
+        int target = newRegister(false, 0, offset);
+        plan.code.push_back({layer.op, target, -1, -1, -1, 0});
+        names[called] = target;
+        return target;
+      }
+    start = at;
+    fail("nom inconnu : " + called);
+    return 0;
+  }
+
+  int call(const std::string &called, std::size_t at) {
+    next();
+    int args[3] = {-1, -1, -1};
+    int count = 0;
+    if (token != ')')
+      while (ok) {
+        int value = expression();
+        if (count < 3)
+          args[count] = value;
+        ++count;
+        if (token != ',')
+          break;
+        next();
+      }
+    expect(')', ")");
+    if (!ok)
+      return 0;
+    for (const Function &f : FUNCTIONS)
+      if (called == f.name) {
+        if (count != f.arguments) {
+          start = at;
+          fail(called + " attend " + std::to_string(f.arguments) +
+               " argument(s)");
+          return 0;
+        }
+        return emit(f.op, args[0], args[1], args[2]);
+      }
+    start = at;
+    fail("fonction inconnue : " + called);
+    return 0;
+  }
+
+  // Drops the instructions the result does not depend on (constants folded
+  // away, unused names), then numbers the registers left densely
+  void prune() {
+    std::vector<char> live(plan.registers, 0);
+    live[plan.result] = 1;
+    for (std::size_t i = plan.code.size(); i-- > 0;) {
+      const Expression::Instruction &in = plan.code[i];
+      if (live[in.target])
+        for (int r : {in.a, in.b, in.c})
+          if (r >= 0)
+            live[r] = 1;
+    }
+    std::vector<int> renumber(plan.registers, -1);
+    int count = 0;
+    std::vector<Expression::Instruction> kept;
+    for (Expression::Instruction in : plan.code) {
+      if (!live[in.target])
+        continue;
+      renumber[in.target] = count++;
+      in.target = renumber[in.target];
+      for (int *r : {&in.a, &in.b, &in.c})
+        if (*r >= 0)
+          *r = renumber[*r];
+      kept.push_back(in);
+    }
+    plan.result = renumber[plan.result];
+    plan.registers = count;
+    plan.code.swap(kept);
+  }
+};
+
+bool Expression::compile(const std::string &text, std::string &error) {
+  ExpressionCompiler compiler(text, *this);
+  return compiler.run(error);
+}
+
+bool Expression::uses(const std::string &layer) const {
+  for (const Layer &l : LAYERS)
+    if (layer == l.name)
+      return std::any_of(code.begin(), code.end(), [&](const Instruction &in) {
+        return in.op == l.op;
+      });
+  return false;
+}
+
+void Expression::evaluate(const HeightField &field,
+                          const ExpressionGrids &grids, int row, int col0,
+                          int cols, float *out,
+                          std::vector<float> &scratch) const {
+  const RasterGrid &grid = field.grid;
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  scratch.resize(static_cast<std::size_t>(registers) * BLOCK);
+  auto reg = [&](int r) { return r < 0 ? nullptr : &scratch[r * BLOCK]; };
+  const std::size_t first = static_cast<std::size_t>(row) * grid.width + col0;
+  const float *z = &field.z[first];
+
+  for (const Instruction &in : code) {
+    float *target = reg(in.target);
+    switch (in.op) {
+    case LOAD_Z:
+      std::copy(z, z + cols, target);
+      break;
+    case LOAD_SLOPE:
+    case LOAD_ASPECT:
+      for (int i = 0; i < cols; ++i) {
+        if (std::isnan(z[i])) {
+          target[i] = nan;
+          continue;
+        }
+        double gx, gy;
+        heightFieldGradient(field, row, col0 + i, gx, gy);
+        if (in.op == LOAD_SLOPE)
+          target[i] = static_cast<float>(std::atan(std::hypot(gx, gy)) * DEGREES);
+        else if (gx == 0 && gy == 0)
+          target[i] = nan;
+        else {
+          // Downhill direction, clockwise from north
+          double a = std::atan2(-gx, -gy) * DEGREES;
+          target[i] = static_cast<float>(a < 0 ? a + 360 : a);
+        }
+      }
+      break;
+    // Offsets from (minX, maxY), the compiler tracks the difference
+    case LOAD_X:
+      for (int i = 0; i < cols; ++i)
+        target[i] = static_cast<float>((col0 + i + 0.5) * grid.pixelSizeX);
+      break;
+    case LOAD_Y:
+      std::fill(target, target + cols,
+                static_cast<float>(-(row + 0.5) * grid.pixelSizeY));
+      break;
+    case LOAD_SOUNDINGS:
+    case LOAD_SHORE: {
+      const std::vector<float> &layer = in.op == LOAD_SOUNDINGS
+                                            ? grids.soundingDistance
+                                            : grids.shoreDistance;
+      if (layer.size() == field.z.size())
+        std::copy(&layer[first], &layer[first] + cols, target);
+      else
+        std::fill(target, target + cols, nan);
+      break;
+    }
+    case CONST:
+      std::fill(target, target + cols, static_cast<float>(in.value));
+      break;
+    case CONST_SHIFTED:
+      std::fill(target, target + cols,
+                static_cast<float>(in.value + in.kx * grid.minX +
+                                   in.ky * grid.maxY));
+      break;
+    case SHIFT: {
+      const double offset =
+          in.value + in.kx * grid.minX + in.ky * grid.maxY;
+      const float *a = reg(in.a);
+      for (int i = 0; i < cols; ++i)
+        target[i] = static_cast<float>(a[i] + offset);
+      break;
+    }
+    default:
+      apply(static_cast<Op>(in.op), cols, target, reg(in.a), reg(in.b),
+            reg(in.c));
+      break;
+    }
+  }
+  // Infinities (1 / 0, overflow) are empty, like NaN
+  const float *value = reg(result);
+  for (int i = 0; i < cols; ++i)
+    out[i] = std::isfinite(value[i]) ? value[i] : nan;
+}
+
+namespace {
+
+const int BAND_HEIGHT = 16;
+
+// Evaluates the rows [row0, row1) into values, width per row
+void evaluateBand(const Expression &expression, const HeightField &field,
+                  const ExpressionGrids &grids, int row0, int row1,
+                  float *values,
+                  std::vector<float> &scratch) {
+  const int width = field.grid.width;
+  for (int row = row0; row < row1; ++row)
+    for (int col = 0; col < width; col += Expression::BLOCK)
+      expression.evaluate(field, grids, row, col,
+                          std::min(Expression::BLOCK, width - col),
+                          values + static_cast<std::size_t>(row - row0) * width +
+                              col,
+                          scratch);
+}
+
+bool writeImage(const std::string &filename, const Expression &expression,
+                const HeightField &field, const ExpressionGrids &grids,
+                ThreadPool &pool, ExpressionStats &stats) {
+  const int width = field.grid.width, height = field.grid.height;
+  const int bandCount = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+  std::mutex mutex;
+
+  // First pass: the range of the values, for the colormap
+  stats.min = std::numeric_limits<double>::infinity();
+  stats.max = -stats.min;
+  progressBegin(Stage::Render, 2 * static_cast<std::size_t>(height), "lignes");
+  bool complete = pool.parallelFor(
+      0, bandCount, 1, [&](std::size_t band0, std::size_t band1) {
+        std::vector<float> values(static_cast<std::size_t>(BAND_HEIGHT) * width);
+        std::vector<float> scratch;
+        ExpressionStats local;
+        local.min = stats.min;
+        local.max = stats.max;
+        for (std::size_t band = band0; band < band1; ++band) {
+          int row0 = static_cast<int>(band) * BAND_HEIGHT;
+          int row1 = std::min(height, row0 + BAND_HEIGHT);
+          evaluateBand(expression, field, grids, row0, row1, values.data(),
+                       scratch);
+          for (std::size_t k = 0;
+               k < static_cast<std::size_t>(row1 - row0) * width; ++k)
+            if (!empty(values[k])) {
+              ++local.pixels;
+              local.min = std::min<double>(local.min, values[k]);
+              local.max = std::max<double>(local.max, values[k]);
+            }
+          progressAdvance(row1 - row0);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.pixels += local.pixels;
+        stats.min = std::min(stats.min, local.min);
+        stats.max = std::max(stats.max, local.max);
+      });
+  if (!complete) {
+    progressEnd();
+    return false;
+  }
+  if (stats.pixels == 0)
+    stats.min = stats.max = 0;
+  // A constant result takes the middle of the colormap
+  const double low = stats.max > stats.min ? stats.min : stats.min - 1;
+  const double high = stats.max > stats.min ? stats.max : stats.max + 1;
+
+  // Second pass: the bands colored and written as they are evaluated
+  PpmWriter writer;
+  if (!writer.open(filename, width, height)) {
+    progressEnd();
+    return false;
+  }
+  const std::size_t stride = static_cast<std::size_t>(width) * 3;
+  complete = pool.parallelFor(
+      0, bandCount, 1, [&](std::size_t band0, std::size_t band1) {
+        std::vector<float> values(static_cast<std::size_t>(BAND_HEIGHT) * width);
+        std::vector<unsigned char> pixels(BAND_HEIGHT * stride);
+        std::vector<float> scratch;
+        for (std::size_t band = band0; band < band1; ++band) {
+          int row0 = static_cast<int>(band) * BAND_HEIGHT;
+          int row1 = std::min(height, row0 + BAND_HEIGHT);
+          evaluateBand(expression, field, grids, row0, row1, values.data(),
+                       scratch);
+          for (std::size_t k = 0;
+               k < static_cast<std::size_t>(row1 - row0) * width; ++k) {
+            unsigned char *pixel = &pixels[3 * k];
+            if (empty(values[k])) {
+              pixel[0] = pixel[1] = pixel[2] = 0;
+              continue;
+            }
+            Color color = getColor(values[k], low, high);
+            pixel[0] = static_cast<unsigned char>(color.r);
+            pixel[1] = static_cast<unsigned char>(color.g);
+            pixel[2] = static_cast<unsigned char>(color.b);
+          }
+          writer.writeBlock(row0, row1 - row0, 0, width, pixels.data(),
+                            stride);
+          progressAdvance(row1 - row0);
+        }
+      });
+  progressEnd();
+  return writer.close() && complete;
+}
+
+bool writePoints(const std::string &filename, const Expression &expression,
+                 const HeightField &field, const ExpressionGrids &grids,
+                 ThreadPool &pool, ExpressionStats &stats) {
+  const RasterGrid &grid = field.grid;
+  const int width = grid.width, height = grid.height;
+  const int bandCount = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+  PointWriter writer;
+  if (!writer.open(filename, pointFormatFromPath(filename)))
+    return false;
+
+  // A few bands per thread at a time: evaluated in parallel, then
+  // projected back and written in order
+  const int batch = static_cast<int>(4 * pool.size());
+  std::vector<std::vector<Point>> bands(batch);
+  std::vector<Point> points;
+  stats.min = std::numeric_limits<double>::infinity();
+  stats.max = -stats.min;
+  bool ok = true;
+  progressBegin(Stage::Render, height, "lignes");
+  for (int first = 0; ok && first < bandCount; first += batch) {
+    const int count = std::min(batch, bandCount - first);
+    ok = pool.parallelFor(
+        0, count, 1, [&](std::size_t begin, std::size_t end) {
+          std::vector<float> values(static_cast<std::size_t>(BAND_HEIGHT) *
+                                    width);
+          std::vector<float> scratch;
+          for (std::size_t b = begin; b < end; ++b) {
+            int row0 = (first + static_cast<int>(b)) * BAND_HEIGHT;
+            int row1 = std::min(height, row0 + BAND_HEIGHT);
+            evaluateBand(expression, field, grids, row0, row1, values.data(),
+                         scratch);
+            std::vector<Point> &out = bands[b];
+            out.clear();
+            for (int row = row0; row < row1; ++row)
+              for (int col = 0; col < width; ++col) {
+                float v = values[static_cast<std::size_t>(row - row0) * width +
+                                 col];
+                if (!empty(v))
+                  out.push_back({grid.minX + (col + 0.5) * grid.pixelSizeX,
+                                 grid.maxY - (row + 0.5) * grid.pixelSizeY,
+                                 v});
+              }
+            progressAdvance(row1 - row0);
+          }
+        });
+    points.clear();
+    for (int b = 0; ok && b < count; ++b)
+      points.insert(points.end(), bands[b].begin(), bands[b].end());
+    for (const Point &p : points) {
+      stats.min = std::min(stats.min, p.z);
+      stats.max = std::max(stats.max, p.z);
+    }
+    stats.pixels += points.size();
+    ok = ok && deprojeterPoints(points, pool) && writer.write(points);
+  }
+  progressEnd();
+  if (stats.pixels == 0)
+    stats.min = stats.max = 0;
+  return writer.close() && ok;
+}
+
+} // namespace
+
+bool writeExpression(const std::string &filename, const Expression &expression,
+                     const HeightField &field, const ExpressionGrids &grids,
+                     ThreadPool &pool, ExpressionStats *stats) {
+  ExpressionStats counts;
+  StageTimer timer(Stage::Render);
+  const bool image = filename.size() >= 4 &&
+                     filename.compare(filename.size() - 4, 4, ".ppm") == 0;
+  bool ok = image
+                ? writeImage(filename, expression, field, grids, pool, counts)
+                : writePoints(filename, expression, field, grids, pool, counts);
+  if (stats)
+    *stats = counts;
+  return ok;
+}
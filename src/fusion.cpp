@@ -0,0 +1,196 @@
+/**
+ * @file fusion.cpp
+ * @brief Implementation of the fusion of several point sources.
+ */
+
+#include "fusion.hpp"
+#include "logging.hpp"
+#include "quadtree.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+namespace {
+
+// Key of the hash cell containing (x, y)
+std::uint64_t cellKey(double x, double y, double cellSize) {
+  auto cx = static_cast<std::int64_t>(std::floor(x / cellSize));
+  auto cy = static_cast<std::int64_t>(std::floor(y / cellSize));
+  return (static_cast<std::uint64_t>(cx) << 32) ^
+         static_cast<std::uint32_t>(cy);
+}
+
+BoundingBox boundsOf(const std::vector<Point> &points) {
+  const double inf = std::numeric_limits<double>::infinity();
+  BoundingBox b{inf, inf, -inf, -inf};
+  for (const Point &p : points) {
+    b.minX = std::min(b.minX, p.x);
+    b.minY = std::min(b.minY, p.y);
+    b.maxX = std::max(b.maxX, p.x);
+    b.maxY = std::max(b.maxY, p.y);
+  }
+  return b;
+}
+
+BoundingBox intersection(const BoundingBox &a, const BoundingBox &b) {
+  return {std::max(a.minX, b.minX), std::max(a.minY, b.minY),
+          std::min(a.maxX, b.maxX), std::min(a.maxY, b.maxY)};
+}
+
+bool parseNumber(const std::string &text, double &value) {
+  char *end = nullptr;
+  value = std::strtod(text.c_str(), &end);
+  return !text.empty() && *end == '\0';
+}
+
+} // namespace
+
+bool parseSourceSpec(const std::string &text, SourceSpec &spec) {
+  spec = SourceSpec();
+  spec.path = text;
+  // Up to two numeric fields after the last colons
+  double fields[2];
+  int count = 0;
+  while (count < 2) {
+    std::size_t colon = spec.path.rfind(':');
+    if (colon == std::string::npos ||
+        !parseNumber(spec.path.substr(colon + 1), fields[count]))
+      break;
+    spec.path.erase(colon);
+    ++count;
+  }
+  if (count == 2) {
+    spec.priority = static_cast<int>(fields[1]);
+    spec.quality = fields[0];
+  } else if (count == 1) {
+    spec.priority = static_cast<int>(fields[0]);
+  }
+  return !spec.path.empty() && spec.quality >= 0;
+}
+
+bool parseOverlapRule(const std::string &name, OverlapRule &out) {
+  if (name == "priority")
+    out = OverlapRule::Priority;
+  else if (name == "recency")
+    out = OverlapRule::Recency;
+  else
+    return false;
+  return true;
+}
+
+std::vector<Point> fuseSources(const std::vector<SourceSpec> &sources,
+                               const FusionOptions &options, ThreadPool &pool,
+                               std::vector<SourceStats> *stats) {
+  const std::size_t n = sources.size();
+  if (n == 0)
+    return {};
+  std::vector<std::vector<Point>> sets(n);
+  std::vector<BoundingBox> boxes(n);
+  if (stats)
+    stats->assign(n, SourceStats());
+
+  // Each load already spreads parsing and projection over the whole pool
+  for (std::size_t s = 0; s < n; ++s) {
+    logInfo() << "Source " << s + 1 << "/" << n << " : " << sources[s].path
+              << std::endl;
+    sets[s] = lireEtConvertir(sources[s].path, pool);
+    if (sets[s].empty()) {
+      logError() << "Aucun point lu dans " << sources[s].path << std::endl;
+      return {};
+    }
+    boxes[s] = boundsOf(sets[s]);
+    if (stats)
+      (*stats)[s].loaded = sets[s].size();
+  }
+
+  // Rank of each source, highest wins; an unknown quality loses ties
+  std::vector<std::size_t> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  if (options.rule == OverlapRule::Priority) {
+    auto accuracy = [&](std::size_t s) {
+      return sources[s].quality > 0 ? sources[s].quality
+                                    : std::numeric_limits<double>::infinity();
+    };
+    std::stable_sort(order.begin(), order.end(),
+                     [&](std::size_t a, std::size_t b) {
+                       if (sources[a].priority != sources[b].priority)
+                         return sources[a].priority < sources[b].priority;
+                       return accuracy(a) > accuracy(b);
+                     });
+  }
+  std::vector<std::uint32_t> rank(n);
+  for (std::size_t r = 0; r < n; ++r)
+    rank[order[r]] = static_cast<std::uint32_t>(r);
+
+  // Overlaps of each source with the others: only points inside one of
+  // them can be contested
+  std::vector<std::vector<BoundingBox>> overlaps(n);
+  for (std::size_t a = 0; a < n; ++a)
+    for (std::size_t b = 0; b < n; ++b)
+      if (a != b && boxes[a].intersects(boxes[b]))
+        overlaps[a].push_back(intersection(boxes[a], boxes[b]));
+  auto contested = [&](std::size_t s, const Point &p) {
+    for (const BoundingBox &o : overlaps[s])
+      if (o.contains(p.x, p.y))
+        return true;
+    return false;
+  };
+
+  // Best rank seen in each cell of the overlaps
+  const double cell = options.cellSize > 0 ? options.cellSize : 10.0;
+  std::unordered_map<std::uint64_t, std::uint32_t> best;
+  for (std::size_t s = 0; s < n; ++s) {
+    if (overlaps[s].empty())
+      continue;
+    for (const Point &p : sets[s]) {
+      if (!contested(s, p))
+        continue;
+      auto it = best.emplace(cellKey(p.x, p.y, cell), rank[s]).first;
+      it->second = std::max(it->second, rank[s]);
+    }
+  }
+
+  // Drop the points of cells won by another source, in parallel per source
+  std::vector<std::vector<char>> keep(n);
+  for (std::size_t s = 0; s < n; ++s) {
+    if (overlaps[s].empty())
+      continue;
+    const std::vector<Point> &pts = sets[s];
+    keep[s].assign(pts.size(), 1);
+    pool.parallelFor(0, pts.size(), 1 << 14,
+                     [&](std::size_t b, std::size_t e) {
+                       for (std::size_t i = b; i < e; ++i)
+                         if (contested(s, pts[i]) &&
+                             best.find(cellKey(pts[i].x, pts[i].y, cell))
+                                     ->second != rank[s])
+                           keep[s][i] = 0;
+                     });
+  }
+
+  std::size_t total = 0;
+  for (std::size_t s = 0; s < n; ++s) {
+    if (!keep[s].empty()) {
+      std::size_t next = 0;
+      for (std::size_t i = 0; i < sets[s].size(); ++i)
+        if (keep[s][i])
+          sets[s][next++] = sets[s][i];
+      if (stats)
+        (*stats)[s].dropped = sets[s].size() - next;
+      sets[s].resize(next);
+    }
+    total += sets[s].size();
+  }
+
+  std::vector<Point> fused = std::move(sets[0]);
+  fused.reserve(total);
+  for (std::size_t s = 1; s < n; ++s) {
+    fused.insert(fused.end(), sets[s].begin(), sets[s].end());
+    std::vector<Point>().swap(sets[s]);
+  }
+  return fused;
+}
@@ -0,0 +1,223 @@
+/**
+ * @file heightfield.cpp
+ * @brief Coloring and gap filling of per-pixel altitude grids.
+ */
+
+#include "heightfield.hpp"
+#include "image_io.hpp"
+#include "logging.hpp"
+#include "memory_policy.hpp"
+#include "profiling.hpp"
+#include "progress.hpp"
+#include "quadtree.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+namespace {
+
+// Slope along one axis from the neighbours before and after (NaN if absent)
+double slope(float before, float here, float after, double step) {
+  bool hasBefore = !std::isnan(before), hasAfter = !std::isnan(after);
+  if (hasBefore && hasAfter)
+    return (after - before) / (2 * step);
+  if (hasAfter)
+    return (after - here) / step;
+  if (hasBefore)
+    return (here - before) / step;
+  return 0;
+}
+
+} // namespace
+
+bool makeMeshField(const Mesh &mesh, int width, ThreadPool &pool,
+                   HeightField &field) {
+  RasterGrid grid;
+  if (!makeRasterGrid(mesh.points, width, grid)) {
+    logError() << "Dimensions du maillage invalides." << std::endl;
+    return false;
+  }
+
+  logInfo() << "Construction de QuadTree..." << std::endl;
+  QuadTree quadTree(grid.bounds);
+  {
+    StageTimer timer(Stage::Index);
+    progressBegin(Stage::Index, 0, "triangles");
+    quadTree.build(mesh.triangles, mesh.points, pool);
+    progressEnd();
+  }
+  logInfo() << "Générer les altitudes " << width << "x" << grid.height
+            << std::endl;
+
+  field.reset(grid);
+  const int BAND_HEIGHT = 16;
+  const int bandCount = (grid.height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+  StageTimer timer(Stage::Render);
+  progressBegin(Stage::Render, grid.height, "lignes");
+  bool complete = pool.parallelFor(
+      0, bandCount, 1, [&](std::size_t band0, std::size_t band1) {
+        for (std::size_t band = band0; band < band1; ++band) {
+          int row0 = static_cast<int>(band) * BAND_HEIGHT;
+          int row1 = std::min(grid.height, row0 + BAND_HEIGHT);
+          for (int row = row0; row < row1; ++row) {
+            double y = grid.maxY - (row + 0.5) * grid.pixelSizeY;
+            for (int col = 0; col < grid.width; ++col) {
+              double x = grid.minX + (col + 0.5) * grid.pixelSizeX;
+              auto triangleOpt = quadTree.find(x, y, mesh.points);
+              if (!triangleOpt)
+                continue;
+              const Triangle &t = *triangleOpt;
+              field.z[static_cast<std::size_t>(row) * grid.width + col] =
+                  static_cast<float>(interpolateZ(x, y, mesh.points[t.p1],
+                                                  mesh.points[t.p2],
+                                                  mesh.points[t.p3]));
+            }
+          }
+          progressAdvance(row1 - row0);
+        }
+      });
+  progressEnd();
+  if (!complete)
+    logError() << "Rendu annulé, aucune image écrite." << std::endl;
+  return complete;
+}
+
+void heightFieldGradient(const HeightField &field, int row, int col,
+                         double &gx, double &gy) {
+  const RasterGrid &grid = field.grid;
+  float z = field.at(row, col);
+  float west = col > 0 ? field.at(row, col - 1) : NAN;
+  float east = col + 1 < grid.width ? field.at(row, col + 1) : NAN;
+  float north = row > 0 ? field.at(row - 1, col) : NAN;
+  float south = row + 1 < grid.height ? field.at(row + 1, col) : NAN;
+  gx = slope(west, z, east, grid.pixelSizeX);
+  gy = slope(south, z, north, grid.pixelSizeY);
+}
+
+void shadeHeightField(const HeightField &field, int row0, int row1,
+                      unsigned char *out, std::size_t stride) {
+  const RasterGrid &grid = field.grid;
+  const int width = grid.width;
+  for (int row = row0; row < row1; ++row) {
+    unsigned char *pixel = out + (row - row0) * stride;
+    for (int col = 0; col < width; ++col, pixel += 3) {
+      float z = field.at(row, col);
+      if (std::isnan(z)) {
+        pixel[0] = pixel[1] = pixel[2] = 0;
+        continue;
+      }
+      double gx, gy;
+      heightFieldGradient(field, row, col, gx, gy);
+
+      // Facet through the pixel with that slope, vertices in the same
+      // turning order as the triangles of the mesh
+      Point p1{0, 0, 0}, p2{0, 1, gy}, p3{1, 0, gx};
+      Color color = getColor(z, grid.minZ, grid.maxZ);
+      double shade = calculateShade(p1, p2, p3);
+      pixel[0] = static_cast<unsigned char>(std::min(255.0, color.r * shade));
+      pixel[1] = static_cast<unsigned char>(std::min(255.0, color.g * shade));
+      pixel[2] = static_cast<unsigned char>(std::min(255.0, color.b * shade));
+    }
+  }
+}
+
+bool writeHeightFieldImage(const std::string &filename,
+                           const HeightField &field, ThreadPool &pool) {
+  const int width = field.grid.width, height = field.grid.height;
+  const int BAND_HEIGHT = 16;
+  const int bandCount = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+  const std::size_t stride = static_cast<std::size_t>(width) * 3;
+  LargeBuffer pixels(stride * height);
+  if (!pixels.data())
+    return false;
+
+  {
+    StageTimer timer(Stage::Render);
+    progressBegin(Stage::Render, height, "lignes");
+    bool complete = pool.parallelFor(
+        0, bandCount, 1, [&](std::size_t band0, std::size_t band1) {
+          for (std::size_t band = band0; band < band1; ++band) {
+            int row0 = static_cast<int>(band) * BAND_HEIGHT;
+            int row1 = std::min(height, row0 + BAND_HEIGHT);
+            shadeHeightField(field, row0, row1, pixels.data() + row0 * stride,
+                             stride);
+            progressAdvance(row1 - row0);
+          }
+        });
+    progressEnd();
+    if (!complete) {
+      logError() << "Rendu annulé, aucune image écrite." << std::endl;
+      return false;
+    }
+  }
+
+  StageTimer timer(Stage::Write);
+  PpmWriter writer;
+  if (!writer.open(filename, width, height) ||
+      !writer.writeBlock(0, height, 0, width, pixels.data(), stride) ||
+      !writer.close()) {
+    logError() << "Erreur d'écriture dans " << filename << std::endl;
+    return false;
+  }
+  logInfo() << "Image enregistrée dans " << filename << std::endl;
+  return true;
+}
+
+std::size_t fillGaps(HeightField &field, int radius) {
+  if (radius <= 0)
+    return 0;
+  const int width = field.grid.width, height = field.grid.height;
+  const std::int64_t NONE = -1;
+
+  // Nearest filled pixel found so far, as a pixel index
+  std::vector<std::int64_t> nearest(field.z.size(), NONE);
+  for (std::size_t i = 0; i < field.z.size(); ++i)
+    if (!std::isnan(field.z[i]))
+      nearest[i] = static_cast<std::int64_t>(i);
+
+  auto distSq = [&](int row, int col, std::int64_t seed) {
+    std::int64_t dr = row - seed / width, dc = col - seed % width;
+    return dr * dr + dc * dc;
+  };
+  auto scan = [&](int row, int col, const int (*offsets)[2]) {
+    std::int64_t &best = nearest[static_cast<std::size_t>(row) * width + col];
+    std::int64_t bestDist = best == NONE ? INT64_MAX : distSq(row, col, best);
+    for (int k = 0; k < 4; ++k) {
+      int r = row + offsets[k][0], c = col + offsets[k][1];
+      if (r < 0 || r >= height || c < 0 || c >= width)
+        continue;
+      std::int64_t seed = nearest[static_cast<std::size_t>(r) * width + c];
+      if (seed == NONE)
+        continue;
+      std::int64_t d = distSq(row, col, seed);
+      if (d < bestDist) {
+        best = seed;
+        bestDist = d;
+      }
+    }
+  };
+
+  static const int before[4][2] = {{-1, -1}, {-1, 0}, {-1, 1}, {0, -1}};
+  static const int after[4][2] = {{1, 1}, {1, 0}, {1, -1}, {0, 1}};
+  for (int row = 0; row < height; ++row)
+    for (int col = 0; col < width; ++col)
+      scan(row, col, before);
+  for (int row = height - 1; row >= 0; --row)
+    for (int col = width - 1; col >= 0; --col)
+      scan(row, col, after);
+
+  const std::int64_t limit = static_cast<std::int64_t>(radius) * radius;
+  std::size_t filled = 0;
+  for (int row = 0; row < height; ++row)
+    for (int col = 0; col < width; ++col) {
+      std::size_t i = static_cast<std::size_t>(row) * width + col;
+      std::int64_t seed = nearest[i];
+      if (std::isnan(field.z[i]) && seed != NONE &&
+          distSq(row, col, seed) <= limit) {
+        field.z[i] = field.z[seed];
+        ++filled;
+      }
+    }
+  return filled;
+}
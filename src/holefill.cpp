@@ -0,0 +1,366 @@
+/**
+ * @file holefill.cpp
+ * @brief Membrane filling of the holes of a height field.
+ */
+
+#include "holefill.hpp"
+#include "progress.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+// Largest correction (m) a Jacobi step would still make once solved
+const double TOLERANCE = 1e-3;
+const int MAX_ITERATIONS = 100;
+// Gauss-Seidel sweeps before and after the coarse correction of a V-cycle
+const int SWEEPS = 2;
+// Over-relaxed sweep pairs solving the coarsest level
+const int COARSEST_SWEEPS = 20;
+const double OMEGA = 1.5;
+// A level is not coarsened further once this small
+const int COARSEST_SIZE = 8;
+
+// Empty region surrounded by data; its pixels are pixels[first, last)
+struct Hole {
+  std::size_t first, last;
+  int row0, row1, col0, col1; // Bounding box, last row/column excluded
+};
+
+// One grid of the multigrid pyramid over a hole's window. Each unknown
+// cell k satisfies d[k] u[k] - (sum of w u over its unknown neighbours) =
+// f[k], w being east[] towards k + 1 and south[] towards k + width. On the
+// finest level d counts the present neighbours (the altitudes of the known
+// ones are in f): the mean of the neighbours, with a free edge where data
+// is missing. Coarser levels solve for a correction, with the Galerkin
+// operator: d and w summed over the 2 x 2 children. Unknown cells are never
+// on the edge of their level, so their 4 neighbours always exist
+struct Level {
+  int width = 0, height = 0;
+  std::vector<double> u, f, d, inverse; // inverse = 1 / d
+  std::vector<float> east, south;
+  // Indices of the unknown cells, those with an even row + column first:
+  // neighbours always have different colors, so that each color relaxes
+  // without depending on itself
+  std::vector<std::uint32_t> cells;
+  std::size_t red = 0;                // Number of even cells
+  std::vector<std::uint32_t> parents; // Cells of the next level, per cell
+};
+
+// Orders the unknown cells by color and computes the inverse diagonal
+void prepare(Level &level) {
+  const std::uint32_t width = level.width;
+  auto even = [&](std::uint32_t k) { return (k / width + k % width) % 2 == 0; };
+  level.red = std::stable_partition(level.cells.begin(), level.cells.end(),
+                                    even) -
+              level.cells.begin();
+  level.inverse.assign(level.d.size(), 0.0);
+  for (std::uint32_t k : level.cells)
+    level.inverse[k] = 1 / level.d[k];
+}
+
+// Weighted sum of v over the unknown neighbours of cell k
+inline double neighbourSum(const Level &level, const std::vector<double> &v,
+                           std::size_t k) {
+  const std::size_t width = level.width;
+  return level.east[k - 1] * v[k - 1] + level.east[k] * v[k + 1] +
+         level.south[k - width] * v[k - width] + level.south[k] * v[k + width];
+}
+
+// Relaxes the cells [begin, end) of one color
+void relaxColor(Level &level, std::size_t begin, std::size_t end,
+                double omega) {
+  for (std::size_t i = begin; i < end; ++i) {
+    std::uint32_t k = level.cells[i];
+    double target =
+        (level.f[k] + neighbourSum(level, level.u, k)) * level.inverse[k];
+    level.u[k] += omega * (target - level.u[k]);
+  }
+}
+
+// Red-black Gauss-Seidel sweeps, over-relaxed if omega > 1; backward
+// sweeps (black first) make the V-cycle symmetric, as conjugate gradients
+// require
+void relax(Level &level, int sweeps, double omega, bool backward) {
+  const std::size_t n = level.cells.size();
+  for (int sweep = 0; sweep < sweeps; ++sweep) {
+    relaxColor(level, backward ? level.red : 0, backward ? n : level.red,
+               omega);
+    relaxColor(level, backward ? 0 : level.red, backward ? level.red : n,
+               omega);
+  }
+}
+
+// Next level of the pyramid: a cell is unknown if one of its children is.
+// Fine cell (row, col) falls in coarse cell ((row + 1) / 2, (col + 1) / 2),
+// which keeps the edge of the coarse level free
+Level coarsen(Level &fine) {
+  Level coarse;
+  coarse.width = (fine.width + 1) / 2 + 1;
+  coarse.height = (fine.height + 1) / 2 + 1;
+  std::size_t size = static_cast<std::size_t>(coarse.width) * coarse.height;
+  coarse.u.assign(size, 0.0);
+  coarse.f.assign(size, 0.0);
+  coarse.d.assign(size, 0.0);
+  coarse.east.assign(size, 0.0f);
+  coarse.south.assign(size, 0.0f);
+  const std::size_t width = fine.width;
+  auto parent = [&](std::size_t k) {
+    return static_cast<std::uint32_t>((k / width + 1) / 2 * coarse.width +
+                                      (k % width + 1) / 2);
+  };
+  std::vector<std::uint8_t> unknown(size, 0);
+  fine.parents.resize(fine.cells.size());
+  for (std::size_t i = 0; i < fine.cells.size(); ++i) {
+    std::uint32_t k = fine.cells[i], p = parent(k);
+    fine.parents[i] = p;
+    unknown[p] = 1;
+    coarse.d[p] += fine.d[k];
+    // Couplings inside a coarse cell leave its diagonal, counted from both
+    // sides; the others add to the coupling of the coarse cells
+    if (fine.east[k] != 0) {
+      if (parent(k + 1) == p)
+        coarse.d[p] -= 2 * fine.east[k];
+      else
+        coarse.east[p] += fine.east[k];
+    }
+    if (fine.south[k] != 0) {
+      if (parent(k + width) == p)
+        coarse.d[p] -= 2 * fine.south[k];
+      else
+        coarse.south[p] += fine.south[k];
+    }
+  }
+  for (std::size_t k = 0; k < size; ++k)
+    if (unknown[k])
+      coarse.cells.push_back(static_cast<std::uint32_t>(k));
+  prepare(coarse);
+  return coarse;
+}
+
+// One V-cycle from level l, for u starting at zero: relax, solve for the
+// error of the residual on the coarser levels, add it back constant over
+// the children, relax in the other direction
+void vCycle(std::vector<Level> &levels, std::size_t l) {
+  Level &level = levels[l];
+  if (l + 1 == levels.size()) {
+    for (int sweep = 0; sweep < COARSEST_SWEEPS; ++sweep) {
+      relax(level, 1, OMEGA, false);
+      relax(level, 1, OMEGA, true);
+    }
+    return;
+  }
+  relax(level, SWEEPS, 1.0, false);
+  Level &coarse = levels[l + 1];
+  for (std::uint32_t k : coarse.cells)
+    coarse.u[k] = coarse.f[k] = 0;
+  for (std::size_t i = 0; i < level.cells.size(); ++i) {
+    std::uint32_t k = level.cells[i];
+    coarse.f[level.parents[i]] += level.f[k] +
+                                  neighbourSum(level, level.u, k) -
+                                  level.d[k] * level.u[k];
+  }
+  vCycle(levels, l + 1);
+  for (std::size_t i = 0; i < level.cells.size(); ++i)
+    level.u[level.cells[i]] += coarse.u[level.parents[i]];
+  relax(level, SWEEPS, 1.0, true);
+}
+
+// Solves one hole; its altitudes go to values[first, last), in the order
+// of its pixels
+void solveHole(const HeightField &field, const Hole &hole,
+               const std::vector<std::size_t> &pixels,
+               std::vector<float> &values) {
+  const int gridWidth = field.grid.width;
+  // Window: the bounding box and the ring of data around it
+  const int row0 = hole.row0 - 1, col0 = hole.col0 - 1;
+  std::vector<Level> levels(1);
+  Level &base = levels[0];
+  base.width = hole.col1 - hole.col0 + 2;
+  base.height = hole.row1 - hole.row0 + 2;
+  std::size_t size = static_cast<std::size_t>(base.width) * base.height;
+  base.u.resize(size);
+  base.f.assign(size, 0.0);
+  base.d.assign(size, 0.0);
+  base.east.assign(size, 0.0f);
+  base.south.assign(size, 0.0f);
+  std::vector<std::uint8_t> unknown(size, 0);
+  std::vector<std::uint32_t> order; // Cells in the order of the pixels
+  double sum = 0;
+  std::size_t known = 0;
+  for (int row = 0; row < base.height; ++row)
+    for (int col = 0; col < base.width; ++col) {
+      float z = field.at(row0 + row, col0 + col);
+      base.u[static_cast<std::size_t>(row) * base.width + col] = z;
+      if (!std::isnan(z))
+        sum += z, ++known;
+    }
+  for (std::size_t i = hole.first; i < hole.last; ++i) {
+    int row = static_cast<int>(pixels[i] / gridWidth) - row0;
+    int col = static_cast<int>(pixels[i] % gridWidth) - col0;
+    std::uint32_t k = static_cast<std::uint32_t>(row) * base.width + col;
+    unknown[k] = 1;
+    order.push_back(k);
+  }
+
+  // The 4 neighbours of a hole pixel are in the hole or known: a missing
+  // one would belong to the same hole
+  const std::size_t width = base.width;
+  for (std::uint32_t k : order) {
+    const std::size_t around[4] = {k - 1, k + 1, k - width, k + width};
+    for (std::size_t j : around) {
+      base.d[k] += 1;
+      if (!unknown[j])
+        base.f[k] += base.u[j];
+    }
+    if (unknown[k + 1])
+      base.east[k] = 1;
+    if (unknown[k + width])
+      base.south[k] = 1;
+  }
+  std::fill(base.u.begin(), base.u.end(), 0.0);
+  base.cells = order;
+  prepare(base);
+
+  while (std::max(levels.back().width, levels.back().height) >
+             COARSEST_SIZE &&
+         levels.back().cells.size() > 1)
+    levels.push_back(coarsen(levels.back()));
+
+  // Conjugate gradients on the finest level, preconditioned by a V-cycle
+  // (with u and f of the finest level as its output and input), starting
+  // from the mean of the altitudes around
+  Level &finest = levels[0];
+  const std::vector<std::uint32_t> &cells = finest.cells;
+  std::vector<double> x(size, 0.0), r(size, 0.0), p(size, 0.0), q(size, 0.0);
+  for (std::uint32_t k : cells)
+    x[k] = known > 0 ? sum / known : 0;
+  for (std::uint32_t k : cells)
+    r[k] = finest.f[k] + neighbourSum(finest, x, k) - finest.d[k] * x[k];
+  auto precondition = [&]() {
+    std::fill(finest.u.begin(), finest.u.end(), 0.0);
+    for (std::uint32_t k : cells)
+      finest.f[k] = r[k];
+    vCycle(levels, 0);
+    double rz = 0;
+    for (std::uint32_t k : cells)
+      rz += r[k] * finest.u[k];
+    return rz;
+  };
+  double rz = precondition();
+  for (std::uint32_t k : cells)
+    p[k] = finest.u[k];
+  for (int iteration = 0; iteration < MAX_ITERATIONS; ++iteration) {
+    double pq = 0;
+    for (std::uint32_t k : cells) {
+      q[k] = finest.d[k] * p[k] - neighbourSum(finest, p, k);
+      pq += p[k] * q[k];
+    }
+    if (!(pq > 0))
+      break;
+    double alpha = rz / pq, largest = 0;
+    for (std::uint32_t k : cells) {
+      x[k] += alpha * p[k];
+      r[k] -= alpha * q[k];
+      largest = std::max(largest, std::abs(r[k]) / finest.d[k]);
+    }
+    if (largest < TOLERANCE)
+      break;
+    double next = precondition();
+    for (std::uint32_t k : cells)
+      p[k] = finest.u[k] + next / rz * p[k];
+    rz = next;
+  }
+
+  for (std::size_t i = hole.first; i < hole.last; ++i)
+    values[i] = static_cast<float>(x[order[i - hole.first]]);
+}
+
+} // namespace
+
+bool fillHoles(HeightField &field, double maxArea, ThreadPool &pool,
+               HoleFillStats *stats) {
+  const int width = field.grid.width, height = field.grid.height;
+  const double pixelArea = field.grid.pixelSizeX * field.grid.pixelSizeY;
+  const std::size_t maxPixels =
+      static_cast<std::size_t>(std::max(0.0, maxArea / pixelArea));
+  HoleFillStats found;
+
+  // Empty regions, by flood fill; those reaching the edge or too large are
+  // traversed to the end but not kept
+  std::vector<Hole> holes;
+  std::vector<std::size_t> pixels;
+  std::vector<bool> visited(field.z.size(), false);
+  std::vector<std::size_t> stack;
+  progressBegin(Stage::Render, height, "lignes");
+  for (int startRow = 0; startRow < height; ++startRow) {
+    for (int startCol = 0; startCol < width; ++startCol) {
+      std::size_t start = static_cast<std::size_t>(startRow) * width + startCol;
+      if (visited[start] || !std::isnan(field.z[start]))
+        continue;
+      Hole hole{pixels.size(), 0, startRow, startRow + 1, startCol,
+                startCol + 1};
+      bool edge = false;
+      std::size_t count = 0;
+      visited[start] = true;
+      stack.assign(1, start);
+      while (!stack.empty()) {
+        std::size_t k = stack.back();
+        stack.pop_back();
+        int row = static_cast<int>(k / width), col = static_cast<int>(k % width);
+        if (row == 0 || row == height - 1 || col == 0 || col == width - 1)
+          edge = true;
+        if (!edge && ++count <= maxPixels) {
+          pixels.push_back(k);
+          hole.row0 = std::min(hole.row0, row);
+          hole.row1 = std::max(hole.row1, row + 1);
+          hole.col0 = std::min(hole.col0, col);
+          hole.col1 = std::max(hole.col1, col + 1);
+        }
+        auto push = [&](std::size_t next) {
+          if (!visited[next] && std::isnan(field.z[next])) {
+            visited[next] = true;
+            stack.push_back(next);
+          }
+        };
+        if (col > 0)
+          push(k - 1);
+        if (col + 1 < width)
+          push(k + 1);
+        if (row > 0)
+          push(k - width);
+        if (row + 1 < height)
+          push(k + width);
+      }
+      if (!edge && count <= maxPixels) {
+        hole.last = pixels.size();
+        holes.push_back(hole);
+        found.pixels += count;
+      } else {
+        pixels.resize(hole.first);
+        // The area outside the survey is not a hole
+        if (!edge)
+          ++found.skipped;
+      }
+    }
+    progressAdvance(1);
+  }
+  progressEnd();
+  found.filled = holes.size();
+
+  std::vector<float> values(pixels.size());
+  bool complete =
+      pool.parallelFor(0, holes.size(), 1, [&](std::size_t h0, std::size_t h1) {
+        for (std::size_t h = h0; h < h1; ++h)
+          solveHole(field, holes[h], pixels, values);
+      });
+  if (!complete)
+    return false;
+  for (std::size_t i = 0; i < pixels.size(); ++i)
+    field.z[pixels[i]] = values[i];
+  if (stats)
+    *stats = found;
+  return true;
+}
@@ -0,0 +1,143 @@
+/**
+ * @file idw.cpp
+ * @brief Implementation of the inverse-distance-weighting engine.
+ */
+
+#include "idw.hpp"
+#include "logging.hpp"
+#include "profiling.hpp"
+#include "progress.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+const int TILE_SIZE = 64;
+const int BLOCK_SIZE = 8;
+
+// Closer than this, a point gives its own altitude (avoids 1 / 0)
+const double EPSILON_SQ = 1e-12;
+
+} // namespace
+
+bool idwGrid(const KdTree &tree, HeightField &field, const IdwOptions &options,
+             ThreadPool &pool) {
+  const RasterGrid &grid = field.grid;
+  const int tilesX = (grid.width + TILE_SIZE - 1) / TILE_SIZE;
+  const int tilesY = (grid.height + TILE_SIZE - 1) / TILE_SIZE;
+  const double radiusSq = options.radius * options.radius;
+  const double halfPower = options.power / 2;
+  const std::vector<Point> &points = tree.points();
+
+  return pool.parallelFor(
+      0, static_cast<std::size_t>(tilesX) * tilesY, 1,
+      [&](std::size_t t0, std::size_t t1) {
+        std::vector<KdTree::Neighbour> found;
+        for (std::size_t t = t0; t < t1; ++t) {
+          int tileCol = static_cast<int>(t % tilesX) * TILE_SIZE;
+          int tileRow = static_cast<int>(t / tilesX) * TILE_SIZE;
+          int tileCol1 = std::min(grid.width, tileCol + TILE_SIZE);
+          int tileRow1 = std::min(grid.height, tileRow + TILE_SIZE);
+
+          // Previous query point and its farthest neighbour (-1 if it had
+          // fewer than k)
+          double prevX = 0, prevY = 0, previous = -1;
+          for (int row0 = tileRow; row0 < tileRow1; row0 += BLOCK_SIZE)
+            for (int col0 = tileCol; col0 < tileCol1; col0 += BLOCK_SIZE) {
+              int row1 = std::min(tileRow1, row0 + BLOCK_SIZE);
+              int col1 = std::min(tileCol1, col0 + BLOCK_SIZE);
+
+              // A block with no point within the radius of its corners is
+              // skipped with a single query from its center
+              double cx = grid.minX + 0.5 * (col0 + col1) * grid.pixelSizeX;
+              double cy = grid.maxY - 0.5 * (row0 + row1) * grid.pixelSizeY;
+              double reach = options.radius +
+                             0.5 * std::hypot((col1 - col0) * grid.pixelSizeX,
+                                              (row1 - row0) * grid.pixelSizeY);
+              tree.nearest(cx, cy, 1, reach * reach, found);
+              if (found.empty())
+                continue;
+
+              for (int row = row0; row < row1; ++row) {
+                bool forward = (row - row0) % 2 == 0;
+                for (int n = 0; n < col1 - col0; ++n) {
+                  int col = forward ? col0 + n : col1 - 1 - n;
+                  double x = grid.minX + (col + 0.5) * grid.pixelSizeX;
+                  double y = grid.maxY - (row + 0.5) * grid.pixelSizeY;
+                  double limit = radiusSq;
+                  if (previous >= 0) {
+                    double r = previous + std::hypot(x - prevX, y - prevY);
+                    limit = std::min(limit, r * r);
+                  }
+                  tree.nearest(x, y, options.neighbours, limit, found);
+                  prevX = x;
+                  prevY = y;
+                  previous =
+                      static_cast<int>(found.size()) == options.neighbours
+                          ? std::sqrt(found.front().distSq)
+                          : -1;
+                  if (found.empty())
+                    continue;
+
+                  double weights = 0, sum = 0;
+                  for (const KdTree::Neighbour &nb : found) {
+                    if (nb.distSq < EPSILON_SQ) {
+                      sum = points[nb.index].z;
+                      weights = 1;
+                      break;
+                    }
+                    double w = 1.0 / std::pow(nb.distSq, halfPower);
+                    weights += w;
+                    sum += w * points[nb.index].z;
+                  }
+                  field.z[static_cast<std::size_t>(row) * grid.width + col] =
+                      static_cast<float>(sum / weights);
+                }
+              }
+            }
+          if (tileCol == 0)
+            progressAdvance(tileRow1 - tileRow);
+        }
+      });
+}
+
+bool makeIdwField(std::vector<Point> points, int width,
+                  const IdwOptions &options, ThreadPool &pool,
+                  HeightField &field) {
+  RasterGrid grid;
+  if (!makeRasterGrid(points, width, grid)) {
+    logError() << "Dimensions de la grille invalides." << std::endl;
+    return false;
+  }
+
+  logInfo() << "Construction du k-d tree..." << std::endl;
+  KdTree tree;
+  {
+    StageTimer timer(Stage::Index);
+    tree.build(std::move(points), pool);
+  }
+
+  logInfo() << "Générer une image " << width << "x" << grid.height
+            << " par pondération inverse à la distance (" << options.neighbours
+            << " voisins)" << std::endl;
+  field.reset(grid);
+  bool complete;
+  {
+    StageTimer timer(Stage::Render);
+    progressBegin(Stage::Render, grid.height, "lignes");
+    complete = idwGrid(tree, field, options, pool);
+    progressEnd();
+  }
+  if (!complete)
+    logError() << "Rendu annulé, aucune image écrite." << std::endl;
+  return complete;
+}
+
+void generateIdwImage(const std::string &filename, int width,
+                      std::vector<Point> points, const IdwOptions &options,
+                      ThreadPool &pool) {
+  HeightField field;
+  if (makeIdwField(std::move(points), width, options, pool, field))
+    writeHeightFieldImage(filename, field, pool);
+}
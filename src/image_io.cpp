@@ -0,0 +1,292 @@
+/**
+ * @file image_io.cpp
+ * @brief Implementation of PPM image reading and writing.
+ */
+
+#include "image_io.hpp"
+#include "logging.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+namespace {
+
+// Skips whitespace and '#' comments between PPM header fields
+void skipSeparators(std::istream &is) {
+  while (is) {
+    int c = is.peek();
+    if (c == '#') {
+      std::string comment;
+      std::getline(is, comment);
+    } else if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+      is.get();
+    } else {
+      break;
+    }
+  }
+}
+
+// Writes length bytes at offset, looping over short writes
+bool pwriteAll(int fd, const unsigned char *data, std::size_t length,
+               off_t offset) {
+  std::size_t done = 0;
+  while (done < length) {
+    ssize_t n = ::pwrite(fd, data + done, length - done, offset + done);
+    if (n <= 0)
+      return false;
+    done += static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+const char *const PART_TAG = "terrain-part";
+
+} // namespace
+
+bool readPPM(const std::string &filename, Image &image) {
+  std::ifstream ifs(filename, std::ios::binary);
+  if (!ifs) {
+    logError() << "Impossible d'ouvrir l'image " << filename << std::endl;
+    return false;
+  }
+
+  std::string magic;
+  int maxValue = 0;
+  ifs >> magic;
+  skipSeparators(ifs);
+  ifs >> image.width;
+  skipSeparators(ifs);
+  ifs >> image.height;
+  skipSeparators(ifs);
+  ifs >> maxValue;
+  ifs.get(); // Single whitespace before the raster
+
+  if (!ifs || magic != "P6" || maxValue != 255 || image.width <= 0 ||
+      image.height <= 0) {
+    logError() << "Format PPM non supporté : " << filename << std::endl;
+    return false;
+  }
+
+  image.pixels.resize(static_cast<std::size_t>(image.width) * image.height * 3);
+  ifs.read(reinterpret_cast<char *>(image.pixels.data()), image.pixels.size());
+  return static_cast<std::size_t>(ifs.gcount()) == image.pixels.size();
+}
+
+bool writePPM(const std::string &filename, const Image &image) {
+  std::ofstream ofs(filename, std::ios::binary);
+  if (!ofs) {
+    logError() << "Impossible de créer l'image " << filename << std::endl;
+    return false;
+  }
+  ofs << "P6\n" << image.width << " " << image.height << "\n255\n";
+  ofs.write(reinterpret_cast<const char *>(image.pixels.data()),
+            image.pixels.size());
+  return static_cast<bool>(ofs);
+}
+
+PpmWriter::~PpmWriter() { close(); }
+
+bool PpmWriter::open(const std::string &filename, int w, int h,
+                     const std::string &comment, bool keep) {
+  close();
+  failed = false;
+  width = w;
+  height = h;
+  fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | (keep ? 0 : O_TRUNC),
+              0644);
+  if (fd < 0) {
+    logError() << "Impossible de créer l'image " << filename << std::endl;
+    return false;
+  }
+
+  std::string header = "P6\n";
+  if (!comment.empty())
+    header += "# " + comment + "\n";
+  header += std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+  headerSize = header.size();
+  off_t total = static_cast<off_t>(headerSize) +
+                static_cast<off_t>(width) * height * 3;
+  if (::pwrite(fd, header.data(), header.size(), 0) !=
+          static_cast<ssize_t>(header.size()) ||
+      ::ftruncate(fd, total) != 0) {
+    logError() << "Erreur d'écriture dans " << filename << std::endl;
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool PpmWriter::writeBlock(int row0, int rows, int col0, int cols,
+                           const unsigned char *pixels, std::size_t stride) {
+  if (fd < 0)
+    return false;
+  std::size_t length = static_cast<std::size_t>(cols) * 3;
+  off_t start = static_cast<off_t>(headerSize) +
+                (static_cast<off_t>(row0) * width + col0) * 3;
+
+  // Full-width rows are contiguous in the file: a single write
+  if (col0 == 0 && cols == width && stride == length) {
+    if (!pwriteAll(fd, pixels, length * rows, start)) {
+      failed = true;
+      return false;
+    }
+    return true;
+  }
+
+  for (int r = 0; r < rows; ++r) {
+    off_t offset = start + static_cast<off_t>(r) * width * 3;
+    if (!pwriteAll(fd, pixels + r * stride, length, offset)) {
+      failed = true;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool PpmWriter::sync() {
+  if (fd < 0 || ::fdatasync(fd) != 0)
+    failed = true;
+  return !failed;
+}
+
+bool PpmWriter::close() {
+  if (fd < 0)
+    return !failed;
+  if (::close(fd) != 0)
+    failed = true;
+  fd = -1;
+  return !failed;
+}
+
+std::string ppmPartComment(int row0, int height) {
+  return std::string(PART_TAG) + " " + std::to_string(row0) + " " +
+         std::to_string(height);
+}
+
+bool readPpmPart(const std::string &filename, PpmPart &part) {
+  std::ifstream ifs(filename, std::ios::binary);
+  if (!ifs) {
+    logError() << "Impossible d'ouvrir la partie " << filename << std::endl;
+    return false;
+  }
+
+  // "P6", the tag comment, then the usual size and maximum value
+  std::string magic, comment;
+  int maxValue = 0;
+  std::getline(ifs, magic);
+  std::getline(ifs, comment);
+  std::istringstream tag(comment);
+  std::string hash, name;
+  tag >> hash >> name >> part.row0 >> part.height;
+  ifs >> part.width >> part.rows >> maxValue;
+  ifs.get();
+
+  if (!ifs || !tag || magic != "P6" || hash != "#" || name != PART_TAG ||
+      maxValue != 255 || part.width <= 0 || part.rows < 0 || part.row0 < 0 ||
+      part.row0 + part.rows > part.height) {
+    logError() << "Ce fichier n'est pas une partie d'image : " << filename
+               << std::endl;
+    return false;
+  }
+  part.dataOffset = static_cast<std::size_t>(ifs.tellg());
+  return true;
+}
+
+bool mergePpmParts(const std::string &output,
+                   const std::vector<std::string> &parts, ThreadPool &pool) {
+  std::vector<PpmPart> headers(parts.size());
+  for (std::size_t i = 0; i < parts.size(); ++i)
+    if (!readPpmPart(parts[i], headers[i]))
+      return false;
+  if (headers.empty()) {
+    logError() << "Aucune partie à assembler." << std::endl;
+    return false;
+  }
+
+  // Same image everywhere, and every row exactly once
+  std::vector<std::size_t> order(parts.size());
+  for (std::size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+    return headers[a].row0 < headers[b].row0;
+  });
+  const int width = headers[0].width;
+  const int height = headers[0].height;
+  int next = 0;
+  for (std::size_t i : order) {
+    const PpmPart &part = headers[i];
+    if (part.width != width || part.height != height) {
+      logError() << "Taille d'image différente dans " << parts[i] << std::endl;
+      return false;
+    }
+    if (part.rows == 0)
+      continue;
+    if (part.row0 != next) {
+      logError() << (part.row0 > next ? "Lignes manquantes : "
+                                      : "Lignes en double : ")
+                 << std::min(next, part.row0) << " à "
+                 << std::max(next, part.row0) - 1 << std::endl;
+      return false;
+    }
+    next = part.row0 + part.rows;
+  }
+  if (next != height) {
+    logError() << "Lignes manquantes : " << next << " à " << height - 1
+               << std::endl;
+    return false;
+  }
+
+  PpmWriter writer;
+  if (!writer.open(output, width, height))
+    return false;
+
+  // Copy by slabs of rows so that memory stays bounded
+  const std::size_t rowBytes = static_cast<std::size_t>(width) * 3;
+  const int slabRows =
+      std::max<int>(1, static_cast<int>((std::size_t(16) << 20) / rowBytes));
+  std::atomic<bool> ok{true};
+  pool.parallelFor(0, parts.size(), 1, [&](std::size_t b, std::size_t e) {
+    std::vector<unsigned char> slab;
+    for (std::size_t i = b; i < e && ok; ++i) {
+      const PpmPart &part = headers[i];
+      int fd = ::open(parts[i].c_str(), O_RDONLY);
+      if (fd < 0) {
+        ok = false;
+        break;
+      }
+      for (int r = 0; r < part.rows && ok; r += slabRows) {
+        int rows = std::min(slabRows, part.rows - r);
+        std::size_t length = rowBytes * rows;
+        slab.resize(length);
+        off_t offset = static_cast<off_t>(part.dataOffset) +
+                       static_cast<off_t>(r) * rowBytes;
+        std::size_t done = 0;
+        while (done < length) {
+          ssize_t n = ::pread(fd, slab.data() + done, length - done,
+                              offset + done);
+          if (n <= 0)
+            break;
+          done += static_cast<std::size_t>(n);
+        }
+        if (done < length ||
+            !writer.writeBlock(part.row0 + r, rows, 0, width, slab.data(),
+                               rowBytes))
+          ok = false;
+      }
+      ::close(fd);
+    }
+  });
+
+  if (!writer.close() || !ok) {
+    logError() << "Erreur lors de l'assemblage de " << output << std::endl;
+    return false;
+  }
+  logInfo() << "Image assemblée dans " << output << " (" << parts.size()
+            << " parties)" << std::endl;
+  return true;
+}
@@ -0,0 +1,136 @@
+/**
+ * @file kdtree.cpp
+ * @brief Implementation of the static k-d tree.
+ */
+
+#include "kdtree.hpp"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+// Ranges this small are scanned instead of split
+const std::size_t LEAF_SIZE = 8;
+
+// Subtrees at least this large are built as tasks
+const std::size_t PARALLEL_THRESHOLD = 1 << 15;
+
+bool closer(const KdTree::Neighbour &a, const KdTree::Neighbour &b) {
+  return a.distSq < b.distSq;
+}
+
+} // namespace
+
+void KdTree::build(std::vector<Point> points, ThreadPool &pool,
+                   bool keepOrder) {
+  pts = std::move(points);
+  axis.assign(pts.size(), 0);
+  ids.clear();
+  if (!keepOrder) {
+    buildRange(0, pts.size(), pool);
+    return;
+  }
+
+  // Indices are partitioned, the points stay in input order until the end
+  ids.resize(pts.size());
+  std::iota(ids.begin(), ids.end(), 0);
+  buildRange(0, pts.size(), pool);
+  std::vector<Point> sorted(pts.size());
+  pool.parallelFor(0, pts.size(), 1 << 16, [&](std::size_t b, std::size_t e) {
+    for (std::size_t i = b; i < e; ++i)
+      sorted[i] = pts[ids[i]];
+  });
+  pts.swap(sorted);
+}
+
+void KdTree::buildRange(std::size_t begin, std::size_t end, ThreadPool &pool) {
+  if (end - begin <= LEAF_SIZE)
+    return;
+
+  // Point at tree position i, through the indices while they are kept
+  auto at = [this](std::size_t i) -> const Point & {
+    return ids.empty() ? pts[i] : pts[ids[i]];
+  };
+  double minX = at(begin).x, maxX = minX, minY = at(begin).y, maxY = minY;
+  for (std::size_t i = begin + 1; i < end; ++i) {
+    minX = std::min(minX, at(i).x);
+    maxX = std::max(maxX, at(i).x);
+    minY = std::min(minY, at(i).y);
+    maxY = std::max(maxY, at(i).y);
+  }
+  const std::uint8_t a = maxY - minY > maxX - minX ? 1 : 0;
+  const std::size_t middle = begin + (end - begin) / 2;
+  auto less = [a](const Point &p, const Point &q) {
+    return a ? p.y < q.y : p.x < q.x;
+  };
+  if (ids.empty())
+    std::nth_element(pts.begin() + begin, pts.begin() + middle,
+                     pts.begin() + end, less);
+  else
+    std::nth_element(ids.begin() + begin, ids.begin() + middle,
+                     ids.begin() + end,
+                     [&](std::uint32_t p, std::uint32_t q) {
+                       return less(pts[p], pts[q]);
+                     });
+  axis[middle] = a;
+
+  if (end - begin >= PARALLEL_THRESHOLD) {
+    TaskGroup group(pool);
+    group.run([&] { buildRange(begin, middle, pool); });
+    buildRange(middle + 1, end, pool);
+    group.wait();
+  } else {
+    buildRange(begin, middle, pool);
+    buildRange(middle + 1, end, pool);
+  }
+}
+
+void KdTree::nearest(double x, double y, int k, double maxDistSq,
+                     std::vector<Neighbour> &out) const {
+  out.clear();
+  if (k <= 0 || pts.empty())
+    return;
+  double bound = maxDistSq;
+  search(0, pts.size(), x, y, static_cast<std::size_t>(k), bound, out);
+}
+
+void KdTree::search(std::size_t begin, std::size_t end, double x, double y,
+                    std::size_t k, double &bound,
+                    std::vector<Neighbour> &out) const {
+  // Keeps the k closest in a max-heap; bound shrinks once it is full
+  auto offer = [&](std::size_t i) {
+    double dx = pts[i].x - x, dy = pts[i].y - y;
+    double d = dx * dx + dy * dy;
+    if (d > bound || (out.size() == k && d >= bound))
+      return;
+    if (out.size() == k) {
+      std::pop_heap(out.begin(), out.end(), closer);
+      out.pop_back();
+    }
+    out.push_back({d, static_cast<std::uint32_t>(i)});
+    std::push_heap(out.begin(), out.end(), closer);
+    if (out.size() == k)
+      bound = out.front().distSq;
+  };
+
+  if (end - begin <= LEAF_SIZE) {
+    for (std::size_t i = begin; i < end; ++i)
+      offer(i);
+    return;
+  }
+
+  const std::size_t middle = begin + (end - begin) / 2;
+  double diff = axis[middle] ? y - pts[middle].y : x - pts[middle].x;
+  // Near side first, so that the bound is tight before the far side
+  if (diff < 0) {
+    search(begin, middle, x, y, k, bound, out);
+    offer(middle);
+    if (diff * diff <= bound)
+      search(middle + 1, end, x, y, k, bound, out);
+  } else {
+    search(middle + 1, end, x, y, k, bound, out);
+    offer(middle);
+    if (diff * diff <= bound)
+      search(begin, middle, x, y, k, bound, out);
+  }
+}
@@ -0,0 +1,240 @@
+/**
+ * @file lattice.cpp
+ * @brief Implementation of the regular-grid fast path.
+ */
+
+#include "lattice.hpp"
+#include "image_io.hpp"
+#include "logging.hpp"
+#include "memory_policy.hpp"
+#include "profiling.hpp"
+#include "progress.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <memory>
+
+namespace {
+
+// Pixels between two control points converted back to geographic
+// coordinates; the projection is smooth enough for a bilinear fill
+const int CONTROL_STEP = 8;
+
+// Consecutive pairs looked at to estimate the steps
+const std::size_t STEP_SAMPLE = 1 << 16;
+
+// Same edge filter as the triangulation
+const double MAX_EDGE_SQ = 70.0 * 70.0;
+
+double edgeSq(const Point &a, const Point &b) {
+  return (a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y);
+}
+
+// Spacing along one axis: smallest consecutive step clearly above the
+// rounding of the text, then refined so that the extent is a whole number
+// of steps
+double estimateStep(const std::vector<Point> &points, double Point::*axis,
+                    double span, double noise) {
+  double step = std::numeric_limits<double>::infinity();
+  std::size_t last = std::min(points.size(), STEP_SAMPLE + 1);
+  for (std::size_t k = 1; k < last; ++k) {
+    double d = std::fabs(points[k].*axis - points[k - 1].*axis);
+    if (d > noise)
+      step = std::min(step, d);
+  }
+  if (!std::isfinite(step) || !(span > 0))
+    return 0;
+  return span / std::round(span / step);
+}
+
+} // namespace
+
+bool parseLatticeMode(const std::string &name, LatticeMode &out) {
+  if (name == "off")
+    out = LatticeMode::Off;
+  else if (name == "auto")
+    out = LatticeMode::Auto;
+  else if (name == "on")
+    out = LatticeMode::On;
+  else
+    return false;
+  return true;
+}
+
+bool detectLattice(const std::vector<Point> &points, double tolerance,
+                   Lattice &lattice) {
+  if (points.size() < 4 || points.size() >= Lattice::NO_POINT)
+    return false;
+
+  double minLon = points[0].x, maxLon = points[0].x;
+  double minLat = points[0].y, maxLat = points[0].y;
+  for (const Point &p : points) {
+    minLon = std::min(minLon, p.x);
+    maxLon = std::max(maxLon, p.x);
+    minLat = std::min(minLat, p.y);
+    maxLat = std::max(maxLat, p.y);
+  }
+
+  // Typical spacing of the points; steps far below it are rounding noise
+  double side = std::sqrt(static_cast<double>(points.size()));
+  double dLon = estimateStep(points, &Point::x, maxLon - minLon,
+                             tolerance * (maxLon - minLon) / side);
+  double dLat = estimateStep(points, &Point::y, maxLat - minLat,
+                             tolerance * (maxLat - minLat) / side);
+  if (!(dLon > 0) || !(dLat > 0))
+    return false;
+  double cols = std::round((maxLon - minLon) / dLon) + 1;
+  double rows = std::round((maxLat - minLat) / dLat) + 1;
+  if (cols < 2 || rows < 2 || cols * rows > 4.0 * points.size())
+    return false;
+
+  Lattice grid;
+  grid.lon0 = minLon;
+  grid.lat0 = minLat;
+  grid.dLon = dLon;
+  grid.dLat = dLat;
+  grid.cols = static_cast<int>(cols);
+  grid.rows = static_cast<int>(rows);
+  grid.nodes.assign(static_cast<std::size_t>(grid.cols) * grid.rows,
+                    Lattice::NO_POINT);
+  for (std::size_t k = 0; k < points.size(); ++k) {
+    double fi = (points[k].x - minLon) / dLon;
+    double fj = (points[k].y - minLat) / dLat;
+    double i = std::round(fi), j = std::round(fj);
+    if (std::fabs(fi - i) > tolerance || std::fabs(fj - j) > tolerance)
+      return false;
+    grid.nodes[static_cast<std::size_t>(j) * grid.cols +
+               static_cast<std::size_t>(i)] = static_cast<std::uint32_t>(k);
+  }
+  lattice = std::move(grid);
+  return true;
+}
+
+void generateLatticeImage(const std::string &filename, int width,
+                          const Lattice &lattice,
+                          const std::vector<Point> &points,
+                          const RenderOptions &options) {
+  std::unique_ptr<ThreadPool> ownPool;
+  if (!options.pool)
+    ownPool = std::make_unique<ThreadPool>(std::max(1, options.threads));
+  ThreadPool &pool = options.pool ? *options.pool : *ownPool;
+
+  RasterGrid grid;
+  if (!makeRasterGrid(points, width, grid)) {
+    logError() << "Dimensions de la grille invalides." << std::endl;
+    return;
+  }
+  const int height = grid.height;
+  logInfo() << "Générer une image " << width << "x" << height
+            << " depuis une grille " << lattice.cols << "x" << lattice.rows
+            << std::endl;
+
+  // Geographic coordinates of every CONTROL_STEP-th pixel center
+  const int controlCols = width / CONTROL_STEP + 2;
+  const int controlRows = height / CONTROL_STEP + 2;
+  std::vector<Point> control(static_cast<std::size_t>(controlCols) *
+                             controlRows);
+  {
+    StageTimer timer(Stage::Index);
+    for (int r = 0; r < controlRows; ++r)
+      for (int c = 0; c < controlCols; ++c)
+        control[static_cast<std::size_t>(r) * controlCols + c] = {
+            grid.minX + (c * CONTROL_STEP + 0.5) * grid.pixelSizeX,
+            grid.maxY - (r * CONTROL_STEP + 0.5) * grid.pixelSizeY, 0};
+    if (!deprojeterPoints(control, pool))
+      return;
+  }
+
+  const int BAND_HEIGHT = 16;
+  const int bandCount = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+  const std::size_t stride = static_cast<std::size_t>(width) * 3;
+  LargeBuffer pixels(stride * height);
+  if (!pixels.data())
+    return;
+
+  auto node = [&](int i, int j) -> const Point * {
+    std::uint32_t k =
+        lattice.nodes[static_cast<std::size_t>(j) * lattice.cols + i];
+    return k == Lattice::NO_POINT ? nullptr : &points[k];
+  };
+
+  auto renderRows = [&](int row0, int row1) {
+    for (int row = row0; row < row1; ++row) {
+      double y = grid.maxY - (row + 0.5) * grid.pixelSizeY;
+      int r = row / CONTROL_STEP;
+      double v = double(row % CONTROL_STEP) / CONTROL_STEP;
+      const Point *top = &control[static_cast<std::size_t>(r) * controlCols];
+      const Point *bottom = top + controlCols;
+      unsigned char *pixel = pixels.data() + row * stride;
+
+      for (int col = 0; col < width; ++col, pixel += 3) {
+        double x = grid.minX + (col + 0.5) * grid.pixelSizeX;
+        int c = col / CONTROL_STEP;
+        double u = double(col % CONTROL_STEP) / CONTROL_STEP;
+        double lon = (1 - v) * ((1 - u) * top[c].x + u * top[c + 1].x) +
+                     v * ((1 - u) * bottom[c].x + u * bottom[c + 1].x);
+        double lat = (1 - v) * ((1 - u) * top[c].y + u * top[c + 1].y) +
+                     v * ((1 - u) * bottom[c].y + u * bottom[c + 1].y);
+
+        // Cell of the pixel, then the half of it; vertices turn clockwise
+        // in the projected plane, as in the triangulation
+        double fi = (lon - lattice.lon0) / lattice.dLon;
+        double fj = (lat - lattice.lat0) / lattice.dLat;
+        int i = static_cast<int>(std::floor(fi));
+        int j = static_cast<int>(std::floor(fj));
+        if (i < 0 || j < 0 || i >= lattice.cols - 1 || j >= lattice.rows - 1)
+          continue;
+        double a = fi - i, b = fj - j;
+        const Point *p1, *p2, *p3;
+        if (a + b <= 1) {
+          p1 = node(i, j);
+          p2 = node(i, j + 1);
+          p3 = node(i + 1, j);
+        } else {
+          p1 = node(i + 1, j + 1);
+          p2 = node(i + 1, j);
+          p3 = node(i, j + 1);
+        }
+        if (!p1 || !p2 || !p3 || edgeSq(*p1, *p2) > MAX_EDGE_SQ ||
+            edgeSq(*p2, *p3) > MAX_EDGE_SQ || edgeSq(*p3, *p1) > MAX_EDGE_SQ)
+          continue;
+
+        double z = interpolateZ(x, y, *p1, *p2, *p3);
+        Color color = getColor(z, grid.minZ, grid.maxZ);
+        double shade = calculateShade(*p1, *p2, *p3);
+        pixel[0] = static_cast<unsigned char>(std::min(255.0, color.r * shade));
+        pixel[1] = static_cast<unsigned char>(std::min(255.0, color.g * shade));
+        pixel[2] = static_cast<unsigned char>(std::min(255.0, color.b * shade));
+      }
+    }
+  };
+
+  {
+    StageTimer timer(Stage::Render);
+    progressBegin(Stage::Render, height, "lignes");
+    bool complete = pool.parallelFor(
+        0, bandCount, 1, [&](std::size_t band0, std::size_t band1) {
+          for (std::size_t band = band0; band < band1; ++band) {
+            int row0 = static_cast<int>(band) * BAND_HEIGHT;
+            int row1 = std::min(height, row0 + BAND_HEIGHT);
+            renderRows(row0, row1);
+            progressAdvance(row1 - row0);
+          }
+        });
+    progressEnd();
+    if (!complete) {
+      logError() << "Rendu annulé, aucune image écrite." << std::endl;
+      return;
+    }
+  }
+
+  StageTimer timer(Stage::Write);
+  PpmWriter writer;
+  if (writer.open(filename, width, height) &&
+      writer.writeBlock(0, height, 0, width, pixels.data(), stride) &&
+      writer.close())
+    logInfo() << "Image enregistrée dans " << filename << std::endl;
+  else
+    logError() << "Erreur d'écriture dans " << filename << std::endl;
+}
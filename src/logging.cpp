@@ -0,0 +1,60 @@
+/**
+ * @file logging.cpp
+ * @brief Implementation of the console verbosity levels.
+ */
+
+#include "logging.hpp"
+#include <atomic>
+#include <iostream>
+
+namespace {
+
+std::atomic<LogLevel> level{LogLevel::Info};
+
+// Stream whose buffer discards everything: formatting still happens, but
+// nothing reaches the terminal.
+class NullBuffer : public std::streambuf {
+protected:
+  int overflow(int c) override { return traits_type::not_eof(c); }
+  std::streamsize xsputn(const char *, std::streamsize n) override {
+    return n;
+  }
+};
+
+std::ostream &nullStream() {
+  static NullBuffer buffer;
+  static std::ostream stream(&buffer);
+  return stream;
+}
+
+} // namespace
+
+void setLogLevel(LogLevel newLevel) { level = newLevel; }
+
+LogLevel logLevel() { return level; }
+
+bool parseLogLevel(const std::string &name, LogLevel &out) {
+  if (name == "quiet")
+    out = LogLevel::Quiet;
+  else if (name == "error")
+    out = LogLevel::Error;
+  else if (name == "info")
+    out = LogLevel::Info;
+  else if (name == "debug")
+    out = LogLevel::Debug;
+  else
+    return false;
+  return true;
+}
+
+std::ostream &logError() {
+  return level >= LogLevel::Error ? std::cerr : nullStream();
+}
+
+std::ostream &logInfo() {
+  return level >= LogLevel::Info ? std::cout : nullStream();
+}
+
+std::ostream &logDebug() {
+  return level >= LogLevel::Debug ? std::cout : nullStream();
+}
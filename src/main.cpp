@@ -6,45 +6,992 @@
  * and rasterization.
  */
 
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <fcntl.h>
 #include <cstdlib>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <unistd.h>
+#include <utility>
 #include <vector>
 
 #include "MNT.hpp"
+#include "binning.hpp"
+#include "checkpoint.hpp"
+#include "distance.hpp"
+#include "expression.hpp"
+#include "fusion.hpp"
+#include "holefill.hpp"
+#include "idw.hpp"
+#include "image_io.hpp"
+#include "lattice.hpp"
+#include "logging.hpp"
+#include "memory_policy.hpp"
+#include "outliers.hpp"
+#include "perspective.hpp"
+#include "planner.hpp"
+#include "point_index.hpp"
+#include "point_io.hpp"
+#include "profiling.hpp"
+#include "pyramid.hpp"
+#include "progress.hpp"
 #include "rasterizer.hpp"
+#include "sibson.hpp"
+#include "simplify.hpp"
+#include "streaming.hpp"
+#include "thread_pool.hpp"
+#include "tiling.hpp"
 #include "triangulation.hpp"
 
+namespace {
+
+ThreadPool *poolEnCours = nullptr;
+
+// Ctrl-C : annule les boucles du pool ; un second Ctrl-C termine le
+// processus normalement
+void interrompre(int) {
+  if (poolEnCours)
+    poolEnCours->cancel();
+  std::signal(SIGINT, SIG_DFL);
+}
+
+void usage() {
+  std::cerr << "Usage: ./create_raster <fichier_donnees> <largeur_image> "
+               "[options]\n"
+               "       ./create_raster index <fichier_donnees> "
+               "[--range-size 1M] [--threads 0]\n"
+               "       ./create_raster merge <sortie.ppm> <parties...> "
+               "[--threads 0]\n"
+               "       ./create_raster stream <entrée|-> <largeur_image> "
+               "--extent <lat0,lon0,lat1,lon1>\n"
+               "               --z-range <zmin,zmax> [--tile 256] "
+               "[--tile-halo 150] [--publish 2]\n"
+               "               [--threads 0]\n"
+               "  --log-level quiet|error|info|debug   messages (info)\n"
+               "  --progress none|human|json           avancement (human si\n"
+               "                                       la sortie est un "
+               "terminal)\n"
+               "  --progress-fd 2                      descripteur de sortie\n"
+               "  --progress-interval 0.5              période (s)\n"
+               "  --threads 0                          threads (0 = tous les "
+               "CPU)\n"
+               "  --affinity none|compact|<cpus>       épinglage des threads,\n"
+               "                                       ex. 0-7,16-23\n"
+               "  --huge-pages off|thp|explicit        grandes pages pour les\n"
+               "                                       gros tableaux (off)\n"
+               "  --numa default|interleave|split      placement mémoire\n"
+               "                                       (default)\n"
+               "  --tile <px>                          rendu par tuiles de\n"
+               "                                       <px> pixels de côté\n"
+               "  --tile-halo 150                      marge autour d'une "
+               "tuile (m)\n"
+               "  --tiles-in-flight 0                  tuiles en mémoire\n"
+               "                                       (0 = 2 x threads)\n"
+               "  --memory-limit <taille>              budget mémoire, ex. 8G ;\n"
+               "                                       choisit le découpage\n"
+               "  --shard <i>/<N>                      rend la partie i (0 à\n"
+               "                                       N-1) dans "
+               "output.part-i-of-N.ppm\n"
+               "  --source <fichier>[:prio[:qualité]]  source de plus, fusionnée\n"
+               "                                       avec la première (prio "
+               "0)\n"
+               "  --overlap priority|recency           source gardée là où\n"
+               "                                       elles se recouvrent\n"
+               "  --fusion-cell 10                     côté des cellules de\n"
+               "                                       recouvrement (m)\n"
+               "  --engine <moteur>                    calcul des altitudes :\n"
+               "                                       triangulation, binning,\n"
+               "                                       idw ou natural\n"
+               "                                       (triangulation)\n"
+               "  --bin-stat mean|min|max              altitude d'un pixel\n"
+               "                                       en binning (mean)\n"
+               "  --bin-fill 2                         trous comblés en\n"
+               "                                       binning (pixels)\n"
+               "  --density <fichier>                  image du nombre de\n"
+               "                                       points par pixel\n"
+               "  --idw-neighbours 8                   points pondérés par\n"
+               "                                       pixel (idw)\n"
+               "  --idw-radius 70                      rayon de recherche (m)\n"
+               "  --idw-power 2                        poids 1/distance^p\n"
+               "  --clean <seuil>                      écarte les points à plus\n"
+               "                                       de <seuil> écarts "
+               "robustes\n"
+               "                                       de leurs voisins\n"
+               "  --clean-neighbours 16                voisins comparés\n"
+               "  --clean-rejected <fichier>           points écartés\n"
+               "  --fill-holes <m²>                    comble les trous du\n"
+               "                                       relevé jusqu'à cette "
+               "aire\n"
+               "  --expr <programme>                   algèbre sur les altitudes,\n"
+               "                                       ex. \"d = 325 - z; d > 10\"\n"
+               "  --expr-output expression.ppm         sortie de --expr (.ppm ou\n"
+               "                                       fichier de points)\n"
+               "  --shoreline <z>                      niveau de l'eau pour la\n"
+               "                                       couche shore_distance\n"
+               "  --region <lat0,lon0,lat1,lon1>       min, max et moyenne des\n"
+               "                                       altitudes de la zone\n"
+               "                                       (répétable)\n"
+               "  --simplify <m>|auto                  maillage simplifié, erreur\n"
+               "                                       verticale max (auto : un\n"
+               "                                       demi-pixel)\n"
+               "  --lod-levels 1                       niveaux de détail, tolérance\n"
+               "                                       doublée à chaque niveau\n"
+               "  --perspective <fichier>              vue oblique du maillage\n"
+               "  --view-size 1920x1080                taille de la vue\n"
+               "  --view 200,35                        azimut et élévation de la\n"
+               "                                       caméra (degrés)\n"
+               "  --view-fov 40                        champ vertical (degrés)\n"
+               "  --view-distance 1                    recul, 1 : tout le\n"
+               "                                       maillage dans le cadre\n"
+               "  --exaggeration 1                     exagération du relief\n"
+               "  --sun 315,45                         azimut et élévation du\n"
+               "                                       soleil (degrés)\n"
+               "  --grid auto|on|off                   grille régulière rendue\n"
+               "                                       sans triangulation "
+               "(auto)\n"
+               "  --grid-tolerance 0.05                écart admis à un noeud\n"
+               "                                       (fraction du pas)\n"
+               "  --checkpoint <s>                     journal des bandes ou\n"
+               "                                       tuiles finies, toutes "
+               "les <s> s\n"
+               "  --resume                             reprend un rendu "
+               "interrompu\n"
+               "  --checkpoint-mesh                    garde aussi le maillage "
+               "(sans\n"
+               "                                       tuiles) pour la "
+               "reprise\n";
+}
+
+// Remplace le maillage par le niveau de détail le plus grossier dont
+// l'erreur verticale reste sous un demi-pixel de l'image (tolérance nulle :
+// un seul niveau à un demi-pixel)
+bool simplifierMaillage(Mesh &mesh, const std::vector<std::uint32_t> &voisins,
+                        double tolerance, int niveaux, int largeur,
+                        ThreadPool &pool) {
+  RasterGrid grille;
+  if (!makeRasterGrid(mesh.points, largeur, grille))
+    return true;
+  const double demiPixel = grille.pixelSizeX / 2;
+  if (tolerance <= 0)
+    tolerance = demiPixel;
+  std::vector<double> tolerances;
+  for (int i = 0; i < niveaux; ++i)
+    tolerances.push_back(tolerance * (1 << i));
+
+  logInfo() << "Simplification du maillage..." << std::endl;
+  std::vector<LodLevel> lod;
+  {
+    StageTimer timer(Stage::Triangulate);
+    if (!simplifyMesh(mesh, voisins, tolerances, pool, lod))
+      return !pool.cancelled();
+  }
+  for (const LodLevel &niveau : lod)
+    logInfo() << "  Tolérance " << niveau.tolerance << " m : "
+              << niveau.mesh.points.size() << " sommets, "
+              << niveau.mesh.triangles.size() << " triangles (erreur "
+              << niveau.error << " m)" << std::endl;
+  std::size_t choix = selectLod(lod, demiPixel);
+  if (lod[choix].tolerance > demiPixel)
+    logInfo() << "Aucun niveau sous le demi-pixel (" << demiPixel
+              << " m), le plus fin est rendu." << std::endl;
+  logInfo() << "Simplification terminée : " << lod[choix].mesh.points.size()
+            << " sommets gardés sur " << mesh.points.size() << ", tolérance "
+            << lod[choix].tolerance << " m (demi-pixel " << demiPixel
+            << " m)." << std::endl;
+  mesh = std::move(lod[choix].mesh);
+  return true;
+}
+
+// Vue en perspective du maillage, en plus de l'image vue du dessus
+bool rendreVue(const std::string &fichier, const Mesh &mesh,
+               const PerspectiveOptions &vue, ThreadPool &pool) {
+  logInfo() << "Vue en perspective " << vue.width << "x" << vue.height
+            << "..." << std::endl;
+  PerspectiveStats bilan;
+  {
+    StageTimer timer(Stage::Render);
+    if (!renderPerspective(fichier, mesh, vue, pool, &bilan))
+      return false;
+  }
+  logInfo() << "Vue enregistrée dans " << fichier << " : " << bilan.visible
+            << " triangles visibles, " << bilan.binned
+            << " dans les tuiles, " << bilan.pixels << " pixels de terrain"
+            << std::endl;
+  return true;
+}
+
+// Lit "--threads n" et "--range-size s" à partir de argv[debut]
+bool optionsSousCommande(int argc, char *argv[], int debut, int &threads,
+                         std::size_t *tailleBloc) {
+  for (int i = debut; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool ok = i + 1 < argc;
+    std::string value = ok ? argv[++i] : "";
+    if (ok && arg == "--threads") {
+      threads = std::atoi(value.c_str());
+      ok = threads >= 0;
+    } else if (ok && tailleBloc && arg == "--range-size") {
+      ok = parseByteSize(value, *tailleBloc);
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      std::cerr << "Option invalide : " << arg << " " << value << std::endl;
+      usage();
+      return false;
+    }
+  }
+  return true;
+}
+
+// create_raster index <fichier> : index spatial à côté du fichier
+int commandeIndex(int argc, char *argv[]) {
+  int threads = 0;
+  std::size_t tailleBloc = 1 << 20;
+  if (argc < 3 || !optionsSousCommande(argc, argv, 3, threads, &tailleBloc))
+    return EXIT_FAILURE;
+
+  ThreadPool pool(threads);
+  std::string fichier = argv[2];
+  PointIndex index;
+  logInfo() << "Indexation de " << fichier << "..." << std::endl;
+  if (!buildPointIndex(fichier, tailleBloc, pool, index) ||
+      !writePointIndex(pointIndexPath(fichier), index))
+    return EXIT_FAILURE;
+  logInfo() << "Index écrit dans " << pointIndexPath(fichier) << " : "
+            << index.ranges.size() << " plages, " << index.points
+            << " points" << std::endl;
+  return EXIT_SUCCESS;
+}
+
+// create_raster merge <sortie> <parties...> : assemblage des parties
+int commandeMerge(int argc, char *argv[]) {
+  int threads = 0;
+  std::vector<std::string> parties;
+  int i = 3;
+  while (i < argc && std::string(argv[i]).rfind("--", 0) != 0)
+    parties.push_back(argv[i++]);
+  if (argc < 4 || !optionsSousCommande(argc, argv, i, threads, nullptr))
+    return EXIT_FAILURE;
+
+  ThreadPool pool(threads);
+  return mergePpmParts(argv[2], parties, pool) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Lit "a,b" ou "a,b,c,d" dans valeurs
+bool lireListe(const std::string &texte, std::vector<double> &valeurs,
+               std::size_t attendues) {
+  valeurs.clear();
+  std::istringstream is(texte);
+  double v;
+  char sep = ',';
+  while (sep == ',' && is >> v) {
+    valeurs.push_back(v);
+    sep = 0;
+    is >> sep;
+  }
+  return valeurs.size() == attendues && is.eof();
+}
+
+// Emprise projetée de "lat0,lon0,lat1,lon1" : boîte englobante des quatre
+// coins
+bool projeterEmprise(const std::vector<double> &emprise, ThreadPool &pool,
+                     BoundingBox &boite) {
+  std::vector<Point> coins = {{emprise[1], emprise[0], 0},
+                              {emprise[3], emprise[0], 0},
+                              {emprise[1], emprise[2], 0},
+                              {emprise[3], emprise[2], 0}};
+  if (!projeterPoints(coins, pool))
+    return false;
+  boite = {coins[0].x, coins[0].y, coins[0].x, coins[0].y};
+  for (const Point &c : coins) {
+    boite.minX = std::min(boite.minX, c.x);
+    boite.minY = std::min(boite.minY, c.y);
+    boite.maxX = std::max(boite.maxX, c.x);
+    boite.maxY = std::max(boite.maxY, c.y);
+  }
+  return true;
+}
+
+// create_raster stream <entrée> <largeur> : carte tenue à jour en direct
+int commandeStream(int argc, char *argv[]) {
+  if (argc < 4) {
+    usage();
+    return EXIT_FAILURE;
+  }
+  StreamOptions options;
+  options.width = std::atoi(argv[3]);
+  int threads = 0;
+  std::vector<double> emprise, altitudes;
+  for (int i = 4; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool ok = i + 1 < argc;
+    std::string value = ok ? argv[++i] : "";
+    if (ok && arg == "--extent") {
+      ok = lireListe(value, emprise, 4);
+    } else if (ok && arg == "--z-range") {
+      ok = lireListe(value, altitudes, 2) && altitudes[0] < altitudes[1];
+    } else if (ok && arg == "--tile") {
+      options.tileSize = std::atoi(value.c_str());
+      ok = options.tileSize >= 16;
+    } else if (ok && arg == "--tile-halo") {
+      options.halo = std::atof(value.c_str());
+      ok = options.halo >= 0;
+    } else if (ok && arg == "--publish") {
+      options.publishInterval = std::atof(value.c_str());
+      ok = options.publishInterval > 0;
+    } else if (ok && arg == "--threads") {
+      threads = std::atoi(value.c_str());
+      ok = threads >= 0;
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      std::cerr << "Option invalide : " << arg << " " << value << std::endl;
+      usage();
+      return EXIT_FAILURE;
+    }
+  }
+  if (emprise.empty() || altitudes.empty() || options.width <= 0) {
+    std::cerr << "stream demande une largeur, --extent et --z-range."
+              << std::endl;
+    usage();
+    return EXIT_FAILURE;
+  }
+
+  ThreadPool pool(threads);
+  poolEnCours = &pool;
+  std::signal(SIGINT, interrompre);
+
+  if (!projeterEmprise(emprise, pool, options.extent))
+    return EXIT_FAILURE;
+  options.minZ = altitudes[0];
+  options.maxZ = altitudes[1];
+
+  // "-" : entrée standard ; sinon un fichier ou une FIFO (bloque jusqu'à
+  // l'arrivée d'un écrivain)
+  std::string entree = argv[2];
+  int fd = entree == "-" ? STDIN_FILENO : ::open(entree.c_str(), O_RDONLY);
+  if (fd < 0) {
+    logError() << "Impossible d'ouvrir le flux " << entree << std::endl;
+    return EXIT_FAILURE;
+  }
+  bool ok = streamSurvey(fd, "output.ppm", options, pool);
+  if (fd != STDIN_FILENO)
+    ::close(fd);
+  poolEnCours = nullptr;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace
+
 int main(int argc, char *argv[]) {
   // Vérification des arguments
   if (argc < 3) {
-    std::cerr << "Usage: ./create_raster <fichier_donnees> <largeur_image>"
-              << std::endl;
+    usage();
     return EXIT_FAILURE;
   }
 
+  std::string commande = argv[1];
+  if (commande == "index")
+    return commandeIndex(argc, argv);
+  if (commande == "merge")
+    return commandeMerge(argc, argv);
+  if (commande == "stream")
+    return commandeStream(argc, argv);
+
   std::string nomFichier = argv[1];
   int largeur = std::atoi(argv[2]);
 
+  int progressFd = STDERR_FILENO;
+  double progressInterval = 0.5;
+  ProgressFormat progressFormat =
+      isatty(STDERR_FILENO) ? ProgressFormat::Human : ProgressFormat::None;
+
+  int threads = 0;
+  std::vector<int> cpus;
+  MemoryPolicy politiqueMemoire;
+
+  bool tuiles = false;
+  TileOptions tileOptions;
+  std::size_t limiteMemoire = 0;
+  CheckpointOptions reprise;
+  bool maillageEnReprise = false;
+  std::vector<SourceSpec> sources(1);
+  sources[0].path = nomFichier;
+  FusionOptions fusion;
+  LatticeMode modeGrille = LatticeMode::Auto;
+  double toleranceGrille = 0.05;
+  RenderEngine moteur = RenderEngine::Triangulation;
+  std::string nomMoteur = "triangulation";
+  BinningOptions binning;
+  IdwOptions idw;
+  double aireTrous = 0;
+  bool nettoyage = false;
+  OutlierOptions aberrants;
+  std::string programme;
+  std::vector<std::vector<double>> zones;
+  bool rivage = false;
+  double niveauEau = 0;
+  std::string sortieExpression = "expression.ppm";
+  bool simplifier = false;
+  double toleranceLod = 0; // 0 : un demi-pixel
+  int niveauxLod = 1;
+  std::string sortieVue;
+  PerspectiveOptions vue;
+
+  for (int i = 3; i < argc; ++i) {
+    std::string arg = argv[i];
+    // Options sans valeur
+    if (arg == "--resume") {
+      reprise.enabled = reprise.resume = true;
+      continue;
+    }
+    if (arg == "--checkpoint-mesh") {
+      reprise.enabled = maillageEnReprise = true;
+      continue;
+    }
+    bool ok = i + 1 < argc;
+    std::string value = ok ? argv[++i] : "";
+    if (ok && arg == "--log-level") {
+      LogLevel level = LogLevel::Info;
+      ok = parseLogLevel(value, level);
+      if (ok)
+        setLogLevel(level);
+    } else if (ok && arg == "--progress") {
+      ok = parseProgressFormat(value, progressFormat);
+    } else if (ok && arg == "--progress-fd") {
+      progressFd = std::atoi(value.c_str());
+    } else if (ok && arg == "--progress-interval") {
+      progressInterval = std::atof(value.c_str());
+      ok = progressInterval > 0;
+    } else if (ok && arg == "--threads") {
+      threads = std::atoi(value.c_str());
+      ok = threads >= 0;
+    } else if (ok && arg == "--affinity") {
+      if (value == "compact")
+        cpus = availableCpus();
+      else if (value == "none")
+        cpus.clear();
+      else
+        ok = parseCpuList(value, cpus);
+    } else if (ok && arg == "--huge-pages") {
+      ok = parseHugePages(value, politiqueMemoire.hugePages);
+    } else if (ok && arg == "--numa") {
+      ok = parseNumaPlacement(value, politiqueMemoire.numa);
+    } else if (ok && arg == "--tile") {
+      tileOptions.tileSize = std::atoi(value.c_str());
+      ok = tileOptions.tileSize >= 16;
+      tuiles = true;
+    } else if (ok && arg == "--tile-halo") {
+      tileOptions.halo = std::atof(value.c_str());
+      ok = tileOptions.halo >= 0;
+    } else if (ok && arg == "--tiles-in-flight") {
+      tileOptions.maxInFlight = std::atoi(value.c_str());
+      ok = tileOptions.maxInFlight >= 0;
+    } else if (ok && arg == "--memory-limit") {
+      ok = parseByteSize(value, limiteMemoire);
+    } else if (ok && arg == "--source") {
+      SourceSpec source;
+      ok = parseSourceSpec(value, source);
+      sources.push_back(source);
+    } else if (ok && arg == "--overlap") {
+      ok = parseOverlapRule(value, fusion.rule);
+    } else if (ok && arg == "--fusion-cell") {
+      fusion.cellSize = std::atof(value.c_str());
+      ok = fusion.cellSize > 0;
+    } else if (ok && arg == "--engine") {
+      ok = parseRenderEngine(value, moteur);
+      nomMoteur = value;
+    } else if (ok && arg == "--bin-stat") {
+      ok = parseBinStatistic(value, binning.statistic);
+    } else if (ok && arg == "--bin-fill") {
+      binning.fillRadius = std::atoi(value.c_str());
+      ok = binning.fillRadius >= 0;
+    } else if (ok && arg == "--density") {
+      binning.densityFile = value;
+    } else if (ok && arg == "--idw-neighbours") {
+      idw.neighbours = std::atoi(value.c_str());
+      ok = idw.neighbours >= 1;
+    } else if (ok && arg == "--idw-radius") {
+      idw.radius = std::atof(value.c_str());
+      ok = idw.radius > 0;
+    } else if (ok && arg == "--idw-power") {
+      idw.power = std::atof(value.c_str());
+      ok = idw.power > 0;
+    } else if (ok && arg == "--clean") {
+      aberrants.threshold = std::atof(value.c_str());
+      ok = aberrants.threshold > 0;
+      nettoyage = true;
+    } else if (ok && arg == "--clean-neighbours") {
+      aberrants.neighbours = std::atoi(value.c_str());
+      ok = aberrants.neighbours >= 2;
+    } else if (ok && arg == "--clean-rejected") {
+      aberrants.rejectedFile = value;
+    } else if (ok && arg == "--fill-holes") {
+      aireTrous = std::atof(value.c_str());
+      ok = aireTrous > 0;
+    } else if (ok && arg == "--shoreline") {
+      char *fin = nullptr;
+      niveauEau = std::strtod(value.c_str(), &fin);
+      ok = fin != value.c_str() && *fin == 0;
+      rivage = true;
+    } else if (ok && arg == "--region") {
+      zones.emplace_back();
+      ok = lireListe(value, zones.back(), 4);
+    } else if (ok && arg == "--expr") {
+      programme = value;
+    } else if (ok && arg == "--expr-output") {
+      sortieExpression = value;
+    } else if (ok && arg == "--simplify") {
+      simplifier = true;
+      toleranceLod = value == "auto" ? 0 : std::atof(value.c_str());
+      ok = value == "auto" || toleranceLod > 0;
+    } else if (ok && arg == "--lod-levels") {
+      niveauxLod = std::atoi(value.c_str());
+      ok = niveauxLod >= 1 && niveauxLod <= 16;
+    } else if (ok && arg == "--perspective") {
+      sortieVue = value;
+    } else if (ok && arg == "--view-size") {
+      char sep = 0;
+      std::istringstream is(value);
+      is >> vue.width >> sep >> vue.height;
+      ok = is && sep == 'x' && vue.width > 0 && vue.height > 0 &&
+           vue.width <= 65536 && vue.height <= 65536;
+    } else if (ok && arg == "--view") {
+      std::vector<double> angles;
+      ok = lireListe(value, angles, 2) && angles[1] >= 0 && angles[1] <= 90;
+      if (ok) {
+        vue.azimuth = angles[0];
+        vue.elevation = angles[1];
+      }
+    } else if (ok && arg == "--view-fov") {
+      vue.fov = std::atof(value.c_str());
+      ok = vue.fov > 0 && vue.fov < 180;
+    } else if (ok && arg == "--view-distance") {
+      vue.distance = std::atof(value.c_str());
+      ok = vue.distance > 0;
+    } else if (ok && arg == "--exaggeration") {
+      vue.exaggeration = std::atof(value.c_str());
+      ok = vue.exaggeration > 0;
+    } else if (ok && arg == "--sun") {
+      std::vector<double> angles;
+      ok = lireListe(value, angles, 2) && angles[1] >= -90 && angles[1] <= 90;
+      if (ok) {
+        vue.sunAzimuth = angles[0];
+        vue.sunElevation = angles[1];
+      }
+    } else if (ok && arg == "--grid") {
+      ok = parseLatticeMode(value, modeGrille);
+    } else if (ok && arg == "--grid-tolerance") {
+      toleranceGrille = std::atof(value.c_str());
+      ok = toleranceGrille > 0 && toleranceGrille < 0.5;
+    } else if (ok && arg == "--checkpoint") {
+      reprise.interval = std::atof(value.c_str());
+      reprise.enabled = true;
+      ok = reprise.interval > 0;
+    } else if (ok && arg == "--shard") {
+      char sep = 0;
+      std::istringstream is(value);
+      is >> tileOptions.shard >> sep >> tileOptions.shardCount;
+      ok = is && sep == '/' && tileOptions.shardCount >= 1 &&
+           tileOptions.shard >= 0 &&
+           tileOptions.shard < tileOptions.shardCount;
+      tuiles = tuiles || tileOptions.shardCount > 1;
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      std::cerr << "Option invalide : " << arg << " " << value << std::endl;
+      usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Expression compilée avant toute lecture : une faute de frappe ne coûte
+  // pas un rendu
+  Expression expression;
+  std::string erreurExpression;
+  if (!programme.empty() && !expression.compile(programme, erreurExpression)) {
+    std::cerr << "Expression invalide, " << erreurExpression << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (expression.uses("shore_distance") && !rivage) {
+    std::cerr << "La couche shore_distance demande --shoreline <z>."
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Les autres moteurs, le comblement des trous, les expressions et les
+  // zones calculent toutes les altitudes de l'image en une passe
+  bool parAltitudes = moteur != RenderEngine::Triangulation || aireTrous > 0 ||
+                      !expression.empty() || !zones.empty();
+  if (parAltitudes &&
+      (tuiles || limiteMemoire > 0 || reprise.enabled || maillageEnReprise)) {
+    std::cerr << (aireTrous > 0          ? "--fill-holes"
+                  : !expression.empty() ? "--expr"
+                  : !zones.empty()      ? "--region"
+                                        : "--engine " + nomMoteur)
+              << " ne se combine pas avec --tile, --shard, --memory-limit ni "
+                 "les points de reprise."
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  // Le maillage simplifié remplace le maillage entier, rendu d'un bloc
+  if (simplifier && (moteur != RenderEngine::Triangulation || tuiles ||
+                     limiteMemoire > 0 || reprise.enabled ||
+                     maillageEnReprise)) {
+    std::cerr << "--simplify ne se combine qu'avec le moteur triangulation, "
+                 "sans --tile, --shard, --memory-limit ni points de reprise."
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // La vue part du maillage entier, en mémoire d'un bloc
+  if (!sortieVue.empty() &&
+      (moteur != RenderEngine::Triangulation || tuiles || limiteMemoire > 0)) {
+    std::cerr << "--perspective ne se combine qu'avec le moteur "
+                 "triangulation, sans --tile, --shard ni --memory-limit."
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Avancement suivi par un fil dédié, jamais par la boucle de rendu
+  ProgressReporter reporter(progressFormat, progressFd, progressInterval);
+
+  // La politique mémoire et les compteurs d'accès doivent précéder les
+  // threads, qui en héritent
+  setMemoryPolicy(politiqueMemoire);
+  AccessCounterScope compteursAcces;
+
+  // Un seul pool pour toutes les étapes
+  ThreadPool pool(threads, cpus);
+  poolEnCours = &pool;
+  std::signal(SIGINT, interrompre);
+  logDebug() << "Threads : " << pool.size() << std::endl;
+
+  // Échec immédiat si le chargement seul dépasse le budget
+  if (limiteMemoire > 0) {
+    std::size_t estimation = 0;
+    for (const SourceSpec &source : sources)
+      estimation += estimatePointCount(source.path);
+    std::size_t chargement = estimateLoadBytes(estimation, pool.size());
+    if (chargement > limiteMemoire) {
+      logError() << "Mémoire insuffisante : charger environ " << estimation
+                 << " points demande " << formatBytes(chargement)
+                 << ", limite " << formatBytes(limiteMemoire) << "."
+                 << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Reprise : le maillage sauvegardé évite lecture et triangulation
+  reprise.fingerprint = inputFingerprint(nomFichier);
+  for (std::size_t i = 1; i < sources.size(); ++i)
+    reprise.fingerprint += " " + inputFingerprint(sources[i].path) + ":" +
+                           std::to_string(sources[i].priority);
+  if (nettoyage)
+    reprise.fingerprint += " clean:" + std::to_string(aberrants.threshold) +
+                           ":" + std::to_string(aberrants.neighbours);
+  const std::string cacheMaillage = "output.ppm.mesh";
+  maillageEnReprise = maillageEnReprise && !tuiles;
+  Mesh mesh;
+  bool maillageCharge = false;
+  if (maillageEnReprise && reprise.resume) {
+    StageTimer timer(Stage::Load);
+    maillageCharge = loadMeshCache(cacheMaillage, reprise.fingerprint, mesh);
+    if (maillageCharge)
+      logInfo() << "Maillage repris de " << cacheMaillage << " ("
+                << mesh.triangles.size() << " triangles)" << std::endl;
+  }
+
+  // Une partie se contente des plages de l'index qui touchent sa bande ;
+  // la grille vient alors de l'index, identique pour toutes les parties
+  // (l'index ne couvre qu'un fichier : pas avec plusieurs sources)
+  const bool partie = tileOptions.shardCount > 1;
+  PointIndex index;
+  const bool indexe =
+      partie && sources.size() == 1 && readPointIndex(nomFichier, index);
+  RasterGrid grille;
+  bool grilleValide = false;
+
   // Appel de la fonction de conversion
-  std::cout << "Lecture et projection des données..." << std::endl;
-  auto terrain = lireEtConvertir(nomFichier);
+  std::vector<Point> terrain;
+  Lattice lattice;
+  bool grilleReguliere = false;
+  if (!maillageCharge)
+    logInfo() << "Lecture et projection des données..." << std::endl;
+  if (maillageCharge) {
+    // Rien à lire
+  } else if (indexe) {
+    StageTimer timer(Stage::Load);
+    grilleValide = makeRasterGrid(index.bounds, index.minZ, index.maxZ,
+                                  largeur, grille);
+    auto plages = selectRanges(index, shardArea(grille, tileOptions));
+    logInfo() << "Index : " << plages.size() << " lecture(s) sur "
+              << index.ranges.size() << " plages" << std::endl;
+    terrain = lirePlages(nomFichier, plages, pool);
+    if (!terrain.empty() && !projeterPoints(terrain, pool))
+      terrain.clear();
+  } else if (sources.size() > 1) {
+    // Plusieurs sources : un seul nuage, recouvrements arbitrés
+    StageTimer timer(Stage::Load);
+    std::vector<SourceStats> bilan;
+    terrain = fuseSources(sources, fusion, pool, &bilan);
+    for (std::size_t i = 0; i < bilan.size(); ++i)
+      logInfo() << "  " << sources[i].path << " : " << bilan[i].loaded
+                << " points, " << bilan[i].dropped << " écartés (recouvrement)"
+                << std::endl;
+  } else {
+    StageTimer timer(Stage::Load);
+    terrain = lirePoints(nomFichier, pool);
+    // Grille régulière : reconnue avant projection, en longitude/latitude
+    if (!terrain.empty() && !parAltitudes && !nettoyage && !simplifier &&
+        sortieVue.empty() && modeGrille != LatticeMode::Off && !tuiles &&
+        limiteMemoire == 0 && !reprise.enabled) {
+      grilleReguliere = detectLattice(terrain, toleranceGrille, lattice);
+      if (grilleReguliere)
+        logInfo() << "Grille régulière " << lattice.cols << "x"
+                  << lattice.rows << " détectée" << std::endl;
+    }
+    if (!terrain.empty() && !projeterPoints(terrain, pool))
+      terrain.clear();
+  }
+  if (modeGrille == LatticeMode::On && !grilleReguliere && !terrain.empty()) {
+    logError() << "Les points ne forment pas une grille régulière."
+               << std::endl;
+    return EXIT_FAILURE;
+  }
 
-  std::cout << "Nombre de points chargés : " << terrain.size() << std::endl;
+  if (!maillageCharge)
+    logInfo() << "Nombre de points chargés : " << terrain.size() << std::endl;
 
   if (!terrain.empty()) {
-    std::cout << "Premier point (projeté) : x=" << terrain[0].x
+    logInfo() << "Premier point (projeté) : x=" << terrain[0].x
               << ", y=" << terrain[0].y << ", z=" << terrain[0].z << std::endl;
+  }
+
+  // Pics et points isolés écartés avant toute interpolation
+  if (!terrain.empty() && nettoyage) {
+    logInfo() << "Nettoyage des points aberrants..." << std::endl;
+    std::vector<Point> rejetes;
+    OutlierStats bilan;
+    {
+      StageTimer timer(Stage::Index);
+      if (!removeOutliers(terrain, aberrants, pool, &rejetes, &bilan))
+        return EXIT_FAILURE;
+    }
+    logInfo() << "Points écartés : " << bilan.vertical << " pics, "
+              << bilan.planar << " isolés" << std::endl;
+    if (!aberrants.rejectedFile.empty()) {
+      StageTimer timer(Stage::Write);
+      PointWriter writer;
+      if (deprojeterPoints(rejetes, pool) &&
+          writer.open(aberrants.rejectedFile,
+                      pointFormatFromPath(aberrants.rejectedFile)) &&
+          writer.write(rejetes) && writer.close())
+        logInfo() << "Points écartés enregistrés dans "
+                  << aberrants.rejectedFile << std::endl;
+      else
+        logError() << "Erreur d'écriture dans " << aberrants.rejectedFile
+                   << std::endl;
+    }
+  }
+
+  if (!terrain.empty() && !indexe && (tuiles || limiteMemoire > 0))
+    grilleValide = makeRasterGrid(terrain, largeur, grille);
+  if (!terrain.empty() && (tuiles || limiteMemoire > 0) && !grilleValide) {
+    logError() << "Dimensions du maillage invalides." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Choix du plan d'exécution d'après les points réellement chargés ; les
+  // parties gardent la taille de tuile commune
+  if (!terrain.empty() && limiteMemoire > 0) {
+    MemoryPlan plan;
+    if (!planMemory(terrain, grille, limiteMemoire, pool.size(),
+                    tileOptions.halo, tuiles ? tileOptions.tileSize : 0,
+                    plan)) {
+      logError() << "Aucun plan d'exécution ne tient dans "
+                 << formatBytes(limiteMemoire) << " ; le plus économe :"
+                 << std::endl;
+      printPlan(logError(), plan, limiteMemoire);
+      return EXIT_FAILURE;
+    }
+    logInfo() << "Plan mémoire :" << std::endl;
+    printPlan(logInfo(), plan, limiteMemoire);
+    if (plan.tiled) {
+      tuiles = true;
+      tileOptions.tileSize = plan.tileSize;
+      if (tileOptions.maxInFlight == 0 ||
+          tileOptions.maxInFlight > plan.tilesInFlight)
+        tileOptions.maxInFlight = plan.tilesInFlight;
+    }
+  }
 
+  // Une partie écrit son fichier même si sa bande ne contient aucun point
+  if ((!terrain.empty() || (indexe && grilleValide)) && tuiles) {
+    // Chaque tuile enchaîne ses étapes ; les tuiles se chevauchent
+    logInfo() << "Rendu par tuiles..." << std::endl;
+    tileOptions.checkpoint = reprise;
+    std::string sortie =
+        partie ? shardFileName("output.ppm", tileOptions.shard,
+                               tileOptions.shardCount)
+               : "output.ppm";
+    renderTiled(sortie, grille, std::move(terrain), pool, tileOptions);
+  } else if (!terrain.empty() && parAltitudes) {
+    // Altitudes de chaque pixel, retouchées avant la mise en couleurs
+    HeightField altitudes;
+    bool calcule = false;
+    // Pixels qui tiennent un sondage, relevés avant que le moteur ne
+    // consomme les points (même grille que tous les moteurs)
+    std::vector<std::uint8_t> sondes;
+    if (expression.uses("sounding_distance")) {
+      RasterGrid grilleSondes;
+      if (makeRasterGrid(terrain, largeur, grilleSondes))
+        markPoints(terrain, grilleSondes, sondes);
+    }
+    if (moteur == RenderEngine::Binning) {
+      logInfo() << "Génération de l'image (binning)..." << std::endl;
+      calcule = makeBinnedField(terrain, largeur, binning, pool, altitudes);
+    } else if (moteur == RenderEngine::Idw) {
+      logInfo() << "Génération de l'image (idw)..." << std::endl;
+      calcule =
+          makeIdwField(std::move(terrain), largeur, idw, pool, altitudes);
+    } else {
+      // Le maillage garde les voisins de chaque triangle pour Sibson
+      bool naturel = moteur == RenderEngine::NaturalNeighbour;
+      logInfo() << "Lancement de la triangulation..." << std::endl;
+      std::vector<std::uint32_t> voisins;
+      {
+        StageTimer timer(Stage::Triangulate);
+        mesh = triangulate(terrain, pool,
+                           naturel || simplifier ? &voisins : nullptr);
+      }
+      std::vector<Point>().swap(terrain);
+      if (simplifier && !simplifierMaillage(mesh, voisins, toleranceLod,
+                                            niveauxLod, largeur, pool))
+        return EXIT_FAILURE;
+      if (!sortieVue.empty() && !rendreVue(sortieVue, mesh, vue, pool))
+        return EXIT_FAILURE;
+      if (naturel) {
+        logInfo() << "Génération de l'image (voisins naturels)..."
+                  << std::endl;
+        calcule = makeSibsonField(mesh, voisins, largeur, pool, altitudes);
+      } else {
+        logInfo() << "Génération de l'image..." << std::endl;
+        calcule = makeMeshField(mesh, largeur, pool, altitudes);
+      }
+    }
+    if (calcule && aireTrous > 0) {
+      logInfo() << "Comblement des trous..." << std::endl;
+      HoleFillStats trous;
+      {
+        StageTimer timer(Stage::Render);
+        calcule = fillHoles(altitudes, aireTrous, pool, &trous);
+      }
+      if (calcule)
+        logInfo() << "Trous comblés : " << trous.filled << " ("
+                  << trous.pixels << " pixels), " << trous.skipped
+                  << " trop grands" << std::endl;
+    }
+    if (calcule && !zones.empty()) {
+      // Pyramide min/max/somme/nombre : chaque zone sans parcourir ses
+      // pixels
+      HeightPyramid pyramide;
+      {
+        StageTimer timer(Stage::Index);
+        calcule = pyramide.build(altitudes, pool);
+      }
+      for (std::size_t i = 0; calcule && i < zones.size(); ++i) {
+        BoundingBox boite;
+        if (!projeterEmprise(zones[i], pool, boite))
+          return EXIT_FAILURE;
+        RegionStats zone = pyramide.query(boite);
+        if (zone.count == 0)
+          logInfo() << "Zone " << i + 1 << " : aucune altitude" << std::endl;
+        else
+          logInfo() << "Zone " << i + 1 << " : min " << zone.min << " m, max "
+                    << zone.max << " m, moyenne " << zone.mean() << " m ("
+                    << zone.count << " pixels)" << std::endl;
+      }
+    }
+    ExpressionGrids grilles;
+    if (calcule && (!sondes.empty() || expression.uses("shore_distance"))) {
+      logInfo() << "Calcul des distances..." << std::endl;
+      StageTimer timer(Stage::Render);
+      if (sondes.size() == altitudes.z.size())
+        calcule = distanceTransform(sondes, altitudes.grid, pool,
+                                    grilles.soundingDistance);
+      std::vector<std::uint8_t>().swap(sondes);
+      if (calcule && expression.uses("shore_distance"))
+        calcule = shoreDistance(altitudes, niveauEau, pool,
+                                grilles.shoreDistance);
+    }
+    if (calcule && !expression.empty()) {
+      logInfo() << "Évaluation de l'expression (" << expression.size()
+                << " instructions)..." << std::endl;
+      ExpressionStats bilan;
+      calcule = writeExpression(sortieExpression, expression, altitudes,
+                                grilles, pool, &bilan);
+      if (calcule)
+        logInfo() << "Expression enregistrée dans " << sortieExpression
+                  << " : " << bilan.pixels << " pixels, de " << bilan.min
+                  << " à " << bilan.max << std::endl;
+      else if (!pool.cancelled())
+        logError() << "Erreur d'écriture dans " << sortieExpression
+                   << std::endl;
+    }
+    if (calcule)
+      writeHeightFieldImage("output.ppm", altitudes, pool);
+  } else if (!terrain.empty() && grilleReguliere) {
+    // Pas de triangulation : chaque cellule de la grille donne deux triangles
+    logInfo() << "Génération de l'image (grille régulière)..." << std::endl;
+    RenderOptions options;
+    options.pool = &pool;
+    generateLatticeImage("output.ppm", largeur, lattice, terrain, options);
+  } else if (!terrain.empty() || maillageCharge) {
     // Triangulation
-    std::cout << "Lancement de la triangulation..." << std::endl;
-    Mesh mesh = triangulate(terrain);
-    std::cout << "Triangulation terminée." << std::endl;
+    if (!maillageCharge) {
+      logInfo() << "Lancement de la triangulation..." << std::endl;
+      std::vector<std::uint32_t> voisins;
+      {
+        StageTimer timer(Stage::Triangulate);
+        mesh = triangulate(terrain, pool, simplifier ? &voisins : nullptr);
+      }
+      if (simplifier) {
+        if (!simplifierMaillage(mesh, voisins, toleranceLod, niveauxLod,
+                                largeur, pool))
+          return EXIT_FAILURE;
+      } else {
+        logInfo() << "Triangulation terminée." << std::endl;
+      }
+      if (maillageEnReprise && !pool.cancelled() &&
+          saveMeshCache(cacheMaillage, reprise.fingerprint, mesh))
+        logInfo() << "Maillage sauvegardé dans " << cacheMaillage
+                  << std::endl;
+    }
+
+    if (!sortieVue.empty() && !rendreVue(sortieVue, mesh, vue, pool))
+      return EXIT_FAILURE;
 
     // Rasterization
-    std::cout << "Génération de l'image..." << std::endl;
-    generateImage("output.ppm", largeur, mesh);
+    logInfo() << "Génération de l'image..." << std::endl;
+    RenderOptions options;
+    options.pool = &pool;
+    options.checkpoint = reprise;
+    generateImage("output.ppm", largeur, mesh, options);
+    if (maillageEnReprise && !pool.cancelled())
+      std::remove(cacheMaillage.c_str());
   }
 
-  return EXIT_SUCCESS;
+  pool.printStats(logDebug());
+  logDebug() << "RSS max : " << formatBytes(peakResidentBytes()) << std::endl;
+  logDebug() << "Grandes pages transparentes : " << formatBytes(hugePageBytes())
+             << std::endl;
+  poolEnCours = nullptr;
+  return pool.cancelled() ? EXIT_FAILURE : EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,233 @@
+/**
+ * @file memory_policy.cpp
+ * @brief Implementation of huge-page and NUMA placement of large buffers.
+ */
+
+#include "memory_policy.hpp"
+#include "logging.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <linux/mempolicy.h>
+#include <linux/perf_event.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE 25
+#endif
+
+namespace {
+
+const std::size_t HUGE_PAGE = std::size_t(2) << 20;
+
+MemoryPolicy policy;
+
+// Nodes of /sys/devices/system/node/online, same syntax as a CPU list
+std::vector<int> onlineNodes() {
+  std::ifstream ifs("/sys/devices/system/node/online");
+  std::string line;
+  std::vector<int> nodes;
+  if (!std::getline(ifs, line) || !parseCpuList(line, nodes) || nodes.empty())
+    nodes.assign(1, 0);
+  return nodes;
+}
+
+// Bit mask of the online nodes for set_mempolicy(2) and mbind(2)
+std::vector<unsigned long> nodeMask(unsigned long &maxNode) {
+  const std::size_t BITS = 8 * sizeof(unsigned long);
+  std::vector<int> nodes = onlineNodes();
+  int highest = 0;
+  for (int n : nodes)
+    highest = std::max(highest, n);
+  std::vector<unsigned long> mask(highest / BITS + 1, 0);
+  for (int n : nodes)
+    mask[n / BITS] |= 1UL << (n % BITS);
+  maxNode = static_cast<unsigned long>(highest) + 2;
+  return mask;
+}
+
+// Largest run of whole huge pages inside [data, data + bytes)
+bool hugeRange(const void *data, std::size_t bytes, std::uintptr_t &start,
+               std::size_t &length) {
+  std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(data);
+  std::uintptr_t end = begin + bytes;
+  start = (begin + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+  std::uintptr_t stop = end & ~(HUGE_PAGE - 1);
+  if (stop <= start)
+    return false;
+  length = stop - start;
+  return true;
+}
+
+int openCounter(std::uint32_t type, std::uint64_t config) {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return static_cast<int>(
+      ::syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+std::uint64_t cacheEvent(std::uint64_t cache) {
+  return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+void printCounter(const char *label, int fd) {
+  std::uint64_t value = 0;
+  if (fd >= 0 && ::read(fd, &value, sizeof(value)) == sizeof(value))
+    logDebug() << label << value << std::endl;
+  else
+    logDebug() << label << "compteur indisponible" << std::endl;
+}
+
+} // namespace
+
+bool parseHugePages(const std::string &name, HugePages &out) {
+  if (name == "off")
+    out = HugePages::Off;
+  else if (name == "thp")
+    out = HugePages::Transparent;
+  else if (name == "explicit")
+    out = HugePages::Explicit;
+  else
+    return false;
+  return true;
+}
+
+bool parseNumaPlacement(const std::string &name, NumaPlacement &out) {
+  if (name == "default")
+    out = NumaPlacement::Default;
+  else if (name == "interleave")
+    out = NumaPlacement::Interleave;
+  else if (name == "split")
+    out = NumaPlacement::Split;
+  else
+    return false;
+  return true;
+}
+
+bool setMemoryPolicy(const MemoryPolicy &wanted) {
+  policy = wanted;
+  if (policy.numa != NumaPlacement::Interleave)
+    return true;
+
+  // Equivalent of numactl --interleave=all for this thread and its children
+  unsigned long maxNode = 0;
+  std::vector<unsigned long> mask = nodeMask(maxNode);
+  if (::syscall(SYS_set_mempolicy, MPOL_INTERLEAVE, mask.data(), maxNode) !=
+      0) {
+    logError() << "Politique NUMA refusée par le noyau : "
+               << std::strerror(errno) << std::endl;
+    policy.numa = NumaPlacement::Default;
+    return false;
+  }
+  return true;
+}
+
+const MemoryPolicy &memoryPolicy() { return policy; }
+
+int numaNodeCount() { return static_cast<int>(onlineNodes().size()); }
+
+void placeShared(const void *data, std::size_t bytes) {
+  std::uintptr_t start;
+  std::size_t length;
+  if ((policy.hugePages == HugePages::Off &&
+       policy.numa != NumaPlacement::Split) ||
+      !hugeRange(data, bytes, start, length))
+    return;
+  void *range = reinterpret_cast<void *>(start);
+
+  // Interleave first, so that collapsing builds huge pages on their final
+  // node; both are hints and failures are ignored
+  if (policy.numa == NumaPlacement::Split && numaNodeCount() > 1) {
+    unsigned long maxNode = 0;
+    std::vector<unsigned long> mask = nodeMask(maxNode);
+    ::syscall(SYS_mbind, range, length, MPOL_INTERLEAVE, mask.data(), maxNode,
+              MPOL_MF_MOVE);
+  }
+  if (policy.hugePages != HugePages::Off) {
+    ::madvise(range, length, MADV_HUGEPAGE);
+    ::madvise(range, length, MADV_COLLAPSE);
+  }
+}
+
+LargeBuffer::LargeBuffer(std::size_t size) : length(size) {
+  if (size == 0)
+    return;
+  void *p = MAP_FAILED;
+  if (policy.hugePages == HugePages::Explicit) {
+    mapped = (size + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+    p = ::mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p == MAP_FAILED)
+      logDebug() << "Pas de grandes pages réservées libres, pages "
+                    "transparentes à la place."
+                 << std::endl;
+  }
+  if (p == MAP_FAILED) {
+    mapped = size;
+    p = ::mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED && policy.hugePages != HugePages::Off)
+      ::madvise(p, mapped, MADV_HUGEPAGE);
+  }
+  if (p == MAP_FAILED) {
+    logError() << "Impossible d'allouer " << size << " octets." << std::endl;
+    length = mapped = 0;
+    return;
+  }
+  bytes = static_cast<unsigned char *>(p);
+}
+
+LargeBuffer::~LargeBuffer() {
+  if (bytes)
+    ::munmap(bytes, mapped);
+}
+
+std::size_t hugePageBytes() {
+  std::ifstream ifs("/proc/self/smaps_rollup");
+  std::string line;
+  while (std::getline(ifs, line)) {
+    if (line.compare(0, 14, "AnonHugePages:") == 0) {
+      std::istringstream is(line.substr(14));
+      std::size_t kb = 0;
+      is >> kb;
+      return kb * 1024;
+    }
+  }
+  return 0;
+}
+
+AccessCounterScope::AccessCounterScope() {
+  if (logLevel() < LogLevel::Debug)
+    return;
+  remoteLoads =
+      openCounter(PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_NODE));
+  tlbMisses =
+      openCounter(PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_DTLB));
+}
+
+AccessCounterScope::~AccessCounterScope() {
+  if (logLevel() < LogLevel::Debug)
+    return;
+  logDebug() << "Nœuds NUMA : " << numaNodeCount() << std::endl;
+  printCounter("Lectures sur un nœud distant : ", remoteLoads);
+  printCounter("Défauts de TLB (lectures)    : ", tlbMisses);
+  if (remoteLoads >= 0)
+    ::close(remoteLoads);
+  if (tlbMisses >= 0)
+    ::close(tlbMisses);
+}
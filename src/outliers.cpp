@@ -0,0 +1,136 @@
+/**
+ * @file outliers.cpp
+ * @brief Implementation of the statistical outlier removal.
+ */
+
+#include "outliers.hpp"
+#include "kdtree.hpp"
+#include "progress.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace {
+
+// Scale from the median absolute deviation to the standard deviation of
+// normally distributed data
+const double MAD_TO_SIGMA = 1.4826;
+
+// Smallest altitude deviation of a neighbourhood (m), so that a flat,
+// noiseless bed does not reject every centimetre
+const double MIN_DEVIATION = 0.05;
+
+// Largest distance from the neighbours' centroid, in spreads around it
+const double MAX_OFFSET = 3.0;
+
+enum Verdict : std::uint8_t { KEEP, SPIKE, FLIER };
+
+// Median of values, reordered
+double median(std::vector<double> &values) {
+  auto middle = values.begin() + values.size() / 2;
+  std::nth_element(values.begin(), middle, values.end());
+  return *middle;
+}
+
+} // namespace
+
+bool removeOutliers(std::vector<Point> &points, const OutlierOptions &options,
+                    ThreadPool &pool, std::vector<Point> *rejected,
+                    OutlierStats *stats) {
+  const std::size_t n = points.size();
+  const std::size_t k = static_cast<std::size_t>(std::max(2, options.neighbours));
+  if (n <= k)
+    return true;
+
+  KdTree tree;
+  tree.build(std::move(points), pool, true);
+  const std::vector<Point> &pts = tree.points();
+
+  // Points are visited in tree order, so consecutive ones are close: a
+  // point's k + 1 nearest (itself included) lie within the distance of the
+  // previous point's farthest plus the step between them, which bounds the
+  // search without changing its result
+  std::vector<std::uint8_t> verdict(n, KEEP);
+  progressBegin(Stage::Index, n, "points");
+  bool complete = pool.parallelFor(
+      0, n, 1 << 12, [&](std::size_t b, std::size_t e) {
+        std::vector<KdTree::Neighbour> found;
+        std::vector<double> heights;
+        double reach = std::numeric_limits<double>::infinity();
+        for (std::size_t i = b; i < e; ++i) {
+          const Point &p = pts[i];
+          if (i > b) {
+            double step = std::hypot(p.x - pts[i - 1].x, p.y - pts[i - 1].y);
+            reach = (reach + step) * (1 + 1e-9);
+          }
+          tree.nearest(p.x, p.y, static_cast<int>(k + 1), reach * reach,
+                       found);
+          reach = std::sqrt(found.front().distSq);
+
+          // The k neighbours, without the point (or one of its duplicates)
+          heights.clear();
+          double cx = 0, cy = 0;
+          for (const KdTree::Neighbour &nb : found)
+            if (nb.index != i && heights.size() < k) {
+              const Point &q = pts[nb.index];
+              heights.push_back(q.z);
+              cx += q.x;
+              cy += q.y;
+            }
+          cx /= heights.size();
+          cy /= heights.size();
+
+          double level = median(heights);
+          for (double &h : heights)
+            h = std::abs(h - level);
+          double deviation =
+              std::max(MAD_TO_SIGMA * median(heights), MIN_DEVIATION);
+          if (std::abs(p.z - level) > options.threshold * deviation) {
+            verdict[i] = SPIKE;
+            continue;
+          }
+
+          double spread = 0;
+          std::size_t counted = 0;
+          for (const KdTree::Neighbour &nb : found)
+            if (nb.index != i && counted++ < k) {
+              const Point &q = pts[nb.index];
+              spread += (q.x - cx) * (q.x - cx) + (q.y - cy) * (q.y - cy);
+            }
+          spread = std::sqrt(spread / k);
+          double offsetSq = (p.x - cx) * (p.x - cx) + (p.y - cy) * (p.y - cy);
+          if (offsetSq > MAX_OFFSET * MAX_OFFSET * spread * spread)
+            verdict[i] = FLIER;
+        }
+        progressAdvance(e - b);
+      });
+  progressEnd();
+
+  // Back to the input order: tree position of each input point, then the
+  // kept points compacted in that order
+  std::vector<std::uint32_t> where(n);
+  const std::vector<std::uint32_t> &order = tree.order();
+  for (std::size_t i = 0; i < n; ++i)
+    where[order[i]] = static_cast<std::uint32_t>(i);
+  std::vector<Point> sorted = tree.release();
+  OutlierStats counts;
+  points.clear();
+  points.reserve(complete ? std::count(verdict.begin(), verdict.end(), KEEP)
+                          : n);
+  for (std::size_t j = 0; j < n; ++j) {
+    std::size_t i = where[j];
+    if (!complete || verdict[i] == KEEP) {
+      points.push_back(sorted[i]);
+      continue;
+    }
+    ++(verdict[i] == SPIKE ? counts.vertical : counts.planar);
+    if (rejected)
+      rejected->push_back(sorted[i]);
+  }
+  if (!complete)
+    return false;
+  if (stats)
+    *stats = counts;
+  return true;
+}
@@ -0,0 +1,440 @@
+/**
+ * @file perspective.cpp
+ * @brief Tile-binned z-buffer rendering of perspective views of the mesh.
+ */
+
+#include "perspective.hpp"
+#include "image_io.hpp"
+#include "logging.hpp"
+#include "profiling.hpp"
+#include "progress.hpp"
+#include "rasterizer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+// Side of the tiles rasterized by one task (pixels): their depth buffer
+// and pixels stay in the L1/L2 cache
+const int TILE = 64;
+
+// Triangles culled and binned by one task
+const std::size_t CHUNK = 1 << 16;
+
+// Triangles ahead whose vertices are prefetched while culling: the mesh
+// may list its vertices in any order
+const std::size_t PREFETCH = 32;
+
+// Vertices projected by one task
+const std::size_t VERTEX_GRAIN = 1 << 16;
+
+// Screen coordinates are kept in 1/16 of a pixel
+const int SUBPIXEL_BITS = 4;
+const std::int64_t SUBPIXEL = 1 << SUBPIXEL_BITS;
+
+// Vertices further off-screen than this (pixels) are dropped with their
+// triangles: the edge functions then stay exact in 64 bits
+const double GUARD_BAND = 1 << 20;
+
+const double PI = 3.14159265358979323846;
+
+struct Vector {
+  double x, y, z;
+};
+
+Vector cross(const Vector &a, const Vector &b) {
+  return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+          a.x * b.y - a.y * b.x};
+}
+
+double dot(const Vector &a, const Vector &b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// Unit vector towards an azimuth (clockwise from north) and elevation, in
+// degrees
+Vector direction(double azimuth, double elevation) {
+  double a = azimuth * PI / 180, e = elevation * PI / 180;
+  return {std::sin(a) * std::cos(e), std::cos(a) * std::cos(e), std::sin(e)};
+}
+
+// A corner of a triangle on the screen: position (1/SUBPIXEL pixel, y
+// downwards), inverse of its depth (0 if dropped) and altitude
+struct Corner {
+  std::int32_t x, y;
+  float invDepth;
+  float z;
+};
+
+// A projected vertex and its position in the scene, relative to the middle:
+// the culling pass reads one record, and two fit in a cache line
+struct alignas(32) ScreenVertex {
+  Corner screen;
+  float x, y, z;
+};
+
+// A triangle left after culling, clockwise on the screen, with its shade.
+// It is copied into every bin it overlaps, so a tile reads its triangles
+// in sequence instead of gathering vertices from the whole mesh
+struct Setup {
+  Corner v[3];
+  float shade;
+};
+
+// Twice the signed area of (a, b, c) on screen; positive when clockwise
+// on the screen
+std::int64_t orient(const Corner &a, const Corner &b, const Corner &c) {
+  return static_cast<std::int64_t>(b.x - a.x) * (c.y - a.y) -
+         static_cast<std::int64_t>(b.y - a.y) * (c.x - a.x);
+}
+
+std::int64_t floorDiv(std::int64_t a, std::int64_t b) {
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// Edge function of a -> b, w(p) = A p.x + B p.y + C, positive inside a
+// clockwise triangle; edges that are not top or left lose their pixels
+// exactly on them (bias), so that two triangles never share a pixel center
+struct Edge {
+  std::int64_t a, b, c;
+  int bias;
+
+  Edge(const Corner &p, const Corner &q) {
+    a = static_cast<std::int64_t>(p.y) - q.y;
+    b = static_cast<std::int64_t>(q.x) - p.x;
+    c = static_cast<std::int64_t>(p.x) * q.y -
+        static_cast<std::int64_t>(p.y) * q.x;
+    bool topLeft = (p.y == q.y && q.x > p.x) || q.y < p.y;
+    bias = topLeft ? 0 : 1;
+    c -= bias;
+  }
+
+  std::int64_t at(std::int64_t x, std::int64_t y) const {
+    return a * x + b * y + c;
+  }
+};
+
+// Screen position of the center of pixel i
+std::int64_t center(int i) { return i * SUBPIXEL + SUBPIXEL / 2; }
+
+// Pixels whose center lies in [lo, hi] (screen coordinates), clipped to
+// [0, size)
+void pixelRange(std::int32_t lo, std::int32_t hi, int size, int &first,
+                int &last) {
+  first = static_cast<int>(std::max<std::int64_t>(
+      0, floorDiv(lo - SUBPIXEL / 2 + SUBPIXEL - 1, SUBPIXEL)));
+  last = static_cast<int>(
+      std::min<std::int64_t>(size - 1, floorDiv(hi - SUBPIXEL / 2, SUBPIXEL)));
+}
+
+// Pixels whose center lies in the box of a triangle, clipped to the image
+void pixelBox(const Corner *v, int width, int height, int &px0, int &px1,
+              int &py0, int &py1) {
+  pixelRange(std::min({v[0].x, v[1].x, v[2].x}),
+             std::max({v[0].x, v[1].x, v[2].x}), width, px0, px1);
+  pixelRange(std::min({v[0].y, v[1].y, v[2].y}),
+             std::max({v[0].y, v[1].y, v[2].y}), height, py0, py1);
+}
+
+} // namespace
+
+bool renderPerspective(const std::string &filename, const Mesh &mesh,
+                       const PerspectiveOptions &options, ThreadPool &pool,
+                       PerspectiveStats *stats) {
+  const int width = options.width, height = options.height;
+  if (mesh.points.empty() || mesh.triangles.empty() || width <= 0 ||
+      height <= 0) {
+    logError() << "Maillage vide, aucune vue en perspective." << std::endl;
+    return false;
+  }
+
+  // Scene: relief exaggerated above the lowest point
+  double minX = mesh.points[0].x, maxX = minX;
+  double minY = mesh.points[0].y, maxY = minY;
+  double minZ = mesh.points[0].z, maxZ = minZ;
+  for (const Point &p : mesh.points) {
+    minX = std::min(minX, p.x);
+    maxX = std::max(maxX, p.x);
+    minY = std::min(minY, p.y);
+    maxY = std::max(maxY, p.y);
+    minZ = std::min(minZ, p.z);
+    maxZ = std::max(maxZ, p.z);
+  }
+  const double exaggeration = options.exaggeration;
+  const Vector middle = {(minX + maxX) / 2, (minY + maxY) / 2,
+                         (maxZ - minZ) * exaggeration / 2};
+  const Vector half = {(maxX - minX) / 2, (maxY - minY) / 2,
+                       (maxZ - minZ) * exaggeration / 2};
+  const double radius = std::max(1.0, std::sqrt(dot(half, half)));
+
+  // Camera looking at the middle; at distance 1 the nearest position
+  // where all the corners of the box of the mesh are in the frame
+  const double tanY = std::tan(options.fov * PI / 360);
+  const double tanX = tanY * width / height;
+  const double focal = height / 2.0 / tanY;
+  const Vector back = direction(options.azimuth, options.elevation);
+  const Vector forward = {-back.x, -back.y, -back.z};
+  const double a = options.azimuth * PI / 180;
+  const Vector right = {-std::cos(a), std::sin(a), 0};
+  const Vector up = cross(right, forward);
+  double fit = 0;
+  for (int corner = 0; corner < 8; ++corner) {
+    Vector o = {corner & 1 ? half.x : -half.x, corner & 2 ? half.y : -half.y,
+                corner & 4 ? half.z : -half.z};
+    fit = std::max({fit, dot(o, back) + std::abs(dot(o, right)) / tanX,
+                    dot(o, back) + std::abs(dot(o, up)) / tanY});
+  }
+  const double distance = options.distance * std::max(fit, radius * 1e-3);
+  const Vector eye = {middle.x + distance * back.x,
+                      middle.y + distance * back.y,
+                      middle.z + distance * back.z};
+  const double nearPlane = radius * 1e-3;
+  const Vector light = direction(options.sunAzimuth, options.sunElevation);
+
+  // Vertices
+  std::vector<ScreenVertex> vertices(mesh.points.size());
+  bool complete = pool.parallelFor(
+      0, vertices.size(), VERTEX_GRAIN, [&](std::size_t i0, std::size_t i1) {
+        for (std::size_t i = i0; i < i1; ++i) {
+          const Point &p = mesh.points[i];
+          Vector v = {p.x - eye.x, p.y - eye.y,
+                      (p.z - minZ) * exaggeration - eye.z};
+          double depth = dot(v, forward);
+          double sx = width / 2.0 + focal * dot(v, right) / depth;
+          double sy = height / 2.0 - focal * dot(v, up) / depth;
+          ScreenVertex &s = vertices[i];
+          s.x = static_cast<float>(p.x - middle.x);
+          s.y = static_cast<float>(p.y - middle.y);
+          s.z = static_cast<float>((p.z - minZ) * exaggeration - middle.z);
+          Corner &c = s.screen;
+          c.z = static_cast<float>(p.z);
+          if (depth < nearPlane || std::abs(sx) > GUARD_BAND ||
+              std::abs(sy) > GUARD_BAND) {
+            c.x = c.y = 0;
+            c.invDepth = 0;
+            continue;
+          }
+          c.x = static_cast<std::int32_t>(std::lround(sx * SUBPIXEL));
+          c.y = static_cast<std::int32_t>(std::lround(sy * SUBPIXEL));
+          c.invDepth = static_cast<float>(1 / depth);
+        }
+      });
+  if (!complete)
+    return false;
+
+  // Culling and tile counts, chunk by chunk
+  const int tilesX = (width + TILE - 1) / TILE;
+  const int tilesY = (height + TILE - 1) / TILE;
+  const std::size_t tiles = static_cast<std::size_t>(tilesX) * tilesY;
+  const std::size_t triangles = mesh.triangles.size();
+  const std::size_t chunks = (triangles + CHUNK - 1) / CHUNK;
+  std::vector<std::vector<Setup>> kept(chunks);
+  std::vector<std::size_t> visible(chunks);
+  // counts[tile * chunks + chunk], then where the chunk writes in the tile
+  std::vector<std::size_t> counts(tiles * chunks);
+  auto countTiles = [&](const Setup &setup, std::size_t chunk) {
+    int px0, px1, py0, py1;
+    pixelBox(setup.v, width, height, px0, px1, py0, py1);
+    for (int ty = py0 / TILE; ty <= py1 / TILE; ++ty)
+      for (int tx = px0 / TILE; tx <= px1 / TILE; ++tx)
+        ++counts[(static_cast<std::size_t>(ty) * tilesX + tx) * chunks +
+                 chunk];
+  };
+  complete = pool.parallelFor(
+      0, chunks, 1, [&](std::size_t c0, std::size_t c1) {
+        std::vector<Setup> scratch;
+        for (std::size_t chunk = c0; chunk < c1; ++chunk) {
+          const std::size_t t0 = chunk * CHUNK;
+          const std::size_t t1 = std::min(triangles, t0 + CHUNK);
+          scratch.clear();
+          for (std::size_t t = t0; t < t1; ++t) {
+            if (t + PREFETCH < t1) {
+              const Triangle &next = mesh.triangles[t + PREFETCH];
+              __builtin_prefetch(&vertices[next.p1]);
+              __builtin_prefetch(&vertices[next.p2]);
+              __builtin_prefetch(&vertices[next.p3]);
+            }
+            const Triangle &tri = mesh.triangles[t];
+            const ScreenVertex &v1 = vertices[tri.p1];
+            const ScreenVertex &v2 = vertices[tri.p2];
+            const ScreenVertex &v3 = vertices[tri.p3];
+            Setup setup = {{v1.screen, v2.screen, v3.screen}, 0};
+            if (v1.screen.invDepth == 0 || v2.screen.invDepth == 0 ||
+                v3.screen.invDepth == 0)
+              continue;
+            int px0, px1, py0, py1;
+            pixelBox(setup.v, width, height, px0, px1, py0, py1);
+            if (px0 > px1 || py0 > py1)
+              continue;
+            // Seen from above, the screen reverses the orientation of a
+            // triangle on the ground: same sign, it faces away
+            Vector e1 = {double(v2.x) - v1.x, double(v2.y) - v1.y,
+                         double(v2.z) - v1.z};
+            Vector e2 = {double(v3.x) - v1.x, double(v3.y) - v1.y,
+                         double(v3.z) - v1.z};
+            Vector normal = cross(e1, e2);
+            std::int64_t area = orient(setup.v[0], setup.v[1], setup.v[2]);
+            if (area == 0 || (area > 0) == (normal.z > 0))
+              continue;
+            if (area < 0)
+              std::swap(setup.v[1], setup.v[2]);
+            // Same light model as the top-down image, from the sun
+            double length = std::sqrt(dot(normal, normal));
+            double intensity =
+                std::abs(normal.z) > 0
+                    ? dot(normal, light) / length * (normal.z > 0 ? 1 : -1)
+                    : 0;
+            setup.shade =
+                static_cast<float>(0.4 + 0.6 * std::max(0.0, intensity));
+            countTiles(setup, chunk);
+            scratch.push_back(setup);
+          }
+          kept[chunk].assign(scratch.begin(), scratch.end());
+          visible[chunk] = scratch.size();
+        }
+      });
+  std::vector<ScreenVertex>().swap(vertices);
+  if (!complete)
+    return false;
+
+  // Bins: tile after tile, each in the order of the chunks
+  std::vector<std::size_t> tileStart(tiles + 1);
+  std::size_t total = 0;
+  for (std::size_t tile = 0; tile < tiles; ++tile) {
+    tileStart[tile] = total;
+    for (std::size_t chunk = 0; chunk < chunks; ++chunk) {
+      std::size_t n = counts[tile * chunks + chunk];
+      counts[tile * chunks + chunk] = total;
+      total += n;
+    }
+  }
+  tileStart[tiles] = total;
+  std::vector<Setup> bins(total);
+  complete = pool.parallelFor(
+      0, chunks, 1, [&](std::size_t c0, std::size_t c1) {
+        for (std::size_t chunk = c0; chunk < c1; ++chunk) {
+          for (const Setup &setup : kept[chunk]) {
+            int px0, px1, py0, py1;
+            pixelBox(setup.v, width, height, px0, px1, py0, py1);
+            for (int ty = py0 / TILE; ty <= py1 / TILE; ++ty)
+              for (int tx = px0 / TILE; tx <= px1 / TILE; ++tx)
+                bins[counts[(static_cast<std::size_t>(ty) * tilesX + tx) *
+                                chunks +
+                            chunk]++] = setup;
+          }
+          std::vector<Setup>().swap(kept[chunk]);
+        }
+      });
+  std::vector<std::size_t>().swap(counts);
+  if (!complete)
+    return false;
+
+  PpmWriter writer;
+  if (!writer.open(filename, width, height)) {
+    logError() << "Erreur d'écriture dans " << filename << std::endl;
+    return false;
+  }
+
+  // Tiles, each with its own depth buffer, written as they are done
+  std::atomic<std::size_t> covered{0};
+  std::atomic<bool> writeFailed{false};
+  progressBegin(Stage::Render, tiles, "tuiles");
+  complete = pool.parallelFor(0, tiles, 1, [&](std::size_t k0,
+                                               std::size_t k1) {
+    std::vector<float> depth(TILE * TILE), altitude(TILE * TILE),
+        lit(TILE * TILE);
+    std::vector<unsigned char> pixels(TILE * TILE * 3);
+    for (std::size_t tile = k0; tile < k1; ++tile) {
+      const int col0 = static_cast<int>(tile % tilesX) * TILE;
+      const int row0 = static_cast<int>(tile / tilesX) * TILE;
+      const int cols = std::min(TILE, width - col0);
+      const int rows = std::min(TILE, height - row0);
+      std::fill(depth.begin(), depth.end(), 0.0f);
+
+      for (std::size_t k = tileStart[tile]; k < tileStart[tile + 1]; ++k) {
+        const Setup &setup = bins[k];
+        const Corner &v1 = setup.v[0], &v2 = setup.v[1], &v3 = setup.v[2];
+        const std::int64_t area = orient(v1, v2, v3);
+        // w1 weighs v1 (edge v2 -> v3), and so on
+        const Edge e1(v2, v3), e2(v3, v1), e3(v1, v2);
+        int px0, px1, py0, py1;
+        pixelBox(setup.v, width, height, px0, px1, py0, py1);
+        px0 = std::max(px0, col0);
+        px1 = std::min(px1, col0 + cols - 1);
+        py0 = std::max(py0, row0);
+        py1 = std::min(py1, row0 + rows - 1);
+
+        // Depth and altitude over the depth are linear on the screen
+        const float invArea = 1.0f / static_cast<float>(area);
+        const float d1 = v1.invDepth, d2 = v2.invDepth, d3 = v3.invDepth;
+        const float z1 = v1.z * d1, z2 = v2.z * d2, z3 = v3.z * d3;
+        const float s = setup.shade;
+        const std::int64_t step1 = e1.a * SUBPIXEL, step2 = e2.a * SUBPIXEL,
+                           step3 = e3.a * SUBPIXEL;
+        for (int py = py0; py <= py1; ++py) {
+          std::int64_t w1 = e1.at(center(px0), center(py));
+          std::int64_t w2 = e2.at(center(px0), center(py));
+          std::int64_t w3 = e3.at(center(px0), center(py));
+          const std::size_t line = static_cast<std::size_t>(py - row0) * TILE;
+          for (int px = px0; px <= px1;
+               ++px, w1 += step1, w2 += step2, w3 += step3) {
+            if ((w1 | w2 | w3) < 0)
+              continue;
+            // Weights without the bias: a pixel center on a vertex of a
+            // tiny triangle may have all three at 0 otherwise
+            const float f1 = static_cast<float>(w1 + e1.bias),
+                        f2 = static_cast<float>(w2 + e2.bias),
+                        f3 = static_cast<float>(w3 + e3.bias);
+            const float d = f1 * d1 + f2 * d2 + f3 * d3;
+            const std::size_t p = line + (px - col0);
+            if (d * invArea <= depth[p])
+              continue;
+            depth[p] = d * invArea;
+            altitude[p] = (f1 * z1 + f2 * z2 + f3 * z3) / d;
+            lit[p] = s;
+          }
+        }
+      }
+
+      std::size_t filled = 0;
+      for (int r = 0; r < rows; ++r)
+        for (int c = 0; c < cols; ++c) {
+          const std::size_t p = static_cast<std::size_t>(r) * TILE + c;
+          unsigned char *out = &pixels[p * 3];
+          if (depth[p] == 0) {
+            out[0] = out[1] = out[2] = 0;
+            continue;
+          }
+          ++filled;
+          Color color = getColor(altitude[p], minZ, maxZ);
+          out[0] = static_cast<unsigned char>(color.r * lit[p]);
+          out[1] = static_cast<unsigned char>(color.g * lit[p]);
+          out[2] = static_cast<unsigned char>(color.b * lit[p]);
+        }
+      covered += filled;
+      if (!writer.writeBlock(row0, rows, col0, cols, pixels.data(),
+                             static_cast<std::size_t>(TILE) * 3))
+        writeFailed = true;
+      progressAdvance(1);
+    }
+  });
+  progressEnd();
+  if (!complete)
+    return false;
+  if (writeFailed || !writer.close()) {
+    logError() << "Erreur d'écriture dans " << filename << std::endl;
+    return false;
+  }
+
+  if (stats) {
+    stats->visible = 0;
+    for (std::size_t n : visible)
+      stats->visible += n;
+    stats->binned = total;
+    stats->pixels = covered;
+  }
+  return true;
+}
@@ -0,0 +1,270 @@
+/**
+ * @file planner.cpp
+ * @brief Implementation of the memory-budget planner.
+ */
+
+#include "planner.hpp"
+#include "point_io.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+// Libraries, PROJ database and thread stacks (14 Mio measured on a
+// three-point file)
+const std::size_t BASE_BYTES = std::size_t(16) << 20;
+
+// Per point of a mesh: its copy of the point, the Delaunator buffers, the
+// filtered triangles and the QuadTree. Whole-image runs peak at 283 and 303
+// bytes per point on data/MNT.txt and data/lac.txt, loaded points included,
+// so adding the loaded points on top errs on the safe side.
+const std::size_t MESH_BYTES_PER_POINT = 288;
+
+// Subdivisions of a tile side when counting the points a halo reaches
+const int HALO_SUBDIVISIONS = 8;
+
+// Read buffer of the loader, split in one piece per task
+const std::size_t LOAD_BLOCK_BYTES = std::size_t(8) << 20;
+
+// Bytes of a sample used to measure the average line length
+const std::size_t SAMPLE_BYTES = 1 << 16;
+
+std::size_t wholeImageBytes(std::size_t points, std::size_t width,
+                            std::size_t height, MemoryPlan &plan) {
+  plan.tiled = false;
+  plan.tileSize = 0;
+  plan.tilesInFlight = 0;
+  plan.pointBytes = points * sizeof(Point);
+  plan.meshBytes = points * MESH_BYTES_PER_POINT;
+  plan.imageBytes = width * height * 3;
+  return plan.pointBytes + plan.meshBytes + plan.imageBytes;
+}
+
+// Largest number of points gathered by one tile (its own cell and its
+// halo), counted on the data. The histogram is finer than the tiles so that
+// a halo only adds a thin ring of cells.
+std::size_t densestTile(const std::vector<Point> &points,
+                        const RasterGrid &grid, int tileSize, double halo) {
+  const int k = HALO_SUBDIVISIONS;
+  const int tilesX = (grid.width + tileSize - 1) / tileSize;
+  const int tilesY = (grid.height + tileSize - 1) / tileSize;
+  const int cellsX = tilesX * k;
+  const int cellsY = tilesY * k;
+  const double cellW = tileSize * grid.pixelSizeX / k;
+  const double cellH = tileSize * grid.pixelSizeY / k;
+
+  // Counts per cell, then 2D prefix sums for the tile windows
+  std::vector<std::size_t> sums(static_cast<std::size_t>(cellsX + 1) *
+                                    (cellsY + 1),
+                                0);
+  auto at = [&](int x, int y) -> std::size_t & {
+    return sums[static_cast<std::size_t>(y) * (cellsX + 1) + x];
+  };
+  for (const Point &p : points) {
+    int cx = static_cast<int>(std::floor((p.x - grid.minX) / cellW));
+    int cy = static_cast<int>(std::floor((grid.maxY - p.y) / cellH));
+    cx = std::min(cellsX - 1, std::max(0, cx));
+    cy = std::min(cellsY - 1, std::max(0, cy));
+    ++at(cx + 1, cy + 1);
+  }
+  for (int y = 1; y <= cellsY; ++y)
+    for (int x = 1; x <= cellsX; ++x)
+      at(x, y) += at(x - 1, y) + at(x, y - 1) - at(x - 1, y - 1);
+
+  const int hx = static_cast<int>(std::ceil(halo / cellW));
+  const int hy = static_cast<int>(std::ceil(halo / cellH));
+  std::size_t densest = 0;
+  for (int ty = 0; ty < tilesY; ++ty) {
+    for (int tx = 0; tx < tilesX; ++tx) {
+      int x0 = std::max(0, tx * k - hx);
+      int x1 = std::min(cellsX, (tx + 1) * k + hx);
+      int y0 = std::max(0, ty * k - hy);
+      int y1 = std::min(cellsY, (ty + 1) * k + hy);
+      std::size_t n = at(x1, y1) - at(x0, y1) - at(x1, y0) + at(x0, y0);
+      densest = std::max(densest, n);
+    }
+  }
+  return densest;
+}
+
+} // namespace
+
+bool parseByteSize(const std::string &text, std::size_t &bytes) {
+  const char *s = text.c_str();
+  char *end = nullptr;
+  double value = std::strtod(s, &end);
+  if (end == s || !(value > 0))
+    return false;
+
+  std::string unit(end);
+  for (char &c : unit)
+    c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  if (unit.size() >= 2 && unit.compare(unit.size() - 2, 2, "IB") == 0)
+    unit.resize(unit.size() - 2);
+  else if (!unit.empty() && unit.back() == 'B')
+    unit.pop_back();
+
+  double scale = 1;
+  if (unit == "K")
+    scale = 1024.0;
+  else if (unit == "M")
+    scale = 1024.0 * 1024;
+  else if (unit == "G")
+    scale = 1024.0 * 1024 * 1024;
+  else if (unit == "T")
+    scale = 1024.0 * 1024 * 1024 * 1024;
+  else if (!unit.empty())
+    return false;
+
+  bytes = static_cast<std::size_t>(value * scale);
+  return bytes > 0;
+}
+
+std::string formatBytes(std::size_t bytes) {
+  const char *units[] = {"o", "Kio", "Mio", "Gio", "Tio"};
+  double value = static_cast<double>(bytes);
+  int u = 0;
+  while (value >= 1024 && u < 4) {
+    value /= 1024;
+    ++u;
+  }
+  std::ostringstream os;
+  os << std::fixed << std::setprecision(u == 0 ? 0 : 1) << value << " "
+     << units[u];
+  return os.str();
+}
+
+std::size_t estimatePointCount(const std::string &filename) {
+  FILE *f = fopen(filename.c_str(), "rb");
+  if (!f)
+    return 0;
+  PointFormat format = pointFormatFromPath(filename);
+  if (format == PointFormat::Las) {
+    // Point count of the header, at the offset readLas() reads it from
+    unsigned char count[4];
+    bool ok = fseek(f, 107, SEEK_SET) == 0 && fread(count, 1, 4, f) == 4;
+    fclose(f);
+    if (!ok)
+      return 0;
+    return std::size_t(count[0]) | std::size_t(count[1]) << 8 |
+           std::size_t(count[2]) << 16 | std::size_t(count[3]) << 24;
+  }
+
+  std::vector<char> sample(format == PointFormat::Text ? SAMPLE_BYTES : 0);
+  std::size_t read = fread(sample.data(), 1, sample.size(), f);
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fclose(f);
+  if (size <= 0)
+    return 0;
+  if (format == PointFormat::Binary)
+    return static_cast<std::size_t>(size) / (3 * sizeof(double));
+  if (read == 0)
+    return 0;
+
+  std::size_t lines = std::count(sample.begin(), sample.begin() + read, '\n');
+  if (lines == 0)
+    return 1;
+  double bytesPerLine = static_cast<double>(read) / lines;
+  return static_cast<std::size_t>(std::ceil(size / bytesPerLine));
+}
+
+std::size_t estimateLoadBytes(std::size_t points, int threads) {
+  // Points, plus the growth of the result while the blocks are appended
+  return BASE_BYTES + points * sizeof(Point) * 3 / 2 +
+         LOAD_BLOCK_BYTES * (1 + static_cast<std::size_t>(std::max(1, threads)));
+}
+
+bool planMemory(const std::vector<Point> &points, const RasterGrid &grid,
+                std::size_t limit, int threads, double halo,
+                int forcedTileSize, MemoryPlan &plan) {
+  threads = std::max(1, threads);
+  const std::size_t n = points.size();
+  const std::size_t load = estimateLoadBytes(n, threads);
+
+  if (forcedTileSize <= 0) {
+    std::size_t whole = BASE_BYTES + wholeImageBytes(n, grid.width,
+                                                     grid.height, plan);
+    plan.estimatedBytes = std::max(load, whole);
+    if (plan.estimatedBytes <= limit)
+      return true;
+  }
+
+  // Tiled: the sorted points stay in memory, plus the sort itself (a copy
+  // and one tile number per point), plus the tiles in flight
+  const std::size_t resident = BASE_BYTES + n * sizeof(Point);
+  const std::size_t sorting = resident + n * (sizeof(Point) + 4);
+
+  std::vector<int> sizes;
+  if (forcedTileSize > 0) {
+    sizes.push_back(forcedTileSize);
+  } else {
+    int largest = 1024;
+    while (largest > 32 && largest >= std::max(grid.width, grid.height))
+      largest /= 2;
+    for (int s = largest; s >= 32; s /= 2)
+      sizes.push_back(s);
+  }
+
+  MemoryPlan fallback;
+  bool found = false;
+  for (int size : sizes) {
+    const int tiles = ((grid.width + size - 1) / size) *
+                      ((grid.height + size - 1) / size);
+    std::size_t densest = densestTile(points, grid, size, halo);
+
+    MemoryPlan candidate;
+    candidate.tiled = true;
+    candidate.tileSize = size;
+    candidate.pointBytes = n * sizeof(Point);
+    candidate.meshBytes = densest * MESH_BYTES_PER_POINT;
+    candidate.imageBytes = static_cast<std::size_t>(size) * size * 3;
+    std::size_t perTile = candidate.meshBytes + candidate.imageBytes;
+
+    int wanted = std::min(2 * threads, tiles);
+    std::size_t room = limit > resident ? limit - resident : 0;
+    candidate.tilesInFlight =
+        static_cast<int>(std::min<std::size_t>(wanted, room / perTile));
+    candidate.estimatedBytes =
+        std::max({load, sorting,
+                  resident + std::max(1, candidate.tilesInFlight) * perTile});
+
+    if (candidate.tilesInFlight >= 1 && candidate.estimatedBytes <= limit) {
+      if (candidate.tilesInFlight >= std::min(threads, tiles)) {
+        plan = candidate;
+        return true;
+      }
+      if (!found) {
+        fallback = candidate;
+        found = true;
+      }
+    } else if (!found) {
+      // Keep the smallest plan tried to report what would be needed
+      candidate.tilesInFlight = 1;
+      fallback = candidate;
+    }
+  }
+  plan = fallback;
+  return found;
+}
+
+void printPlan(std::ostream &os, const MemoryPlan &plan, std::size_t limit) {
+  if (plan.tiled)
+    os << "  rendu            : tuiles de " << plan.tileSize << " px, "
+       << plan.tilesInFlight << " en mémoire" << std::endl;
+  else
+    os << "  rendu            : image entière" << std::endl;
+  os << "  points           : " << formatBytes(plan.pointBytes) << std::endl;
+  os << "  maillage + index : " << formatBytes(plan.meshBytes)
+     << (plan.tiled ? " par tuile" : "") << std::endl;
+  os << "  image            : " << formatBytes(plan.imageBytes)
+     << (plan.tiled ? " par tuile, écriture au fil de l'eau" : "")
+     << std::endl;
+  os << "  pic estimé       : " << formatBytes(plan.estimatedBytes) << " / "
+     << formatBytes(limit) << std::endl;
+}
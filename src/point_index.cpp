@@ -0,0 +1,220 @@
+/**
+ * @file point_index.cpp
+ * @brief Implementation of the spatial pre-index of text point files.
+ */
+
+#include "point_index.hpp"
+#include "logging.hpp"
+#include "point_io.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+namespace {
+
+// Ranges read and projected together while indexing
+const std::size_t RANGES_PER_BATCH = 64;
+
+const char *const INDEX_TAG = "terrain-index";
+
+std::size_t fileSize(const std::string &path) {
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f)
+    return 0;
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fclose(f);
+  return size > 0 ? static_cast<std::size_t>(size) : 0;
+}
+
+// Cuts the file into ranges of about rangeBytes ending after a newline
+std::vector<IndexedRange> cutRanges(FILE *f, std::size_t size,
+                                    std::size_t rangeBytes) {
+  std::vector<IndexedRange> ranges;
+  std::size_t start = 0;
+  std::vector<char> buffer(1 << 16);
+  while (start < size) {
+    std::size_t end = std::min(size, start + rangeBytes);
+    // Move end to just after the next newline
+    fseek(f, static_cast<long>(end), SEEK_SET);
+    while (end < size) {
+      std::size_t n = fread(buffer.data(), 1, buffer.size(), f);
+      if (n == 0) {
+        end = size;
+        break;
+      }
+      auto nl = std::find(buffer.begin(), buffer.begin() + n, '\n');
+      if (nl != buffer.begin() + n) {
+        end += static_cast<std::size_t>(nl - buffer.begin()) + 1;
+        break;
+      }
+      end += n;
+    }
+    end = std::min(end, size);
+    IndexedRange range;
+    range.offset = start;
+    range.length = end - start;
+    ranges.push_back(range);
+    start = end;
+  }
+  return ranges;
+}
+
+} // namespace
+
+std::string pointIndexPath(const std::string &input) { return input + ".idx"; }
+
+bool buildPointIndex(const std::string &input, std::size_t rangeBytes,
+                     ThreadPool &pool, PointIndex &index) {
+  if (pointFormatFromPath(input) != PointFormat::Text) {
+    logError() << "Seuls les fichiers texte peuvent être indexés : " << input
+               << std::endl;
+    return false;
+  }
+  FILE *f = fopen(input.c_str(), "rb");
+  if (!f) {
+    logError() << "Impossible d'ouvrir le fichier " << input << std::endl;
+    return false;
+  }
+  index = PointIndex();
+  index.fileSize = fileSize(input);
+  index.ranges = cutRanges(f, index.fileSize, std::max<std::size_t>(
+                                                  rangeBytes, 1));
+  fclose(f);
+
+  const double inf = std::numeric_limits<double>::infinity();
+  index.bounds = {inf, inf, -inf, -inf};
+  index.minZ = inf;
+  index.maxZ = -inf;
+
+  // Ranges are read one by one (to count their points) but projected by
+  // batches, so each batch creates its PROJ contexts once
+  for (std::size_t b = 0; b < index.ranges.size(); b += RANGES_PER_BATCH) {
+    std::size_t e = std::min(index.ranges.size(), b + RANGES_PER_BATCH);
+    std::vector<Point> points;
+    for (std::size_t r = b; r < e; ++r) {
+      std::vector<Point> part = lirePlages(
+          input, {{index.ranges[r].offset, index.ranges[r].length}}, pool);
+      index.ranges[r].points = part.size();
+      points.insert(points.end(), part.begin(), part.end());
+    }
+    if (!points.empty() && !projeterPoints(points, pool))
+      return false;
+
+    std::size_t next = 0;
+    for (std::size_t r = b; r < e; ++r) {
+      IndexedRange &range = index.ranges[r];
+      range.bounds = {inf, inf, -inf, -inf};
+      for (std::size_t i = 0; i < range.points; ++i, ++next) {
+        const Point &p = points[next];
+        range.bounds.minX = std::min(range.bounds.minX, p.x);
+        range.bounds.minY = std::min(range.bounds.minY, p.y);
+        range.bounds.maxX = std::max(range.bounds.maxX, p.x);
+        range.bounds.maxY = std::max(range.bounds.maxY, p.y);
+        index.minZ = std::min(index.minZ, p.z);
+        index.maxZ = std::max(index.maxZ, p.z);
+      }
+      if (range.points == 0)
+        continue;
+      index.points += range.points;
+      index.bounds.minX = std::min(index.bounds.minX, range.bounds.minX);
+      index.bounds.minY = std::min(index.bounds.minY, range.bounds.minY);
+      index.bounds.maxX = std::max(index.bounds.maxX, range.bounds.maxX);
+      index.bounds.maxY = std::max(index.bounds.maxY, range.bounds.maxY);
+    }
+  }
+  return index.points > 0;
+}
+
+bool writePointIndex(const std::string &path, const PointIndex &index) {
+  std::ofstream ofs(path);
+  if (!ofs) {
+    logError() << "Impossible de créer l'index " << path << std::endl;
+    return false;
+  }
+  ofs << std::setprecision(17);
+  ofs << "# " << INDEX_TAG << " 1\n";
+  ofs << "size " << index.fileSize << "\n";
+  ofs << "points " << index.points << "\n";
+  ofs << "bounds " << index.bounds.minX << " " << index.bounds.minY << " "
+      << index.bounds.maxX << " " << index.bounds.maxY << " " << index.minZ
+      << " " << index.maxZ << "\n";
+  for (const IndexedRange &r : index.ranges) {
+    ofs << "range " << r.offset << " " << r.length << " " << r.points;
+    if (r.points > 0)
+      ofs << " " << r.bounds.minX << " " << r.bounds.minY << " "
+          << r.bounds.maxX << " " << r.bounds.maxY;
+    ofs << "\n";
+  }
+  return static_cast<bool>(ofs);
+}
+
+bool readPointIndex(const std::string &input, PointIndex &index) {
+  std::string path = pointIndexPath(input);
+  std::ifstream ifs(path);
+  if (!ifs)
+    return false;
+
+  index = PointIndex();
+  std::string line, tag;
+  int version = 0;
+  std::getline(ifs, line);
+  std::istringstream header(line);
+  header >> tag >> tag >> version;
+  bool ok = tag == INDEX_TAG && version == 1;
+
+  while (ok && std::getline(ifs, line)) {
+    std::istringstream is(line);
+    std::string key;
+    is >> key;
+    if (key == "size") {
+      is >> index.fileSize;
+    } else if (key == "points") {
+      is >> index.points;
+    } else if (key == "bounds") {
+      is >> index.bounds.minX >> index.bounds.minY >> index.bounds.maxX >>
+          index.bounds.maxY >> index.minZ >> index.maxZ;
+    } else if (key == "range") {
+      IndexedRange r;
+      is >> r.offset >> r.length >> r.points;
+      if (r.points > 0)
+        is >> r.bounds.minX >> r.bounds.minY >> r.bounds.maxX >>
+            r.bounds.maxY;
+      index.ranges.push_back(r);
+    } else if (!key.empty()) {
+      ok = false;
+    }
+    ok = ok && !is.fail();
+  }
+
+  if (!ok) {
+    logError() << "Index illisible, ignoré : " << path << std::endl;
+    return false;
+  }
+  if (index.fileSize != fileSize(input)) {
+    logError() << "Index périmé (taille du fichier différente), ignoré : "
+               << path << std::endl;
+    return false;
+  }
+  return index.points > 0;
+}
+
+std::vector<std::pair<std::size_t, std::size_t>>
+selectRanges(const PointIndex &index, const BoundingBox &area) {
+  std::vector<std::pair<std::size_t, std::size_t>> selected;
+  for (const IndexedRange &r : index.ranges) {
+    if (r.points == 0 || !r.bounds.intersects(area))
+      continue;
+    // Adjacent ranges are merged into one read
+    if (!selected.empty() &&
+        selected.back().first + selected.back().second == r.offset)
+      selected.back().second += r.length;
+    else
+      selected.emplace_back(r.offset, r.length);
+  }
+  return selected;
+}
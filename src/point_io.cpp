@@ -0,0 +1,262 @@
+/**
+ * @file point_io.cpp
+ * @brief Implementation of the binary and LAS point-cloud formats.
+ */
+
+#include "point_io.hpp"
+#include "logging.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const std::size_t LAS_HEADER_SIZE = 227;
+const std::size_t LAS_RECORD_SIZE = 20; // Point data format 0
+const double LAS_XY_SCALE = 1e-7;       // Degrees
+const double LAS_Z_SCALE = 1e-3;        // Meters
+
+// Little-endian field access (LAS is little-endian, as is the host)
+template <typename T> void put(char *buf, std::size_t offset, T value) {
+  std::memcpy(buf + offset, &value, sizeof(T));
+}
+
+template <typename T> T get(const char *buf, std::size_t offset) {
+  T value;
+  std::memcpy(&value, buf + offset, sizeof(T));
+  return value;
+}
+
+bool endsWith(const std::string &s, const std::string &suffix) {
+  if (s.size() < suffix.size())
+    return false;
+  return std::equal(suffix.rbegin(), suffix.rend(), s.rbegin(),
+                    [](char a, char b) { return std::tolower(a) == b; });
+}
+
+bool readBinary(FILE *f, std::vector<Point> &points) {
+  double record[3];
+  std::vector<double> chunk(3 * 65536);
+  std::size_t n;
+  while ((n = fread(chunk.data(), sizeof(record), 65536, f)) > 0) {
+    for (std::size_t i = 0; i < n; ++i) {
+      // Stored as latitude, longitude, altitude
+      points.push_back({chunk[3 * i + 1], chunk[3 * i], chunk[3 * i + 2]});
+    }
+  }
+  return !ferror(f);
+}
+
+bool readLas(FILE *f, std::vector<Point> &points) {
+  char header[LAS_HEADER_SIZE];
+  if (fread(header, 1, LAS_HEADER_SIZE, f) != LAS_HEADER_SIZE ||
+      std::memcmp(header, "LASF", 4) != 0) {
+    logError() << "En-tête LAS invalide." << std::endl;
+    return false;
+  }
+  auto dataOffset = get<std::uint32_t>(header, 96);
+  auto recordLength = get<std::uint16_t>(header, 105);
+  std::uint64_t count = get<std::uint32_t>(header, 107);
+  double scale[3], offset[3];
+  for (int k = 0; k < 3; ++k) {
+    scale[k] = get<double>(header, 131 + 8 * k);
+    offset[k] = get<double>(header, 155 + 8 * k);
+  }
+  if (recordLength < 12 || fseek(f, dataOffset, SEEK_SET) != 0)
+    return false;
+
+  points.reserve(points.size() + count);
+  std::vector<char> chunk(static_cast<std::size_t>(recordLength) * 65536);
+  std::uint64_t remaining = count;
+  while (remaining > 0) {
+    std::size_t want =
+        static_cast<std::size_t>(std::min<std::uint64_t>(remaining, 65536));
+    std::size_t n = fread(chunk.data(), recordLength, want, f);
+    if (n == 0)
+      break;
+    for (std::size_t i = 0; i < n; ++i) {
+      const char *r = chunk.data() + i * recordLength;
+      points.push_back({get<std::int32_t>(r, 0) * scale[0] + offset[0],
+                        get<std::int32_t>(r, 4) * scale[1] + offset[1],
+                        get<std::int32_t>(r, 8) * scale[2] + offset[2]});
+    }
+    remaining -= n;
+  }
+  return remaining == 0;
+}
+
+} // namespace
+
+PointFormat pointFormatFromPath(const std::string &path) {
+  if (endsWith(path, ".bin"))
+    return PointFormat::Binary;
+  if (endsWith(path, ".las"))
+    return PointFormat::Las;
+  return PointFormat::Text;
+}
+
+bool parsePointFormat(const std::string &name, PointFormat &format) {
+  if (name == "text" || name == "txt")
+    format = PointFormat::Text;
+  else if (name == "bin" || name == "binary")
+    format = PointFormat::Binary;
+  else if (name == "las")
+    format = PointFormat::Las;
+  else
+    return false;
+  return true;
+}
+
+bool readPointFile(const std::string &path, PointFormat format,
+                   std::vector<Point> &points) {
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f) {
+    logError() << "Impossible d'ouvrir le fichier " << path << std::endl;
+    return false;
+  }
+  bool ok = format == PointFormat::Las ? readLas(f, points)
+                                       : readBinary(f, points);
+  fclose(f);
+  return ok;
+}
+
+PointWriter::~PointWriter() { close(); }
+
+bool PointWriter::open(const std::string &path, PointFormat fmt) {
+  close();
+  format = fmt;
+  count = 0;
+  if (path == "-") {
+    if (format == PointFormat::Las) {
+      logError() << "Le format LAS ne peut pas être écrit sur stdout."
+                << std::endl;
+      return false;
+    }
+    file = stdout;
+    ownsFile = false;
+  } else {
+    file = fopen(path.c_str(), "wb");
+    ownsFile = true;
+    if (!file) {
+      logError() << "Impossible de créer le fichier " << path << std::endl;
+      return false;
+    }
+  }
+  if (format == PointFormat::Las) {
+    // Placeholder, rewritten with the final counts and bounds by close()
+    std::vector<char> header(LAS_HEADER_SIZE, 0);
+    return fwrite(header.data(), 1, header.size(), file) == header.size();
+  }
+  return true;
+}
+
+bool PointWriter::write(const std::vector<Point> &points) {
+  if (!file)
+    return false;
+  if (points.empty())
+    return true;
+
+  if (count == 0) {
+    minX = maxX = points[0].x;
+    minY = maxY = points[0].y;
+    minZ = maxZ = points[0].z;
+  }
+  for (const auto &p : points) {
+    minX = std::min(minX, p.x);
+    maxX = std::max(maxX, p.x);
+    minY = std::min(minY, p.y);
+    maxY = std::max(maxY, p.y);
+    minZ = std::min(minZ, p.z);
+    maxZ = std::max(maxZ, p.z);
+  }
+
+  buffer.clear();
+  if (format == PointFormat::Text) {
+    char line[96];
+    for (const auto &p : points) {
+      int len = snprintf(line, sizeof(line), "%.8f %.8f %.3f\n", p.y, p.x, p.z);
+      buffer.insert(buffer.end(), line, line + len);
+    }
+  } else if (format == PointFormat::Binary) {
+    buffer.resize(points.size() * 3 * sizeof(double));
+    char *out = buffer.data();
+    for (const auto &p : points) {
+      double record[3] = {p.y, p.x, p.z};
+      std::memcpy(out, record, sizeof(record));
+      out += sizeof(record);
+    }
+  } else {
+    if (count + points.size() > UINT32_MAX) {
+      logError() << "LAS 1.2 est limité à 2^32 points." << std::endl;
+      return false;
+    }
+    // Offsets are fixed by the first point so that every record stays in range
+    double offX = std::floor(count ? offsetX : points[0].x);
+    double offY = std::floor(count ? offsetY : points[0].y);
+    offsetX = offX;
+    offsetY = offY;
+    buffer.assign(points.size() * LAS_RECORD_SIZE, 0);
+    char *out = buffer.data();
+    for (const auto &p : points) {
+      put<std::int32_t>(out, 0,
+                        static_cast<std::int32_t>(
+                            std::lround((p.x - offX) / LAS_XY_SCALE)));
+      put<std::int32_t>(out, 4,
+                        static_cast<std::int32_t>(
+                            std::lround((p.y - offY) / LAS_XY_SCALE)));
+      put<std::int32_t>(
+          out, 8, static_cast<std::int32_t>(std::lround(p.z / LAS_Z_SCALE)));
+      out[14] = 0x09; // Return 1 of 1
+      out += LAS_RECORD_SIZE;
+    }
+  }
+  count += points.size();
+  return fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+}
+
+bool PointWriter::writeLasHeader() {
+  char h[LAS_HEADER_SIZE];
+  std::memset(h, 0, sizeof(h));
+  std::memcpy(h, "LASF", 4);
+  h[24] = 1; // Version 1.2
+  h[25] = 2;
+  std::strncpy(h + 26, "synthetic", 32);
+  std::strncpy(h + 58, "terrain_synth", 32);
+  put<std::uint16_t>(h, 94, LAS_HEADER_SIZE);
+  put<std::uint32_t>(h, 96, LAS_HEADER_SIZE);
+  put<std::uint32_t>(h, 100, 0); // No VLR
+  h[104] = 0;                    // Point data format 0
+  put<std::uint16_t>(h, 105, LAS_RECORD_SIZE);
+  put<std::uint32_t>(h, 107, static_cast<std::uint32_t>(count));
+  put<std::uint32_t>(h, 111, static_cast<std::uint32_t>(count));
+  put<double>(h, 131, LAS_XY_SCALE);
+  put<double>(h, 139, LAS_XY_SCALE);
+  put<double>(h, 147, LAS_Z_SCALE);
+  put<double>(h, 155, offsetX);
+  put<double>(h, 163, offsetY);
+  put<double>(h, 171, 0.0);
+  put<double>(h, 179, maxX);
+  put<double>(h, 187, minX);
+  put<double>(h, 195, maxY);
+  put<double>(h, 203, minY);
+  put<double>(h, 211, maxZ);
+  put<double>(h, 219, minZ);
+  return fseek(file, 0, SEEK_SET) == 0 &&
+         fwrite(h, 1, sizeof(h), file) == sizeof(h);
+}
+
+bool PointWriter::close() {
+  if (!file)
+    return true;
+  bool ok = true;
+  if (format == PointFormat::Las)
+    ok = writeLasHeader();
+  ok = fflush(file) == 0 && ok;
+  if (ownsFile)
+    ok = fclose(file) == 0 && ok;
+  file = nullptr;
+  return ok;
+}
@@ -0,0 +1,296 @@
+/**
+ * @file profiling.cpp
+ * @brief Implementation of stage tagging and the opt-in allocation tracker.
+ */
+
+#include "profiling.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+
+namespace {
+
+thread_local Stage tlsStage = Stage::Other;
+
+constexpr int STAGE_COUNT = static_cast<int>(Stage::Count);
+
+const char *const STAGE_NAMES[STAGE_COUNT] = {"other",  "load",   "triangulate",
+                                              "index", "render", "write"};
+
+} // namespace
+
+const char *stageName(Stage stage) {
+  int i = static_cast<int>(stage);
+  return (i >= 0 && i < STAGE_COUNT) ? STAGE_NAMES[i] : "?";
+}
+
+Stage currentStage() { return tlsStage; }
+
+StageScope::StageScope(Stage stage) : previous(tlsStage) { tlsStage = stage; }
+
+StageScope::~StageScope() { tlsStage = previous; }
+
+namespace {
+
+std::atomic<long long> stageNanos[STAGE_COUNT];
+
+// Reads a "Key:   123 kB" line of /proc/self/status
+std::size_t readStatusKb(const char *key) {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  std::size_t keyLen = std::strlen(key);
+  while (std::getline(status, line)) {
+    if (line.compare(0, keyLen, key) == 0 && line.size() > keyLen &&
+        line[keyLen] == ':') {
+      return std::strtoull(line.c_str() + keyLen + 1, nullptr, 10);
+    }
+  }
+  return 0;
+}
+
+} // namespace
+
+StageTimer::StageTimer(Stage stage)
+    : stage(stage), scope(stage), start(std::chrono::steady_clock::now()) {}
+
+StageTimer::~StageTimer() {
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  stageNanos[static_cast<int>(stage)].fetch_add(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+      std::memory_order_relaxed);
+}
+
+double stageSeconds(Stage stage) {
+  return stageNanos[static_cast<int>(stage)].load(std::memory_order_relaxed) *
+         1e-9;
+}
+
+void resetStageTimes() {
+  for (auto &n : stageNanos)
+    n.store(0, std::memory_order_relaxed);
+}
+
+std::size_t peakResidentBytes() { return readStatusKb("VmHWM") * 1024; }
+
+void resetPeakResident() {
+  std::ofstream clearRefs("/proc/self/clear_refs");
+  if (clearRefs)
+    clearRefs << "5";
+}
+
+#ifdef TERRAIN_ALLOC_TRACKING
+
+namespace {
+
+struct StageCounters {
+  std::atomic<std::size_t> allocations;
+  std::atomic<std::size_t> frees;
+  std::atomic<std::size_t> bytes;
+  std::atomic<std::size_t> live;
+  std::atomic<std::size_t> peak;
+};
+
+// Zero-initialised (static storage), usable before any constructor runs.
+StageCounters counters[STAGE_COUNT];
+
+// Placed just before every pointer we hand out.
+struct Header {
+  std::size_t size;
+  std::uint32_t stage;
+  std::uint32_t offset; // Distance from the malloc'ed block to the user data
+};
+static_assert(sizeof(Header) == 16, "Header must keep 16-byte alignment");
+
+void recordAlloc(int stage, std::size_t size) {
+  StageCounters &c = counters[stage];
+  c.allocations.fetch_add(1, std::memory_order_relaxed);
+  c.bytes.fetch_add(size, std::memory_order_relaxed);
+  std::size_t live = c.live.fetch_add(size, std::memory_order_relaxed) + size;
+  std::size_t peak = c.peak.load(std::memory_order_relaxed);
+  while (live > peak &&
+         !c.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+  }
+}
+
+void *trackedAlloc(std::size_t size, std::size_t align) {
+  std::size_t offset = align > sizeof(Header) ? align : sizeof(Header);
+  void *base;
+  if (align > alignof(std::max_align_t)) {
+    std::size_t total = (offset + size + align - 1) / align * align;
+    base = std::aligned_alloc(align, total);
+  } else {
+    base = std::malloc(offset + size);
+  }
+  if (!base)
+    return nullptr;
+
+  int stage = static_cast<int>(tlsStage);
+  char *user = static_cast<char *>(base) + offset;
+  Header *h = reinterpret_cast<Header *>(user) - 1;
+  h->size = size;
+  h->stage = static_cast<std::uint32_t>(stage);
+  h->offset = static_cast<std::uint32_t>(offset);
+  recordAlloc(stage, size);
+  return user;
+}
+
+void trackedFree(void *ptr) {
+  if (!ptr)
+    return;
+  Header *h = static_cast<Header *>(ptr) - 1;
+  StageCounters &c = counters[h->stage];
+  c.frees.fetch_add(1, std::memory_order_relaxed);
+  c.live.fetch_sub(h->size, std::memory_order_relaxed);
+  std::free(static_cast<char *>(ptr) - h->offset);
+}
+
+void *allocOrThrow(std::size_t size, std::size_t align) {
+  void *p = trackedAlloc(size, align);
+  while (!p) {
+    std::new_handler handler = std::get_new_handler();
+    if (!handler)
+      throw std::bad_alloc();
+    handler();
+    p = trackedAlloc(size, align);
+  }
+  return p;
+}
+
+// Emits the summary when the process exits.
+void reportAtExit() {
+  printAllocSummary(std::cerr);
+  if (const char *path = std::getenv("TERRAIN_ALLOC_REPORT")) {
+    std::ofstream ofs(path);
+    writeAllocJson(ofs);
+    ofs << "\n";
+  }
+}
+
+struct ExitReporter {
+  ExitReporter() { std::atexit(reportAtExit); }
+} exitReporter;
+
+} // namespace
+
+void *operator new(std::size_t size) {
+  return allocOrThrow(size, alignof(std::max_align_t));
+}
+void *operator new[](std::size_t size) {
+  return allocOrThrow(size, alignof(std::max_align_t));
+}
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return trackedAlloc(size, alignof(std::max_align_t));
+}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return trackedAlloc(size, alignof(std::max_align_t));
+}
+void *operator new(std::size_t size, std::align_val_t align) {
+  return allocOrThrow(size, static_cast<std::size_t>(align));
+}
+void *operator new[](std::size_t size, std::align_val_t align) {
+  return allocOrThrow(size, static_cast<std::size_t>(align));
+}
+void *operator new(std::size_t size, std::align_val_t align,
+                   const std::nothrow_t &) noexcept {
+  return trackedAlloc(size, static_cast<std::size_t>(align));
+}
+void *operator new[](std::size_t size, std::align_val_t align,
+                     const std::nothrow_t &) noexcept {
+  return trackedAlloc(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void *ptr) noexcept { trackedFree(ptr); }
+void operator delete[](void *ptr) noexcept { trackedFree(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { trackedFree(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { trackedFree(ptr); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+  trackedFree(ptr);
+}
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+  trackedFree(ptr);
+}
+void operator delete(void *ptr, std::align_val_t) noexcept { trackedFree(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+  trackedFree(ptr);
+}
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept {
+  trackedFree(ptr);
+}
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept {
+  trackedFree(ptr);
+}
+void operator delete(void *ptr, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  trackedFree(ptr);
+}
+void operator delete[](void *ptr, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+  trackedFree(ptr);
+}
+
+bool allocTrackingEnabled() { return true; }
+
+void resetAllocPeaks() {
+  for (auto &c : counters)
+    c.peak.store(c.live.load(std::memory_order_relaxed),
+                 std::memory_order_relaxed);
+}
+
+AllocStats allocStats(Stage stage) {
+  const StageCounters &c = counters[static_cast<int>(stage)];
+  return {c.allocations.load(std::memory_order_relaxed),
+          c.frees.load(std::memory_order_relaxed),
+          c.bytes.load(std::memory_order_relaxed),
+          c.live.load(std::memory_order_relaxed),
+          c.peak.load(std::memory_order_relaxed)};
+}
+
+#else
+
+bool allocTrackingEnabled() { return false; }
+
+AllocStats allocStats(Stage) { return {0, 0, 0, 0, 0}; }
+
+void resetAllocPeaks() {}
+
+#endif // TERRAIN_ALLOC_TRACKING
+
+void printAllocSummary(std::ostream &os) {
+  if (!allocTrackingEnabled()) {
+    os << "Suivi des allocations désactivé (TERRAIN_ALLOC_TRACKING=OFF)."
+       << std::endl;
+    return;
+  }
+  os << "Allocations par étape :\n";
+  os << std::left << std::setw(12) << "  etape" << std::right << std::setw(12)
+     << "allocs" << std::setw(12) << "frees" << std::setw(14) << "Mo total"
+     << std::setw(12) << "Mo vivants" << std::setw(12) << "Mo pic" << "\n";
+  os << std::fixed << std::setprecision(2);
+  for (int i = 0; i < STAGE_COUNT; ++i) {
+    AllocStats s = allocStats(static_cast<Stage>(i));
+    os << "  " << std::left << std::setw(10) << STAGE_NAMES[i] << std::right
+       << std::setw(12) << s.allocations << std::setw(12) << s.frees
+       << std::setw(14) << s.bytes / 1048576.0 << std::setw(12)
+       << s.live / 1048576.0 << std::setw(12) << s.peak / 1048576.0 << "\n";
+  }
+  os.unsetf(std::ios::floatfield);
+  os << std::flush;
+}
+
+void writeAllocJson(std::ostream &os) {
+  os << "{";
+  for (int i = 0; i < STAGE_COUNT; ++i) {
+    AllocStats s = allocStats(static_cast<Stage>(i));
+    os << (i ? "," : "") << "\"" << STAGE_NAMES[i] << "\":{"
+       << "\"allocations\":" << s.allocations << ",\"frees\":" << s.frees
+       << ",\"bytes\":" << s.bytes << ",\"live\":" << s.live
+       << ",\"peak\":" << s.peak << "}";
+  }
+  os << "}";
+}
@@ -0,0 +1,218 @@
+/**
+ * @file progress.cpp
+ * @brief Implementation of the progress counters and their reporter thread.
+ */
+
+#include "progress.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Metadata of the tracked stage, changed a handful of times per run under
+// the mutex. Only the work counter is touched by the workers, lock-free.
+std::mutex stateMutex;
+ProgressSample current;
+Clock::time_point startTime;
+std::atomic<std::uint64_t> done{0};
+
+// Last finished stages, so that a stage shorter than the sampling interval
+// still gets its final report.
+const std::size_t HISTORY = 16;
+ProgressSample finishedStages[HISTORY];
+
+void writeAll(int fd, const char *data, std::size_t size) {
+  while (size > 0) {
+    ssize_t n = ::write(fd, data, size);
+    if (n <= 0)
+      return; // Lost progress output is not worth failing for
+    data += n;
+    size -= static_cast<std::size_t>(n);
+  }
+}
+
+double secondsSinceStart() {
+  return std::chrono::duration<double>(Clock::now() - startTime).count();
+}
+
+// Final state of a finished stage, or a sample with generation 0 if it has
+// already left the history
+ProgressSample finishedSample(std::uint64_t generation) {
+  std::lock_guard<std::mutex> lock(stateMutex);
+  const ProgressSample &s = finishedStages[generation % HISTORY];
+  return s.generation == generation ? s : ProgressSample();
+}
+
+} // namespace
+
+ProgressSample progressSnapshot() {
+  std::lock_guard<std::mutex> lock(stateMutex);
+  ProgressSample s = current;
+  if (s.active) {
+    s.done = done.load(std::memory_order_relaxed);
+    s.elapsed = secondsSinceStart();
+  }
+  return s;
+}
+
+void progressBegin(Stage stage, std::uint64_t amount, const char *unit) {
+  std::lock_guard<std::mutex> lock(stateMutex);
+  ++current.generation;
+  current.active = true;
+  current.stage = stage;
+  current.unit = unit;
+  current.done = 0;
+  current.total = amount;
+  current.elapsed = 0.0;
+  startTime = Clock::now();
+  done.store(0, std::memory_order_relaxed);
+}
+
+void progressAdvance(std::uint64_t amount) {
+  done.fetch_add(amount, std::memory_order_relaxed);
+}
+
+void progressEnd() {
+  std::lock_guard<std::mutex> lock(stateMutex);
+  if (!current.active)
+    return;
+  current.active = false;
+  current.done = done.load(std::memory_order_relaxed);
+  current.elapsed = secondsSinceStart();
+  finishedStages[current.generation % HISTORY] = current;
+}
+
+bool parseProgressFormat(const std::string &name, ProgressFormat &format) {
+  if (name == "none")
+    format = ProgressFormat::None;
+  else if (name == "human")
+    format = ProgressFormat::Human;
+  else if (name == "json")
+    format = ProgressFormat::Json;
+  else
+    return false;
+  return true;
+}
+
+ProgressReporter::ProgressReporter(ProgressFormat format, int fd,
+                                   double intervalSeconds)
+    : format(format), fd(fd), interval(intervalSeconds) {
+  if (format != ProgressFormat::None)
+    thread = std::thread(&ProgressReporter::run, this);
+}
+
+ProgressReporter::~ProgressReporter() {
+  if (!thread.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_one();
+  thread.join();
+}
+
+void ProgressReporter::emit(const ProgressSample &s, double rate) {
+  char line[256];
+  bool final = !s.active;
+  double eta = -1.0;
+  if (!final && s.total > 0 && rate > 0.0 && s.done <= s.total)
+    eta = (s.total - s.done) / rate;
+  double percent = s.total > 0 ? 100.0 * s.done / s.total : 0.0;
+  const char *name = stageName(s.stage);
+  int n = 0;
+
+  if (format == ProgressFormat::Json) {
+    n = std::snprintf(
+        line, sizeof(line),
+        "{\"stage\":\"%s\",\"done\":%llu,\"total\":%llu,\"unit\":\"%s\","
+        "\"elapsed_s\":%.3f,\"rate\":%.1f,\"eta_s\":%.3f,\"finished\":%s}\n",
+        name, static_cast<unsigned long long>(s.done),
+        static_cast<unsigned long long>(s.total), s.unit, s.elapsed, rate, eta,
+        final ? "true" : "false");
+  } else if (s.done == 0) {
+    // Stage without measurable steps: only show that it is running
+    n = std::snprintf(line, sizeof(line),
+                      final ? "\r[%s] terminé en %.2f s%20s\n"
+                            : "\r[%s] en cours  %.1f s%s   ",
+                      name, s.elapsed, "");
+  } else if (final) {
+    n = std::snprintf(line, sizeof(line), "\r[%s] %llu %s en %.2f s%20s\n",
+                      name, static_cast<unsigned long long>(s.done), s.unit,
+                      s.elapsed, "");
+  } else if (eta >= 0.0) {
+    n = std::snprintf(line, sizeof(line),
+                      "\r[%s] %llu/%llu %s  %5.1f %%  %.0f %s/s  ETA %.1f s   ",
+                      name, static_cast<unsigned long long>(s.done),
+                      static_cast<unsigned long long>(s.total), s.unit,
+                      percent, rate, s.unit, eta);
+  } else {
+    n = std::snprintf(line, sizeof(line), "\r[%s] %llu %s  %.0f %s/s   ",
+                      name, static_cast<unsigned long long>(s.done), s.unit,
+                      rate, s.unit);
+  }
+  if (n > 0)
+    writeAll(fd, line, std::min<std::size_t>(n, sizeof(line) - 1));
+}
+
+void ProgressReporter::run() {
+  std::uint64_t shown = 0; // Generation of the stage on screen
+  bool finished = true;    // Its final line was written
+  std::uint64_t lastDone = 0;
+  double lastElapsed = 0.0;
+  double rate = 0.0; // Smoothed throughput, units per second
+
+  auto wait = std::chrono::duration<double>(interval);
+  std::unique_lock<std::mutex> lock(mutex);
+  for (bool last = false; !last;) {
+    last = wake.wait_for(lock, wait, [this] { return stopping; });
+
+    ProgressSample s = progressSnapshot();
+
+    // Stages that ended since the previous sample, including any that
+    // started and finished in between
+    for (std::uint64_t g = std::max<std::uint64_t>(shown, 1); g < s.generation;
+         ++g) {
+      if (g == shown && finished)
+        continue;
+      ProgressSample f = finishedSample(g);
+      if (f.generation == 0)
+        continue;
+      emit(f, f.elapsed > 0.0 ? f.done / f.elapsed : 0.0);
+    }
+
+    if (s.generation == 0)
+      continue; // Nothing tracked yet
+    if (s.generation != shown) {
+      shown = s.generation;
+      finished = false;
+      lastDone = 0;
+      lastElapsed = 0.0;
+      rate = 0.0;
+    } else if (finished) {
+      continue;
+    }
+
+    // Exponential smoothing over the last few samples
+    double dt = s.elapsed - lastElapsed;
+    if (dt > 0.0 && s.done >= lastDone) {
+      double instant = (s.done - lastDone) / dt;
+      rate = rate > 0.0 ? 0.7 * rate + 0.3 * instant : instant;
+    }
+    lastDone = s.done;
+    lastElapsed = s.elapsed;
+
+    if (!s.active)
+      rate = s.elapsed > 0.0 ? s.done / s.elapsed : 0.0;
+    emit(s, rate);
+    finished = !s.active;
+  }
+
+  if (!finished && format == ProgressFormat::Human)
+    writeAll(fd, "\n", 1);
+}
@@ -0,0 +1,178 @@
+/**
+ * @file pyramid.cpp
+ * @brief Construction and rectangle queries of the altitude pyramid.
+ */
+
+#include "pyramid.hpp"
+#include "profiling.hpp"
+#include "progress.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Rows of a level merged by one task
+const std::size_t ROW_GRAIN = 16;
+
+// Highest level whose cells across a query border are scanned pixel by
+// pixel rather than split (4 x 4 pixels)
+const int SCAN_LEVEL = 2;
+
+void merge(RegionStats &stats, float min, float max, double sum,
+           std::size_t count) {
+  if (count == 0)
+    return;
+  if (stats.count == 0) {
+    stats.min = min;
+    stats.max = max;
+  } else {
+    stats.min = std::min(stats.min, min);
+    stats.max = std::max(stats.max, max);
+  }
+  stats.sum += sum;
+  stats.count += count;
+}
+
+} // namespace
+
+bool HeightPyramid::build(const HeightField &source, ThreadPool &pool) {
+  levels.clear();
+  rasterGrid = source.grid;
+  field = &source;
+  if (source.z.empty())
+    return false;
+  const std::vector<float> &z = source.z;
+
+  Level base;
+  base.width = rasterGrid.width;
+  base.height = rasterGrid.height;
+  levels.push_back(base);
+
+  progressBegin(Stage::Index, 0, "niveaux");
+  while (levels.back().width > 1 || levels.back().height > 1) {
+    const Level &below = levels.back();
+    const bool fromPixels = levels.size() == 1;
+    Level level;
+    level.width = (below.width + 1) / 2;
+    level.height = (below.height + 1) / 2;
+    const std::size_t cells =
+        static_cast<std::size_t>(level.width) * level.height;
+    level.min.resize(cells);
+    level.max.resize(cells);
+    level.sum.resize(cells);
+    if (static_cast<int>(levels.size()) < WIDE_LEVEL)
+      level.count.resize(cells);
+    else
+      level.wideCount.resize(cells);
+
+    bool complete = pool.parallelFor(
+        0, level.height, ROW_GRAIN, [&](std::size_t r0, std::size_t r1) {
+          for (std::size_t row = r0; row < r1; ++row)
+            for (int col = 0; col < level.width; ++col) {
+              RegionStats cell;
+              for (int dr = 0; dr < 2; ++dr)
+                for (int dc = 0; dc < 2; ++dc) {
+                  int r = static_cast<int>(2 * row) + dr, c = 2 * col + dc;
+                  if (r >= below.height || c >= below.width)
+                    continue;
+                  std::size_t k = static_cast<std::size_t>(r) * below.width + c;
+                  if (fromPixels) {
+                    if (!std::isnan(z[k]))
+                      merge(cell, z[k], z[k], z[k], 1);
+                  } else {
+                    merge(cell, below.min[k], below.max[k], below.sum[k],
+                          below.cellCount(k));
+                  }
+                }
+              std::size_t k = row * level.width + col;
+              level.min[k] = cell.min;
+              level.max[k] = cell.max;
+              level.sum[k] = cell.sum;
+              if (level.wideCount.empty())
+                level.count[k] = static_cast<std::uint32_t>(cell.count);
+              else
+                level.wideCount[k] = cell.count;
+            }
+        });
+    if (!complete) {
+      progressEnd();
+      levels.clear();
+      return false;
+    }
+    levels.push_back(std::move(level));
+    progressAdvance(1);
+  }
+  progressEnd();
+  return true;
+}
+
+void HeightPyramid::visit(int level, int row, int col, int row0, int col0,
+                          int row1, int col1, RegionStats &stats) const {
+  // Pixels covered by the cell
+  const int top = row << level, left = col << level;
+  const int bottom = std::min(rasterGrid.height, (row + 1) << level);
+  const int right = std::min(rasterGrid.width, (col + 1) << level);
+  if (bottom <= row0 || top >= row1 || right <= col0 || left >= col1)
+    return;
+
+  if (level > 0) {
+    const Level &l = levels[level];
+    const std::size_t k = static_cast<std::size_t>(row) * l.width + col;
+    const std::uint64_t count = l.cellCount(k);
+    if (count == 0)
+      return;
+    if (top >= row0 && bottom <= row1 && left >= col0 && right <= col1) {
+      merge(stats, l.min[k], l.max[k], l.sum[k], count);
+      return;
+    }
+  }
+  // Small cells across the border: their pixels inside, row by row
+  if (level <= SCAN_LEVEL) {
+    for (int r = std::max(top, row0); r < std::min(bottom, row1); ++r) {
+      const float *pixel =
+          &field->z[static_cast<std::size_t>(r) * rasterGrid.width];
+      for (int c = std::max(left, col0); c < std::min(right, col1); ++c)
+        if (!std::isnan(pixel[c]))
+          merge(stats, pixel[c], pixel[c], pixel[c], 1);
+    }
+    return;
+  }
+  for (int dr = 0; dr < 2; ++dr)
+    for (int dc = 0; dc < 2; ++dc) {
+      int r = 2 * row + dr, c = 2 * col + dc;
+      if (r < levels[level - 1].height && c < levels[level - 1].width)
+        visit(level - 1, r, c, row0, col0, row1, col1, stats);
+    }
+}
+
+RegionStats HeightPyramid::query(int row0, int col0, int row1,
+                                 int col1) const {
+  RegionStats stats;
+  row0 = std::max(row0, 0);
+  col0 = std::max(col0, 0);
+  row1 = std::min(row1, rasterGrid.height);
+  col1 = std::min(col1, rasterGrid.width);
+  if (levels.empty() || row0 >= row1 || col0 >= col1)
+    return stats;
+  visit(static_cast<int>(levels.size()) - 1, 0, 0, row0, col0, row1, col1,
+        stats);
+  return stats;
+}
+
+RegionStats HeightPyramid::query(const BoundingBox &area) const {
+  // Pixel (row, col) has its center at minX + (col + 0.5) * pixelSizeX,
+  // maxY - (row + 0.5) * pixelSizeY
+  const RasterGrid &g = rasterGrid;
+  auto first = [](double v, int size) {
+    return static_cast<int>(std::clamp(std::ceil(v - 0.5), 0.0, double(size)));
+  };
+  auto last = [](double v, int size) {
+    return static_cast<int>(
+        std::clamp(std::floor(v - 0.5) + 1, 0.0, double(size)));
+  };
+  int col0 = first((area.minX - g.minX) / g.pixelSizeX, g.width);
+  int col1 = last((area.maxX - g.minX) / g.pixelSizeX, g.width);
+  int row0 = first((g.maxY - area.maxY) / g.pixelSizeY, g.height);
+  int row1 = last((g.maxY - area.minY) / g.pixelSizeY, g.height);
+  return query(row0, col0, row1, col1);
+}
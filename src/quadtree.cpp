@@ -16,12 +16,6 @@ bool BoundingBox::intersects(const BoundingBox &other) const {
            other.maxY < minY);
 }
 
-/**
- * @brief Computes the bounding box of a single triangle.
- * @param t The triangle.
- * @param points The list of vertex points.
- * @return BoundingBox The minimal bounding box containing the triangle.
- */
 BoundingBox getTriangleBounds(const Triangle &t,
                               const std::vector<Point> &points) {
   const Point &p1 = points[t.p1];
@@ -32,16 +26,6 @@ BoundingBox getTriangleBounds(const Triangle &t,
           std::max({p1.x, p2.x, p3.x}), std::max({p1.y, p2.y, p3.y})};
 }
 
-/**
- * @brief Checks if a 2D point lies inside a 2D triangle using barycentric
- * coordinates.
- * @param px X coordinate of the point.
- * @param py Y coordinate of the point.
- * @param p1 First vertex of the triangle.
- * @param p2 Second vertex of the triangle.
- * @param p3 Third vertex of the triangle.
- * @return true if the point is inside or on the edge, false otherwise.
- */
 bool isPointInTriangle(double px, double py, const Point &p1, const Point &p2,
                        const Point &p3) {
   double area = 0.5 * (-p2.y * p3.x + p1.y * (-p2.x + p3.x) +
@@ -104,6 +88,56 @@ void QuadTree::insert(const Triangle &triangle,
   }
 }
 
+void QuadTree::build(const std::vector<Triangle> &all,
+                     const std::vector<Point> &points, ThreadPool &pool) {
+  if (all.size() > UINT32_MAX) {
+    for (const auto &t : all)
+      insert(t, points);
+    return;
+  }
+  std::vector<std::uint32_t> ids;
+  ids.reserve(all.size());
+  for (std::size_t i = 0; i < all.size(); ++i)
+    if (bounds.intersects(getTriangleBounds(all[i], points)))
+      ids.push_back(static_cast<std::uint32_t>(i));
+  buildNode(ids, all, points, pool);
+}
+
+void QuadTree::buildNode(std::vector<std::uint32_t> &ids,
+                         const std::vector<Triangle> &all,
+                         const std::vector<Point> &points, ThreadPool &pool) {
+  // Same outcome as insert(): the node only splits on its
+  // (MAX_TRIANGLES + 1)-th triangle
+  if (ids.size() <= static_cast<std::size_t>(MAX_TRIANGLES) ||
+      depth >= MAX_DEPTH) {
+    triangles.reserve(ids.size());
+    for (std::uint32_t id : ids)
+      triangles.push_back(all[id]);
+    return;
+  }
+
+  subdivide();
+  std::vector<std::uint32_t> childIds[4];
+  for (std::uint32_t id : ids) {
+    BoundingBox tBounds = getTriangleBounds(all[id], points);
+    for (int c = 0; c < 4; ++c)
+      if (children[c]->bounds.intersects(tBounds))
+        childIds[c].push_back(id);
+  }
+  std::vector<std::uint32_t>().swap(ids); // Free before recursing
+
+  // Large subtrees are built as tasks, small ones inline
+  const std::size_t PARALLEL_THRESHOLD = 1 << 15;
+  TaskGroup group(pool);
+  for (int c = 0; c < 4; ++c) {
+    if (childIds[c].size() >= PARALLEL_THRESHOLD)
+      group.run([&, c] { children[c]->buildNode(childIds[c], all, points, pool); });
+    else
+      children[c]->buildNode(childIds[c], all, points, pool);
+  }
+  group.wait();
+}
+
 std::optional<Triangle> QuadTree::find(double x, double y,
                                        const std::vector<Point> &points) const {
   if (!bounds.contains(x, y)) {
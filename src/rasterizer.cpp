@@ -5,24 +5,20 @@
  */
 
 #include "rasterizer.hpp"
+#include "image_io.hpp"
+#include "logging.hpp"
+#include "memory_policy.hpp"
+#include "profiling.hpp"
+#include "progress.hpp"
 #include "quadtree.hpp"
 #include <algorithm>
+#include <atomic>
 #include <cmath>
-#include <fstream>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <vector>
 
-struct Color {
-  unsigned char r, g, b;
-};
-
-/**
- * @brief Maps an altitude to a color using a Haxby-like colormap.
- * @param z Current altitude.
- * @param minZ Minimum altitude in the dataset.
- * @param maxZ Maximum altitude in the dataset.
- * @return Color The corresponding RGB color.
- */
 Color getColor(double z, double minZ, double maxZ) {
   // Normalize z to [0, 1]
   double t = (z - minZ) / (maxZ - minZ);
@@ -62,16 +58,6 @@ Color getColor(double z, double minZ, double maxZ) {
   return stops[7].c;
 }
 
-/**
- * @brief Computes the Z coordinate at point (px, py) within a triangle using
- * barycentric interpolation.
- * @param px X coordinate of the target point.
- * @param py Y coordinate of the target point.
- * @param p1 First vertex of the triangle.
- * @param p2 Second vertex of the triangle.
- * @param p3 Third vertex of the triangle.
- * @return double The interpolated altitude (Z).
- */
 double interpolateZ(double px, double py, const Point &p1, const Point &p2,
                     const Point &p3) {
   double det = (p2.y - p3.y) * (p1.x - p3.x) + (p3.x - p2.x) * (p1.y - p3.y);
@@ -83,18 +69,6 @@ double interpolateZ(double px, double py, const Point &p1, const Point &p2,
   return lambda1 * p1.z + lambda2 * p2.z + lambda3 * p3.z;
 }
 
-/**
- * @brief Calculates a shading factor based on the triangle's normal and a fixed
- * light source.
- *
- * Computes the normal vector of the triangle (cross product of edges) and takes
- * the dot product with a fixed light direction (from NW).
- *
- * @param p1 First vertex.
- * @param p2 Second vertex.
- * @param p3 Third vertex.
- * @return double Shading factor (0.4 to 1.0).
- */
 double calculateShade(const Point &p1, const Point &p2, const Point &p3) {
   // Vectors U = p2 - p1, V = p3 - p1
   double ux = p2.x - p1.x;
@@ -145,10 +119,8 @@ double calculateShade(const Point &p1, const Point &p2, const Point &p3) {
   return 0.4 + 0.6 * intensity;
 }
 
-void generateImage(const std::string &filename, int width, const Mesh &mesh) {
-  if (mesh.points.empty())
-    return;
-
+bool makeRasterGrid(const std::vector<Point> &points, int width,
+                    RasterGrid &grid) {
   // Calculate Bounding Box of the whole mesh
   double minX = std::numeric_limits<double>::max();
   double maxX = std::numeric_limits<double>::lowest();
@@ -157,7 +129,7 @@ void generateImage(const std::string &filename, int width, const Mesh &mesh) {
   double minZ = std::numeric_limits<double>::max();
   double maxZ = std::numeric_limits<double>::lowest();
 
-  for (const auto &p : mesh.points) {
+  for (const auto &p : points) {
     if (p.x < minX)
       minX = p.x;
     if (p.x > maxX)
@@ -172,45 +144,41 @@ void generateImage(const std::string &filename, int width, const Mesh &mesh) {
       maxZ = p.z;
   }
 
-  // Build QuadTree
-  std::cout << "Construction de QuadTree..." << std::endl;
-  BoundingBox rootBounds{minX, minY, maxX, maxY};
-  QuadTree quadTree(rootBounds);
-  for (const auto &t : mesh.triangles) {
-    quadTree.insert(t, mesh.points);
-  }
-  std::cout << "QuadTree construit." << std::endl;
-
-  // Determine Image Dimensions
-  double rangeX = maxX - minX;
-  double rangeY = maxY - minY;
-
-  if (rangeX <= 0 || rangeY <= 0) {
-    std::cerr << "Dimensions du maillage invalides." << std::endl;
-    return;
-  }
-
-  int height = static_cast<int>(width * (rangeY / rangeX));
-  std::cout << "Générer une image " << width << "x" << height << std::endl;
-
-  // Rasterization Loop
-  std::vector<unsigned char> pixels;
-  pixels.reserve(width * height * 3);
+  return makeRasterGrid({minX, minY, maxX, maxY}, minZ, maxZ, width, grid);
+}
 
-  double pixelSizeX = rangeX / width;
-  double pixelSizeY = rangeY / height;
+bool makeRasterGrid(const BoundingBox &bounds, double minZ, double maxZ,
+                    int width, RasterGrid &grid) {
+  grid.bounds = bounds;
 
-  for (int row = 0; row < height; ++row) {
-    double y = maxY - (row + 0.5) * pixelSizeY;
+  // Determine Image Dimensions
+  double rangeX = bounds.maxX - bounds.minX;
+  double rangeY = bounds.maxY - bounds.minY;
+  if (width <= 0 || !(rangeX > 0) || !(rangeY > 0))
+    return false;
+
+  grid.minX = bounds.minX;
+  grid.maxY = bounds.maxY;
+  grid.minZ = minZ;
+  grid.maxZ = maxZ;
+  grid.width = width;
+  grid.height = static_cast<int>(width * (rangeY / rangeX));
+  grid.pixelSizeX = rangeX / width;
+  grid.pixelSizeY = rangeY / grid.height;
+  return grid.height > 0;
+}
 
-    if (row % 100 == 0)
-      std::cout << "Ligne de traitement " << row << "/" << height << "\r"
-                << std::flush;
+void renderRegion(const Mesh &mesh, const QuadTree &index,
+                  const RasterGrid &grid, int row0, int row1, int col0,
+                  int col1, unsigned char *out, std::size_t stride) {
+  for (int row = row0; row < row1; ++row) {
+    double y = grid.maxY - (row + 0.5) * grid.pixelSizeY;
+    unsigned char *pixel = out + static_cast<std::size_t>(row - row0) * stride;
 
-    for (int col = 0; col < width; ++col) {
-      double x = minX + (col + 0.5) * pixelSizeX;
+    for (int col = col0; col < col1; ++col) {
+      double x = grid.minX + (col + 0.5) * grid.pixelSizeX;
 
-      auto triangleOpt = quadTree.find(x, y, mesh.points);
+      auto triangleOpt = index.find(x, y, mesh.points);
 
       Color c = {0, 0, 0};
 
@@ -218,7 +186,7 @@ void generateImage(const std::string &filename, int width, const Mesh &mesh) {
         const Triangle &t = *triangleOpt;
         double z = interpolateZ(x, y, mesh.points[t.p1], mesh.points[t.p2],
                                 mesh.points[t.p3]);
-        c = getColor(z, minZ, maxZ);
+        c = getColor(z, grid.minZ, grid.maxZ);
 
         // Apply shading
         double shade = calculateShade(mesh.points[t.p1], mesh.points[t.p2],
@@ -228,17 +196,158 @@ void generateImage(const std::string &filename, int width, const Mesh &mesh) {
         c.b = static_cast<unsigned char>(std::min(255.0, c.b * shade));
       }
 
-      pixels.push_back(c.r);
-      pixels.push_back(c.g);
-      pixels.push_back(c.b);
+      *pixel++ = c.r;
+      *pixel++ = c.g;
+      *pixel++ = c.b;
+    }
+  }
+}
+
+bool parseRenderEngine(const std::string &name, RenderEngine &out) {
+  if (name == "triangulation")
+    out = RenderEngine::Triangulation;
+  else if (name == "binning")
+    out = RenderEngine::Binning;
+  else if (name == "idw")
+    out = RenderEngine::Idw;
+  else if (name == "natural")
+    out = RenderEngine::NaturalNeighbour;
+  else
+    return false;
+  return true;
+}
+
+void generateImage(const std::string &filename, int width, const Mesh &mesh,
+                   const RenderOptions &options) {
+  if (mesh.points.empty())
+    return;
+
+  std::unique_ptr<ThreadPool> ownPool;
+  if (!options.pool)
+    ownPool = std::make_unique<ThreadPool>(std::max(1, options.threads));
+  ThreadPool &pool = options.pool ? *options.pool : *ownPool;
+
+  RasterGrid grid;
+  bool valid = makeRasterGrid(mesh.points, width, grid);
+
+  // Build QuadTree
+  logInfo() << "Construction de QuadTree..." << std::endl;
+  QuadTree quadTree(grid.bounds);
+  {
+    StageTimer timer(Stage::Index);
+    progressBegin(Stage::Index, 0, "triangles");
+    quadTree.build(mesh.triangles, mesh.points, pool);
+    progressEnd();
+  }
+  logInfo() << "QuadTree construit." << std::endl;
+
+  if (!valid) {
+    logError() << "Dimensions du maillage invalides." << std::endl;
+    return;
+  }
+
+  int height = grid.height;
+  logInfo() << "Générer une image " << width << "x" << height << std::endl;
+
+  // Bands are split recursively and stolen by idle workers: the cost of a
+  // row depends on how much of it the survey covers.
+  const int BAND_HEIGHT = 16;
+  int bandCount = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+  const std::size_t stride = static_cast<std::size_t>(width) * 3;
+
+  if (options.checkpoint.enabled) {
+    // Each band goes to the file as soon as it is rendered, and the journal
+    // records it at the next flush
+    Checkpoint checkpoint;
+    const CheckpointOptions &co = options.checkpoint;
+    std::string fingerprint = co.fingerprint + " width=" +
+                              std::to_string(width) + " bands=" +
+                              std::to_string(BAND_HEIGHT);
+    if (!checkpoint.open(filename, fingerprint, bandCount, co.interval,
+                         co.resume))
+      return;
+    if (checkpoint.resumed())
+      logInfo() << "Reprise : " << checkpoint.finishedBefore() << " bandes sur "
+                << bandCount << " déjà rendues" << std::endl;
+    PpmWriter writer;
+    if (!writer.open(filename, width, height, "", checkpoint.resumed()))
+      return;
+    checkpoint.attach(writer);
+
+    std::atomic<bool> writeFailed{false};
+    bool complete;
+    {
+      StageTimer timer(Stage::Render);
+      progressBegin(Stage::Render, height, "lignes");
+      complete = pool.parallelFor(
+          0, bandCount, 1, [&](std::size_t band0, std::size_t band1) {
+            std::vector<unsigned char> pixels;
+            for (std::size_t band = band0; band < band1; ++band) {
+              int row0 = static_cast<int>(band) * BAND_HEIGHT;
+              int row1 = std::min(height, row0 + BAND_HEIGHT);
+              if (!checkpoint.isDone(band)) {
+                pixels.resize(stride * (row1 - row0));
+                renderRegion(mesh, quadTree, grid, row0, row1, 0, width,
+                             pixels.data(), stride);
+                if (writer.writeBlock(row0, row1 - row0, 0, width,
+                                      pixels.data(), stride))
+                  checkpoint.complete(band);
+                else
+                  writeFailed = true;
+              }
+              progressAdvance(row1 - row0);
+            }
+          });
+      progressEnd();
+    }
+
+    StageTimer timer(Stage::Write);
+    if (!complete) {
+      checkpoint.flush();
+      logError() << "Rendu annulé ; relancez avec --resume pour le terminer."
+                 << std::endl;
+      return;
+    }
+    if (writeFailed || !checkpoint.finish() || !writer.close()) {
+      logError() << "Erreur d'écriture dans " << filename << std::endl;
+      return;
+    }
+    logInfo() << "Image enregistrée dans " << filename << std::endl;
+    return;
+  }
+
+  // Rasterization Loop: the pages of the image are untouched until the
+  // worker rendering a band writes them, which places them on its node
+  LargeBuffer pixels(stride * height);
+  if (!pixels.data())
+    return;
+  {
+    StageTimer timer(Stage::Render);
+    progressBegin(Stage::Render, height, "lignes");
+    bool complete = pool.parallelFor(
+        0, bandCount, 1, [&](std::size_t band0, std::size_t band1) {
+          for (std::size_t band = band0; band < band1; ++band) {
+            int row0 = static_cast<int>(band) * BAND_HEIGHT;
+            int row1 = std::min(height, row0 + BAND_HEIGHT);
+            renderRegion(mesh, quadTree, grid, row0, row1, 0, width,
+                         pixels.data() + row0 * stride, stride);
+            progressAdvance(row1 - row0);
+          }
+        });
+    progressEnd();
+    if (!complete) {
+      logError() << "Rendu annulé, aucune image écrite." << std::endl;
+      return;
     }
   }
-  std::cout << std::endl;
 
   // Write PPM
-  std::ofstream ofs(filename, std::ios::binary);
-  ofs << "P6\n" << width << " " << height << "\n255\n";
-  ofs.write(reinterpret_cast<const char *>(pixels.data()), pixels.size());
-  ofs.close();
-  std::cout << "Image enregistrée dans " << filename << std::endl;
+  StageTimer timer(Stage::Write);
+  PpmWriter writer;
+  if (writer.open(filename, width, height) &&
+      writer.writeBlock(0, height, 0, width, pixels.data(), stride) &&
+      writer.close())
+    logInfo() << "Image enregistrée dans " << filename << std::endl;
+  else
+    logError() << "Erreur d'écriture dans " << filename << std::endl;
 }
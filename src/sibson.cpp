@@ -0,0 +1,314 @@
+/**
+ * @file sibson.cpp
+ * @brief Implementation of natural-neighbour interpolation on the mesh.
+ */
+
+#include "sibson.hpp"
+#include "logging.hpp"
+#include "profiling.hpp"
+#include "progress.hpp"
+#include "quadtree.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+// Larger cavities only happen on degenerate (cocircular) patches; they are
+// interpolated linearly
+const std::size_t MAX_CAVITY = 64;
+
+struct Vec {
+  double x, y;
+};
+
+double orient(const Vec &a, const Vec &b, const Vec &c) {
+  return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+// Circumcenter of (0, 0), a and b; false if the three are collinear
+bool circumcenterWithOrigin(const Vec &a, const Vec &b, Vec &out) {
+  double d = 2 * (a.x * b.y - a.y * b.x);
+  double scale = (a.x * a.x + a.y * a.y) + (b.x * b.x + b.y * b.y);
+  if (std::fabs(d) <= 1e-12 * scale)
+    return false;
+  double a2 = a.x * a.x + a.y * a.y, b2 = b.x * b.x + b.y * b.y;
+  out = {(b.y * a2 - a.y * b2) / d, (a.x * b2 - b.x * a2) / d};
+  return true;
+}
+
+Vec circumcenter(const Vec &a, const Vec &b, const Vec &c) {
+  // Relative to a, then shifted back
+  Vec ab{b.x - a.x, b.y - a.y}, ac{c.x - a.x, c.y - a.y}, o{0, 0};
+  circumcenterWithOrigin(ab, ac, o);
+  return {a.x + o.x, a.y + o.y};
+}
+
+// Whether the origin lies strictly inside the circumcircle of (a, b, c)
+bool originInCircle(const Vec &a, const Vec &b, const Vec &c) {
+  double a2 = a.x * a.x + a.y * a.y, b2 = b.x * b.x + b.y * b.y,
+         c2 = c.x * c.x + c.y * c.y;
+  double det = a.x * (b.y * c2 - b2 * c.y) - a.y * (b.x * c2 - b2 * c.x) +
+               a2 * (b.x * c.y - b.y * c.x);
+  return det * orient(a, b, c) > 0;
+}
+
+// Uniform grid of triangle indices (compressed rows), to find the triangle
+// containing a pixel when the previous pixel's triangle does not help
+class TriangleGrid {
+public:
+  void build(const Mesh &mesh) {
+    const std::vector<Point> &pts = mesh.points;
+    double maxX = pts[0].x, maxY = pts[0].y;
+    minX = pts[0].x;
+    minY = pts[0].y;
+    for (const Point &p : pts) {
+      minX = std::min(minX, p.x);
+      minY = std::min(minY, p.y);
+      maxX = std::max(maxX, p.x);
+      maxY = std::max(maxY, p.y);
+    }
+    // About two triangles per cell
+    double area = std::max(1e-9, (maxX - minX) * (maxY - minY));
+    cell = std::sqrt(area / std::max<std::size_t>(1, mesh.triangles.size() / 2));
+    cols = static_cast<int>((maxX - minX) / cell) + 1;
+    rows = static_cast<int>((maxY - minY) / cell) + 1;
+
+    start.assign(static_cast<std::size_t>(cols) * rows + 1, 0);
+    auto forEachCell = [&](const Triangle &t, auto &&visit) {
+      BoundingBox b = getTriangleBounds(t, pts);
+      int c0 = column(b.minX), c1 = column(b.maxX);
+      int r0 = row(b.minY), r1 = row(b.maxY);
+      for (int r = r0; r <= r1; ++r)
+        for (int c = c0; c <= c1; ++c)
+          visit(static_cast<std::size_t>(r) * cols + c);
+    };
+    for (const Triangle &t : mesh.triangles)
+      forEachCell(t, [&](std::size_t k) { ++start[k + 1]; });
+    for (std::size_t k = 1; k < start.size(); ++k)
+      start[k] += start[k - 1];
+    ids.resize(start.back());
+    std::vector<std::uint32_t> fill(start.begin(), start.end() - 1);
+    for (std::size_t i = 0; i < mesh.triangles.size(); ++i)
+      forEachCell(mesh.triangles[i], [&](std::size_t k) {
+        ids[fill[k]++] = static_cast<std::uint32_t>(i);
+      });
+  }
+
+  std::uint32_t locate(double x, double y, const Mesh &mesh) const {
+    int c = column(x), r = row(y);
+    if (x < minX || y < minY || c >= cols || r >= rows)
+      return NO_TRIANGLE;
+    std::size_t k = static_cast<std::size_t>(r) * cols + c;
+    for (std::uint32_t i = start[k]; i < start[k + 1]; ++i) {
+      const Triangle &t = mesh.triangles[ids[i]];
+      if (isPointInTriangle(x, y, mesh.points[t.p1], mesh.points[t.p2],
+                            mesh.points[t.p3]))
+        return ids[i];
+    }
+    return NO_TRIANGLE;
+  }
+
+private:
+  int column(double x) const {
+    return std::min(cols - 1, std::max(0, int((x - minX) / cell)));
+  }
+  int row(double y) const {
+    return std::min(rows - 1, std::max(0, int((y - minY) / cell)));
+  }
+
+  double minX = 0, minY = 0, cell = 1;
+  int cols = 0, rows = 0;
+  std::vector<std::uint32_t> start, ids;
+};
+
+// Scratch space of one worker, reused from pixel to pixel
+struct Cavity {
+  std::vector<std::uint32_t> triangles;
+  std::vector<std::pair<std::size_t, double>> weights; // Vertex, stolen area
+};
+
+bool contains(const Mesh &mesh, std::uint32_t t, double x, double y) {
+  const Triangle &tri = mesh.triangles[t];
+  return isPointInTriangle(x, y, mesh.points[tri.p1], mesh.points[tri.p2],
+                           mesh.points[tri.p3]);
+}
+
+// Sibson interpolation at (x, y) in triangle t; false when the cavity
+// reaches the border of the mesh or is degenerate
+bool naturalNeighbour(const Mesh &mesh,
+                      const std::vector<std::uint32_t> &adjacency,
+                      std::uint32_t start, double x, double y, Cavity &cavity,
+                      double &z) {
+  auto rel = [&](std::size_t v) {
+    return Vec{mesh.points[v].x - x, mesh.points[v].y - y};
+  };
+  auto vertices = [&](std::uint32_t t) {
+    const Triangle &tri = mesh.triangles[t];
+    return std::array<std::size_t, 3>{tri.p1, tri.p2, tri.p3};
+  };
+
+  // Bowyer-Watson cavity, grown across edges from the containing triangle
+  cavity.triangles.clear();
+  cavity.triangles.push_back(start);
+  for (std::size_t i = 0; i < cavity.triangles.size(); ++i) {
+    std::uint32_t t = cavity.triangles[i];
+    for (int k = 0; k < 3; ++k) {
+      std::uint32_t n = adjacency[3 * std::size_t(t) + k];
+      if (n == NO_TRIANGLE)
+        return false; // Unbounded Voronoi cell
+      if (std::find(cavity.triangles.begin(), cavity.triangles.end(), n) !=
+          cavity.triangles.end())
+        continue;
+      auto v = vertices(n);
+      if (originInCircle(rel(v[0]), rel(v[1]), rel(v[2]))) {
+        if (cavity.triangles.size() == MAX_CAVITY)
+          return false;
+        cavity.triangles.push_back(n);
+      }
+    }
+  }
+
+  // Area stolen from each vertex: for every cavity triangle, the triangle
+  // between its circumcenter and the circumcenters of the new point with
+  // the two edges at that vertex, signed so that overlaps cancel
+  cavity.weights.clear();
+  for (std::uint32_t t : cavity.triangles) {
+    auto v = vertices(t);
+    Vec p[3] = {rel(v[0]), rel(v[1]), rel(v[2])};
+    Vec center = circumcenter(p[0], p[1], p[2]);
+    Vec edge[3]; // Circumcenter of the new point with edge k -> k + 1
+    for (int k = 0; k < 3; ++k)
+      if (!circumcenterWithOrigin(p[k], p[(k + 1) % 3], edge[k]))
+        return false; // Pixel on an edge: the triangle gives the value
+    for (int k = 0; k < 3; ++k) {
+      double area = 0.5 * orient(center, edge[k], edge[(k + 2) % 3]);
+      auto it = std::find_if(
+          cavity.weights.begin(), cavity.weights.end(),
+          [&](const std::pair<std::size_t, double> &w) { return w.first == v[k]; });
+      if (it == cavity.weights.end())
+        cavity.weights.emplace_back(v[k], area);
+      else
+        it->second += area;
+    }
+  }
+
+  double total = 0, sum = 0;
+  for (const auto &w : cavity.weights) {
+    total += w.second;
+    sum += w.second * mesh.points[w.first].z;
+  }
+  if (!(std::fabs(total) > 0) || !std::isfinite(sum / total))
+    return false;
+  z = sum / total;
+  return true;
+}
+
+} // namespace
+
+bool sibsonGrid(const Mesh &mesh, const std::vector<std::uint32_t> &adjacency,
+                HeightField &field, ThreadPool &pool, SibsonStats *stats) {
+  if (mesh.triangles.empty())
+    return true;
+  const RasterGrid &grid = field.grid;
+  TriangleGrid locator;
+  locator.build(mesh);
+
+  const int BAND_HEIGHT = 16;
+  const int bandCount = (grid.height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+  std::atomic<std::size_t> natural{0}, linear{0};
+  bool complete = pool.parallelFor(
+      0, bandCount, 1, [&](std::size_t band0, std::size_t band1) {
+        Cavity cavity;
+        std::size_t bandNatural = 0, bandLinear = 0;
+        for (std::size_t band = band0; band < band1; ++band) {
+          int row0 = static_cast<int>(band) * BAND_HEIGHT;
+          int row1 = std::min(grid.height, row0 + BAND_HEIGHT);
+          for (int row = row0; row < row1; ++row) {
+            double y = grid.maxY - (row + 0.5) * grid.pixelSizeY;
+            std::uint32_t hint = NO_TRIANGLE;
+            for (int col = 0; col < grid.width; ++col) {
+              double x = grid.minX + (col + 0.5) * grid.pixelSizeX;
+
+              // Previous pixel's triangle, then its neighbours, then the grid
+              std::uint32_t t = NO_TRIANGLE;
+              if (hint != NO_TRIANGLE) {
+                if (contains(mesh, hint, x, y))
+                  t = hint;
+                for (int k = 0; k < 3 && t == NO_TRIANGLE; ++k) {
+                  std::uint32_t n = adjacency[3 * std::size_t(hint) + k];
+                  if (n != NO_TRIANGLE && contains(mesh, n, x, y))
+                    t = n;
+                }
+              }
+              if (t == NO_TRIANGLE)
+                t = locator.locate(x, y, mesh);
+              hint = t;
+              if (t == NO_TRIANGLE)
+                continue;
+
+              double z;
+              if (naturalNeighbour(mesh, adjacency, t, x, y, cavity, z)) {
+                ++bandNatural;
+              } else {
+                const Triangle &tri = mesh.triangles[t];
+                z = interpolateZ(x, y, mesh.points[tri.p1],
+                                 mesh.points[tri.p2], mesh.points[tri.p3]);
+                ++bandLinear;
+              }
+              field.z[static_cast<std::size_t>(row) * grid.width + col] =
+                  static_cast<float>(z);
+            }
+          }
+          progressAdvance(row1 - row0);
+        }
+        natural += bandNatural;
+        linear += bandLinear;
+      });
+  if (stats) {
+    stats->natural = natural;
+    stats->linear = linear;
+  }
+  return complete;
+}
+
+bool makeSibsonField(const Mesh &mesh,
+                     const std::vector<std::uint32_t> &adjacency, int width,
+                     ThreadPool &pool, HeightField &field) {
+  RasterGrid grid;
+  if (!makeRasterGrid(mesh.points, width, grid)) {
+    logError() << "Dimensions du maillage invalides." << std::endl;
+    return false;
+  }
+  logInfo() << "Générer une image " << width << "x" << grid.height
+            << " par voisins naturels" << std::endl;
+
+  field.reset(grid);
+  SibsonStats stats;
+  bool complete;
+  {
+    StageTimer timer(Stage::Render);
+    progressBegin(Stage::Render, grid.height, "lignes");
+    complete = sibsonGrid(mesh, adjacency, field, pool, &stats);
+    progressEnd();
+  }
+  if (!complete) {
+    logError() << "Rendu annulé, aucune image écrite." << std::endl;
+    return false;
+  }
+  logInfo() << "  Pixels interpolés : " << stats.natural
+            << " voisins naturels, " << stats.linear << " linéaires (bord)"
+            << std::endl;
+  return true;
+}
+
+void generateSibsonImage(const std::string &filename, int width,
+                         const Mesh &mesh,
+                         const std::vector<std::uint32_t> &adjacency,
+                         ThreadPool &pool) {
+  HeightField field;
+  if (makeSibsonField(mesh, adjacency, width, pool, field))
+    writeHeightFieldImage(filename, field, pool);
+}
@@ -0,0 +1,545 @@
+/**
+ * @file simplify.cpp
+ * @brief Error-bounded simplification of the mesh by greedy insertion.
+ */
+
+#include "simplify.hpp"
+#include "progress.hpp"
+#include "rasterizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <delaunator.hpp>
+#include <exception>
+#include <functional>
+#include <unordered_set>
+#include <utility>
+
+namespace {
+
+const std::uint32_t NONE = UINT32_MAX;
+
+// Walk steps after which a location gives up (degenerate rounding)
+const int MAX_WALK = 1 << 20;
+
+// Twice the signed area of (a, b, c): positive if c is left of a -> b
+double orient(double ax, double ay, double bx, double by, double cx,
+              double cy) {
+  return (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+}
+
+// Position along a Z-order curve over the bounding box, so that sorted
+// positions are spatially coherent
+std::uint32_t mortonKey(double x, double y, double minX, double minY,
+                        double scaleX, double scaleY) {
+  auto spread = [](std::uint32_t v) {
+    v &= 0xFFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+  };
+  auto cell = [](double v) {
+    return static_cast<std::uint32_t>(std::clamp(v, 0.0, 65535.0));
+  };
+  return spread(cell((x - minX) * scaleX)) |
+         (spread(cell((y - minY) * scaleY)) << 1);
+}
+
+// Convex hull of the given points (monotone chain), collinear points left
+// out
+std::vector<std::uint32_t> convexHull(const std::vector<Point> &points,
+                                      std::vector<std::uint32_t> ids) {
+  std::sort(ids.begin(), ids.end(), [&](std::uint32_t a, std::uint32_t b) {
+    return points[a].x < points[b].x ||
+           (points[a].x == points[b].x && points[a].y < points[b].y);
+  });
+  std::vector<std::uint32_t> hull(2 * ids.size());
+  std::size_t k = 0;
+  auto turn = [&](std::uint32_t a, std::uint32_t b, std::uint32_t c) {
+    return orient(points[a].x, points[a].y, points[b].x, points[b].y,
+                  points[c].x, points[c].y);
+  };
+  for (std::uint32_t id : ids) {
+    while (k >= 2 && turn(hull[k - 2], hull[k - 1], id) <= 0)
+      --k;
+    hull[k++] = id;
+  }
+  for (std::size_t i = ids.size() - 1, lower = k + 1; i-- > 0;) {
+    while (k >= lower && turn(hull[k - 2], hull[k - 1], ids[i]) <= 0)
+      --k;
+    hull[k++] = ids[i];
+  }
+  hull.resize(k > 1 ? k - 1 : k);
+  return hull;
+}
+
+// Vertices not kept yet, in Z-order so that consecutive ones are close
+struct OpenVertices {
+  std::vector<std::uint32_t> id;       // Vertex of the mesh
+  std::vector<std::uint32_t> triangle; // Simplified triangle holding it
+  std::vector<double> error;           // Vertical distance to that triangle
+
+  // Keeps the vertices for which keep(i) holds, in order
+  template <typename Keep> void filter(Keep keep) {
+    std::size_t n = 0;
+    for (std::size_t i = 0; i < id.size(); ++i)
+      if (keep(i)) {
+        id[n] = id[i];
+        triangle[n] = triangle[i];
+        error[n] = error[i];
+        ++n;
+      }
+    id.resize(n);
+    triangle.resize(n);
+    error.resize(n);
+  }
+};
+
+// Delaunay triangulation of the kept vertices, refined by inserting them
+// one at a time. Same layout as Delaunator's output, from which it starts:
+// half-edge e runs from vertex triangles[e] to the next one of its triangle
+// and halfedges[e] is its twin. A triangle keeps its number when it is
+// split or flipped, so a vertex is found again by walking from the triangle
+// that held it, and only the vertices of changed triangles are measured
+// again
+class Tin {
+public:
+  std::vector<double> coords;           // x, y of each kept vertex
+  std::vector<std::uint32_t> triangles; // 3 kept vertices per triangle
+  std::vector<std::uint32_t> halfedges; // Twin half-edge, NONE on the hull
+  std::vector<char> changed;            // Per triangle, since last cleared
+
+  // Triangulates the first vertices; false if they are all aligned
+  bool start() {
+    try {
+      delaunator::Delaunator d(coords);
+      triangles.assign(d.triangles.begin(), d.triangles.end());
+      halfedges.resize(d.halfedges.size());
+      for (std::size_t e = 0; e < d.halfedges.size(); ++e)
+        halfedges[e] = d.halfedges[e] == delaunator::INVALID_INDEX
+                           ? NONE
+                           : static_cast<std::uint32_t>(d.halfedges[e]);
+    } catch (const std::exception &) {
+      return false;
+    }
+    if (triangles.empty())
+      return false;
+    // Every triangle turns the same way
+    side = edgeSide(0, 0, coords[2 * triangles[2]],
+                    coords[2 * triangles[2] + 1]) > 0
+               ? 1.0
+               : -1.0;
+    changed.assign(triangleCount(), 1);
+    return true;
+  }
+
+  std::size_t triangleCount() const { return triangles.size() / 3; }
+
+  // Triangle across the edge from vertex k to vertex k + 1, NONE on the hull
+  std::uint32_t neighbour(std::size_t t, int k) const {
+    std::uint32_t h = halfedges[3 * t + k];
+    return h == NONE ? NONE : h / 3;
+  }
+
+  // Triangle holding (x, y), walking from t. If the point is outside the
+  // hull (by rounding: the hull is kept from the start), the hull triangle
+  // where the walk stopped, and edge receives the edge it could not cross
+  std::uint32_t locate(double x, double y, std::uint32_t t,
+                       int *edge = nullptr) const {
+    if (edge)
+      *edge = -1;
+    for (int step = 0; step < MAX_WALK; ++step) {
+      bool moved = false;
+      // Edges tried from a rotating first one, so that rounding cannot
+      // send the walk around in circles
+      for (int i = 0; i < 3 && !moved; ++i) {
+        int k = (i + step) % 3;
+        if (side * edgeSide(t, k, x, y) >= 0)
+          continue;
+        std::uint32_t h = halfedges[3 * t + k];
+        if (h == NONE) {
+          if (edge)
+            *edge = k;
+          return t;
+        }
+        t = h / 3;
+        moved = true;
+      }
+      if (!moved)
+        return t;
+    }
+    return t;
+  }
+
+  // Inserts kept vertex v, found in triangle t with locate(); false if it
+  // coincides with a vertex
+  bool insert(std::uint32_t v, std::uint32_t t, int outsideEdge) {
+    const double x = coords[2 * v], y = coords[2 * v + 1];
+    for (int k = 0; k < 3; ++k) {
+      std::uint32_t a = triangles[3 * t + k];
+      if (coords[2 * a] == x && coords[2 * a + 1] == y)
+        return false;
+    }
+    int onEdge = outsideEdge;
+    for (int k = 0; k < 3 && onEdge < 0; ++k)
+      if (edgeSide(t, k, x, y) == 0)
+        onEdge = k;
+    if (onEdge >= 0)
+      splitEdge(v, static_cast<std::uint32_t>(3 * t + onEdge));
+    else
+      splitTriangle(v, t);
+    return true;
+  }
+
+private:
+  double side = 1;
+  std::vector<std::uint32_t> stack;
+
+  double edgeSide(std::size_t t, int k, double x, double y) const {
+    std::uint32_t a = triangles[3 * t + k], b = triangles[3 * t + (k + 1) % 3];
+    return orient(coords[2 * a], coords[2 * a + 1], coords[2 * b],
+                  coords[2 * b + 1], x, y);
+  }
+
+  static std::uint32_t next(std::uint32_t e) {
+    return e % 3 == 2 ? e - 2 : e + 1;
+  }
+
+  void link(std::uint32_t a, std::uint32_t b) {
+    halfedges[a] = b;
+    if (b != NONE)
+      halfedges[b] = a;
+  }
+
+  std::uint32_t addTriangle(std::uint32_t a, std::uint32_t b, std::uint32_t c) {
+    std::uint32_t t = static_cast<std::uint32_t>(triangleCount());
+    triangles.insert(triangles.end(), {a, b, c});
+    halfedges.insert(halfedges.end(), {NONE, NONE, NONE});
+    changed.push_back(1);
+    return t;
+  }
+
+  // (a, b, c) becomes (a, b, v), (b, c, v) and (c, a, v)
+  void splitTriangle(std::uint32_t v, std::uint32_t t) {
+    std::uint32_t a = triangles[3 * t], b = triangles[3 * t + 1],
+                  c = triangles[3 * t + 2];
+    std::uint32_t ob = halfedges[3 * t + 1], oc = halfedges[3 * t + 2];
+    std::uint32_t t1 = addTriangle(b, c, v), t2 = addTriangle(c, a, v);
+    triangles[3 * t + 2] = v;
+    changed[t] = 1;
+    link(3 * t1, ob);
+    link(3 * t2, oc);
+    link(3 * t + 1, 3 * t1 + 2);
+    link(3 * t + 2, 3 * t2 + 1);
+    link(3 * t1 + 1, 3 * t2 + 2);
+    legalize(3 * t);
+    legalize(3 * t1);
+    legalize(3 * t2);
+  }
+
+  // v on half-edge e, from a to b in (a, b, c): (a, v, c) and (v, b, c),
+  // and likewise across e unless on the hull
+  void splitEdge(std::uint32_t v, std::uint32_t e) {
+    std::uint32_t t = e / 3, e1 = next(e), e2 = next(e1);
+    std::uint32_t b = triangles[e1], c = triangles[e2];
+    std::uint32_t o = halfedges[e], ob = halfedges[e1];
+    std::uint32_t n = addTriangle(v, b, c);
+    triangles[e1] = v;
+    changed[t] = 1;
+    link(3 * n + 1, ob);
+    link(3 * n + 2, e1);
+    std::uint32_t outer[4] = {e2, 3 * n + 1, NONE, NONE};
+    if (o == NONE) {
+      link(e, NONE);
+      link(3 * n, NONE);
+    } else {
+      // Across: (b, a, d) becomes (v, a, d) and (b, v, d)
+      std::uint32_t o1 = next(o), o2 = next(o1);
+      std::uint32_t d = triangles[o2], od = halfedges[o2];
+      std::uint32_t m = addTriangle(b, v, d);
+      triangles[o] = v;
+      changed[o / 3] = 1;
+      link(3 * m + 2, od);
+      link(3 * m + 1, o2);
+      link(e, o);
+      link(3 * n, 3 * m);
+      outer[2] = o1;
+      outer[3] = 3 * m + 2;
+    }
+    for (std::uint32_t edge : outer)
+      if (edge != NONE)
+        legalize(edge);
+  }
+
+  // Flips half-edge a, then the edges the flip exposes, while the vertex
+  // across is inside the circumcircle (Delaunator's legalize, without its
+  // hull bookkeeping)
+  void legalize(std::uint32_t a) {
+    stack.assign(1, a);
+    while (!stack.empty()) {
+      a = stack.back();
+      stack.pop_back();
+      std::uint32_t b = halfedges[a];
+      if (b == NONE)
+        continue;
+      std::uint32_t a0 = 3 * (a / 3), b0 = 3 * (b / 3);
+      std::uint32_t ar = a0 + (a + 2) % 3, al = a0 + (a + 1) % 3;
+      std::uint32_t bl = b0 + (b + 2) % 3, br = b0 + (b + 1) % 3;
+      std::uint32_t p0 = triangles[ar], pr = triangles[a], pl = triangles[al],
+                    p1 = triangles[bl];
+      if (!delaunator::in_circle(coords[2 * p0], coords[2 * p0 + 1],
+                                 coords[2 * pr], coords[2 * pr + 1],
+                                 coords[2 * pl], coords[2 * pl + 1],
+                                 coords[2 * p1], coords[2 * p1 + 1]))
+        continue;
+      triangles[a] = p1;
+      triangles[b] = p0;
+      std::uint32_t hbl = halfedges[bl], har = halfedges[ar];
+      link(a, hbl);
+      link(b, har);
+      link(ar, bl);
+      changed[a / 3] = changed[b / 3] = 1;
+      stack.push_back(a);
+      stack.push_back(br);
+    }
+  }
+};
+
+} // namespace
+
+bool simplifyMesh(const Mesh &mesh, const std::vector<std::uint32_t> &adjacency,
+                  std::vector<double> tolerances, ThreadPool &pool,
+                  std::vector<LodLevel> &levels) {
+  levels.clear();
+  const std::vector<Point> &pts = mesh.points;
+  if (mesh.triangles.empty() || tolerances.empty())
+    return false;
+  std::sort(tolerances.begin(), tolerances.end(), std::greater<double>());
+
+  // Vertices of the kept triangles (the points the filter isolated are left
+  // out), and the edges of the mesh (hull or 70 m filter). Edges are kept
+  // in the direction they run in their triangle: all triangles turn the
+  // same way, so a triangle running along one lies on its inner side
+  std::vector<char> used(pts.size(), 0), onEdge(pts.size(), 0);
+  std::unordered_set<std::uint64_t> edges;
+  auto edgeKey = [](std::uint64_t a, std::uint64_t b) { return a << 32 | b; };
+  for (std::size_t t = 0; t < mesh.triangles.size(); ++t) {
+    const Triangle &tri = mesh.triangles[t];
+    const std::size_t corners[3] = {tri.p1, tri.p2, tri.p3};
+    for (int k = 0; k < 3; ++k) {
+      used[corners[k]] = 1;
+      if (adjacency[3 * t + k] != NO_TRIANGLE)
+        continue;
+      std::size_t a = corners[k], b = corners[(k + 1) % 3];
+      onEdge[a] = onEdge[b] = 1;
+      edges.insert(edgeKey(a, b));
+    }
+  }
+  std::vector<std::uint32_t> vertices;
+  for (std::size_t i = 0; i < pts.size(); ++i)
+    if (used[i])
+      vertices.push_back(static_cast<std::uint32_t>(i));
+
+  double minX = pts[vertices[0]].x, maxX = minX;
+  double minY = pts[vertices[0]].y, maxY = minY;
+  std::uint32_t lowest = vertices[0], highest = vertices[0];
+  for (std::uint32_t v : vertices) {
+    minX = std::min(minX, pts[v].x);
+    maxX = std::max(maxX, pts[v].x);
+    minY = std::min(minY, pts[v].y);
+    maxY = std::max(maxY, pts[v].y);
+    if (pts[v].z < pts[lowest].z)
+      lowest = v;
+    if (pts[v].z > pts[highest].z)
+      highest = v;
+  }
+
+  // Extremes of all the points, carried by every level without a triangle
+  // so that the image grid and color scale stay those of the mesh
+  auto coordinate = [&](std::uint32_t i, int k) {
+    return k == 0 ? pts[i].x : k == 1 ? pts[i].y : pts[i].z;
+  };
+  std::uint32_t extremes[6] = {0, 0, 0, 0, 0, 0};
+  for (std::uint32_t i = 0; i < pts.size(); ++i)
+    for (int k = 0; k < 3; ++k) {
+      if (coordinate(i, k) < coordinate(extremes[2 * k], k))
+        extremes[2 * k] = i;
+      if (coordinate(i, k) > coordinate(extremes[2 * k + 1], k))
+        extremes[2 * k + 1] = i;
+    }
+
+  // Kept from the start: the hull, so that every vertex lies in a
+  // triangle; the lowest and highest vertices; and the edges of the mesh.
+  // An edge of the Delaunay triangulation stays one in the triangulation of
+  // any subset holding its two ends, so every level keeps the edges of the
+  // mesh and each simplified triangle lies entirely inside or outside it
+  Tin tin;
+  std::vector<std::uint32_t> kept;
+  std::vector<char> isKept(pts.size(), 0);
+  auto keep = [&](std::uint32_t v) {
+    isKept[v] = 1;
+    kept.push_back(v);
+    tin.coords.push_back(pts[v].x);
+    tin.coords.push_back(pts[v].y);
+  };
+  for (std::uint32_t v : convexHull(pts, vertices))
+    keep(v);
+  for (std::uint32_t v : {lowest, highest})
+    if (!isKept[v])
+      keep(v);
+  for (std::uint32_t v : vertices)
+    if (onEdge[v] && !isKept[v])
+      keep(v);
+  if (!tin.start())
+    return false;
+
+  OpenVertices open;
+  {
+    double scaleX = 65535.0 / std::max(maxX - minX, 1e-9);
+    double scaleY = 65535.0 / std::max(maxY - minY, 1e-9);
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> order;
+    for (std::uint32_t v : vertices)
+      if (!isKept[v])
+        order.push_back(
+            {mortonKey(pts[v].x, pts[v].y, minX, minY, scaleX, scaleY), v});
+    std::sort(order.begin(), order.end());
+    for (const auto &entry : order)
+      open.id.push_back(entry.second);
+    open.triangle.assign(open.id.size(), 0);
+    open.error.assign(open.id.size(), 0.0);
+  }
+
+  // Simplified triangles inside the mesh: those along an edge of the mesh
+  // on its inner side, and those reached from them without crossing one
+  const char UNKNOWN = 2;
+  std::vector<char> inside;
+  std::vector<std::uint32_t> stack, worst;
+
+  std::size_t level = 0;
+  bool firstRound = true;
+  progressBegin(Stage::Triangulate, tolerances.size(), "niveaux");
+  while (level < tolerances.size()) {
+    // Vertical error of the open vertices whose triangle changed, located
+    // in parallel from that triangle (from the previous vertex's in the
+    // first round)
+    bool complete = pool.parallelFor(
+        0, open.id.size(), 1 << 11, [&](std::size_t b, std::size_t e) {
+          std::uint32_t previous = open.triangle[b];
+          for (std::size_t i = b; i < e; ++i) {
+            std::uint32_t &t = open.triangle[i];
+            if (!tin.changed[t]) {
+              previous = t;
+              continue;
+            }
+            const Point &p = pts[open.id[i]];
+            t = tin.locate(p.x, p.y, firstRound ? previous : t);
+            previous = t;
+            const std::uint32_t *v = &tin.triangles[3 * t];
+            double z = interpolateZ(p.x, p.y, pts[kept[v[0]]],
+                                    pts[kept[v[1]]], pts[kept[v[2]]]);
+            open.error[i] = std::abs(p.z - z);
+          }
+        });
+    if (!complete)
+      break;
+    firstRound = false;
+    std::fill(tin.changed.begin(), tin.changed.end(), 0);
+
+    // Farthest vertex of each triangle
+    const std::size_t m = tin.triangleCount();
+    worst.assign(m, NONE);
+    double maxError = 0;
+    for (std::size_t i = 0; i < open.id.size(); ++i) {
+      std::uint32_t t = open.triangle[i];
+      maxError = std::max(maxError, open.error[i]);
+      if (worst[t] == NONE || open.error[i] > open.error[worst[t]])
+        worst[t] = static_cast<std::uint32_t>(i);
+    }
+
+    // Levels reached: their triangles inside the mesh
+    if (maxError <= tolerances[level]) {
+      inside.assign(m, UNKNOWN);
+      stack.clear();
+      auto original = [&](std::size_t t, int k) {
+        return static_cast<std::uint64_t>(kept[tin.triangles[3 * t + k]]);
+      };
+      for (std::size_t t = 0; t < m; ++t)
+        for (int k = 0; k < 3 && inside[t] == UNKNOWN; ++k) {
+          std::uint64_t a = original(t, k), b = original(t, (k + 1) % 3);
+          if (edges.count(edgeKey(a, b)))
+            inside[t] = 1;
+          else if (edges.count(edgeKey(b, a)))
+            inside[t] = 0;
+          if (inside[t] != UNKNOWN)
+            stack.push_back(static_cast<std::uint32_t>(t));
+        }
+      while (!stack.empty()) {
+        std::uint32_t t = stack.back();
+        stack.pop_back();
+        for (int k = 0; k < 3; ++k) {
+          std::uint32_t u = tin.neighbour(t, k);
+          std::uint64_t a = original(t, k), b = original(t, (k + 1) % 3);
+          if (u == NONE || inside[u] != UNKNOWN ||
+              edges.count(edgeKey(a, b)) || edges.count(edgeKey(b, a)))
+            continue;
+          inside[u] = inside[t];
+          stack.push_back(u);
+        }
+      }
+    }
+    while (level < tolerances.size() && maxError <= tolerances[level]) {
+      LodLevel lod;
+      lod.tolerance = tolerances[level];
+      lod.error = maxError;
+      for (std::uint32_t v : kept)
+        lod.mesh.points.push_back(pts[v]);
+      for (std::uint32_t v : extremes)
+        lod.mesh.points.push_back(pts[v]);
+      for (std::size_t t = 0; t < m; ++t)
+        if (inside[t] != 0)
+          lod.mesh.triangles.push_back({tin.triangles[3 * t],
+                                        tin.triangles[3 * t + 1],
+                                        tin.triangles[3 * t + 2]});
+      levels.push_back(std::move(lod));
+      progressAdvance(1);
+      ++level;
+    }
+    if (level == tolerances.size())
+      break;
+
+    // Next round: the farthest vertex of each triangle beyond the
+    // tolerance, inserted one by one with edge flips. A vertex at the
+    // position of a kept one (never in a Delaunay mesh) is dropped
+    for (std::size_t t = 0; t < m; ++t) {
+      std::uint32_t i = worst[t];
+      if (i == NONE || open.error[i] <= tolerances[level])
+        continue;
+      const Point &p = pts[open.id[i]];
+      int edge;
+      std::uint32_t at = tin.locate(p.x, p.y, open.triangle[i], &edge);
+      isKept[open.id[i]] = 1;
+      kept.push_back(open.id[i]);
+      tin.coords.push_back(p.x);
+      tin.coords.push_back(p.y);
+      if (!tin.insert(static_cast<std::uint32_t>(kept.size() - 1), at, edge)) {
+        kept.pop_back();
+        tin.coords.resize(tin.coords.size() - 2);
+      }
+    }
+    open.filter([&](std::size_t i) { return !isKept[open.id[i]]; });
+  }
+  progressEnd();
+  if (level < tolerances.size()) {
+    levels.clear();
+    return false;
+  }
+  return true;
+}
+
+std::size_t selectLod(const std::vector<LodLevel> &levels, double maxError) {
+  for (std::size_t i = 0; i < levels.size(); ++i)
+    if (levels[i].tolerance <= maxError)
+      return i;
+  return levels.empty() ? 0 : levels.size() - 1;
+}
@@ -0,0 +1,238 @@
+/**
+ * @file streaming.cpp
+ * @brief Implementation of the live survey map.
+ */
+
+#include "streaming.hpp"
+#include "logging.hpp"
+#include "quadtree.hpp"
+#include "triangulation.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <poll.h>
+#include <unistd.h>
+
+namespace {
+
+// Read size for the input stream
+const std::size_t READ_SIZE = 1 << 20;
+
+// Tile containing a coordinate measured from the grid origin
+int tileOf(double offset, double tileExtent, int count) {
+  int t = static_cast<int>(std::floor(offset / tileExtent));
+  return std::min(count - 1, std::max(0, t));
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+} // namespace
+
+bool LiveMap::open(const std::string &output, const StreamOptions &options) {
+  if (!makeRasterGrid(options.extent, options.minZ, options.maxZ,
+                      options.width, grid)) {
+    logError() << "Emprise de la carte invalide." << std::endl;
+    return false;
+  }
+  tileSize = std::max(16, options.tileSize);
+  tilesX = (grid.width + tileSize - 1) / tileSize;
+  tilesY = (grid.height + tileSize - 1) / tileSize;
+  tileW = tileSize * grid.pixelSizeX;
+  tileH = tileSize * grid.pixelSizeY;
+  halo = std::max(0.0, options.halo);
+  buckets.assign(static_cast<std::size_t>(tilesX) * tilesY, {});
+  isDirty.assign(buckets.size(), 0);
+  dirty.clear();
+  total = 0;
+  logInfo() << "Carte " << grid.width << "x" << grid.height << " en "
+            << tilesX << "x" << tilesY << " tuiles de " << tileSize << " px"
+            << std::endl;
+  return writer.open(output, grid.width, grid.height);
+}
+
+std::size_t LiveMap::add(const std::vector<Point> &points) {
+  std::size_t kept = 0;
+  for (const Point &p : points) {
+    if (!grid.bounds.contains(p.x, p.y))
+      continue;
+    double ox = p.x - grid.minX;
+    double oy = grid.maxY - p.y;
+    buckets[static_cast<std::size_t>(tileOf(oy, tileH, tilesY)) * tilesX +
+            tileOf(ox, tileW, tilesX)]
+        .push_back(p);
+    ++kept;
+
+    // Every tile whose gathered area (tile plus halo) holds the point
+    int tx0 = tileOf(ox - halo, tileW, tilesX);
+    int tx1 = tileOf(ox + halo, tileW, tilesX);
+    int ty0 = tileOf(oy - halo, tileH, tilesY);
+    int ty1 = tileOf(oy + halo, tileH, tilesY);
+    for (int ty = ty0; ty <= ty1; ++ty) {
+      for (int tx = tx0; tx <= tx1; ++tx) {
+        std::size_t t = static_cast<std::size_t>(ty) * tilesX + tx;
+        if (!isDirty[t]) {
+          isDirty[t] = 1;
+          dirty.push_back(t);
+        }
+      }
+    }
+  }
+  total += kept;
+  return kept;
+}
+
+// Points of tile (tx, ty) and of its halo, as renderTiled() gathers them
+std::vector<Point> LiveMap::gather(int tx, int ty) const {
+  const double inf = std::numeric_limits<double>::infinity();
+  double x0 = tx == 0 ? -inf : tx * tileW - halo;
+  double x1 = tx == tilesX - 1 ? inf : (tx + 1) * tileW + halo;
+  double y0 = ty == 0 ? -inf : ty * tileH - halo;
+  double y1 = ty == tilesY - 1 ? inf : (ty + 1) * tileH + halo;
+  int cx0 = tx == 0 ? 0 : tileOf(x0, tileW, tilesX);
+  int cx1 = tx == tilesX - 1 ? tx : tileOf(x1, tileW, tilesX);
+  int cy0 = ty == 0 ? 0 : tileOf(y0, tileH, tilesY);
+  int cy1 = ty == tilesY - 1 ? ty : tileOf(y1, tileH, tilesY);
+
+  std::vector<Point> local;
+  for (int cy = cy0; cy <= cy1; ++cy) {
+    for (int cx = cx0; cx <= cx1; ++cx) {
+      for (const Point &p : buckets[static_cast<std::size_t>(cy) * tilesX +
+                                    cx]) {
+        double ox = p.x - grid.minX;
+        double oy = grid.maxY - p.y;
+        if (ox >= x0 && ox < x1 && oy >= y0 && oy < y1)
+          local.push_back(p);
+      }
+    }
+  }
+  return local;
+}
+
+bool LiveMap::publish(ThreadPool &pool) {
+  std::vector<std::size_t> tiles;
+  tiles.swap(dirty);
+  for (std::size_t t : tiles)
+    isDirty[t] = 0;
+
+  std::atomic<bool> writeFailed{false};
+  bool complete =
+      pool.parallelFor(0, tiles.size(), 1, [&](std::size_t b, std::size_t e) {
+        for (std::size_t i = b; i < e; ++i) {
+          int tx = static_cast<int>(tiles[i] % tilesX);
+          int ty = static_cast<int>(tiles[i] / tilesX);
+          int row0 = ty * tileSize;
+          int row1 = std::min(grid.height, row0 + tileSize);
+          int col0 = tx * tileSize;
+          int col1 = std::min(grid.width, col0 + tileSize);
+
+          Mesh mesh = buildMesh(gather(tx, ty), pool);
+          std::size_t stride = static_cast<std::size_t>(col1 - col0) * 3;
+          std::vector<unsigned char> pixels(stride * (row1 - row0), 0);
+          if (!mesh.triangles.empty()) {
+            RasterGrid bounds;
+            makeRasterGrid(mesh.points, 1, bounds);
+            QuadTree index(bounds.bounds);
+            index.build(mesh.triangles, mesh.points, pool);
+            renderRegion(mesh, index, grid, row0, row1, col0, col1,
+                         pixels.data(), stride);
+          }
+          if (!writer.writeBlock(row0, row1 - row0, col0, col1 - col0,
+                                 pixels.data(), stride))
+            writeFailed = true;
+        }
+      });
+  return complete && !writeFailed;
+}
+
+bool LiveMap::close() { return writer.close(); }
+
+bool streamSurvey(int fd, const std::string &output,
+                  const StreamOptions &options, ThreadPool &pool) {
+  LiveMap map;
+  if (!map.open(output, options))
+    return false;
+
+  std::vector<char> buffer(READ_SIZE);
+  std::string pending; // Incomplete last line
+  std::vector<Point> fresh;
+  bool endOfInput = false;
+  bool ok = true;
+  auto nextPublish = std::chrono::steady_clock::now() +
+                     std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::duration<double>(
+                             options.publishInterval));
+
+  while (ok && !endOfInput && !pool.cancelled()) {
+    auto now = std::chrono::steady_clock::now();
+    int waitMs = static_cast<int>(std::max<long long>(
+        0, std::chrono::duration_cast<std::chrono::milliseconds>(nextPublish -
+                                                                 now)
+               .count()));
+    pollfd pfd{fd, POLLIN, 0};
+    int ready = ::poll(&pfd, 1, waitMs);
+    if (ready > 0) {
+      ssize_t n = ::read(fd, buffer.data(), buffer.size());
+      if (n > 0) {
+        pending.append(buffer.data(), static_cast<std::size_t>(n));
+        std::size_t cut = pending.rfind('\n');
+        if (cut != std::string::npos) {
+          analyserLignes(pending.substr(0, cut + 1), fresh);
+          pending.erase(0, cut + 1);
+        }
+      } else if (n == 0) {
+        endOfInput = true;
+        analyserLignes(pending, fresh);
+      } else if (errno != EINTR && errno != EAGAIN) {
+        logError() << "Erreur de lecture du flux : " << std::strerror(errno)
+                   << std::endl;
+        ok = false;
+      }
+    } else if (ready < 0 && errno != EINTR) {
+      logError() << "Erreur de lecture du flux : " << std::strerror(errno)
+                 << std::endl;
+      ok = false;
+    }
+    if (pool.cancelled() ||
+        (!endOfInput && std::chrono::steady_clock::now() < nextPublish))
+      continue;
+
+    // Publication: only the tiles the new points reach
+    auto start = std::chrono::steady_clock::now();
+    std::size_t received = fresh.size();
+    std::size_t kept = 0;
+    if (!fresh.empty() && projeterPoints(fresh, pool))
+      kept = map.add(fresh);
+    fresh.clear();
+    std::size_t tiles = map.dirtyTiles();
+    if (tiles > 0) {
+      ok = map.publish(pool) && ok;
+      logInfo() << "Publication : " << kept << " points nouveaux";
+      if (kept < received)
+        logInfo() << " (" << received - kept << " hors emprise)";
+      logInfo() << ", " << tiles << " tuiles en "
+                << static_cast<int>(secondsSince(start) * 1000) << " ms, "
+                << map.pointCount() << " points au total" << std::endl;
+    }
+    nextPublish = std::chrono::steady_clock::now() +
+                  std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::duration<double>(options.publishInterval));
+  }
+
+  bool closed = map.close();
+  if (pool.cancelled()) {
+    logError() << "Flux interrompu ; " << output
+               << " garde la dernière publication." << std::endl;
+    return false;
+  }
+  return ok && closed;
+}
@@ -0,0 +1,329 @@
+/**
+ * @file synthetic.cpp
+ * @brief Implementation of the synthetic terrain point-cloud generator.
+ */
+
+#include "synthetic.hpp"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+const double METERS_PER_DEGREE = 111320.0;
+
+// SplitMix64: decorrelates (seed, chunk) pairs into independent RNG seeds
+std::uint64_t mix(std::uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/**
+ * @class Elevation
+ * @brief Fractal elevation field over the unit square, in [-1, 1].
+ */
+class Elevation {
+public:
+  explicit Elevation(const SyntheticOptions &options)
+      : model(options.model), octaves(std::max(1, options.octaves)),
+        roughness(options.roughness) {
+    std::mt19937_64 rng(mix(options.seed));
+    for (int i = 0; i < 256; ++i)
+      perm[i] = static_cast<unsigned char>(i);
+    std::shuffle(perm, perm + 256, rng);
+    for (int i = 0; i < 256; ++i)
+      perm[256 + i] = perm[i];
+
+    if (model == TerrainModel::DiamondSquare)
+      buildHeightmap(rng);
+  }
+
+  double operator()(double u, double v) const {
+    return model == TerrainModel::Perlin ? fbm(u, v) : heightmapAt(u, v);
+  }
+
+private:
+  TerrainModel model;
+  int octaves;
+  double roughness;
+  unsigned char perm[512];
+  int gridSize = 0;
+  std::vector<float> heightmap;
+
+  static double fade(double t) { return t * t * t * (t * (t * 6 - 15) + 10); }
+
+  static double grad(int hash, double x, double y) {
+    switch (hash & 7) {
+    case 0:
+      return x + y;
+    case 1:
+      return x - y;
+    case 2:
+      return -x + y;
+    case 3:
+      return -x - y;
+    case 4:
+      return x;
+    case 5:
+      return -x;
+    case 6:
+      return y;
+    default:
+      return -y;
+    }
+  }
+
+  // Improved Perlin noise, roughly in [-1, 1]
+  double perlin(double x, double y) const {
+    int xi = static_cast<int>(std::floor(x)) & 255;
+    int yi = static_cast<int>(std::floor(y)) & 255;
+    double xf = x - std::floor(x);
+    double yf = y - std::floor(y);
+    double u = fade(xf), v = fade(yf);
+    int aa = perm[perm[xi] + yi], ab = perm[perm[xi] + yi + 1];
+    int ba = perm[perm[xi + 1] + yi], bb = perm[perm[xi + 1] + yi + 1];
+    double x1 = grad(aa, xf, yf) + u * (grad(ba, xf - 1, yf) - grad(aa, xf, yf));
+    double x2 = grad(ab, xf, yf - 1) +
+                u * (grad(bb, xf - 1, yf - 1) - grad(ab, xf, yf - 1));
+    return x1 + v * (x2 - x1);
+  }
+
+  double fbm(double u, double v) const {
+    double sum = 0.0, amplitude = 1.0, norm = 0.0, frequency = 3.0;
+    for (int o = 0; o < octaves; ++o) {
+      sum += amplitude * perlin(u * frequency, v * frequency);
+      norm += amplitude;
+      amplitude *= roughness;
+      frequency *= 2.0;
+    }
+    return std::clamp(sum / norm * 1.5, -1.0, 1.0);
+  }
+
+  void buildHeightmap(std::mt19937_64 &rng) {
+    int levels = std::clamp(octaves + 4, 5, 12);
+    gridSize = (1 << levels) + 1;
+    heightmap.assign(static_cast<std::size_t>(gridSize) * gridSize, 0.0f);
+    std::uniform_real_distribution<double> d(-1.0, 1.0);
+    auto at = [&](int i, int j) -> float & {
+      return heightmap[static_cast<std::size_t>(j) * gridSize + i];
+    };
+
+    int last = gridSize - 1;
+    at(0, 0) = d(rng);
+    at(last, 0) = d(rng);
+    at(0, last) = d(rng);
+    at(last, last) = d(rng);
+
+    double amplitude = 1.0;
+    for (int step = last; step > 1; step /= 2) {
+      int half = step / 2;
+      // Diamond step
+      for (int j = half; j < gridSize; j += step)
+        for (int i = half; i < gridSize; i += step)
+          at(i, j) = (at(i - half, j - half) + at(i + half, j - half) +
+                      at(i - half, j + half) + at(i + half, j + half)) /
+                         4.0f +
+                     amplitude * d(rng);
+      // Square step
+      for (int j = 0; j < gridSize; j += half)
+        for (int i = (j / half % 2 == 0) ? half : 0; i < gridSize; i += step) {
+          double sum = 0.0;
+          int n = 0;
+          if (i >= half) sum += at(i - half, j), ++n;
+          if (i + half < gridSize) sum += at(i + half, j), ++n;
+          if (j >= half) sum += at(i, j - half), ++n;
+          if (j + half < gridSize) sum += at(i, j + half), ++n;
+          at(i, j) = sum / n + amplitude * d(rng);
+        }
+      amplitude *= roughness;
+    }
+
+    auto range = std::minmax_element(heightmap.begin(), heightmap.end());
+    float lo = *range.first, hi = *range.second;
+    for (auto &h : heightmap)
+      h = hi > lo ? 2.0f * (h - lo) / (hi - lo) - 1.0f : 0.0f;
+  }
+
+  double heightmapAt(double u, double v) const {
+    double gx = std::clamp(u, 0.0, 1.0) * (gridSize - 1);
+    double gy = std::clamp(v, 0.0, 1.0) * (gridSize - 1);
+    int i = std::min(static_cast<int>(gx), gridSize - 2);
+    int j = std::min(static_cast<int>(gy), gridSize - 2);
+    double fx = gx - i, fy = gy - j;
+    const float *r0 = &heightmap[static_cast<std::size_t>(j) * gridSize + i];
+    const float *r1 = r0 + gridSize;
+    return (1 - fy) * ((1 - fx) * r0[0] + fx * r0[1]) +
+           fy * ((1 - fx) * r1[0] + fx * r1[1]);
+  }
+};
+
+struct Cluster {
+  double u, v, sigma, weight;
+};
+
+std::vector<Cluster> makeClusters(std::uint64_t seed) {
+  std::mt19937_64 rng(mix(seed ^ 0xc1u));
+  std::uniform_real_distribution<double> pos(0.1, 0.9);
+  std::uniform_real_distribution<double> sig(0.005, 0.08);
+  std::uniform_real_distribution<double> w(0.2, 1.0);
+  std::vector<Cluster> clusters(16);
+  double total = 0.0;
+  for (auto &c : clusters) {
+    c = {pos(rng), pos(rng), sig(rng), w(rng)};
+    total += c.weight;
+  }
+  double acc = 0.0;
+  for (auto &c : clusters) { // Cumulative weights
+    acc += c.weight / total;
+    c.weight = acc;
+  }
+  return clusters;
+}
+
+/**
+ * @brief Position of point index i in the unit square for the deterministic
+ * samplings (tracks, rows).
+ */
+void orderedPosition(const SyntheticOptions &o, std::uint64_t i, double &u,
+                     double &v) {
+  if (o.sampling == Sampling::Rows) {
+    std::uint64_t side = static_cast<std::uint64_t>(
+        std::ceil(std::sqrt(static_cast<double>(o.count))));
+    u = (i % side + 0.5) / side;
+    v = (i / side + 0.5) / side;
+    return;
+  }
+
+  // Survey lines along X, swept back and forth, several passes if needed
+  int beams = std::max(1, o.beams);
+  std::uint64_t ping = i / beams;
+  int beam = static_cast<int>(i % beams);
+  std::uint64_t pingsPerLine =
+      std::max<std::uint64_t>(1, static_cast<std::uint64_t>(o.size / o.pingSpacing));
+  std::uint64_t lines =
+      std::max<std::uint64_t>(1, static_cast<std::uint64_t>(o.size / o.trackSpacing));
+  std::uint64_t line = ping / pingsPerLine;
+  std::uint64_t pass = line / lines;
+  double along = (ping % pingsPerLine + 0.5) / pingsPerLine;
+  if (line % 2 == 1)
+    along = 1.0 - along;
+  double passOffset = std::fmod(pass * 0.618033988749895, 1.0);
+  double lineV = ((line % lines) + passOffset) * o.trackSpacing / o.size;
+  double swath = 1.2 * o.trackSpacing / o.size;
+  double across = beams > 1 ? (double(beam) / (beams - 1) - 0.5) * swath : 0.0;
+  u = along;
+  v = lineV + across;
+}
+
+} // namespace
+
+bool parseTerrainModel(const std::string &name, TerrainModel &model) {
+  if (name == "perlin")
+    model = TerrainModel::Perlin;
+  else if (name == "diamond" || name == "diamond-square")
+    model = TerrainModel::DiamondSquare;
+  else
+    return false;
+  return true;
+}
+
+bool parseSampling(const std::string &name, Sampling &sampling) {
+  if (name == "uniform")
+    sampling = Sampling::Uniform;
+  else if (name == "clustered")
+    sampling = Sampling::Clustered;
+  else if (name == "tracks")
+    sampling = Sampling::Tracks;
+  else if (name == "rows")
+    sampling = Sampling::Rows;
+  else if (name == "hotspot")
+    sampling = Sampling::Hotspot;
+  else
+    return false;
+  return true;
+}
+
+void generateSynthetic(
+    const SyntheticOptions &options,
+    const std::function<bool(const std::vector<Point> &)> &sink,
+    std::size_t chunkSize) {
+  Elevation elevation(options);
+  std::vector<Cluster> clusters = makeClusters(options.seed);
+  double metersPerLon =
+      METERS_PER_DEGREE * std::cos(options.centerLat * PI / 180.0);
+
+  std::vector<Point> chunk;
+  chunkSize = std::max<std::size_t>(1, chunkSize);
+  for (std::uint64_t first = 0, c = 0; first < options.count;
+       first += chunkSize, ++c) {
+    std::uint64_t last = std::min<std::uint64_t>(options.count, first + chunkSize);
+    std::mt19937_64 rng(mix(options.seed * 0x100000001b3ULL + c));
+    std::uniform_real_distribution<double> uni(0.0, 1.0);
+    std::normal_distribution<double> gauss(0.0, 1.0);
+
+    chunk.clear();
+    for (std::uint64_t i = first; i < last; ++i) {
+      if (!chunk.empty() && uni(rng) < options.duplicates) {
+        chunk.push_back(chunk.back());
+        continue;
+      }
+
+      double u, v;
+      switch (options.sampling) {
+      case Sampling::Uniform:
+        u = uni(rng);
+        v = uni(rng);
+        break;
+      case Sampling::Clustered: {
+        double pick = uni(rng);
+        const Cluster *cl = &clusters.back();
+        for (const auto &k : clusters)
+          if (pick <= k.weight) {
+            cl = &k;
+            break;
+          }
+        u = std::clamp(cl->u + cl->sigma * gauss(rng), 0.0, 1.0);
+        v = std::clamp(cl->v + cl->sigma * gauss(rng), 0.0, 1.0);
+        break;
+      }
+      case Sampling::Hotspot:
+        u = 0.5 + (uni(rng) - 0.5) / options.size;
+        v = 0.5 + (uni(rng) - 0.5) / options.size;
+        break;
+      default:
+        orderedPosition(options, i, u, v);
+        if (options.sampling == Sampling::Tracks) { // Positioning noise
+          u += 0.1 * gauss(rng) / options.size;
+          v += 0.1 * gauss(rng) / options.size;
+        }
+        break;
+      }
+
+      double z = options.baseZ + 0.5 * options.relief * elevation(u, v) +
+                 options.noise * gauss(rng);
+      if (options.spikes > 0 && uni(rng) < options.spikes)
+        z += (uni(rng) < 0.5 ? -1 : 1) * options.spikeHeight *
+             (0.5 + 0.5 * uni(rng));
+
+      double dx = (u - 0.5) * options.size;
+      double dy = (v - 0.5) * options.size;
+      chunk.push_back({options.centerLon + dx / metersPerLon,
+                       options.centerLat + dy / METERS_PER_DEGREE, z});
+    }
+    if (!sink(chunk))
+      return;
+  }
+}
+
+std::vector<Point> generateSynthetic(const SyntheticOptions &options) {
+  std::vector<Point> points;
+  points.reserve(options.count);
+  generateSynthetic(options, [&](const std::vector<Point> &chunk) {
+    points.insert(points.end(), chunk.begin(), chunk.end());
+    return true;
+  });
+  return points;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file task_graph.cpp
+ * @brief Implementation of the dependency-graph scheduler.
+ */
+
+#include "task_graph.hpp"
+#include <deque>
+
+TaskGraph::Node TaskGraph::add(std::function<void()> fn) {
+  nodes.push_back(std::make_unique<NodeData>());
+  nodes.back()->fn = std::move(fn);
+  return nodes.size() - 1;
+}
+
+void TaskGraph::depend(Node node, Node prerequisite) {
+  nodes[prerequisite]->successors.push_back(node);
+  ++nodes[node]->prerequisites;
+}
+
+void TaskGraph::launch(Node node, ThreadPool &pool, TaskGroup &group) {
+  group.run([this, node, &pool, &group] {
+    NodeData &data = *nodes[node];
+    if (!pool.cancelled())
+      data.fn();
+    data.fn = nullptr; // Release captured state early
+    for (Node next : data.successors)
+      if (nodes[next]->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        launch(next, pool, group);
+  });
+}
+
+bool TaskGraph::run(ThreadPool &pool) {
+  for (auto &n : nodes)
+    n->remaining.store(n->prerequisites, std::memory_order_relaxed);
+
+  if (pool.size() == 1) {
+    // Inline pool: an explicit queue instead of recursion through run()
+    std::deque<Node> ready;
+    for (Node n = 0; n < nodes.size(); ++n)
+      if (nodes[n]->prerequisites == 0)
+        ready.push_back(n);
+    while (!ready.empty()) {
+      // Most recent first: finish a chain before starting the next one
+      Node node = ready.back();
+      ready.pop_back();
+      NodeData &data = *nodes[node];
+      if (!pool.cancelled())
+        data.fn();
+      data.fn = nullptr;
+      for (auto it = data.successors.rbegin(); it != data.successors.rend();
+           ++it)
+        if (--nodes[*it]->remaining == 0)
+          ready.push_back(*it);
+    }
+    return !pool.cancelled();
+  }
+
+  TaskGroup group(pool);
+  for (Node n = 0; n < nodes.size(); ++n)
+    if (nodes[n]->prerequisites == 0)
+      launch(n, pool, group);
+  group.wait();
+  return !pool.cancelled();
+}
@@ -0,0 +1,389 @@
+/**
+ * @file thread_pool.cpp
+ * @brief Implementation of the work-stealing thread pool.
+ */
+
+#include "thread_pool.hpp"
+#include "logging.hpp"
+#include <cstdlib>
+#include <iomanip>
+#include <pthread.h>
+#include <sched.h>
+
+// ---------------------------------------------------------------------------
+// Chase–Lev deque (Lê, Pop, Cohen, Zappa Nardelli, "Correct and efficient
+// work-stealing for weak memory models", PPoPP 2013)
+// ---------------------------------------------------------------------------
+
+struct WorkDeque::Ring {
+  explicit Ring(std::int64_t capacity)
+      : capacity(capacity), slots(new std::atomic<PoolTask *>[capacity]) {}
+
+  PoolTask *get(std::int64_t i) const {
+    return slots[i & (capacity - 1)].load(std::memory_order_relaxed);
+  }
+  void put(std::int64_t i, PoolTask *task) {
+    slots[i & (capacity - 1)].store(task, std::memory_order_relaxed);
+  }
+
+  std::int64_t capacity; // Power of two
+  std::unique_ptr<std::atomic<PoolTask *>[]> slots;
+};
+
+WorkDeque::WorkDeque() {
+  rings.push_back(std::make_unique<Ring>(256));
+  ring.store(rings.back().get(), std::memory_order_relaxed);
+}
+
+WorkDeque::~WorkDeque() = default;
+
+WorkDeque::Ring *WorkDeque::grow(Ring *old, std::int64_t b, std::int64_t t) {
+  rings.push_back(std::make_unique<Ring>(old->capacity * 2));
+  Ring *bigger = rings.back().get();
+  for (std::int64_t i = t; i < b; ++i)
+    bigger->put(i, old->get(i));
+  ring.store(bigger, std::memory_order_release);
+  return bigger;
+}
+
+void WorkDeque::push(PoolTask *task) {
+  std::int64_t b = bottom.load(std::memory_order_relaxed);
+  std::int64_t t = top.load(std::memory_order_acquire);
+  Ring *r = ring.load(std::memory_order_relaxed);
+  if (b - t > r->capacity - 1)
+    r = grow(r, b, t);
+  r->put(b, task);
+  std::atomic_thread_fence(std::memory_order_release);
+  bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+PoolTask *WorkDeque::pop() {
+  std::int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+  Ring *r = ring.load(std::memory_order_relaxed);
+  bottom.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  std::int64_t t = top.load(std::memory_order_relaxed);
+  if (t > b) {
+    // Empty
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  PoolTask *task = r->get(b);
+  if (t == b) {
+    // Last task: race against thieves
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed))
+      task = nullptr;
+    bottom.store(b + 1, std::memory_order_relaxed);
+  }
+  return task;
+}
+
+PoolTask *WorkDeque::steal() {
+  std::int64_t t = top.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  std::int64_t b = bottom.load(std::memory_order_acquire);
+  if (t >= b)
+    return nullptr;
+  Ring *r = ring.load(std::memory_order_acquire);
+  PoolTask *task = r->get(t);
+  if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                   std::memory_order_relaxed))
+    return nullptr;
+  return task;
+}
+
+// ---------------------------------------------------------------------------
+// Pool
+// ---------------------------------------------------------------------------
+
+struct ThreadPool::Slot {
+  WorkDeque deque;
+  std::atomic<std::uint64_t> tasks{0};
+  std::atomic<std::uint64_t> steals{0};
+  std::atomic<std::int64_t> busyNs{0};
+  unsigned victimSeed = 0;
+};
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Pool and slot of the calling thread
+thread_local ThreadPool *tlsPool = nullptr;
+thread_local int tlsSlot = -1;
+thread_local int tlsDepth = 0; // Nesting of execute() on this thread
+
+void pinCurrentThread(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    logError() << "Impossible d'attacher un thread au CPU " << cpu
+               << std::endl;
+}
+
+} // namespace
+
+ThreadPool::ThreadPool(int threadCount, const std::vector<int> &cpus)
+    : statsStart(Clock::now()) {
+  if (threadCount <= 0)
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  for (int i = 0; i < threadCount; ++i) {
+    slots.push_back(std::make_unique<Slot>());
+    slots.back()->victimSeed = 0x9E3779B9u * (i + 1);
+  }
+
+  if (threadCount == 1)
+    return; // Runs inline, no thread to register
+
+  // The creating thread is slot 0
+  previousPool = tlsPool;
+  previousSlot = tlsSlot;
+  tlsPool = this;
+  tlsSlot = 0;
+  if (!cpus.empty())
+    pinCurrentThread(cpus[0]);
+
+  for (int i = 1; i < threadCount; ++i) {
+    int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+    threads.emplace_back([this, i, cpu] {
+      tlsPool = this;
+      tlsSlot = i;
+      if (cpu >= 0)
+        pinCurrentThread(cpu);
+      workerLoop(i);
+    });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    stopping = true;
+  }
+  sleepCv.notify_all();
+  for (auto &t : threads)
+    t.join();
+  if (tlsPool == this) {
+    tlsPool = previousPool;
+    tlsSlot = previousSlot;
+  }
+}
+
+ThreadPool &ThreadPool::serial() {
+  static ThreadPool pool(1);
+  return pool;
+}
+
+int ThreadPool::currentSlot() const {
+  if (size() == 1)
+    return 0; // Everything runs inline on the caller
+  return tlsPool == this ? tlsSlot : -1;
+}
+
+void ThreadPool::submit(PoolTask *task) {
+  if (tlsPool == this) {
+    slots[tlsSlot]->deque.push(task);
+  } else {
+    std::lock_guard<std::mutex> lock(injectMutex);
+    injected.push_back(task);
+  }
+  // Paired with the sleepers/queued check of workerLoop(): either the
+  // sleeper sees the task or we see the sleeper.
+  queued.fetch_add(1, std::memory_order_seq_cst);
+  if (sleepers.load(std::memory_order_seq_cst) > 0) {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    sleepCv.notify_one();
+  }
+}
+
+PoolTask *ThreadPool::findTask(int slot) {
+  PoolTask *task = slot >= 0 ? slots[slot]->deque.pop() : nullptr;
+
+  if (!task) {
+    std::unique_lock<std::mutex> lock(injectMutex, std::try_to_lock);
+    if (lock.owns_lock() && !injected.empty()) {
+      task = injected.front();
+      injected.pop_front();
+    }
+  }
+
+  if (!task && size() > 1) {
+    // Steal, starting from a pseudo-random victim to spread contention
+    unsigned &seed = slots[std::max(slot, 0)]->victimSeed;
+    seed = seed * 1664525u + 1013904223u;
+    int n = size();
+    int start = static_cast<int>(seed >> 8) % n;
+    for (int k = 0; k < n && !task; ++k) {
+      int victim = (start + k) % n;
+      if (victim != slot)
+        task = slots[victim]->deque.steal();
+    }
+    if (task && slot >= 0)
+      slots[slot]->steals.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  if (task)
+    queued.fetch_sub(1, std::memory_order_relaxed);
+  return task;
+}
+
+void ThreadPool::execute(PoolTask *task, int slot) {
+  auto start = Clock::now();
+  ++tlsDepth;
+  {
+    StageScope scope(task->stage);
+    task->fn();
+  }
+  --tlsDepth;
+  if (slot >= 0) {
+    slots[slot]->tasks.fetch_add(1, std::memory_order_relaxed);
+    // Tasks run while helping inside another task are already timed
+    if (tlsDepth == 0)
+      slots[slot]->busyNs.fetch_add(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                               start)
+              .count(),
+          std::memory_order_relaxed);
+  }
+  std::atomic<std::size_t> *pending = task->pending;
+  delete task;
+  pending->fetch_sub(1, std::memory_order_release);
+}
+
+void ThreadPool::workerLoop(int slot) {
+  int idleRounds = 0;
+  while (!stopping.load(std::memory_order_relaxed)) {
+    if (PoolTask *task = findTask(slot)) {
+      execute(task, slot);
+      idleRounds = 0;
+      continue;
+    }
+    // Spin a little before sleeping: tasks often come in bursts
+    if (++idleRounds < 64) {
+      std::this_thread::yield();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    sleepers.fetch_add(1, std::memory_order_seq_cst);
+    sleepCv.wait(lock, [this] {
+      return stopping.load(std::memory_order_relaxed) ||
+             queued.load(std::memory_order_seq_cst) > 0;
+    });
+    sleepers.fetch_sub(1, std::memory_order_relaxed);
+    idleRounds = 0;
+  }
+}
+
+void ThreadPool::helpUntil(const std::atomic<std::size_t> &pending) {
+  int slot = currentSlot();
+  while (pending.load(std::memory_order_acquire) > 0) {
+    PoolTask *task = slot >= 0 ? findTask(slot) : nullptr;
+    if (task)
+      execute(task, slot);
+    else
+      std::this_thread::yield();
+  }
+}
+
+std::vector<WorkerStats> ThreadPool::stats() const {
+  double wall = std::chrono::duration<double>(Clock::now() - statsStart).count();
+  std::vector<WorkerStats> result(slots.size());
+  for (std::size_t i = 0; i < slots.size(); ++i) {
+    result[i].tasks = slots[i]->tasks.load(std::memory_order_relaxed);
+    result[i].steals = slots[i]->steals.load(std::memory_order_relaxed);
+    result[i].busySeconds =
+        slots[i]->busyNs.load(std::memory_order_relaxed) * 1e-9;
+    result[i].utilization = wall > 0 ? result[i].busySeconds / wall : 0.0;
+  }
+  return result;
+}
+
+void ThreadPool::resetStats() {
+  for (auto &s : slots) {
+    s->tasks = 0;
+    s->steals = 0;
+    s->busyNs = 0;
+  }
+  statsStart = Clock::now();
+}
+
+void ThreadPool::printStats(std::ostream &os) const {
+  std::vector<WorkerStats> all = stats();
+  os << "Utilisation des threads :\n"
+     << "  thread      taches     vols    occupé (s)  utilisation\n";
+  for (std::size_t i = 0; i < all.size(); ++i) {
+    os << "  " << std::left << std::setw(8) << i << std::right << std::setw(10)
+       << all[i].tasks << std::setw(9) << all[i].steals << std::fixed
+       << std::setprecision(3) << std::setw(14) << all[i].busySeconds
+       << std::setprecision(1) << std::setw(12) << all[i].utilization * 100
+       << " %\n";
+    os.unsetf(std::ios::floatfield);
+  }
+}
+
+// ---------------------------------------------------------------------------
+// TaskGroup
+// ---------------------------------------------------------------------------
+
+TaskGroup::TaskGroup(ThreadPool &pool) : pool(pool) {}
+
+TaskGroup::~TaskGroup() { wait(); }
+
+void TaskGroup::run(std::function<void()> fn) {
+  if (pool.size() == 1) {
+    fn();
+    return;
+  }
+  pending.fetch_add(1, std::memory_order_relaxed);
+  pool.submit(new PoolTask{std::move(fn), &pending, currentStage()});
+}
+
+void TaskGroup::wait() {
+  if (pending.load(std::memory_order_acquire) > 0)
+    pool.helpUntil(pending);
+}
+
+// ---------------------------------------------------------------------------
+// CPU lists
+// ---------------------------------------------------------------------------
+
+bool parseCpuList(const std::string &text, std::vector<int> &cpus) {
+  cpus.clear();
+  const char *p = text.c_str();
+  while (*p) {
+    char *end = nullptr;
+    long first = std::strtol(p, &end, 10);
+    if (end == p || first < 0)
+      return false;
+    long last = first;
+    p = end;
+    if (*p == '-') {
+      ++p;
+      last = std::strtol(p, &end, 10);
+      if (end == p || last < first)
+        return false;
+      p = end;
+    }
+    for (long c = first; c <= last; ++c)
+      cpus.push_back(static_cast<int>(c));
+    if (*p == ',')
+      ++p;
+    else if (*p)
+      return false;
+  }
+  return !cpus.empty();
+}
+
+std::vector<int> availableCpus() {
+  std::vector<int> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int c = 0; c < CPU_SETSIZE; ++c)
+      if (CPU_ISSET(c, &set))
+        cpus.push_back(c);
+  }
+  return cpus;
+}
@@ -0,0 +1,306 @@
+/**
+ * @file tiling.cpp
+ * @brief Implementation of the tiled pipeline scheduled as a task graph.
+ */
+
+#include "tiling.hpp"
+#include "checkpoint.hpp"
+#include "image_io.hpp"
+#include "logging.hpp"
+#include "profiling.hpp"
+#include "progress.hpp"
+#include "quadtree.hpp"
+#include "rasterizer.hpp"
+#include "task_graph.hpp"
+#include "triangulation.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+
+namespace {
+
+struct Tile {
+  int row0, row1, col0, col1; // Pixels covered
+  Mesh mesh;
+  std::unique_ptr<QuadTree> index;
+  std::vector<unsigned char> pixels;
+};
+
+// Tile containing a coordinate measured from the grid origin
+int tileOf(double offset, double tileExtent, int count) {
+  int t = static_cast<int>(std::floor(offset / tileExtent));
+  return std::min(count - 1, std::max(0, t));
+}
+
+// Band of tile rows [first, last) rendered by a shard
+void shardTileRows(const RasterGrid &grid, const TileOptions &options,
+                   int &first, int &last) {
+  const int tileSize = std::max(16, options.tileSize);
+  const int tilesY = (grid.height + tileSize - 1) / tileSize;
+  const int count = std::max(1, options.shardCount);
+  first = static_cast<int>(static_cast<long long>(tilesY) * options.shard /
+                           count);
+  last = static_cast<int>(static_cast<long long>(tilesY) *
+                          (options.shard + 1) / count);
+}
+
+} // namespace
+
+std::string shardFileName(const std::string &output, int shard, int count) {
+  std::string suffix =
+      ".part-" + std::to_string(shard) + "-of-" + std::to_string(count);
+  std::size_t dot = output.find_last_of('.');
+  std::size_t slash = output.find_last_of('/');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    return output + suffix;
+  return output.substr(0, dot) + suffix + output.substr(dot);
+}
+
+BoundingBox shardArea(const RasterGrid &grid, const TileOptions &options) {
+  const int tileSize = std::max(16, options.tileSize);
+  const double tileH = tileSize * grid.pixelSizeY;
+  const double halo = std::max(0.0, options.halo);
+  const int tilesY = (grid.height + tileSize - 1) / tileSize;
+  int first, last;
+  shardTileRows(grid, options, first, last);
+
+  // Rows run downwards from maxY; edge tiles reach the border of the survey.
+  // One pixel of slack keeps rounding on the safe side: tiles filter their
+  // points exactly when gathering them.
+  const double margin = halo + grid.pixelSizeY;
+  BoundingBox area = grid.bounds;
+  if (last < tilesY)
+    area.minY = grid.maxY - (last * tileH + margin);
+  if (first > 0)
+    area.maxY = grid.maxY - (first * tileH - margin);
+  area.minY = std::max(area.minY, grid.bounds.minY);
+  area.maxY = std::min(area.maxY, grid.bounds.maxY);
+  return area;
+}
+
+bool renderTiled(const std::string &filename, int width,
+                 std::vector<Point> points, ThreadPool &pool,
+                 const TileOptions &options) {
+  RasterGrid grid;
+  if (!makeRasterGrid(points, width, grid)) {
+    logError() << "Dimensions du maillage invalides." << std::endl;
+    return false;
+  }
+  return renderTiled(filename, grid, std::move(points), pool, options);
+}
+
+bool renderTiled(const std::string &filename, const RasterGrid &grid,
+                 std::vector<Point> points, ThreadPool &pool,
+                 const TileOptions &options) {
+  const int tileSize = std::max(16, options.tileSize);
+  const int tilesX = (grid.width + tileSize - 1) / tileSize;
+  const int tilesY = (grid.height + tileSize - 1) / tileSize;
+  const double tileW = tileSize * grid.pixelSizeX;
+  const double tileH = tileSize * grid.pixelSizeY;
+  const double halo = std::max(0.0, options.halo);
+  logInfo() << "Image " << grid.width << "x" << grid.height << " en "
+            << tilesX << "x" << tilesY << " tuiles de " << tileSize
+            << " px (halo " << halo << " m)" << std::endl;
+
+  // A shard renders a band of tile rows into a partial image, and only
+  // needs the points its tiles can gather
+  const bool shard = options.shardCount > 1;
+  int shardFirst = 0, shardLast = tilesY;
+  if (shard) {
+    shardTileRows(grid, options, shardFirst, shardLast);
+    BoundingBox area = shardArea(grid, options);
+    points.erase(std::remove_if(points.begin(), points.end(),
+                                [&](const Point &p) {
+                                  return p.y < area.minY || p.y > area.maxY;
+                                }),
+                 points.end());
+    logInfo() << "Partie " << options.shard << "/" << options.shardCount
+              << " : rangées de tuiles " << shardFirst << " à "
+              << shardLast - 1 << ", " << points.size() << " points"
+              << std::endl;
+  }
+  const int rowBegin = std::min(grid.height, shardFirst * tileSize);
+  const int rowEnd = std::min(grid.height, shardLast * tileSize);
+
+  std::vector<Tile> tiles(static_cast<std::size_t>(tilesX) * tilesY);
+  for (int ty = 0; ty < tilesY; ++ty) {
+    for (int tx = 0; tx < tilesX; ++tx) {
+      Tile &t = tiles[static_cast<std::size_t>(ty) * tilesX + tx];
+      t.row0 = ty * tileSize;
+      t.row1 = std::min(grid.height, t.row0 + tileSize);
+      t.col0 = tx * tileSize;
+      t.col1 = std::min(grid.width, t.col0 + tileSize);
+    }
+  }
+
+  // Counting sort of the points by tile: a tile then gathers itself and its
+  // halo from the neighbouring ranges only when it starts, so halo copies
+  // exist for the tiles in flight only.
+  std::vector<std::size_t> first(tiles.size() + 1, 0);
+  {
+    StageTimer timer(Stage::Load);
+    std::vector<std::uint32_t> cell(points.size());
+    for (std::size_t i = 0; i < points.size(); ++i) {
+      int tx = tileOf(points[i].x - grid.minX, tileW, tilesX);
+      int ty = tileOf(grid.maxY - points[i].y, tileH, tilesY);
+      cell[i] = static_cast<std::uint32_t>(ty * tilesX + tx);
+      ++first[cell[i] + 1];
+    }
+    for (std::size_t t = 0; t < tiles.size(); ++t)
+      first[t + 1] += first[t];
+    std::vector<std::size_t> next(first.begin(), first.end() - 1);
+    std::vector<Point> sorted(points.size());
+    for (std::size_t i = 0; i < points.size(); ++i)
+      sorted[next[cell[i]]++] = points[i];
+    points.swap(sorted);
+  }
+
+  // Points of tile (tx, ty) and of its halo; edge tiles extend to infinity
+  // so that points on the far border of the survey are not lost
+  auto gather = [&](int tx, int ty) {
+    const double inf = std::numeric_limits<double>::infinity();
+    double x0 = tx == 0 ? -inf : tx * tileW - halo;
+    double x1 = tx == tilesX - 1 ? inf : (tx + 1) * tileW + halo;
+    double y0 = ty == 0 ? -inf : ty * tileH - halo;
+    double y1 = ty == tilesY - 1 ? inf : (ty + 1) * tileH + halo;
+    int cx0 = tx == 0 ? 0 : tileOf(x0, tileW, tilesX);
+    int cx1 = tx == tilesX - 1 ? tx : tileOf(x1, tileW, tilesX);
+    int cy0 = ty == 0 ? 0 : tileOf(y0, tileH, tilesY);
+    int cy1 = ty == tilesY - 1 ? ty : tileOf(y1, tileH, tilesY);
+
+    std::vector<Point> local;
+    for (int cy = cy0; cy <= cy1; ++cy) {
+      for (int cx = cx0; cx <= cx1; ++cx) {
+        std::size_t c = static_cast<std::size_t>(cy) * tilesX + cx;
+        for (std::size_t i = first[c]; i < first[c + 1]; ++i) {
+          double ox = points[i].x - grid.minX;
+          double oy = grid.maxY - points[i].y;
+          if (ox >= x0 && ox < x1 && oy >= y0 && oy < y1)
+            local.push_back(points[i]);
+        }
+      }
+    }
+    return local;
+  };
+
+  // The journal lists finished tiles; a resumed run keeps the image file
+  // and skips them
+  Checkpoint checkpoint;
+  const CheckpointOptions &co = options.checkpoint;
+  if (co.enabled) {
+    std::string fingerprint =
+        co.fingerprint + " width=" + std::to_string(grid.width) +
+        " height=" + std::to_string(grid.height) + " tile=" +
+        std::to_string(tileSize) + " halo=" + std::to_string(halo) +
+        " shard=" + std::to_string(options.shard) + "/" +
+        std::to_string(options.shardCount);
+    if (!checkpoint.open(filename, fingerprint, tiles.size(), co.interval,
+                         co.resume))
+      return false;
+    if (checkpoint.resumed())
+      logInfo() << "Reprise : " << checkpoint.finishedBefore()
+                << " tuiles déjà rendues" << std::endl;
+  }
+
+  PpmWriter writer;
+  const bool keep = checkpoint.resumed();
+  if (shard ? !writer.open(filename, grid.width, rowEnd - rowBegin,
+                           ppmPartComment(rowBegin, grid.height), keep)
+            : !writer.open(filename, grid.width, grid.height, "", keep))
+    return false;
+  if (co.enabled)
+    checkpoint.attach(writer);
+
+  // One chain per tile; a tile only starts once the tile maxInFlight places
+  // before it has been written, which bounds the memory in use.
+  const std::size_t inFlight =
+      options.maxInFlight > 0 ? options.maxInFlight : 2 * pool.size();
+  TaskGraph graph;
+  std::vector<TaskGraph::Node> encoded;
+  std::atomic<bool> writeFailed{false};
+
+  const std::size_t firstTile = static_cast<std::size_t>(shardFirst) * tilesX;
+  const std::size_t lastTile = static_cast<std::size_t>(shardLast) * tilesX;
+  for (std::size_t i = firstTile; i < lastTile; ++i) {
+    if (checkpoint.isDone(i))
+      continue;
+    Tile &tile = tiles[i];
+
+    int tx = static_cast<int>(i % tilesX);
+    int ty = static_cast<int>(i / tilesX);
+    auto triangulateNode = graph.add([&tile, &pool, &gather, tx, ty] {
+      StageTimer timer(Stage::Triangulate);
+      tile.mesh = buildMesh(gather(tx, ty), pool);
+    });
+
+    auto indexNode = graph.add([&tile, &pool] {
+      StageTimer timer(Stage::Index);
+      if (tile.mesh.triangles.empty())
+        return;
+      RasterGrid bounds;
+      makeRasterGrid(tile.mesh.points, 1, bounds);
+      tile.index = std::make_unique<QuadTree>(bounds.bounds);
+      tile.index->build(tile.mesh.triangles, tile.mesh.points, pool);
+    });
+
+    auto renderNode = graph.add([&tile, &grid] {
+      StageTimer timer(Stage::Render);
+      std::size_t stride = static_cast<std::size_t>(tile.col1 - tile.col0) * 3;
+      tile.pixels.assign(stride * (tile.row1 - tile.row0), 0);
+      if (tile.index)
+        renderRegion(tile.mesh, *tile.index, grid, tile.row0, tile.row1,
+                     tile.col0, tile.col1, tile.pixels.data(), stride);
+      tile.index.reset();
+      tile.mesh = Mesh();
+    });
+
+    auto encodeNode = graph.add([&tile, &writer, &writeFailed, &checkpoint,
+                                 &co, rowBegin, i] {
+      StageTimer timer(Stage::Write);
+      std::size_t stride = static_cast<std::size_t>(tile.col1 - tile.col0) * 3;
+      if (!writer.writeBlock(tile.row0 - rowBegin, tile.row1 - tile.row0,
+                             tile.col0, tile.col1 - tile.col0,
+                             tile.pixels.data(), stride))
+        writeFailed = true;
+      else if (co.enabled)
+        checkpoint.complete(i);
+      tile.pixels = std::vector<unsigned char>();
+      progressAdvance(1);
+    });
+
+    graph.depend(indexNode, triangulateNode);
+    graph.depend(renderNode, indexNode);
+    graph.depend(encodeNode, renderNode);
+    if (encoded.size() >= inFlight)
+      graph.depend(triangulateNode, encoded[encoded.size() - inFlight]);
+    encoded.push_back(encodeNode);
+  }
+
+  progressBegin(Stage::Render, encoded.size(), "tuiles");
+  bool complete = graph.run(pool);
+  progressEnd();
+
+  if (!complete) {
+    if (co.enabled) {
+      checkpoint.flush();
+      logError() << "Rendu annulé ; relancez avec --resume pour le terminer."
+                 << std::endl;
+    } else {
+      logError() << "Rendu annulé, image incomplète : " << filename
+                 << std::endl;
+    }
+    return false;
+  }
+  // The journal goes last, once the image is synced
+  bool written = !writeFailed && (!co.enabled || checkpoint.finish()) &&
+                 writer.close();
+  if (!written) {
+    logError() << "Erreur d'écriture dans " << filename << std::endl;
+    return false;
+  }
+  logInfo() << "Image enregistrée dans " << filename << std::endl;
+  return true;
+}
@@ -4,9 +4,15 @@
  */
 
 #include "triangulation.hpp"
+#include "logging.hpp"
+#include "memory_policy.hpp"
+#include "progress.hpp"
+#include <algorithm>
 #include <cmath>
 #include <delaunator.hpp>
+#include <exception>
 #include <iostream>
+#include <memory>
 
 /**
  * @brief Calculates the squared Euclidean distance between two points.
@@ -21,53 +27,117 @@ double distSq(const Point &a, const Point &b) {
   return (a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y);
 }
 
-Mesh triangulate(const std::vector<Point> &points) {
+Mesh buildMesh(std::vector<Point> points, ThreadPool &pool,
+               std::size_t *rejected, std::vector<std::uint32_t> *adjacency) {
   Mesh mesh;
-  mesh.points = points;
+  mesh.points = std::move(points);
+  const std::vector<Point> &pts = mesh.points;
+  placeShared(pts.data(), pts.size() * sizeof(Point));
+  if (rejected)
+    *rejected = 0;
+  if (adjacency)
+    adjacency->clear();
+  if (pts.size() < 3)
+    return mesh;
 
   // Préparation pour Delaunator
   std::vector<double> coords;
-  coords.reserve(points.size() * 2);
-  for (const auto &p : points) {
+  coords.reserve(pts.size() * 2);
+  for (const auto &p : pts) {
     coords.push_back(p.x);
     coords.push_back(p.y);
   }
 
-  // Exécution de Delaunay
-  delaunator::Delaunator d(coords);
+  // Exécution de Delaunay (points tous alignés : pas de triangle)
+  std::unique_ptr<delaunator::Delaunator> triangulation;
+  try {
+    triangulation = std::make_unique<delaunator::Delaunator>(coords);
+  } catch (const std::exception &) {
+    return mesh;
+  }
+  const delaunator::Delaunator &d = *triangulation;
 
   // Filtrage des triangles trop grands
   // Seuil : Si un côté du triangle fait plus de X mètres, on le jette.
   const double MAX_EDGE_LENGTH = 70.0;
   const double MAX_DIST_SQ = MAX_EDGE_LENGTH * MAX_EDGE_LENGTH;
 
-  int trianglesRejetes = 0;
+  // Filtrage par blocs en parallèle, recollés dans l'ordre de Delaunator
+  const std::size_t BLOC = 1 << 16;
+  std::size_t nbTriangles = d.triangles.size() / 3;
+  std::size_t nbBlocs = (nbTriangles + BLOC - 1) / BLOC;
+  std::vector<std::vector<Triangle>> gardes(nbBlocs);
+  std::vector<char> garde(adjacency ? nbTriangles : 0, 0);
 
-  for (std::size_t i = 0; i < d.triangles.size(); i += 3) {
-    std::size_t idx0 = d.triangles[i];
-    std::size_t idx1 = d.triangles[i + 1];
-    std::size_t idx2 = d.triangles[i + 2];
+  pool.parallelFor(0, nbBlocs, 1, [&](std::size_t b0, std::size_t b1) {
+    for (std::size_t b = b0; b < b1; ++b) {
+      std::size_t fin = std::min(nbTriangles, (b + 1) * BLOC);
+      for (std::size_t t = b * BLOC; t < fin; ++t) {
+        std::size_t idx0 = d.triangles[3 * t];
+        std::size_t idx1 = d.triangles[3 * t + 1];
+        std::size_t idx2 = d.triangles[3 * t + 2];
 
-    const Point &p0 = points[idx0];
-    const Point &p1 = points[idx1];
-    const Point &p2 = points[idx2];
+        const Point &p0 = pts[idx0];
+        const Point &p1 = pts[idx1];
+        const Point &p2 = pts[idx2];
 
-    // Vérifier la longueur des 3 côtés
-    if (distSq(p0, p1) > MAX_DIST_SQ || distSq(p1, p2) > MAX_DIST_SQ ||
-        distSq(p2, p0) > MAX_DIST_SQ) {
+        // Vérifier la longueur des 3 côtés
+        if (distSq(p0, p1) > MAX_DIST_SQ || distSq(p1, p2) > MAX_DIST_SQ ||
+            distSq(p2, p0) > MAX_DIST_SQ)
+          continue; // Ce triangle est trop grand, il ne l'ajoute pas !
 
-      trianglesRejetes++;
-      continue; // Ce triangle est trop grand, il ne l'ajoute pas !
+        // Si le triangle est valide, il l'ajoute
+        gardes[b].push_back({idx0, idx1, idx2});
+        if (adjacency)
+          garde[t] = 1;
+      }
     }
+  });
+
+  std::size_t total = 0;
+  for (const auto &bloc : gardes)
+    total += bloc.size();
+  mesh.triangles.reserve(total);
+  // Before the copy below first touches the pages
+  placeShared(mesh.triangles.data(), total * sizeof(Triangle));
+  for (const auto &bloc : gardes)
+    mesh.triangles.insert(mesh.triangles.end(), bloc.begin(), bloc.end());
+  if (rejected)
+    *rejected = nbTriangles - total;
 
-    // Si le triangle est valide, il l'ajoute
-    mesh.triangles.push_back({idx0, idx1, idx2});
+  // Voisins : numéro gardé de chaque triangle de Delaunator, puis demi-arêtes
+  if (adjacency) {
+    std::vector<std::uint32_t> numero(nbTriangles, NO_TRIANGLE);
+    std::uint32_t suivant = 0;
+    for (std::size_t t = 0; t < nbTriangles; ++t)
+      if (garde[t])
+        numero[t] = suivant++;
+    adjacency->assign(3 * total, NO_TRIANGLE);
+    pool.parallelFor(0, nbTriangles, BLOC, [&](std::size_t t0, std::size_t t1) {
+      for (std::size_t t = t0; t < t1; ++t) {
+        if (numero[t] == NO_TRIANGLE)
+          continue;
+        for (std::size_t k = 0; k < 3; ++k) {
+          std::size_t h = d.halfedges[3 * t + k];
+          if (h != delaunator::INVALID_INDEX)
+            (*adjacency)[3 * numero[t] + k] = numero[h / 3];
+        }
+      }
+    });
   }
+  return mesh;
+}
 
-  std::cout << "Triangulation terminée." << std::endl;
-  std::cout << "  Triangles gardés  : " << mesh.triangles.size() << std::endl;
-  std::cout << "  Triangles rejetés : " << trianglesRejetes << " (trop longs)"
+Mesh triangulate(const std::vector<Point> &points, ThreadPool &pool,
+                 std::vector<std::uint32_t> *adjacency) {
+  progressBegin(Stage::Triangulate, 0, "triangles");
+  std::size_t trianglesRejetes = 0;
+  Mesh mesh = buildMesh(points, pool, &trianglesRejetes, adjacency);
+  progressEnd();
+  logInfo() << "Triangulation terminée." << std::endl;
+  logInfo() << "  Triangles gardés  : " << mesh.triangles.size() << std::endl;
+  logInfo() << "  Triangles rejetés : " << trianglesRejetes << " (trop longs)"
             << std::endl;
 
   return mesh;
-}
\ No newline at end of file
+}
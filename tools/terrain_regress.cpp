@@ -0,0 +1,396 @@
+/**
+ * @file terrain_regress.cpp
+ * @brief Golden-image regression and per-stage performance budgets.
+ *
+ * Renders every case of a configuration file, compares the result to a
+ * stored reference image (per-pixel tolerance, diff image on failure) and
+ * checks the time and memory of each stage against a budget file. Exits with
+ * a non-zero status if any case fails, so it can gate a CI job.
+ *
+ * Cases with create_raster options (another engine, cleaning, shards,
+ * resume...) run the create_raster executable in a directory of their own
+ * instead of the in-process pipeline; only their image is checked.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MNT.hpp"
+#include "image_io.hpp"
+#include "profiling.hpp"
+#include "rasterizer.hpp"
+#include "thread_pool.hpp"
+#include "tiling.hpp"
+#include "triangulation.hpp"
+
+namespace {
+
+using Section = std::map<std::string, std::string>;
+
+/**
+ * @brief Reads an INI-like file: "[name]" sections of "key = value" lines,
+ * '#' starts a comment.
+ */
+bool readSections(const std::string &path,
+                  std::vector<std::pair<std::string, Section>> &sections) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Impossible d'ouvrir " << path << std::endl;
+    return false;
+  }
+  auto trim = [](std::string s) {
+    s.erase(0, s.find_first_not_of(" \t\r"));
+    s.erase(s.find_last_not_of(" \t\r") + 1);
+    return s;
+  };
+  std::string line;
+  while (std::getline(in, line)) {
+    line = trim(line.substr(0, line.find('#')));
+    if (line.empty())
+      continue;
+    if (line.front() == '[' && line.back() == ']') {
+      sections.push_back({line.substr(1, line.size() - 2), {}});
+    } else if (!sections.empty() && line.find('=') != std::string::npos) {
+      std::size_t eq = line.find('=');
+      sections.back().second[trim(line.substr(0, eq))] =
+          trim(line.substr(eq + 1));
+    }
+  }
+  return true;
+}
+
+std::string value(const Section &s, const std::string &key,
+                  const std::string &fallback) {
+  auto it = s.find(key);
+  return it == s.end() ? fallback : it->second;
+}
+
+struct Comparison {
+  std::size_t badPixels = 0;
+  int maxDiff = 0;
+};
+
+/**
+ * @brief Compares two images channel by channel and builds a diff image:
+ * pixels within tolerance are shown dimmed, the others in bright red.
+ */
+Comparison compareImages(const Image &out, const Image &ref, int tolerance,
+                         Image &diff) {
+  Comparison c;
+  diff.width = ref.width;
+  diff.height = ref.height;
+  diff.pixels.assign(ref.pixels.size(), 0);
+  for (std::size_t p = 0; p < ref.pixels.size(); p += 3) {
+    int d = 0;
+    for (int k = 0; k < 3; ++k)
+      d = std::max(d, std::abs(int(out.pixels[p + k]) - int(ref.pixels[p + k])));
+    c.maxDiff = std::max(c.maxDiff, d);
+    if (d > tolerance) {
+      ++c.badPixels;
+      diff.pixels[p] = 255;
+    } else {
+      for (int k = 0; k < 3; ++k)
+        diff.pixels[p + k] = ref.pixels[p + k] / 4;
+    }
+  }
+  return c;
+}
+
+// Single-quoted for the shell
+std::string quote(const std::string &s) {
+  std::string out = "'";
+  for (char c : s)
+    out += c == '\'' ? std::string("'\\''") : std::string(1, c);
+  return out + "'";
+}
+
+/**
+ * @brief Runs a case through create_raster, in outputDir/<name>, and copies
+ * the image to compare to output.
+ *
+ * "engine" and "options" are passed on the command line. With "shards",
+ * the shards are rendered one after the other and merged. With "resume",
+ * a first run is interrupted (SIGINT) after that many seconds and the same
+ * command is run again with --resume.
+ */
+bool runCreateRaster(const std::string &program, const std::string &name,
+                     const Section &cfg, const std::string &input, int width,
+                     int threads, const std::string &outputDir,
+                     const std::string &output) {
+  namespace fs = std::filesystem;
+  const fs::path dir = fs::absolute(outputDir) / name;
+  std::error_code error;
+  fs::remove_all(dir, error);
+  fs::create_directories(dir);
+
+  std::string args = quote(fs::absolute(input).string()) + " " +
+                     std::to_string(width) + " --threads " +
+                     std::to_string(threads) + " --progress none";
+  std::string engine = value(cfg, "engine", "");
+  if (!engine.empty())
+    args += " --engine " + engine;
+  args += " " + value(cfg, "options", "");
+  auto run = [&](const std::string &prefix, const std::string &arguments) {
+    std::string command = "cd " + quote(dir.string()) + " && " + prefix +
+                          quote(program) + " " + arguments +
+                          " >>run.log 2>&1";
+    return std::system(command.c_str()) == 0;
+  };
+
+  std::string image = value(cfg, "image", "output.ppm");
+  bool ok = true;
+  int shards = std::atoi(value(cfg, "shards", "0").c_str());
+  std::string resume = value(cfg, "resume", "");
+  if (shards > 0) {
+    std::string parts;
+    for (int i = 0; ok && i < shards; ++i) {
+      std::string part = std::to_string(i) + "/" + std::to_string(shards);
+      ok = run("", args + " --shard " + part);
+      parts += " output.part-" + std::to_string(i) + "-of-" +
+               std::to_string(shards) + ".ppm";
+    }
+    ok = ok && run("", "merge merged.ppm" + parts + " --threads " +
+                           std::to_string(threads));
+    image = "merged.ppm";
+  } else if (!resume.empty()) {
+    // The interrupted run fails by design; the resumed one must not
+    run("timeout -s INT " + resume + " ", args);
+    ok = run("", args + " --resume");
+  } else {
+    ok = run("", args);
+  }
+  if (!ok) {
+    std::cout << "  ECHEC : create_raster, voir " << (dir / "run.log").string()
+              << std::endl;
+    return false;
+  }
+  fs::copy_file(dir / image, output, fs::copy_options::overwrite_existing,
+                error);
+  return !error;
+}
+
+void usage() {
+  std::cerr << "Usage: terrain_regress [--config regress/golden.cfg]\n"
+               "                       [--budgets regress/budgets.cfg]\n"
+               "                       [--output-dir regress_out] [--update]\n"
+               "                       [--case <nom>]\n"
+               "                       [--create-raster <exécutable>]\n"
+               "  --update   remplace les images de référence (sans budgets)\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::string configPath = "regress/golden.cfg";
+  std::string budgetsPath = "regress/budgets.cfg";
+  std::string outputDir = "regress_out";
+  std::string only;
+  bool update = false;
+  // Next to terrain_regress in the build directory by default
+  std::string createRaster =
+      (std::filesystem::absolute(argv[0]).parent_path() / "create_raster")
+          .string();
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--update") {
+      update = true;
+    } else if (i + 1 < argc && arg == "--config") {
+      configPath = argv[++i];
+    } else if (i + 1 < argc && arg == "--budgets") {
+      budgetsPath = argv[++i];
+    } else if (i + 1 < argc && arg == "--output-dir") {
+      outputDir = argv[++i];
+    } else if (i + 1 < argc && arg == "--case") {
+      only = argv[++i];
+    } else if (i + 1 < argc && arg == "--create-raster") {
+      createRaster = argv[++i];
+    } else {
+      usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::vector<std::pair<std::string, Section>> cases, budgetList;
+  if (!readSections(configPath, cases))
+    return EXIT_FAILURE;
+  std::map<std::string, Section> budgets;
+  if (!update && readSections(budgetsPath, budgetList))
+    budgets.insert(budgetList.begin(), budgetList.end());
+  std::filesystem::create_directories(outputDir);
+
+  const Stage stages[] = {Stage::Load, Stage::Triangulate, Stage::Index,
+                          Stage::Render, Stage::Write};
+  int failures = 0;
+  int ran = 0;
+
+  for (const auto &[name, cfg] : cases) {
+    if (!only.empty() && name != only)
+      continue;
+    ++ran;
+    std::string input = value(cfg, "input", "");
+    int width = std::atoi(value(cfg, "width", "0").c_str());
+    int threads = std::atoi(value(cfg, "threads", "1").c_str());
+    int tile = std::atoi(value(cfg, "tile", "0").c_str());
+    std::string reference = value(cfg, "reference", "");
+    int tolerance = std::atoi(value(cfg, "tolerance", "0").c_str());
+    double maxBad = std::atof(value(cfg, "max_bad_fraction", "0").c_str());
+    std::string output = outputDir + "/" + name + ".ppm";
+
+    std::cout << "[" << name << "] " << input << " largeur=" << width
+              << " threads=" << threads;
+    if (tile > 0)
+      std::cout << " tuiles=" << tile;
+    const bool external = cfg.count("options") || cfg.count("engine") ||
+                          cfg.count("shards") || cfg.count("resume");
+    if (cfg.count("engine"))
+      std::cout << " moteur=" << value(cfg, "engine", "");
+    if (cfg.count("options"))
+      std::cout << " options=" << value(cfg, "options", "");
+    if (cfg.count("shards"))
+      std::cout << " parties=" << value(cfg, "shards", "");
+    if (cfg.count("resume"))
+      std::cout << " reprise=" << value(cfg, "resume", "") << "s";
+    std::cout << std::endl;
+
+    // Pipeline, instrumented the same way as create_raster
+    resetStageTimes();
+    resetAllocPeaks();
+    resetPeakResident();
+    std::filesystem::remove(output);
+    if (external) {
+      runCreateRaster(createRaster, name, cfg, input, width, threads,
+                      outputDir, output);
+    } else {
+      std::ostringstream sink;
+      std::streambuf *old = std::cout.rdbuf(sink.rdbuf());
+      ThreadPool pool(threads);
+      std::vector<Point> terrain;
+      {
+        StageTimer timer(Stage::Load);
+        terrain = lireEtConvertir(input, pool);
+      }
+      if (tile > 0) {
+        TileOptions tiling;
+        tiling.tileSize = tile;
+        tiling.halo = std::atof(value(cfg, "halo", "150").c_str());
+        renderTiled(output, width, std::move(terrain), pool, tiling);
+      } else {
+        Mesh mesh;
+        {
+          StageTimer timer(Stage::Triangulate);
+          mesh = triangulate(terrain, pool);
+        }
+        RenderOptions options;
+        options.pool = &pool;
+        generateImage(output, width, mesh, options);
+      }
+      std::cout.rdbuf(old);
+    }
+    std::size_t peakRss = peakResidentBytes();
+
+    bool ok = true;
+    Image out, ref;
+    if (!readPPM(output, out)) {
+      std::cout << "  ECHEC : aucune image produite" << std::endl;
+      ++failures;
+      continue;
+    }
+
+    if (update) {
+      if (writePPM(reference, out))
+        std::cout << "  référence mise à jour : " << reference << std::endl;
+      else
+        ++failures;
+      continue;
+    }
+
+    // Golden image
+    if (!readPPM(reference, ref)) {
+      ok = false;
+    } else if (ref.width != out.width || ref.height != out.height) {
+      std::cout << "  ECHEC : taille " << out.width << "x" << out.height
+                << " au lieu de " << ref.width << "x" << ref.height
+                << std::endl;
+      ok = false;
+    } else {
+      Image diff;
+      Comparison c = compareImages(out, ref, tolerance, diff);
+      double fraction =
+          double(c.badPixels) / (static_cast<double>(ref.width) * ref.height);
+      bool imageOk = fraction <= maxBad;
+      std::cout << "  image : " << c.badPixels << " pixels hors tolérance ("
+                << std::setprecision(4) << fraction * 100
+                << " %), écart max " << c.maxDiff
+                << (imageOk ? "  OK" : "  ECHEC") << std::endl;
+      if (!imageOk) {
+        std::string diffPath = outputDir + "/" + name + "_diff.ppm";
+        writePPM(diffPath, diff);
+        std::cout << "  différences : " << diffPath << std::endl;
+        ok = false;
+      }
+    }
+
+    // Budgets
+    auto b = budgets.find(name);
+    if (b != budgets.end()) {
+      for (Stage s : stages) {
+        std::string key = stageName(s);
+        double seconds = stageSeconds(s);
+        auto limit = b->second.find(key + "_s");
+        if (limit != b->second.end()) {
+          double max = std::atof(limit->second.c_str());
+          bool within = seconds <= max;
+          std::cout << "  " << std::left << std::setw(12) << key << std::right
+                    << std::fixed << std::setprecision(3) << std::setw(8)
+                    << seconds << " s / " << std::setw(8) << max << " s"
+                    << (within ? "" : "  DEPASSEMENT") << std::endl;
+          std::cout.unsetf(std::ios::floatfield);
+          ok = ok && within;
+        }
+        auto memLimit = b->second.find(key + "_mb");
+        if (memLimit != b->second.end() && allocTrackingEnabled()) {
+          double mb = allocStats(s).peak / 1048576.0;
+          double max = std::atof(memLimit->second.c_str());
+          bool within = mb <= max;
+          std::cout << "  " << std::left << std::setw(12) << key << std::right
+                    << std::fixed << std::setprecision(1) << std::setw(8) << mb
+                    << " Mo / " << std::setw(8) << max << " Mo"
+                    << (within ? "" : "  DEPASSEMENT") << std::endl;
+          std::cout.unsetf(std::ios::floatfield);
+          ok = ok && within;
+        }
+      }
+      auto rssLimit = b->second.find("peak_rss_mb");
+      if (rssLimit != b->second.end()) {
+        double mb = peakRss / 1048576.0;
+        double max = std::atof(rssLimit->second.c_str());
+        bool within = mb <= max;
+        std::cout << "  RSS max     " << std::fixed << std::setprecision(1)
+                  << std::setw(8) << mb << " Mo / " << std::setw(8) << max
+                  << " Mo" << (within ? "" : "  DEPASSEMENT") << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+        ok = ok && within;
+      }
+    }
+
+    std::cout << "  => " << (ok ? "OK" : "ECHEC") << std::endl;
+    failures += ok ? 0 : 1;
+  }
+
+  if (ran == 0) {
+    std::cerr << "Aucun cas exécuté." << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << ran - failures << "/" << ran << " cas réussis" << std::endl;
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}